@@ -197,22 +197,26 @@ cf_atomic32_add(cf_atomic32 *a, int32_t b)
 #define cf_atomic32_incr(a) (cf_atomic32_add((a), 1))
 #define cf_atomic32_decr(a) (cf_atomic32_add((a), -1))
 
-#ifndef CF_WINDOWS
-// This following section is not used by cl_libevent2 client.
-// Thus not ported for libevent2 windows client.
-// This also will help to clear out the sections which are no longer in use.
-// In case somebody wants them in windows environment, please be aware they not ported yet.
-
 static inline int32_t
 cf_atomic32_cas(cf_atomic32 *a, int32_t b, int32_t x)
 {
 	int32_t p;
 
+#ifndef CF_WINDOWS
 	__asm__ __volatile__ ("lock; cmpxchg %1,%2" : "=a"(p) : "q"(x), "m"(*(a)), "0"(b) : "memory");
+#else
+	p = _InterlockedCompareExchange((volatile long *)a, x, b);
+#endif
 
 	return(p);
 }
 
+#ifndef CF_WINDOWS
+// This following section is not used by cl_libevent2 client.
+// Thus not ported for libevent2 windows client.
+// This also will help to clear out the sections which are no longer in use.
+// In case somebody wants them in windows environment, please be aware they not ported yet.
+
 #define cf_atomic32_cas_m(_a, _b, _x) \
 ({  __typeof__(_b) __b = _b; \
 	__asm__ __volatile__ ("lock; cmpxchg %1,%2" : "=a"(__b) : "q"(_x), "m"(*(_a)), "0"(_b) : "memory"); \
@@ -0,0 +1,30 @@
+/*
+ *  Citrusleaf Foundation
+ *  include/cf_base64.h - base 64 decoding
+ *
+ *  Copyright 2013 by Citrusleaf.  All rights reserved.
+ *  THIS IS UNPUBLISHED PROPRIETARY SOURCE CODE.  THE COPYRIGHT NOTICE
+ *  ABOVE DOES NOT EVIDENCE ANY ACTUAL OR INTENDED PUBLICATION.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+/* SYNOPSIS
+ * Base 64 decoding of padded input, as in partition bitmaps. Long input is
+ * decoded 16 or 32 characters at a time using SIMD where the CPU supports it.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* cf_base64_decode
+ * Decode len characters (a multiple of 4) of in, to len / 4 * 3 bytes of out.
+ * Padding and invalid characters decode as 0 bits */
+void cf_base64_decode(const char* in, int len, uint8_t* out);
+
+#ifdef __cplusplus
+} // end extern "C"
+#endif
@@ -11,7 +11,8 @@
 
 #include <stddef.h>
 #include <stdint.h>
-#include <openssl/ripemd.h>
+
+#include "citrusleaf/cf_ripemd160.h"
 
 /* SYNOPSIS
  * Cryptographic message digests
@@ -27,7 +28,7 @@ extern "C" {
 
 /* cf_digest
  * Storage for a message digest */
-#define CF_DIGEST_KEY_SZ RIPEMD160_DIGEST_LENGTH
+#define CF_DIGEST_KEY_SZ CF_RIPEMD160_DIGEST_SZ
 typedef struct { uint8_t digest[CF_DIGEST_KEY_SZ]; } cf_digest;
 
 void cf_digest_string(cf_digest *digest, char* output);
@@ -38,7 +39,9 @@ void cf_digest_dump(cf_digest *digest);
 static inline void
 cf_digest_compute(void *data, size_t len, cf_digest *d)
 {
-	RIPEMD160((const unsigned char *) data, len, (unsigned char *) d->digest);
+	cf_ripemd160_part part = { data, len };
+
+	cf_ripemd160(&part, 1, d->digest);
 }
 
 
@@ -51,16 +54,9 @@ cf_digest_compute(void *data, size_t len, cf_digest *d)
 static inline void
 cf_digest_compute2(const void *data1, size_t len1, const void *data2, size_t len2, cf_digest *d)
 {
-	if (len1 == 0) {
-		RIPEMD160((const unsigned char *) data2, len2, (unsigned char *) d->digest);
-	}
-	else {
-		RIPEMD160_CTX c;
-		RIPEMD160_Init(&c);
-		RIPEMD160_Update(&c, data1, len1);
-		RIPEMD160_Update(&c, data2, len2);
-		RIPEMD160_Final( (unsigned char *)(d->digest), &c);
-	}
+	cf_ripemd160_part parts[2] = { { data1, len1 }, { data2, len2 } };
+
+	cf_ripemd160(parts, 2, d->digest);
 }
 
 /* as_partition_getid
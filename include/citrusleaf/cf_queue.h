@@ -64,6 +64,9 @@ extern int cf_queue_push(cf_queue *q, void *ptr);
 // Push element on the queue only if size < limit.
 extern bool cf_queue_push_limit(cf_queue *q, void *ptr, uint32_t limit);
 
+// Push n elements, contiguous in buf, under one lock acquisition.
+extern int cf_queue_push_n(cf_queue *q, void *buf, uint32_t n);
+
 // Get the number of elements currently in the queue
 extern int cf_queue_sz(cf_queue *q);
 
@@ -85,6 +88,10 @@ extern int cf_queue_sz(cf_queue *q);
 #define CF_QUEUE_NOWAIT 0
 extern int cf_queue_pop(cf_queue *q, void *buf, int mswait);
 
+// Pop up to n elements into buf under one lock acquisition, without waiting.
+// Returns the number popped.
+extern uint32_t cf_queue_pop_n(cf_queue *q, void *buf, uint32_t n);
+
 // Queue Reduce
 // Run the entire queue, calling the callback, with the lock held
 // You can return values in the callback to cause deletes
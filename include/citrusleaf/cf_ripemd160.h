@@ -0,0 +1,55 @@
+/*
+ *  Citrusleaf Foundation
+ *  include/cf_ripemd160.h - RIPEMD-160 message digest
+ *
+ *  Copyright 2013 by Citrusleaf.  All rights reserved.
+ *  THIS IS UNPUBLISHED PROPRIETARY SOURCE CODE.  THE COPYRIGHT NOTICE
+ *  ABOVE DOES NOT EVIDENCE ANY ACTUAL OR INTENDED PUBLICATION.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* SYNOPSIS
+ * In-tree RIPEMD-160, used for key digests. A message may be passed as several
+ * parts, hashed as if concatenated, so callers needn't copy keys together with
+ * set names. Messages of up to CF_RIPEMD160_SINGLE_BLOCK_MAX bytes take a
+ * single compression, and cf_ripemd160_many() hashes such short messages
+ * several at a time using SIMD where the CPU supports it.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CF_RIPEMD160_DIGEST_SZ 20
+#define CF_RIPEMD160_BLOCK_SZ 64
+
+// Longest message that fits in one block along with padding and length.
+#define CF_RIPEMD160_SINGLE_BLOCK_MAX (CF_RIPEMD160_BLOCK_SZ - 9)
+
+typedef struct cf_ripemd160_part_s {
+	const void*	data;
+	size_t		len;
+} cf_ripemd160_part;
+
+/* cf_ripemd160
+ * Digest one message made of n_parts parts */
+void cf_ripemd160(const cf_ripemd160_part* parts, int n_parts, uint8_t* digest);
+
+/* cf_ripemd160_many
+ * Digest n_msgs messages, each made of n_parts parts - message i is parts
+ * [i * n_parts] to [(i * n_parts) + n_parts - 1], and its digest goes to
+ * digests + (i * CF_RIPEMD160_DIGEST_SZ) */
+void cf_ripemd160_many(const cf_ripemd160_part* parts, int n_parts, int n_msgs,
+		uint8_t* digests);
+
+/* cf_ripemd160_lanes
+ * How many short messages cf_ripemd160_many() hashes at once on this CPU */
+int cf_ripemd160_lanes(void);
+
+#ifdef __cplusplus
+} // end extern "C"
+#endif
@@ -22,6 +22,7 @@
 #include <arpa/inet.h>
 #include <netinet/in.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 
 // Windows send() and recv() parameter types are different.
 #define cf_socket_data_t void
@@ -65,6 +66,13 @@ cf_print_sockaddr_in(char *prefix, struct sockaddr_in *sa_in);
 
 #define SHUT_RDWR		SD_BOTH
 
+// Only so structures can carry an iovec - there's no sendmsg() on Windows, so
+// scatter-gather sends aren't used there.
+struct iovec {
+	void*	iov_base;
+	size_t	iov_len;
+};
+
 
 #endif // CF_WINDOWS
 
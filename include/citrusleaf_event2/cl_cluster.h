@@ -39,6 +39,8 @@ extern "C" {
 
 struct sockaddr_in;
 
+typedef struct cl_pipe_conn_s cl_pipe_conn;
+
 #define CLUSTER_NODE_MAGIC 0x9B00134C
 #define MAX_INTERVALS_ABSENT 1
 #define MAX_HISTORY_INTERVALS 64 // power of 2 makes mod operation fast
@@ -52,9 +54,102 @@ typedef enum {
 
 #define NODE_INFO_REQ_MAX_INTERVALS 5
 
+// Names in info responses we act on - see cl_info_next_pair().
+typedef enum {
+	CL_INFO_NAME_UNKNOWN				= 0,
+	CL_INFO_NAME_NODE					= 1,
+	CL_INFO_NAME_PARTITIONS				= 2,
+	CL_INFO_NAME_PARTITION_GENERATION	= 3,
+	CL_INFO_NAME_SERVICES				= 4,
+	CL_INFO_NAME_REPLICAS_ALL			= 5
+} cl_info_name;
+
+// A name/value pair parsed in place from an info response.
+typedef struct cl_info_pair_s {
+	cl_info_name	id;
+	char*			name;
+	char*			value;
+} cl_info_pair;
+
+// Lock-free cache of idle sockets in front of a node's socket pool - threads
+// are spread over stripes, each two (64-byte) cache lines of its own.
+#define FD_CACHE_STRIPES 8
+#define FD_CACHE_SLOTS 14
+
+// How many sockets move between a stripe and the pool at a time.
+#define FD_CACHE_BATCH (FD_CACHE_SLOTS / 2)
+
+// Idle sockets used this recently aren't checked for remote close - a caller
+// that can retry finds out soon enough if one's dead.
+#define FD_TRUST_MS 1000
+
+// An idle socket in conn_q, and when it was last put back.
+typedef struct cl_idle_fd_s {
+	int						fd;
+	uint32_t				put_ms;
+} cl_idle_fd;
+
+// A slot holds fd + 1, or 0 if empty. Its put_ms is stamped as it's filled,
+// in the same cache line.
+typedef struct cl_fd_slot_s {
+	cf_atomic32				fd;
+	uint32_t				put_ms;
+} cl_fd_slot;
+
+// A stripe of idle sockets, with its own counts of sockets got from it or
+// not - the counts share the first line with the first slots, which are
+// tried first.
+typedef struct cl_fd_stripe_s {
+	cf_atomic_int			n_hits;
+	cf_atomic_int			n_misses;
+	cl_fd_slot				slots[FD_CACHE_SLOTS];
+} __attribute__ ((aligned(64))) cl_fd_stripe;
+
+// Most sockets a node's timer connects at once, when topping up idle sockets
+// to min_idle_sockets.
+#define NODE_WARM_MAX_CONNECTS 4
+
+// Adaptive concurrency limits are fixed point - CL_LIMIT_ONE is one
+// transaction. Limits are cut by CL_LIMIT_CUT_PCT, at most once every
+// CL_LIMIT_CUT_MS, but never below CL_LIMIT_MIN.
+#define CL_LIMIT_SHIFT 16
+#define CL_LIMIT_ONE (1 << CL_LIMIT_SHIFT)
+#define CL_LIMIT_MAX 65535
+#define CL_LIMIT_MIN 4
+#define CL_LIMIT_CUT_PCT 80
+#define CL_LIMIT_CUT_MS 100
+
+// What a transaction tells a node's concurrency limiter when it's done.
+typedef enum {
+	CL_LIMIT_NONE		= 0,	// nothing learned (e.g. will retry)
+	CL_LIMIT_GOOD		= 1,	// completed in good time
+	CL_LIMIT_CONGESTED	= 2		// timed out or was slow
+} cl_limit_signal;
+
+// Node circuit breaker states.
+#define CL_CIRCUIT_CLOSED		0	// good
+#define CL_CIRCUIT_OPEN			1	// bad - avoid, or fail fast
+#define CL_CIRCUIT_HALF_OPEN	2	// cooled down - let a few probes through
+
+// Problem scores - a node's circuit opens when the score of problems since
+// its last success reaches CL_NODE_DUN_THRESHOLD.
+#define CL_NODE_DUN_TIMEOUT		100
+#define CL_NODE_DUN_NET_ERROR	200
+#define CL_NODE_DUN_CONNECT		200
+
+// How long an open circuit stays open before probing, and how many probes
+// must succeed to close it. Up to CL_CIRCUIT_PROBES probes may be in flight at
+// once - if they haven't closed the circuit within CL_CIRCUIT_COOL_MS of it
+// going half-open, it re-opens.
+#define CL_CIRCUIT_COOL_MS		2000
+#define CL_CIRCUIT_PROBES		3
+
 // Must be >= longest "names" string sent in a node info request.
 #define INFO_STR_MAX_LEN 64
 
+// Size of node info response header buffer, including read-ahead.
+#define INFO_READ_AHEAD 1024
+
 typedef struct node_info_req_s {
 	// What type of info request is in progress, if any.
 	node_info_req_type		type;
@@ -67,8 +162,9 @@ typedef struct node_info_req_s {
 	size_t					wbuf_size;
 	size_t					wbuf_pos;
 
-	// Buffer for reading proto header from socket.
-	uint8_t					hbuf[sizeof(cl_proto)];
+	// Buffer for reading proto header from socket - also reads ahead into
+	// the body, so a small response takes one recv().
+	uint8_t					hbuf[INFO_READ_AHEAD];
 	size_t					hbuf_pos;
 
 	// Buffer for reading proto body from socket.
@@ -77,6 +173,21 @@ typedef struct node_info_req_s {
 	size_t					rbuf_pos;
 } node_info_req;
 
+// A node's partition ownership in a namespace, as last applied to the
+// partition table. Bitmaps are as in replicas-all - a bit per partition, high
+// bit of each byte first.
+typedef struct cl_node_ownership_s {
+	struct cl_node_ownership_s* next;
+
+	char					ns[33];
+
+	// If not set, the next update applies every partition.
+	bool					valid;
+
+	// A bitmap per replica index, CL_PARTITION_REPLICAS of them, master first.
+	uint8_t					bitmaps[];
+} cl_node_ownership;
+
 typedef struct cl_cluster_node_s {
 	// Sanity-checking field.
 	uint32_t				MAGIC;
@@ -105,22 +216,69 @@ typedef struct cl_cluster_node_s {
 	// Rate at which transactions to this node are being throttled.
 	cf_atomic32				throttle_pct;
 
+	// Transactions in flight on this node, their smoothed (EWMA) latency and
+	// estimated 95th percentile latency in microseconds - for read replica
+	// choice, concurrency limiting and hedging.
+	cf_atomic32				n_in_flight;
+	cf_atomic32				latency_us;
+	cf_atomic32				latency_p95_us;
+
+	// Adaptive concurrency control - the current limit (fixed point, 0 while
+	// at node_concurrency_max), and when the limit was last cut.
+	cf_atomic32				limit;
+	cf_atomic32				limit_cut_ms;
+
+	// Circuit breaker - score of problems since the last success, circuit
+	// state, when the circuit last opened or went half-open, and half-open
+	// probes in flight and succeeded.
+	cf_atomic32				dun_score;
+	cf_atomic32				circuit;
+	cf_atomic32				circuit_opened_ms;
+	cf_atomic32				n_probes;
+	cf_atomic32				n_probe_successes;
+
 	// Socket pool for (non-info) transactions on this node.
 	cf_queue*				conn_q;
 
+	// Idle sockets cached per thread stripe, in front of conn_q - an array of
+	// FD_CACHE_STRIPES, allocated cache line aligned.
+	cl_fd_stripe*			fd_cache;
+
+	// Number of idle sockets, in fd_cache and conn_q - never more than
+	// socket_pool_max.
+	cf_atomic32				n_fds_idle;
+
 	// Number of sockets open on this node - for now just for stats.
 	cf_atomic32				n_fds_open;
 
+	// Pipelined connections to this node, for all event bases.
+	cl_pipe_conn*			pipe_conns;
+	uint32_t				n_pipe_conns;
+	void*					pipe_lock;
+
 	// What version of partition information we have for this node.
 	cf_atomic_int			partition_generation;
 
+	// Ownership last applied, per namespace - cluster manager thread only.
+	cl_node_ownership*		ownership;
+
+	// Partitions this node is master and prole of in the current partition
+	// maps, over all namespaces - cluster manager thread only.
+	uint32_t				n_master_partitions;
+	uint32_t				n_prole_partitions;
+
 	// Socket for info transactions on this node.
 	int						info_fd;
 
 	// The info transaction in progress, if any.
 	node_info_req			info_req;
 
-	// Space for two events: periodic node timer, and info request.
+	// Sockets being connected to top up idle sockets - -1 if slot is free.
+	int						warm_fds[NODE_WARM_MAX_CONNECTS];
+	uint32_t				n_warm_fds;
+
+	// Space for events: periodic node timer, info request, and one per warming
+	// socket slot.
 	uint8_t					event_space[];
 } cl_cluster_node;
 
@@ -130,8 +288,12 @@ typedef struct cl_cluster_node_s {
 // Must be in-sync with ev2citrusleaf_cluster_runtime_options.
 typedef struct threadsafe_runtime_options_s {
 	cf_atomic32				socket_pool_max;
+	cf_atomic32				min_idle_sockets;
+	cf_atomic32				socket_idle_timeout_seconds;
+	cf_atomic32				socket_max_age_seconds;
 
 	cf_atomic32				read_master_only;
+	cf_atomic32				read_replica_policy;
 
 	cf_atomic32				throttle_reads;
 	cf_atomic32				throttle_writes;
@@ -141,21 +303,69 @@ typedef struct threadsafe_runtime_options_s {
 	uint32_t				throttle_window_seconds;
 	uint32_t				throttle_factor;
 
+	cf_atomic32				node_concurrency_max;
+	cf_atomic32				node_latency_target_ms;
+
+	cf_atomic32				circuit_breaker;
+
+	cf_atomic32				hedge_reads;
+	cf_atomic32				hedge_delay_ms;
+	cf_atomic32				hedge_budget_pct;
+
+	cf_atomic32				zero_copy_threshold;
+
+	cf_atomic32				pipelining;
+	cf_atomic32				pipeline_max_conns;
+	cf_atomic32				pipeline_max_depth;
+
+	cf_atomic32				borrowed_results;
+
 	// For groups of options that need to change together:
 	void*					lock;
 } threadsafe_runtime_options;
 
-typedef struct cl_partition_s {
-	// Mutex to cover master/prole transitions for this partition.
-	void*					lock;
-
-	// Which node, if any, is the master.
-	cl_cluster_node*		master;
-
-	// Which node, if any, is the prole.
-	// TODO - not ideal for replication factor > 2.
-	cl_cluster_node*		prole;
-} cl_partition;
+// Replicas kept for each partition, in the server's order - index 0 is the
+// master, the rest are proles. Replicas beyond this many are ignored.
+#define CL_PARTITION_REPLICAS 4
+
+// Nodes a snapshot can refer to. Partitions refer to nodes by uint8_t slot
+// index, and slot 0 is always empty, meaning no node.
+#define CL_PARTITION_MAP_SLOTS 256
+
+// An immutable snapshot of a namespace's partitions. Each node it refers to
+// has a slot, holding one reference to the node for the snapshot's lifetime,
+// and partitions hold slot indices - so a snapshot for 4096 partitions is
+// about 10K, and a new one takes a reference per node, not per partition.
+// Updates make a new snapshot and swap it in. A replaced snapshot is freed
+// once every reader stripe has been seen idle, since then no thread can still
+// be reading it.
+typedef struct cl_partition_map_s {
+	// Next in the cluster's list of replaced snapshots.
+	struct cl_partition_map_s* retired_next;
+
+	// While replaced, reader stripes not yet seen idle (bit per stripe).
+	uint32_t				busy_stripes;
+
+	// Bumped for each new snapshot of the namespace.
+	uint32_t				version;
+
+	// Slots in use are below this.
+	uint32_t				n_slots;
+
+	// The nodes referred to - slots[0] is always NULL.
+	cl_cluster_node*		slots[CL_PARTITION_MAP_SLOTS];
+
+	// Slot index of each partition's replicas, CL_PARTITION_REPLICAS per
+	// partition - 0 if there's no such replica.
+	uint8_t					replicas[];
+} cl_partition_map;
+
+// The slot indices of a partition's replicas.
+static inline uint8_t*
+cl_partition_map_replicas(cl_partition_map* map, cl_partition_id pid)
+{
+	return &map->replicas[pid * CL_PARTITION_REPLICAS];
+}
 
 typedef struct cl_partition_table_s {
 	// Pointer to next element in this linked list.
@@ -167,10 +377,43 @@ typedef struct cl_partition_table_s {
 	// For logging - only dump table to log if it changed since last time.
 	bool					was_dumped;
 
-	// Space for array of cl_partition objects.
-	cl_partition			partitions[];
+	// The current snapshot (a cl_partition_map*) - swapped only in the
+	// cluster manager thread, read without locks by transaction threads.
+	cf_atomic_p				map;
 } cl_partition_table;
 
+// Public ev2citrusleaf_namespace_handle - interned handles are owned by the
+// cluster and never change once made, except to cache the partition table.
+// Non-interned handles are made on the stack for calls passing a name.
+struct ev2citrusleaf_namespace_s {
+	// Next in the cluster's list of interned handles.
+	struct ev2citrusleaf_namespace_s* next;
+
+	ev2citrusleaf_cluster*	asc;
+	bool					interned;
+
+	char					ns[33];
+	int						ns_len;
+
+	// The namespace field as sent, in network order.
+	size_t					field_size;
+	uint8_t					field[sizeof(cl_msg_field) + 32];
+
+	// The namespace's partition table (a cl_partition_table*), once it
+	// exists - tables are never freed while the cluster lasts.
+	cf_atomic_p				pt;
+};
+
+// Must be no more than bits in cl_partition_map busy_stripes.
+#define CL_PMAP_READER_STRIPES 32
+
+// Count of threads in a stripe reading partition snapshots - a cache line
+// each, so stripes don't contend.
+typedef struct cl_pmap_readers_s {
+	cf_atomic32				n;
+	uint8_t					pad[64 - sizeof(cf_atomic32)];
+} cl_pmap_readers;
+
 struct ev2citrusleaf_cluster_s {
 	// Global linked list of all clusters.
 	cf_ll_element			ll_e;
@@ -214,6 +457,10 @@ struct ev2citrusleaf_cluster_s {
 	// other than to issue a warning if there are incomplete transactions.
 	cf_atomic_int			requests_in_progress;
 
+	// Hedged read budget - read transactions add hedge_budget_pct credits, and
+	// each hedge sent uses 100.
+	cf_atomic32				hedge_credits;
+
 	// Internal non-node info requests in progress, used for clean shutdown.
 	cf_atomic_int			pings_in_progress;
 
@@ -223,6 +470,15 @@ struct ev2citrusleaf_cluster_s {
 	// Head of linked list of partition tables (one table per namespace).
 	cl_partition_table*		partition_table_head;
 
+	// Interned namespace handles, looked up only when apps get a handle.
+	ev2citrusleaf_namespace_handle* ns_handles;
+	void*					ns_handles_lock;
+
+	// Threads reading partition snapshots, by thread stripe, and replaced
+	// snapshots waiting for readers to move on.
+	cl_pmap_readers			pmap_readers[CL_PMAP_READER_STRIPES];
+	cl_partition_map*		pmap_retired;
+
 	// How many tender timer periods this cluster has lasted.
 	uint32_t				tender_intervals;
 
@@ -247,9 +503,56 @@ struct ev2citrusleaf_cluster_s {
 	cf_atomic_int			n_req_failures;
 	cf_atomic_int			n_req_timeouts;
 	cf_atomic_int			n_req_throttles;
+	cf_atomic_int			n_req_limited;
+	cf_atomic_int			n_limit_cuts;
+	cf_atomic_int			n_req_circuit_rejects;
+
+		// Node circuits opened and closed.
+	cf_atomic_int			n_circuits_opened;
+	cf_atomic_int			n_circuits_closed;
+
+		// Hedged reads sent, those whose response came first, those
+		// abandoned, and those not sent for lack of budget.
+	cf_atomic_int			n_hedges;
+	cf_atomic_int			n_hedges_won;
+	cf_atomic_int			n_hedges_wasted;
+	cf_atomic_int			n_hedges_no_budget;
+
 	cf_atomic_int			n_internal_retries;
 	cf_atomic_int			n_internal_retries_off_q;
 
+		// Idle sockets got from fd_cache, or not, on nodes since destroyed
+		// (live nodes count per stripe), and batches moved between fd_cache and
+		// conn_q.
+	cf_atomic_int			n_fd_cache_hits;
+	cf_atomic_int			n_fd_cache_misses;
+	cf_atomic_int			n_fd_cache_spills;
+	cf_atomic_int			n_fd_cache_refills;
+
+		// Idle sockets checked for remote close on checkout, and not.
+	cf_atomic_int			n_fd_checks;
+	cf_atomic_int			n_fd_checks_skipped;
+
+		// Sockets connected in the background to keep nodes' idle sockets
+		// topped up, and those that failed to connect.
+	cf_atomic_int			n_warm_connects;
+	cf_atomic_int			n_warm_connect_failures;
+
+		// Idle sockets closed for being unused too long, and sockets closed
+		// for being open too long.
+	cf_atomic_int			n_fds_reaped;
+	cf_atomic_int			n_fds_rotated;
+
+		// Socket reads for all transactions.
+	cf_atomic_int			n_recv_calls;
+
+		// Totals for pipelined transactions. Discards are responses dropped
+		// because the request lost a hedged read race.
+	cf_atomic_int			n_pipe_requests;
+	cf_atomic_int			n_pipe_conns_opened;
+	cf_atomic_int			n_pipe_conns_failed;
+	cf_atomic_int			n_pipe_discards;
+
 		// Totals for batch transactions.
 	cf_atomic_int			n_batch_node_successes;
 	cf_atomic_int			n_batch_node_failures;
@@ -274,13 +577,21 @@ typedef void (*cl_lookup_async_fn) (int result, cf_vector *sockaddr_in_v, void *
 extern int cl_lookup(struct evdns_base *base, char *hostname, short port, cl_lookup_async_fn cb, void *udata);
 
 // Cluster calls
-extern cl_cluster_node *cl_cluster_node_get(ev2citrusleaf_cluster *asc, const char *ns, const cf_digest *d, bool write);  // get node from cluster
+extern cl_cluster_node *cl_cluster_node_get(ev2citrusleaf_cluster *asc, cl_partition_table *pt, const cf_digest *d, bool write);  // get node from cluster
 extern void cl_cluster_node_release(cl_cluster_node *cn, char *msg);
 extern void cl_cluster_node_reserve(cl_cluster_node *cn, char *msg);
 extern void cl_cluster_node_put(cl_cluster_node *cn);          // put node back
-extern int cl_cluster_node_fd_get(cl_cluster_node *cn);			// get an FD to the node
+extern int cl_cluster_node_fd_get(cl_cluster_node *cn, bool trust_recent, bool *p_pooled);	// get an FD to the node
 extern void cl_cluster_node_fd_put(cl_cluster_node *cn, int fd); // put the FD back
 extern bool cl_cluster_node_throttle_drop(cl_cluster_node* cn);
+extern bool cl_cluster_node_limit_admit(cl_cluster_node* cn, uint32_t limit_max, bool may_reject);
+extern void cl_cluster_node_limit_release(cl_cluster_node* cn, uint32_t limit_max, cl_limit_signal signal);
+extern void cl_cluster_node_latency_add(cl_cluster_node* cn, uint64_t latency_us);
+extern void cl_cluster_node_dun(cl_cluster_node* cn, uint32_t score);
+extern void cl_cluster_node_ok(cl_cluster_node* cn);
+extern bool cl_cluster_node_circuit_allow(cl_cluster_node* cn, bool* p_probe);
+extern void cl_cluster_node_probe_done(cl_cluster_node* cn);
+extern bool cl_cluster_node_circuit_avoid(cl_cluster_node* cn);
 
 // Count a transaction as a success or failure.
 // TODO - add a tag parameter for debugging or detailed stats?
@@ -300,18 +611,28 @@ cl_cluster_node_had_failure(cl_cluster_node* cn)
 //
 extern int citrusleaf_info_host(struct sockaddr_in *sa_in, char *names, char **values, int timeout_ms);
 extern int citrusleaf_info_parse_single(char *values, char **value);
+extern bool cl_info_next_pair(char** p_pos, cl_info_pair* pair);
 
 extern int citrusleaf_cluster_init();
 extern int citrusleaf_cluster_shutdown();
 
 // Partition table calls
-// --- all these assume the partition lock is held
+// --- all but the gets are for the cluster manager thread only
 extern void cl_partition_table_destroy_all(ev2citrusleaf_cluster *asc);
+extern void cl_partition_table_reclaim(ev2citrusleaf_cluster* asc);
 extern bool cl_partition_table_is_node_present(cl_cluster_node* node);
-extern void cl_partition_table_update(cl_cluster_node* node, const char* ns, bool* masters, bool* proles);
-extern cl_cluster_node *cl_partition_table_get( ev2citrusleaf_cluster *asc, const char *ns, cl_partition_id pid, bool write);
+extern void cl_partition_table_update(cl_cluster_node* node, const char* ns, const uint8_t** bitmaps);
+extern void cl_partition_table_ownership_free(cl_cluster_node* node);
+extern cl_partition_table* cl_partition_table_get_by_ns(ev2citrusleaf_cluster* asc, const char* ns);
+extern cl_cluster_node *cl_partition_table_get( ev2citrusleaf_cluster *asc, cl_partition_table *pt, cl_partition_id pid, bool write);
+extern cl_cluster_node* cl_partition_table_get_other(ev2citrusleaf_cluster* asc, cl_partition_table* pt, cl_partition_id pid, const cl_cluster_node* node);
 extern void cl_partition_table_dump(ev2citrusleaf_cluster* asc);
 
+// Namespace handle calls
+extern bool cl_namespace_init(ev2citrusleaf_namespace_handle* nsh, ev2citrusleaf_cluster* asc, const char* ns);
+extern cl_partition_table* cl_namespace_get_table(const ev2citrusleaf_namespace_handle* nsh);
+extern void cl_namespace_destroy_all(ev2citrusleaf_cluster* asc);
+
 #ifdef __cplusplus
 } // end extern "C"
 #endif
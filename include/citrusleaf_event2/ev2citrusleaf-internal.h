@@ -16,6 +16,9 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#ifndef CF_WINDOWS
+#include <sched.h>
+#endif
 #include <event2/dns.h>
 #include <event2/event.h>
 
@@ -23,6 +26,7 @@
 #include "citrusleaf/cf_base_types.h"
 #include "citrusleaf/cf_digest.h"
 #include "citrusleaf/cf_hooks.h"
+#include "citrusleaf/cf_socket.h"
 #include "citrusleaf/proto.h"
 
 #include "ev2citrusleaf.h"
@@ -60,12 +64,79 @@ extern ev2citrusleaf_lock_callbacks *g_lock_cb;
 #define MUTEX_LOCK(__l)		if (__l) { g_lock_cb->lock(__l); }
 #define MUTEX_UNLOCK(__l)	if (__l) { g_lock_cb->unlock(__l); }
 
+#ifndef CF_WINDOWS
+#define CL_THREAD_LOCAL __thread
+#define CL_CPU_PAUSE() __asm__ __volatile__ ("pause" : : : "memory")
+#define CL_YIELD() sched_yield()
+#define CL_COMPILER_BARRIER() __asm__ __volatile__ ("" : : : "memory")
+#else
+#define CL_THREAD_LOCAL __declspec(thread)
+#define CL_CPU_PAUSE() YieldProcessor()
+#define CL_YIELD() SwitchToThread()
+#define CL_COMPILER_BARRIER() _ReadWriteBarrier()
+#endif
+
+//
+// Start state of "cross-threaded" transactions. Events may fire in the
+// callback thread before the original non-blocking call is done with the
+// transaction - if so they wait (briefly) for it. If the call fails after
+// adding the timeout event, the timeout event cleans up. Transactions that
+// aren't cross-threaded stay CL_START_DONE and never wait.
+//
+
+#define CL_START_DONE		0
+#define CL_START_PENDING	1
+#define CL_START_FAILED		2
+
+// Spins before yielding while waiting for a start to finish.
+#define CL_START_SPINS		1000
+
+static inline void
+cl_start_begin(cf_atomic32* p_state)
+{
+	// No event can see this until it's added, which publishes it.
+	cf_atomic32_set(p_state, CL_START_PENDING);
+}
+
+static inline void
+cl_start_end(cf_atomic32* p_state, bool ok)
+{
+	// Atomic add is a full barrier - the transaction's fields are visible to
+	// waiting events once they see the new state.
+	cf_atomic32_add(p_state, ok ? -1 : 1);
+}
+
+static inline uint32_t
+cl_start_wait(cf_atomic32* p_state)
+{
+	uint32_t state;
+	int spins = 0;
+
+	while ((state = cf_atomic32_get(*p_state)) == CL_START_PENDING) {
+		if (++spins < CL_START_SPINS) {
+			CL_CPU_PAUSE();
+		}
+		else {
+			CL_YIELD();
+		}
+	}
+
+	// Don't let the compiler read the transaction before the state.
+	CL_COMPILER_BARRIER();
+
+	return state;
+}
+
 struct cl_cluster_node_s;
+struct cl_pipe_conn_s;
 struct sockaddr_in;
 
 
 #define CL_REQUEST_MAGIC 0xBEEF1070
 
+// Enough for a request with 3 values sent in place - more and we'll malloc.
+#define CL_REQUEST_IOV_TMP 7
+
 typedef struct cl_request_s {
 
 	uint32_t MAGIC;
@@ -80,6 +151,8 @@ typedef struct cl_request_s {
 	ev2citrusleaf_callback user_cb;
 	void 					*user_data;
 
+	// Requests made with a namespace handle use it, others the name.
+	const ev2citrusleaf_namespace_handle* nsh;
 	char 			ns[33];
 	cf_digest 		d;
 	bool 			write;
@@ -88,7 +161,13 @@ typedef struct cl_request_s {
 	size_t		    wr_buf_pos;  // current write location
 	size_t		 	wr_buf_size;   // total inuse size of buffer
 
-	uint8_t			rd_header_buf[sizeof(cl_proto)]; // is: a cl_proto
+	// If any values are sent in place from the app's buffers, the whole
+	// packet is described by wr_iov, and wr_buf_size/pos are totals over it.
+	struct iovec	*wr_iov;
+	int				wr_iov_n;
+
+	// The proto header is read into the start of rd_tmp, along with as much
+	// of the body as fits (read-ahead).
 	size_t		    rd_header_pos;
 
 	uint8_t			*rd_buf; // cl_msg[data] starts here
@@ -99,14 +178,45 @@ typedef struct cl_request_s {
 	uint32_t		timeout_set;
 	uint32_t		base_hop_set;
 
-	uint8_t	wr_tmp[1024];
-	uint8_t rd_tmp[1024];
+	// Set if fd is a recently used pooled socket, which may not have been
+	// checked for remote close. If such a socket fails, retries get checked
+	// sockets.
+	bool			fd_trusted;
+	bool			fd_trust_failed;
+
+	// The node a read last failed on, so a retry can walk on to the next
+	// replica. Only compared, never dereferenced - it holds no reference.
+	const struct cl_cluster_node_s	*failed_node;
+
+	// Set while the request is counted in its node's n_in_flight, and when
+	// it was started on the node. A request counted as one of its node's
+	// half-open circuit probes is given back along with in_flight.
+	bool			in_flight;
+	bool			probe;
+	uint64_t		node_start_us;
+
+	// Set while the request is on a pipelined connection. If the request is
+	// abandoned meanwhile (a hedge won) its response is read and dropped.
+	struct cl_pipe_conn_s	*pipe;
+	struct cl_request_s		*pipe_next;
+	bool					pipe_discard;
+
+	// Hedged reads - while a hedge is in flight it and the original request
+	// point at each other. Only the original request has a hedge timer.
+	struct cl_request_s		*hedge;
+	struct cl_request_s		*hedge_of;
+	uint32_t		hedge_timer_set;
 
     uint64_t start_time;
 
-    // Relevant only for "cross-threaded" transactions.
-	void*			cross_thread_lock;
-	bool			cross_thread_locked;
+    // Relevant only for "cross-threaded" transactions - see cl_start_wait().
+	cf_atomic32		start_state;
+
+	// Everything from here on is not zeroed when a request is (re)allocated -
+	// add new fields above wr_tmp.
+	uint8_t	wr_tmp[1024];
+	uint8_t rd_tmp[1024];
+	struct iovec wr_iov_tmp[CL_REQUEST_IOV_TMP];
 
     uint8_t   event_space[]; // this will be preallocated
     						 // based on the size of struct event
@@ -143,6 +253,19 @@ typedef struct cl_info_request_s {
 typedef struct cl_statistics_s {
 	// Info requests made by app via public API.
 	cf_atomic_int	app_info_requests;
+
+	// cl_request objects malloc'd because pools were empty, and freed because
+	// pools were full. Pool hits and bytes held are counted per thread pool,
+	// off shared lines, and summed when stats are dumped. Also times a base
+	// found no shared stack free to claim.
+	cf_atomic_int	req_pool_misses;
+	cf_atomic_int	req_pool_frees;
+	cf_atomic_int	req_pool_no_stack;
+
+	// Timeout events added in libevent common-timeout queues, and (if a base
+	// ran out of common timeouts) in the ordinary timer heap.
+	cf_atomic_int	timers_common;
+	cf_atomic_int	timers_heap;
 } cl_statistics;
 
 extern cl_statistics g_cl_stats;
@@ -152,6 +275,25 @@ extern int ev2citrusleaf_info_host(struct event_base *base, struct sockaddr_in *
 
 extern void ev2citrusleaf_request_complete(cl_request *req, bool timedout);
 
+// Where a response body goes if it fits in rd_tmp after the proto header.
+static inline uint8_t*
+cl_request_rd_tmp_body(cl_request *req)
+{
+	return req->rd_tmp + sizeof(cl_proto);
+}
+
+extern int cl_timer_add(struct event *ev, int timeout_ms);
+extern bool cl_request_rd_buf_init(cl_request *req);
+extern void cl_request_rd_buf_free(cl_request *req);
+extern bool ev2citrusleaf_restart(cl_request *req, bool may_throttle, bool first_try);
+extern void cl_request_node_done(cl_request *req, struct cl_cluster_node_s *node, int signal);
+extern void cl_request_discard_done(cl_request *req, int signal);
+
+// Pipelined transactions, in cl_pipe.c:
+extern bool cl_pipe_add(cl_request *req);
+extern void cl_pipe_request_abort(cl_request *req);
+extern void cl_pipe_node_destroy(struct cl_cluster_node_s *cn);
+
 
 // a very useful function to see if connections are still connected
 
@@ -163,7 +305,7 @@ extern void ev2citrusleaf_request_complete(cl_request *req, bool timedout);
 extern int ev2citrusleaf_is_connected(int fd);
 
 // Used in ev2citrusleaf.c and cl_batch.c:
-void cl_set_value_particular(cl_msg_op* op, ev2citrusleaf_bin* value);
+void cl_set_value_particular(cl_msg_op* op, ev2citrusleaf_bin* value, bool borrow);
 uint8_t* cl_write_header(uint8_t* buf, size_t msg_size, int info1, int info2,
 		uint32_t generation, uint32_t expiration, uint32_t timeout,
 		uint32_t n_fields, uint32_t n_ops);
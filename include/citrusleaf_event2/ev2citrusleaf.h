@@ -64,6 +64,11 @@ enum ev2citrusleaf_write_policy { CL_WRITE_ASYNC, CL_WRITE_ONESHOT, CL_WRITE_RET
 
 typedef enum ev2citrusleaf_write_policy ev2citrusleaf_write_policy;
 
+enum ev2citrusleaf_read_replica_policy { CL_READ_REPLICA_RANDOM, CL_READ_REPLICA_MASTER_ONLY,
+	CL_READ_REPLICA_LEAST_LOADED, CL_READ_REPLICA_LOWEST_LATENCY };
+
+typedef enum ev2citrusleaf_read_replica_policy ev2citrusleaf_read_replica_policy;
+
 typedef char ev2citrusleaf_bin_name[32];
 
 //
@@ -130,11 +135,19 @@ void ev2citrusleaf_object_init_float(ev2citrusleaf_object *o, double f);
 void ev2citrusleaf_object_free(ev2citrusleaf_object *o);
 void ev2citrusleaf_bins_free(ev2citrusleaf_bin *bins, int n_bins);
 
+// Make an independent copy of bins, e.g. to keep borrowed results (see
+// borrowed_results runtime option) beyond a callback. Copied string values are
+// null-terminated. Free the copies' objects using ev2citrusleaf_bins_free().
+// Returns 0 on success, -1 if an allocation fails (nothing is left allocated).
+int ev2citrusleaf_bins_copy(ev2citrusleaf_bin *dst, const ev2citrusleaf_bin *src, int n_bins);
+
 
 // Callback to report results of database operations.
 //
 // If bins array is present, application is responsible for freeing bins'
 // objects using ev2citrusleaf_bins_free(), but client will free bins array.
+// (Unless the cluster's borrowed_results runtime option is set - then nothing
+// in bins need be freed, and nothing in bins is valid after the callback.)
 //
 // expiration is reported as seconds from now, the time the callback is made.
 // (Currently the server returns an epoch-based time which the client converts
@@ -174,6 +187,14 @@ int ev2citrusleaf_init(ev2citrusleaf_lock_callbacks *lock_cb);
 
 void ev2citrusleaf_shutdown(bool fail_requests);
 
+//
+// Freed transaction objects are kept in a per-thread pool for reuse, overflowing
+// into a shared pool per event base. This sets how many each thread, and each
+// event base, may hold (default 128, 0 disables pooling). Memory held is
+// roughly 2.5K per pooled object.
+//
+void ev2citrusleaf_request_pool_set_max(uint32_t max_per_thread);
+
 //
 // This call will print stats to stderr
 //
@@ -201,10 +222,38 @@ typedef struct ev2citrusleaf_cluster_runtime_options_s {
 	// sockets can be open at once, just how many are kept for re-use.)
 	uint32_t	socket_pool_max;
 
+	// Per node, the number of idle sockets the client tries to keep open ahead
+	// of demand. New nodes, and nodes whose idle sockets are used up, get
+	// connections opened in the background, a few at a time. Default value is
+	// 0 (off). Capped by socket_pool_max.
+	uint32_t	min_idle_sockets;
+
+	// Per node, idle sockets unused for longer than this many seconds are
+	// closed (but never fewer than min_idle_sockets are left). Default value
+	// is 0 (never close idle sockets).
+	uint32_t	socket_idle_timeout_seconds;
+
+	// Sockets open for longer than this many seconds are closed when next
+	// idle, and replaced as needed. Default value is 0 (never rotate sockets).
+	uint32_t	socket_max_age_seconds;
+
 	// true		- Force all get transactions to read only the master copy.
-	// false	- Default - Allow get transactions to read master or replica.
+	// false	- Default - Allow get transactions to read master or replicas.
 	bool		read_master_only;
 
+	// How get transactions choose among the master and replicas (all of them,
+	// for replication factor above 2), if allowed to:
+	// CL_READ_REPLICA_RANDOM			- Default - pick any at random.
+	// CL_READ_REPLICA_MASTER_ONLY		- same as read_master_only true.
+	// CL_READ_REPLICA_LEAST_LOADED		- pick the node with fewest transactions
+	//									  in flight.
+	// CL_READ_REPLICA_LOWEST_LATENCY	- pick the node with lowest recent
+	//									  (smoothed) latency, with a few picks
+	//									  at random to keep all measured.
+	// Nodes being throttled, or with open circuits, are avoided regardless. A
+	// read retried after a node fails goes to the partition's next replica.
+	ev2citrusleaf_read_replica_policy	read_replica_policy;
+
 	// If transactions to a particular database server node are failing too
 	// often, the client can be set to "throttle" transactions to that node by
 	// specifying which transactions may be throttled, the threshold failure
@@ -234,6 +283,82 @@ typedef struct ev2citrusleaf_cluster_runtime_options_s {
 
 	// How hard to throttle. Default value is 10.
 	uint32_t	throttle_factor;
+
+	// Adaptive concurrency limiting, independent of throttling - the client
+	// limits how many transactions may be in flight on each node. A node's
+	// limit creeps up by about one per limit's worth of good transactions, and
+	// is cut by 20% (at most every 100 ms) when a transaction times out or
+	// takes too long. Get, put and operate calls that would exceed the limit
+	// return EV2CITRUSLEAF_FAIL_THROTTLED. (Internal retries are not limited,
+	// nor are batch transactions.)
+
+	// Highest (and starting) limit per node, max 65535. Default value is 0 -
+	// no limiting.
+	uint32_t	node_concurrency_max;
+
+	// Transactions taking longer than this many milliseconds cut the limit.
+	// Default value is 0 - only timeouts cut the limit.
+	uint32_t	node_latency_target_ms;
+
+	// true		- Nodes with a run of timeouts, network errors or connect
+	//			  failures are marked bad ("open circuit"). Reads go to replicas
+	//			  where possible, and other transactions on the node fail fast
+	//			  with EV2CITRUSLEAF_FAIL_THROTTLED. After a cool-down a few
+	//			  transactions are let through to test the node, and if they
+	//			  succeed it's marked good again.
+	// false	- Default - Don't mark nodes bad.
+	bool		circuit_breaker;
+
+	// Hedged reads - if a read transaction's response hasn't come after a
+	// delay, the request is also sent to the partition's next replica. The
+	// first response is used, and the other transaction is abandoned (and its
+	// socket closed). Not used for batch transactions.
+
+	// true		- Hedge read transactions.
+	// false	- Default - Don't hedge.
+	bool		hedge_reads;
+
+	// Hedge after this many milliseconds. Default value is 0 - hedge after the
+	// node's recent 95th percentile latency.
+	uint32_t	hedge_delay_ms;
+
+	// Send at most this many hedges per 100 read transactions, max 100.
+	// Default value is 5.
+	uint32_t	hedge_budget_pct;
+
+	// String and blob values of at least this many bytes are written to the
+	// socket directly from the app's buffers, instead of being copied into
+	// the request. If this is used, the app must keep such value buffers
+	// valid and unchanged until the transaction's callback is made (or until
+	// the put or operate call returns, if it fails). Default value is 0 -
+	// values are always copied and may be freed as soon as the call returns.
+	uint32_t	zero_copy_threshold;
+
+	// true		- Send many transactions at once on each node socket, matching
+	//			  responses in order. Used only if the cluster is not
+	//			  cross-threaded. Connections belong to the event base of the
+	//			  transactions using them.
+	// false	- Default - Each transaction has a node socket to itself.
+	bool		pipelining;
+
+	// Per node, the maximum number of pipelined connections open, for all event
+	// bases together. Default value is 16. When all are in use by other event
+	// bases, transactions use the non-pipelined path.
+	uint32_t	pipeline_max_conns;
+
+	// Per pipelined connection, the maximum number of transactions in flight.
+	// Default value is 64. When a base's connections are all full and no more
+	// may be opened, transactions use the non-pipelined path.
+	uint32_t	pipeline_max_depth;
+
+	// true		- Bin values in transaction callbacks (except batch) point
+	//			  directly into the response buffer, and are valid only for the
+	//			  duration of the callback. String values are then NOT null-
+	//			  terminated - use the object's size. Use
+	//			  ev2citrusleaf_bins_copy() to keep values.
+	// false	- Default - String values are copied and null-terminated, and
+	//			  the app must free them using ev2citrusleaf_bins_free().
+	bool		borrowed_results;
 } ev2citrusleaf_cluster_runtime_options;
 
 // Client uses base for internal cluster management events. If NULL is passed,
@@ -375,6 +500,96 @@ ev2citrusleaf_operate_digest(ev2citrusleaf_cluster *cl, char *ns, cf_digest *d,
 	ev2citrusleaf_operation *ops, int n_ops, ev2citrusleaf_write_parameters *wparam,
 	int timeout_ms, ev2citrusleaf_callback cb, void *udata, struct event_base *base);
 
+//
+// Namespace handles
+//
+
+// For apps that do many transactions in a namespace - a handle caches what
+// the calls above work out from the namespace name on every transaction. A
+// handle belongs to the cluster and lasts until the cluster is destroyed - it
+// must not be freed, and may be shared across threads. Getting the handle for
+// the same name again returns the same handle. Returns NULL if the name is too
+// long (or on allocation failure).
+
+typedef struct ev2citrusleaf_namespace_s ev2citrusleaf_namespace_handle;
+
+ev2citrusleaf_namespace_handle *
+ev2citrusleaf_cluster_get_namespace(ev2citrusleaf_cluster *cl, const char *ns);
+
+// These behave like the corresponding calls above.
+
+int
+ev2citrusleaf_get_h(ev2citrusleaf_cluster *cl, const ev2citrusleaf_namespace_handle *nsh,
+	char *set, ev2citrusleaf_object *key, const char **bins, int n_bins, int timeout_ms,
+	ev2citrusleaf_callback cb, void *udata, struct event_base *base);
+
+int
+ev2citrusleaf_get_digest_h(ev2citrusleaf_cluster *cl, const ev2citrusleaf_namespace_handle *nsh,
+	cf_digest *d, const char **bins, int n_bins, int timeout_ms, ev2citrusleaf_callback cb,
+	void *udata, struct event_base *base);
+
+int
+ev2citrusleaf_put_h(ev2citrusleaf_cluster *cl, const ev2citrusleaf_namespace_handle *nsh,
+	char *set, ev2citrusleaf_object *key, ev2citrusleaf_bin *bins, int n_bins,
+	ev2citrusleaf_write_parameters *wparam, int timeout_ms, ev2citrusleaf_callback cb,
+	void *udata, struct event_base *base);
+
+int
+ev2citrusleaf_put_digest_h(ev2citrusleaf_cluster *cl, const ev2citrusleaf_namespace_handle *nsh,
+	cf_digest *d, ev2citrusleaf_bin *bins, int n_bins, ev2citrusleaf_write_parameters *wparam,
+	int timeout_ms, ev2citrusleaf_callback cb, void *udata, struct event_base *base);
+
+int
+ev2citrusleaf_operate_h(ev2citrusleaf_cluster *cl, const ev2citrusleaf_namespace_handle *nsh,
+	char *set, ev2citrusleaf_object *key, ev2citrusleaf_operation *ops, int n_ops,
+	ev2citrusleaf_write_parameters *wparam, int timeout_ms, ev2citrusleaf_callback cb,
+	void *udata, struct event_base *base);
+
+int
+ev2citrusleaf_operate_digest_h(ev2citrusleaf_cluster *cl, const ev2citrusleaf_namespace_handle *nsh,
+	cf_digest *d, ev2citrusleaf_operation *ops, int n_ops, ev2citrusleaf_write_parameters *wparam,
+	int timeout_ms, ev2citrusleaf_callback cb, void *udata, struct event_base *base);
+
+//
+// Prepared calls
+//
+
+// For many transactions with the same namespace, set and bins (or operations),
+// where only the key (or digest), values and write parameters differ. The
+// invariant parts of the request are laid out once when preparing. A prepared
+// object is not changed by transactions, so may be shared across threads. It
+// must not be destroyed until all ev2citrusleaf_prepared_start() calls using
+// it have returned.
+
+typedef struct ev2citrusleaf_prepared_s ev2citrusleaf_prepared;
+
+// Prepare a get of the named bins, or of all bins if n_bins is 0.
+ev2citrusleaf_prepared *
+ev2citrusleaf_prepare_get(const char *ns, const char *set, const char **bins, int n_bins);
+
+// Prepare a put of the named bins.
+ev2citrusleaf_prepared *
+ev2citrusleaf_prepare_put(const char *ns, const char *set, const char **bins, int n_bins);
+
+// Prepare an operate - only the ops' bin names and types are used.
+ev2citrusleaf_prepared *
+ev2citrusleaf_prepare_operate(const char *ns, const char *set,
+	const ev2citrusleaf_operation *ops, int n_ops);
+
+void
+ev2citrusleaf_prepared_destroy(ev2citrusleaf_prepared *p);
+
+// Start a prepared transaction. Pass key, or NULL key and a digest (in which
+// case no set is sent, as with the _digest calls). For puts and operates,
+// values has an object for each prepared bin or op, in order - objects for read
+// ops are ignored. For gets, pass NULL values and wparam. Otherwise behaves like
+// the corresponding non-prepared call.
+int
+ev2citrusleaf_prepared_start(ev2citrusleaf_cluster *cl, const ev2citrusleaf_prepared *p,
+	ev2citrusleaf_object *key, cf_digest *d, ev2citrusleaf_object *values,
+	ev2citrusleaf_write_parameters *wparam, int timeout_ms, ev2citrusleaf_callback cb,
+	void *udata, struct event_base *base);
+
 //
 // Batch calls
 //
@@ -428,6 +643,16 @@ int
 ev2citrusleaf_get_many_digest(ev2citrusleaf_cluster *cl, const char *ns, const cf_digest *digests, int n_digests,
 		const char **bins, int n_bins, int timeout_ms, ev2citrusleaf_get_many_cb cb, void *udata, struct event_base *base);
 
+// Get a batch of records, specified by set and array of keys. The keys'
+// digests are computed in bulk (see ev2citrusleaf_calculate_digests()) and
+// the batch proceeds as in ev2citrusleaf_get_many_digest(). Result records
+// are identified by digest, not key.
+
+int
+ev2citrusleaf_get_many(ev2citrusleaf_cluster *cl, const char *ns, const char *set, const ev2citrusleaf_object *keys,
+		int n_keys, const char **bins, int n_bins, int timeout_ms, ev2citrusleaf_get_many_cb cb, void *udata,
+		struct event_base *base);
+
 // Check existence of a batch of records, specified by array of digests.
 //
 // If return value is EV2CITRUSLEAF_OK, the callback will always be made. If
@@ -437,6 +662,23 @@ int
 ev2citrusleaf_exists_many_digest(ev2citrusleaf_cluster *cl, const char *ns, const cf_digest *digests, int n_digests,
 		int timeout_ms, ev2citrusleaf_get_many_cb cb, void *udata, struct event_base *base);
 
+// Batch calls using a namespace handle - otherwise as above.
+
+int
+ev2citrusleaf_get_many_digest_h(ev2citrusleaf_cluster *cl, const ev2citrusleaf_namespace_handle *nsh,
+		const cf_digest *digests, int n_digests, const char **bins, int n_bins, int timeout_ms,
+		ev2citrusleaf_get_many_cb cb, void *udata, struct event_base *base);
+
+int
+ev2citrusleaf_get_many_h(ev2citrusleaf_cluster *cl, const ev2citrusleaf_namespace_handle *nsh,
+		const char *set, const ev2citrusleaf_object *keys, int n_keys, const char **bins, int n_bins,
+		int timeout_ms, ev2citrusleaf_get_many_cb cb, void *udata, struct event_base *base);
+
+int
+ev2citrusleaf_exists_many_digest_h(ev2citrusleaf_cluster *cl, const ev2citrusleaf_namespace_handle *nsh,
+		const cf_digest *digests, int n_digests, int timeout_ms, ev2citrusleaf_get_many_cb cb,
+		void *udata, struct event_base *base);
+
 
 //
 // the info interface allows
@@ -455,6 +697,14 @@ ev2citrusleaf_info(struct event_base *base, struct evdns_base *dns_base, char *h
 int
 ev2citrusleaf_calculate_digest(const char *set, const ev2citrusleaf_object *key, cf_digest *digest);
 
+//
+// Calculate digests for an array of keys in one set - much faster than calling
+// ev2citrusleaf_calculate_digest() per key, since short keys are hashed several
+// at a time. Returns -1 if any key is of an unsupported type.
+//
+int
+ev2citrusleaf_calculate_digests(const char *set, const ev2citrusleaf_object *keys, int n_keys, cf_digest *digests);
+
 //
 // Logging - see cf_log.h
 //
@@ -0,0 +1,226 @@
+/*
+ *  Citrusleaf Foundation
+ *  src/cf_base64.c - base 64 decoding
+ *
+ *  Copyright 2013 by Citrusleaf.  All rights reserved.
+ *  THIS IS UNPUBLISHED PROPRIETARY SOURCE CODE.  THE COPYRIGHT NOTICE
+ *  ABOVE DOES NOT EVIDENCE ANY ACTUAL OR INTENDED PUBLICATION.
+ */
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define CF_BASE64_X86
+#endif
+
+#include "citrusleaf/cf_base64.h"
+
+
+//==========================================================
+// Scalar version.
+//
+
+static const uint8_t CF_BASE64_DECODE_ARRAY[] = {
+	    /*00*/ /*01*/ /*02*/ /*03*/ /*04*/ /*05*/ /*06*/ /*07*/   /*08*/ /*09*/ /*0A*/ /*0B*/ /*0C*/ /*0D*/ /*0E*/ /*0F*/
+/*00*/	    0,     0,     0,     0,     0,     0,     0,     0,       0,     0,     0,     0,     0,     0,     0,     0,
+/*10*/      0,     0,     0,     0,     0,     0,     0,     0,       0,     0,     0,     0,     0,     0,     0,     0,
+/*20*/	    0,     0,     0,     0,     0,     0,     0,     0,       0,     0,     0,    62,     0,     0,     0,    63,
+/*30*/	   52,    53,    54,    55,    56,    57,    58,    59,      60,    61,     0,     0,     0,     0,     0,     0,
+/*40*/	    0,     0,     1,     2,     3,     4,     5,     6,       7,     8,     9,    10,    11,    12,    13,    14,
+/*50*/	   15,    16,    17,    18,    19,    20,    21,    22,      23,    24,    25,     0,     0,     0,     0,     0,
+/*60*/	    0,    26,    27,    28,    29,    30,    31,    32,      33,    34,    35,    36,    37,    38,    39,    40,
+/*70*/	   41,    42,    43,    44,    45,    46,    47,    48,      49,    50,    51,     0,     0,     0,     0,     0,
+/*80*/	    0,     0,     0,     0,     0,     0,     0,     0,       0,     0,     0,     0,     0,     0,     0,     0,
+/*90*/	    0,     0,     0,     0,     0,     0,     0,     0,       0,     0,     0,     0,     0,     0,     0,     0,
+/*A0*/	    0,     0,     0,     0,     0,     0,     0,     0,       0,     0,     0,     0,     0,     0,     0,     0,
+/*B0*/	    0,     0,     0,     0,     0,     0,     0,     0,       0,     0,     0,     0,     0,     0,     0,     0,
+/*C0*/	    0,     0,     0,     0,     0,     0,     0,     0,       0,     0,     0,     0,     0,     0,     0,     0,
+/*D0*/	    0,     0,     0,     0,     0,     0,     0,     0,       0,     0,     0,     0,     0,     0,     0,     0,
+/*E0*/	    0,     0,     0,     0,     0,     0,     0,     0,       0,     0,     0,     0,     0,     0,     0,     0,
+/*F0*/	    0,     0,     0,     0,     0,     0,     0,     0,       0,     0,     0,     0,     0,     0,     0,     0
+};
+
+#define B64DA(__c) CF_BASE64_DECODE_ARRAY[(uint8_t)(__c)]
+
+static inline void
+decode_scalar(const char* in, int len, uint8_t* out)
+{
+	int i = 0;
+	int j = 0;
+
+	while (i < len) {
+		out[j + 0] = (B64DA(in[i + 0]) << 2) | (B64DA(in[i + 1]) >> 4);
+		out[j + 1] = (B64DA(in[i + 1]) << 4) | (B64DA(in[i + 2]) >> 2);
+		out[j + 2] = (B64DA(in[i + 2]) << 6) |  B64DA(in[i + 3]);
+
+		i += 4;
+		j += 3;
+	}
+}
+
+
+//==========================================================
+// SIMD versions.
+//
+// Characters are translated to 6-bit values by adding an offset looked up by
+// their high nibble (with '/' adjusted), and checked by ANDing flags looked up
+// by both nibbles - any non-zero flag means a character outside the alphabet.
+// Then each 4 values are packed into 3 bytes by multiply-adds and a shuffle.
+// A block with '=' padding or an invalid character is left to the scalar
+// version, so all versions decode identically.
+//
+// Stores are full vectors, of which only 3/4 are decoded bytes, so the SIMD
+// loops stop while there's still room for a whole vector in out.
+//
+
+#ifdef CF_BASE64_X86
+
+// Flags by low nibble, and by high nibble.
+#define LUT_LO \
+	0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, \
+	0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A
+#define LUT_HI \
+	0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, \
+	0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10
+
+// Offsets by high nibble - index 1 is for '/'.
+#define LUT_ROLL \
+	0, 16, 19, 4, -65, -65, -71, -71, \
+	0, 0, 0, 0, 0, 0, 0, 0
+
+// Bytes to keep from each 32-bit lane after packing.
+#define PACK_SHUFFLE \
+	2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1
+
+__attribute__ ((target ("ssse3")))
+static void
+decode_ssse3(const char* in, int len, uint8_t* out)
+{
+	const __m128i lut_lo = _mm_setr_epi8(LUT_LO);
+	const __m128i lut_hi = _mm_setr_epi8(LUT_HI);
+	const __m128i lut_roll = _mm_setr_epi8(LUT_ROLL);
+	const __m128i pack = _mm_setr_epi8(PACK_SHUFFLE);
+	const __m128i mask_2f = _mm_set1_epi8(0x2F);
+	const __m128i zero = _mm_setzero_si128();
+
+	int i = 0;
+	int j = 0;
+
+	while ((len - i) / 4 * 3 >= 16) {
+		__m128i v = _mm_loadu_si128((const __m128i*)(in + i));
+		__m128i hi_nibbles = _mm_and_si128(_mm_srli_epi32(v, 4), mask_2f);
+		__m128i lo_nibbles = _mm_and_si128(v, mask_2f);
+		__m128i hi = _mm_shuffle_epi8(lut_hi, hi_nibbles);
+		__m128i lo = _mm_shuffle_epi8(lut_lo, lo_nibbles);
+
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(lo, hi), zero)) !=
+				0xFFFF) {
+			break;
+		}
+
+		__m128i eq_2f = _mm_cmpeq_epi8(v, mask_2f);
+		__m128i roll = _mm_shuffle_epi8(lut_roll,
+				_mm_add_epi8(eq_2f, hi_nibbles));
+
+		v = _mm_add_epi8(v, roll);
+		v = _mm_maddubs_epi16(v, _mm_set1_epi32(0x01400140));
+		v = _mm_madd_epi16(v, _mm_set1_epi32(0x00011000));
+		v = _mm_shuffle_epi8(v, pack);
+
+		_mm_storeu_si128((__m128i*)(out + j), v);
+
+		i += 16;
+		j += 12;
+	}
+
+	decode_scalar(in + i, len - i, out + j);
+}
+
+__attribute__ ((target ("avx2")))
+static void
+decode_avx2(const char* in, int len, uint8_t* out)
+{
+	const __m256i lut_lo = _mm256_setr_epi8(LUT_LO, LUT_LO);
+	const __m256i lut_hi = _mm256_setr_epi8(LUT_HI, LUT_HI);
+	const __m256i lut_roll = _mm256_setr_epi8(LUT_ROLL, LUT_ROLL);
+	const __m256i pack = _mm256_setr_epi8(PACK_SHUFFLE, PACK_SHUFFLE);
+	const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, -1, -1);
+	const __m256i mask_2f = _mm256_set1_epi8(0x2F);
+
+	int i = 0;
+	int j = 0;
+
+	while ((len - i) / 4 * 3 >= 32) {
+		__m256i v = _mm256_loadu_si256((const __m256i*)(in + i));
+		__m256i hi_nibbles = _mm256_and_si256(_mm256_srli_epi32(v, 4), mask_2f);
+		__m256i lo_nibbles = _mm256_and_si256(v, mask_2f);
+		__m256i hi = _mm256_shuffle_epi8(lut_hi, hi_nibbles);
+		__m256i lo = _mm256_shuffle_epi8(lut_lo, lo_nibbles);
+
+		if (! _mm256_testz_si256(lo, hi)) {
+			break;
+		}
+
+		__m256i eq_2f = _mm256_cmpeq_epi8(v, mask_2f);
+		__m256i roll = _mm256_shuffle_epi8(lut_roll,
+				_mm256_add_epi8(eq_2f, hi_nibbles));
+
+		v = _mm256_add_epi8(v, roll);
+		v = _mm256_maddubs_epi16(v, _mm256_set1_epi32(0x01400140));
+		v = _mm256_madd_epi16(v, _mm256_set1_epi32(0x00011000));
+		v = _mm256_shuffle_epi8(v, pack);
+		v = _mm256_permutevar8x32_epi32(v, lanes);
+
+		_mm256_storeu_si256((__m256i*)(out + j), v);
+
+		i += 32;
+		j += 24;
+	}
+
+	// The rest may still be long enough for a few 16-character blocks.
+	decode_ssse3(in + i, len - i, out + j);
+}
+
+#endif // CF_BASE64_X86
+
+
+typedef void (*decode_fn)(const char* in, int len, uint8_t* out);
+
+static decode_fn g_decode = decode_scalar;
+static pthread_once_t g_decode_once = PTHREAD_ONCE_INIT;
+
+// Pick the widest version this CPU runs. Called once, via pthread_once().
+static void
+choose_decode()
+{
+	decode_fn fn = decode_scalar;
+
+#ifdef CF_BASE64_X86
+	__builtin_cpu_init();
+
+	if (__builtin_cpu_supports("avx2")) {
+		fn = decode_avx2;
+	}
+	else if (__builtin_cpu_supports("ssse3")) {
+		fn = decode_ssse3;
+	}
+#endif
+
+	g_decode = fn;
+}
+
+
+//==========================================================
+// Public API
+//
+
+void
+cf_base64_decode(const char* in, int len, uint8_t* out)
+{
+	pthread_once(&g_decode_once, choose_decode);
+
+	g_decode(in, len, out);
+}
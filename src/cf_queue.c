@@ -268,6 +268,109 @@ cf_queue_push_limit(cf_queue *q, void *ptr, uint32_t limit)
 	return true;
 }
 
+//
+// Internal function. Call with new size (big enough for what's queued) with
+// lock held. Unlike cf_queue_resize(), works on queues that aren't full, and
+// leaves the queue as it was if it can't allocate.
+//
+static int
+cf_queue_grow(cf_queue *q, uint32_t new_sz)
+{
+	uint8_t *newq = (uint8_t*)malloc(new_sz * q->elementsz);
+	if (!newq) {
+		return(-1);
+	}
+
+	// copy what's queued from the read point, unwrapping it
+	uint32_t sz = CF_Q_SZ(q);
+	uint32_t endsz = q->allocsz - (q->read_offset % q->allocsz);
+	if (endsz > sz) endsz = sz;
+
+	memcpy(&newq[0], CF_Q_ELEM_PTR(q, q->read_offset), endsz * q->elementsz);
+	memcpy(&newq[endsz * q->elementsz], &q->queue[0], (sz - endsz) * q->elementsz);
+
+	free(q->queue);
+	q->queue = newq;
+
+	q->read_offset = 0;
+	q->write_offset = sz;
+	q->allocsz = new_sz;
+	return(0);
+}
+
+/* cf_queue_push_n
+ * Push n elements, laid out contiguously in buf, under one lock acquisition.
+ * All or nothing - if the queue can't grow to fit them, returns -1 having
+ * pushed none.
+ * */
+int
+cf_queue_push_n(cf_queue *q, void *buf, uint32_t n)
+{
+	QUEUE_LOCK(q);
+
+	/* Check queue length - grow enough for all n before pushing any */
+	if (CF_Q_SZ(q) + n > q->allocsz) {
+		uint32_t new_sz = q->allocsz + CF_QUEUE_ALLOCSZ;
+
+		while (CF_Q_SZ(q) + n > new_sz) {
+			new_sz += CF_QUEUE_ALLOCSZ;
+		}
+
+		if (0 != cf_queue_grow(q, new_sz)) {
+			QUEUE_UNLOCK(q);
+			return(-1);
+		}
+	}
+
+	for (uint32_t i = 0; i < n; i++) {
+		memcpy(CF_Q_ELEM_PTR(q,q->write_offset), buf, q->elementsz);
+		q->write_offset++;
+		buf = (uint8_t*)buf + q->elementsz;
+	}
+
+	// we're at risk of overflow if the write offset is that high
+	if (q->write_offset & 0xC0000000) cf_queue_unwrap(q);
+
+#ifndef EXTERNAL_LOCKS
+	if (q->threadsafe)
+		pthread_cond_broadcast(&q->CV);
+#endif
+
+	QUEUE_UNLOCK(q);
+
+	return(0);
+}
+
+/* cf_queue_pop_n
+ * Pop up to n elements into buf under one lock acquisition, without waiting.
+ * Returns the number popped.
+ * */
+uint32_t
+cf_queue_pop_n(cf_queue *q, void *buf, uint32_t n)
+{
+	QUEUE_LOCK(q);
+
+	uint32_t size = CF_Q_SZ(q);
+
+	if (n > size) {
+		n = size;
+	}
+
+	for (uint32_t i = 0; i < n; i++) {
+		memcpy(buf, CF_Q_ELEM_PTR(q,q->read_offset), q->elementsz);
+		q->read_offset++;
+		buf = (uint8_t*)buf + q->elementsz;
+	}
+
+	if (q->read_offset == q->write_offset) {
+		q->read_offset = q->write_offset = 0;
+	}
+
+	QUEUE_UNLOCK(q);
+
+	return(n);
+}
+
 /* cf_queue_pop
  * if ms_wait < 0, wait forever
  * if ms_wait = 0, don't wait at all
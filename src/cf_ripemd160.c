@@ -0,0 +1,415 @@
+/*
+ *  Citrusleaf Foundation
+ *  src/cf_ripemd160.c - RIPEMD-160 message digest
+ *
+ *  Copyright 2013 by Citrusleaf.  All rights reserved.
+ *  THIS IS UNPUBLISHED PROPRIETARY SOURCE CODE.  THE COPYRIGHT NOTICE
+ *  ABOVE DOES NOT EVIDENCE ANY ACTUAL OR INTENDED PUBLICATION.
+ */
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "citrusleaf/cf_ripemd160.h"
+
+
+/*
+ * The compression function is written once, as a macro, using only operators
+ * which work on both uint32_t and GCC vector types. Instantiated for uint32_t
+ * it's the scalar version. Instantiated for vectors of 4 or 8 uint32_t it
+ * hashes 4 or 8 independent blocks at once, one per lane - SSE2 and AVX2 on
+ * x86. (Compilers without vector extensions just get the scalar version.)
+ */
+
+// Message word selection, left and right lines.
+static const uint8_t RL[80] = {
+	0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+	7, 4, 13, 1, 10, 6, 15, 3, 12, 0, 9, 5, 2, 14, 11, 8,
+	3, 10, 14, 4, 9, 15, 8, 1, 2, 7, 0, 6, 13, 11, 5, 12,
+	1, 9, 11, 10, 0, 8, 12, 4, 13, 3, 7, 15, 14, 5, 6, 2,
+	4, 0, 5, 9, 7, 12, 2, 10, 14, 1, 3, 8, 11, 6, 15, 13
+};
+
+static const uint8_t RR[80] = {
+	5, 14, 7, 0, 9, 2, 11, 4, 13, 6, 15, 8, 1, 10, 3, 12,
+	6, 11, 3, 7, 0, 13, 5, 10, 14, 15, 8, 12, 4, 9, 1, 2,
+	15, 5, 1, 3, 7, 14, 6, 9, 11, 8, 12, 2, 10, 0, 4, 13,
+	8, 6, 4, 1, 3, 11, 15, 0, 5, 12, 2, 13, 9, 7, 10, 14,
+	12, 15, 10, 4, 1, 5, 8, 7, 6, 2, 13, 14, 0, 3, 9, 11
+};
+
+// Rotate amounts, left and right lines.
+static const uint8_t SL[80] = {
+	11, 14, 15, 12, 5, 8, 7, 9, 11, 13, 14, 15, 6, 7, 9, 8,
+	7, 6, 8, 13, 11, 9, 7, 15, 7, 12, 15, 9, 11, 7, 13, 12,
+	11, 13, 6, 7, 14, 9, 13, 15, 14, 8, 13, 6, 5, 12, 7, 5,
+	11, 12, 14, 15, 14, 15, 9, 8, 9, 14, 5, 6, 8, 6, 5, 12,
+	9, 15, 5, 11, 6, 8, 13, 12, 5, 12, 13, 14, 11, 8, 5, 6
+};
+
+static const uint8_t SR[80] = {
+	8, 9, 9, 11, 13, 15, 15, 5, 7, 7, 8, 11, 14, 14, 12, 6,
+	9, 13, 15, 7, 12, 8, 9, 11, 7, 7, 12, 7, 6, 15, 13, 11,
+	9, 7, 15, 11, 8, 6, 6, 14, 12, 13, 5, 14, 13, 13, 7, 5,
+	15, 5, 8, 11, 14, 14, 6, 14, 6, 9, 12, 9, 12, 5, 15, 8,
+	8, 5, 12, 9, 12, 5, 14, 6, 8, 13, 6, 5, 15, 13, 11, 11
+};
+
+static const uint32_t H_INIT[5] = {
+	0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0
+};
+
+#define F1(x, y, z) ((x) ^ (y) ^ (z))
+#define F2(x, y, z) (((x) & (y)) | (~(x) & (z)))
+#define F3(x, y, z) (((x) | ~(y)) ^ (z))
+#define F4(x, y, z) (((x) & (z)) | ((y) & ~(z)))
+#define F5(x, y, z) ((x) ^ ((y) | ~(z)))
+
+#define ROL(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+
+// 16 steps of both lines - FL, KL for left, FR, KR for right.
+#define RMD_ROUND(T, round, FL, KL, FR, KR) \
+	for (int j = 16 * round; j < 16 * (round + 1); j++) { \
+		T t = ROL(al + FL(bl, cl, dl) + X[RL[j]] + (uint32_t)KL, SL[j]) + el; \
+		al = el; el = dl; dl = ROL(cl, 10); cl = bl; bl = t; \
+		t = ROL(ar + FR(br, cr, dr) + X[RR[j]] + (uint32_t)KR, SR[j]) + er; \
+		ar = er; er = dr; dr = ROL(cr, 10); cr = br; br = t; \
+	}
+
+#define RMD_COMPRESS(T, h, X) \
+	do { \
+		T al = h[0], bl = h[1], cl = h[2], dl = h[3], el = h[4]; \
+		T ar = al, br = bl, cr = cl, dr = dl, er = el; \
+		RMD_ROUND(T, 0, F1, 0x00000000, F5, 0x50A28BE6) \
+		RMD_ROUND(T, 1, F2, 0x5A827999, F4, 0x5C4DD124) \
+		RMD_ROUND(T, 2, F3, 0x6ED9EBA1, F3, 0x6D703EF3) \
+		RMD_ROUND(T, 3, F4, 0x8F1BBCDC, F2, 0x7A6D76E9) \
+		RMD_ROUND(T, 4, F5, 0xA953FD4E, F1, 0x00000000) \
+		T t = h[1] + cl + dr; \
+		h[1] = h[2] + dl + er; \
+		h[2] = h[3] + el + ar; \
+		h[3] = h[4] + al + br; \
+		h[4] = h[0] + bl + cr; \
+		h[0] = t; \
+	} while (0)
+
+static inline uint32_t
+get_le32(const uint8_t* p)
+{
+	return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) |
+			((uint32_t)p[3] << 24);
+}
+
+static inline void
+put_le32(uint8_t* p, uint32_t v)
+{
+	p[0] = (uint8_t)v;
+	p[1] = (uint8_t)(v >> 8);
+	p[2] = (uint8_t)(v >> 16);
+	p[3] = (uint8_t)(v >> 24);
+}
+
+static void
+compress(uint32_t* h, const uint8_t* block)
+{
+	uint32_t X[16];
+
+	for (int i = 0; i < 16; i++) {
+		X[i] = get_le32(block + (i * 4));
+	}
+
+	RMD_COMPRESS(uint32_t, h, X);
+}
+
+static inline void
+put_digest(uint8_t* digest, const uint32_t* h)
+{
+	for (int i = 0; i < 5; i++) {
+		put_le32(digest + (i * 4), h[i]);
+	}
+}
+
+static inline size_t
+parts_len(const cf_ripemd160_part* parts, int n_parts)
+{
+	size_t len = 0;
+
+	for (int i = 0; i < n_parts; i++) {
+		len += parts[i].len;
+	}
+
+	return len;
+}
+
+// Lay out a message that fits in one block, with padding and length.
+static void
+single_block(uint8_t* block, const cf_ripemd160_part* parts, int n_parts,
+		size_t len)
+{
+	uint8_t* p = block;
+
+	for (int i = 0; i < n_parts; i++) {
+		memcpy(p, parts[i].data, parts[i].len);
+		p += parts[i].len;
+	}
+
+	*p++ = 0x80;
+	memset(p, 0, block + CF_RIPEMD160_BLOCK_SZ - 8 - p);
+
+	uint64_t bits = (uint64_t)len << 3;
+
+	put_le32(block + CF_RIPEMD160_BLOCK_SZ - 8, (uint32_t)bits);
+	put_le32(block + CF_RIPEMD160_BLOCK_SZ - 4, (uint32_t)(bits >> 32));
+}
+
+
+//==========================================================
+// Multi-buffer versions.
+//
+
+#if defined(__GNUC__)
+
+typedef uint32_t v4u32 __attribute__ ((vector_size (16)));
+
+static void
+compress_x4(const uint8_t* blocks, uint8_t** digests, int n)
+{
+	v4u32 X[16];
+	v4u32 h[5];
+
+	for (int i = 0; i < 16; i++) {
+		for (int l = 0; l < 4; l++) {
+			X[i][l] = get_le32(blocks + (l * CF_RIPEMD160_BLOCK_SZ) + (i * 4));
+		}
+	}
+
+	for (int i = 0; i < 5; i++) {
+		h[i] = (v4u32){ H_INIT[i], H_INIT[i], H_INIT[i], H_INIT[i] };
+	}
+
+	RMD_COMPRESS(v4u32, h, X);
+
+	for (int l = 0; l < n; l++) {
+		for (int i = 0; i < 5; i++) {
+			put_le32(digests[l] + (i * 4), h[i][l]);
+		}
+	}
+}
+
+#define MAX_LANES 4
+
+#if defined(__x86_64__) || defined(__i386__)
+
+typedef uint32_t v8u32 __attribute__ ((vector_size (32)));
+
+__attribute__ ((target ("avx2")))
+static void
+compress_x8(const uint8_t* blocks, uint8_t** digests, int n)
+{
+	v8u32 X[16];
+	v8u32 h[5];
+
+	for (int i = 0; i < 16; i++) {
+		for (int l = 0; l < 8; l++) {
+			X[i][l] = get_le32(blocks + (l * CF_RIPEMD160_BLOCK_SZ) + (i * 4));
+		}
+	}
+
+	for (int i = 0; i < 5; i++) {
+		uint32_t v = H_INIT[i];
+
+		h[i] = (v8u32){ v, v, v, v, v, v, v, v };
+	}
+
+	RMD_COMPRESS(v8u32, h, X);
+
+	for (int l = 0; l < n; l++) {
+		for (int i = 0; i < 5; i++) {
+			put_le32(digests[l] + (i * 4), h[i][l]);
+		}
+	}
+}
+
+#undef MAX_LANES
+#define MAX_LANES 8
+
+#endif // x86
+
+#else // no vector extensions
+
+#define MAX_LANES 1
+
+#endif
+
+typedef void (*compress_lanes_fn)(const uint8_t* blocks, uint8_t** digests,
+		int n);
+
+static int g_lanes = 0;
+static compress_lanes_fn g_compress_lanes = NULL;
+static pthread_once_t g_lanes_once = PTHREAD_ONCE_INIT;
+
+// Pick the widest version this CPU runs. Called once, via pthread_once(), so
+// callers see both the lane count and function.
+static void
+choose_lanes()
+{
+	compress_lanes_fn fn = NULL;
+	int lanes = 1;
+
+#if defined(__GNUC__)
+	fn = compress_x4;
+	lanes = 4;
+
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_cpu_init();
+
+	if (__builtin_cpu_supports("avx2")) {
+		fn = compress_x8;
+		lanes = 8;
+	}
+#endif
+#endif
+
+	g_compress_lanes = fn;
+	g_lanes = lanes;
+}
+
+
+//==========================================================
+// Public API
+//
+
+int
+cf_ripemd160_lanes(void)
+{
+	pthread_once(&g_lanes_once, choose_lanes);
+
+	return g_lanes;
+}
+
+void
+cf_ripemd160(const cf_ripemd160_part* parts, int n_parts, uint8_t* digest)
+{
+	uint32_t h[5] = { H_INIT[0], H_INIT[1], H_INIT[2], H_INIT[3], H_INIT[4] };
+	uint8_t block[CF_RIPEMD160_BLOCK_SZ];
+	size_t len = parts_len(parts, n_parts);
+
+	// Fast path for short messages, e.g. most keys.
+	if (len <= CF_RIPEMD160_SINGLE_BLOCK_MAX) {
+		single_block(block, parts, n_parts, len);
+		compress(h, block);
+		put_digest(digest, h);
+		return;
+	}
+
+	size_t pos = 0;
+
+	for (int i = 0; i < n_parts; i++) {
+		const uint8_t* p = (const uint8_t*)parts[i].data;
+		size_t left = parts[i].len;
+
+		// Top up a partial block first.
+		if (pos != 0) {
+			size_t n = CF_RIPEMD160_BLOCK_SZ - pos;
+
+			n = n < left ? n : left;
+			memcpy(block + pos, p, n);
+			pos += n;
+			p += n;
+			left -= n;
+
+			if (pos < CF_RIPEMD160_BLOCK_SZ) {
+				continue;
+			}
+
+			compress(h, block);
+			pos = 0;
+		}
+
+		// Whole blocks straight from the part.
+		while (left >= CF_RIPEMD160_BLOCK_SZ) {
+			compress(h, p);
+			p += CF_RIPEMD160_BLOCK_SZ;
+			left -= CF_RIPEMD160_BLOCK_SZ;
+		}
+
+		memcpy(block, p, left);
+		pos = left;
+	}
+
+	// Padding, and length in the last 8 bytes - may take another block.
+	block[pos++] = 0x80;
+
+	if (pos > CF_RIPEMD160_BLOCK_SZ - 8) {
+		memset(block + pos, 0, CF_RIPEMD160_BLOCK_SZ - pos);
+		compress(h, block);
+		pos = 0;
+	}
+
+	memset(block + pos, 0, CF_RIPEMD160_BLOCK_SZ - 8 - pos);
+
+	uint64_t bits = (uint64_t)len << 3;
+
+	put_le32(block + CF_RIPEMD160_BLOCK_SZ - 8, (uint32_t)bits);
+	put_le32(block + CF_RIPEMD160_BLOCK_SZ - 4, (uint32_t)(bits >> 32));
+	compress(h, block);
+
+	put_digest(digest, h);
+}
+
+void
+cf_ripemd160_many(const cf_ripemd160_part* parts, int n_parts, int n_msgs,
+		uint8_t* digests)
+{
+	int lanes = cf_ripemd160_lanes();
+
+	if (lanes == 1) {
+		for (int m = 0; m < n_msgs; m++) {
+			cf_ripemd160(parts + (m * n_parts), n_parts,
+					digests + (m * CF_RIPEMD160_DIGEST_SZ));
+		}
+
+		return;
+	}
+
+	// Gather short messages into blocks, and hash a full set of lanes at a
+	// time. Longer messages go the scalar way.
+	uint8_t blocks[MAX_LANES * CF_RIPEMD160_BLOCK_SZ];
+	uint8_t* lane_digests[MAX_LANES];
+	int n = 0;
+
+	for (int m = 0; m < n_msgs; m++) {
+		const cf_ripemd160_part* msg_parts = parts + (m * n_parts);
+		uint8_t* digest = digests + (m * CF_RIPEMD160_DIGEST_SZ);
+		size_t len = parts_len(msg_parts, n_parts);
+
+		if (len > CF_RIPEMD160_SINGLE_BLOCK_MAX) {
+			cf_ripemd160(msg_parts, n_parts, digest);
+			continue;
+		}
+
+		single_block(blocks + (n * CF_RIPEMD160_BLOCK_SZ), msg_parts, n_parts,
+				len);
+		lane_digests[n++] = digest;
+
+		if (n == lanes) {
+			g_compress_lanes(blocks, lane_digests, n);
+			n = 0;
+		}
+	}
+
+	if (n == 1) {
+		uint32_t h[5] = { H_INIT[0], H_INIT[1], H_INIT[2], H_INIT[3], H_INIT[4] };
+
+		compress(h, blocks);
+		put_digest(lane_digests[0], h);
+	}
+	else if (n != 0) {
+		// Unused lanes hash zeros - results ignored.
+		memset(blocks + (n * CF_RIPEMD160_BLOCK_SZ), 0,
+				(lanes - n) * CF_RIPEMD160_BLOCK_SZ);
+		g_compress_lanes(blocks, lane_digests, n);
+	}
+}
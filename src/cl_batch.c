@@ -38,6 +38,10 @@
 
 #define MAX_NODES 128
 
+// Size of each node request's read-ahead buffer. Proto bodies with at least
+// this much left to read are read directly into the body buffer.
+#define BATCH_READ_AHEAD (16 * 1024)
+
 
 //==========================================================
 // Forward Declarations
@@ -46,8 +50,8 @@
 typedef struct cl_batch_job_s cl_batch_job;
 typedef struct cl_batch_node_req_s cl_batch_node_req;
 
-static int get_many(ev2citrusleaf_cluster* cl, const char* ns,
-		const cf_digest* digests, int n_digests, const char** bins, int n_bins,
+static int get_many(ev2citrusleaf_cluster* cl,
+		const ev2citrusleaf_namespace_handle* nsh, const cf_digest* digests, int n_digests, const char** bins, int n_bins,
 		bool get_bin_data, int timeout_ms, ev2citrusleaf_get_many_cb cb,
 		void* udata, struct event_base* base);
 
@@ -67,11 +71,12 @@ static void cl_batch_job_destroy(cl_batch_job* _this);
 static inline struct event_base* cl_batch_job_get_base(cl_batch_job* _this);
 static bool cl_batch_job_add_node_unique(cl_batch_job* _this,
 		cl_cluster_node* p_node);
-static bool cl_batch_job_compile(cl_batch_job* _this, const char* ns,
-		const cf_digest* digests, const char** bins, int n_bins,
+static bool cl_batch_job_compile(cl_batch_job* _this,
+		const ev2citrusleaf_namespace_handle* nsh, const cf_digest* digests, const char** bins, int n_bins,
 		bool get_bin_data, cl_cluster_node** nodes);
 static bool cl_batch_job_start(cl_batch_job* _this);
-static inline void cl_batch_job_cross_thread_check(cl_batch_job* _this);
+static void cl_batch_job_abort(cl_batch_job* _this);
+static inline uint32_t cl_batch_job_cross_thread_check(cl_batch_job* _this);
 static inline ev2citrusleaf_rec* cl_batch_job_get_rec(cl_batch_job* _this);
 static inline void cl_batch_job_rec_done(cl_batch_job* _this);
 static void cl_batch_job_node_done(cl_batch_job* _this,
@@ -85,9 +90,8 @@ static void cl_batch_job_timeout_event(evutil_socket_t fd, short event,
 //
 
 struct cl_batch_job_s {
-	// Fields used only in cross-threaded transaction model.
-	void*						cross_thread_lock;
-	bool						cross_thread_locked;
+	// Field used only in cross-threaded transaction model.
+	cf_atomic32					start_state;
 
 	// All events use this base.
 	struct event_base*			p_event_base;
@@ -148,6 +152,7 @@ static void cl_batch_node_req_event(evutil_socket_t fd, short event,
 		void* pv_this);
 static bool cl_batch_node_req_handle_send(cl_batch_node_req* _this);
 static bool cl_batch_node_req_handle_recv(cl_batch_node_req* _this);
+static bool cl_batch_node_req_handle_proto_body(cl_batch_node_req* _this);
 static int cl_batch_node_req_parse_proto_body(cl_batch_node_req* _this,
 		bool* p_is_last);
 static void cl_batch_node_req_done(cl_batch_node_req* _this, int node_result);
@@ -186,6 +191,11 @@ struct cl_batch_node_req_s {
 	size_t						rbuf_size;
 	size_t						rbuf_pos;
 
+	// Bytes read from socket but not yet copied to hbuf or rbuf.
+	size_t						ra_pos;
+	size_t						ra_len;
+	uint8_t						ra_buf[BATCH_READ_AHEAD];
+
 	// Save read buffer for blob objects to point into.
 	uint8_t*					pbuf;
 
@@ -205,8 +215,76 @@ ev2citrusleaf_get_many_digest(ev2citrusleaf_cluster* cl, const char* ns,
 		int timeout_ms, ev2citrusleaf_get_many_cb cb, void* udata,
 		struct event_base* base)
 {
-	return get_many(cl, ns, digests, n_digests, bins, n_bins, true, timeout_ms,
+	ev2citrusleaf_namespace_handle nsh;
+
+	if (! (ns && cl_namespace_init(&nsh, cl, ns))) {
+		cf_error("invalid parameter");
+		return EV2CITRUSLEAF_FAIL_CLIENT_ERROR;
+	}
+
+	return get_many(cl, &nsh, digests, n_digests, bins, n_bins, true,
+			timeout_ms, cb, udata, base);
+}
+
+int
+ev2citrusleaf_get_many_digest_h(ev2citrusleaf_cluster* cl,
+		const ev2citrusleaf_namespace_handle* nsh, const cf_digest* digests,
+		int n_digests, const char** bins, int n_bins, int timeout_ms,
+		ev2citrusleaf_get_many_cb cb, void* udata, struct event_base* base)
+{
+	return get_many(cl, nsh, digests, n_digests, bins, n_bins, true,
+			timeout_ms, cb, udata, base);
+}
+
+int
+ev2citrusleaf_get_many(ev2citrusleaf_cluster* cl, const char* ns,
+		const char* set, const ev2citrusleaf_object* keys, int n_keys,
+		const char** bins, int n_bins, int timeout_ms,
+		ev2citrusleaf_get_many_cb cb, void* udata, struct event_base* base)
+{
+	ev2citrusleaf_namespace_handle nsh;
+
+	if (! (ns && cl_namespace_init(&nsh, cl, ns))) {
+		cf_error("invalid parameter");
+		return EV2CITRUSLEAF_FAIL_CLIENT_ERROR;
+	}
+
+	return ev2citrusleaf_get_many_h(cl, &nsh, set, keys, n_keys, bins, n_bins,
+			timeout_ms, cb, udata, base);
+}
+
+int
+ev2citrusleaf_get_many_h(ev2citrusleaf_cluster* cl,
+		const ev2citrusleaf_namespace_handle* nsh, const char* set,
+		const ev2citrusleaf_object* keys, int n_keys, const char** bins,
+		int n_bins, int timeout_ms, ev2citrusleaf_get_many_cb cb, void* udata,
+		struct event_base* base)
+{
+	if (! (keys && n_keys > 0)) {
+		cf_error("invalid parameter");
+		return EV2CITRUSLEAF_FAIL_CLIENT_ERROR;
+	}
+
+	// There may be a very large number of keys, so don't use the stack.
+	cf_digest* digests = (cf_digest*)malloc(n_keys * sizeof(cf_digest));
+
+	if (! digests) {
+		cf_error("digest array allocation failed");
+		return EV2CITRUSLEAF_FAIL_CLIENT_ERROR;
+	}
+
+	if (ev2citrusleaf_calculate_digests(set, keys, n_keys, digests) != 0) {
+		free(digests);
+		return EV2CITRUSLEAF_FAIL_CLIENT_ERROR;
+	}
+
+	// Digests are copied into the node requests, so we're done with them.
+	int rv = get_many(cl, nsh, digests, n_keys, bins, n_bins, true, timeout_ms,
 			cb, udata, base);
+
+	free(digests);
+
+	return rv;
 }
 
 int
@@ -214,8 +292,25 @@ ev2citrusleaf_exists_many_digest(ev2citrusleaf_cluster* cl, const char* ns,
 		const cf_digest* digests, int n_digests, int timeout_ms,
 		ev2citrusleaf_get_many_cb cb, void* udata, struct event_base* base)
 {
-	return get_many(cl, ns, digests, n_digests, NULL, 0, false, timeout_ms, cb,
-			udata, base);
+	ev2citrusleaf_namespace_handle nsh;
+
+	if (! (ns && cl_namespace_init(&nsh, cl, ns))) {
+		cf_error("invalid parameter");
+		return EV2CITRUSLEAF_FAIL_CLIENT_ERROR;
+	}
+
+	return get_many(cl, &nsh, digests, n_digests, NULL, 0, false, timeout_ms,
+			cb, udata, base);
+}
+
+int
+ev2citrusleaf_exists_many_digest_h(ev2citrusleaf_cluster* cl,
+		const ev2citrusleaf_namespace_handle* nsh, const cf_digest* digests,
+		int n_digests, int timeout_ms, ev2citrusleaf_get_many_cb cb,
+		void* udata, struct event_base* base)
+{
+	return get_many(cl, nsh, digests, n_digests, NULL, 0, false, timeout_ms,
+			cb, udata, base);
 }
 
 
@@ -230,17 +325,21 @@ ev2citrusleaf_exists_many_digest(ev2citrusleaf_cluster* cl, const char* ns,
 // these nodes and starts their transactions.
 //
 static int
-get_many(ev2citrusleaf_cluster* cl, const char* ns, const cf_digest* digests,
-		int n_digests, const char** bins, int n_bins, bool get_bin_data,
-		int timeout_ms, ev2citrusleaf_get_many_cb cb, void* udata,
-		struct event_base* base)
+get_many(ev2citrusleaf_cluster* cl, const ev2citrusleaf_namespace_handle* nsh,
+		const cf_digest* digests, int n_digests, const char** bins, int n_bins,
+		bool get_bin_data, int timeout_ms, ev2citrusleaf_get_many_cb cb,
+		void* udata, struct event_base* base)
 {
 	// Quick sanity check for parameters.
-	if (! (cl && ns && *ns && digests && n_digests > 0 && cb && base)) {
+	if (! (cl && nsh && nsh->asc == cl && nsh->ns_len != 0 && digests &&
+			n_digests > 0 && cb && base)) {
 		cf_error("invalid parameter");
 		return EV2CITRUSLEAF_FAIL_CLIENT_ERROR;
 	}
 
+	// Look up the namespace once for the whole batch.
+	cl_partition_table* pt = cl_namespace_get_table(nsh);
+
 	// Allocate an array of node pointers, one per digest. There may be a very
 	// large number of digests, so don't use the stack.
 	cl_cluster_node** nodes = (cl_cluster_node**)
@@ -265,28 +364,28 @@ get_many(ev2citrusleaf_cluster* cl, const char* ns, const cf_digest* digests,
 	for (int i = 0; i < n_digests; i++) {
 		// This increments the node's ref-count, so overall a given node's
 		// ref-count increases by the number of (these) digests on that node.
-		nodes[i] = cl_cluster_node_get(cl, ns, &digests[i], true);
+		nodes[i] = cl_cluster_node_get(cl, pt, &digests[i], true);
 
 		if (! nodes[i]) {
 			cf_error("can't get node for digest index %d", i);
-			cl_batch_job_destroy(p_job);
+			cl_batch_job_abort(p_job);
 			free(nodes);
 			return EV2CITRUSLEAF_FAIL_CLIENT_ERROR;
 		}
 
 		if (! cl_batch_job_add_node_unique(p_job, nodes[i])) {
 			cf_error("can't create batch request for node %s", nodes[i]->name);
-			cl_batch_job_destroy(p_job);
+			cl_batch_job_abort(p_job);
 			free(nodes);
 			return EV2CITRUSLEAF_FAIL_CLIENT_ERROR;
 		}
 	}
 
 	// Compile the requests.
-	if (! cl_batch_job_compile(p_job, ns, digests, bins, n_bins, get_bin_data,
+	if (! cl_batch_job_compile(p_job, nsh, digests, bins, n_bins, get_bin_data,
 			nodes)) {
 		cf_error("failed batch job compile");
-		cl_batch_job_destroy(p_job);
+		cl_batch_job_abort(p_job);
 		free(nodes);
 		return EV2CITRUSLEAF_FAIL_CLIENT_ERROR;
 	}
@@ -294,7 +393,7 @@ get_many(ev2citrusleaf_cluster* cl, const char* ns, const cf_digest* digests,
 	// Start all the requests.
 	if (! cl_batch_job_start(p_job)) {
 		cf_error("failed batch job start");
-		cl_batch_job_destroy(p_job);
+		cl_batch_job_abort(p_job);
 		free(nodes);
 		return EV2CITRUSLEAF_FAIL_CLIENT_ERROR;
 	}
@@ -329,9 +428,7 @@ cl_batch_job_create(bool cross_threaded, struct event_base* base,
 	memset((void*)_this, 0, size);
 
 	if (cross_threaded) {
-		MUTEX_ALLOC(_this->cross_thread_lock);
-		MUTEX_LOCK(_this->cross_thread_lock);
-		_this->cross_thread_locked = true;
+		cl_start_begin(&_this->start_state);
 	}
 
 	// Add the timeout event right away.
@@ -339,12 +436,8 @@ cl_batch_job_create(bool cross_threaded, struct event_base* base,
 	evtimer_assign((struct event*)_this->timer_event_space, base,
 			cl_batch_job_timeout_event, _this);
 
-	struct timeval tv;
-
-	tv.tv_sec = timeout_ms / 1000;
-	tv.tv_usec = (timeout_ms % 1000) * 1000;
-
-	if (0 != evtimer_add((struct event*)_this->timer_event_space, &tv)) {
+	if (0 != cl_timer_add((struct event*)_this->timer_event_space,
+			timeout_ms)) {
 		cf_error("batch job add timer event failed");
 		cl_batch_job_destroy(_this);
 		return NULL;
@@ -363,7 +456,7 @@ cl_batch_job_create(bool cross_threaded, struct event_base* base,
 
 	if (! _this->recs) {
 		cf_error("batch request recs allocation failed");
-		cl_batch_job_destroy(_this);
+		cl_batch_job_abort(_this);
 		return NULL;
 	}
 
@@ -399,14 +492,6 @@ cl_batch_job_destroy(cl_batch_job* _this)
 		evtimer_del((struct event*)_this->timer_event_space);
 	}
 
-	if (_this->cross_thread_lock) {
-		if (_this->cross_thread_locked) {
-			MUTEX_UNLOCK(_this->cross_thread_lock);
-		}
-
-		MUTEX_FREE(_this->cross_thread_lock);
-	}
-
 	free(_this);
 }
 
@@ -457,12 +542,11 @@ cl_batch_job_add_node_unique(cl_batch_job* _this, cl_cluster_node* p_node)
 // Call all the node request's compile methods.
 //
 static bool
-cl_batch_job_compile(cl_batch_job* _this, const char* ns,
-		const cf_digest* digests, const char** bins, int n_bins,
-		bool get_bin_data, cl_cluster_node** nodes)
+cl_batch_job_compile(cl_batch_job* _this,
+		const ev2citrusleaf_namespace_handle* nsh, const cf_digest* digests,
+		const char** bins, int n_bins, bool get_bin_data,
+		cl_cluster_node** nodes)
 {
-	size_t ns_len = strlen(ns);
-
 	// AKG - This isn't optimal for big clusters and very large batches: for n
 	// nodes and d digests, we do n*d operations. We could gain a factor of 2 by
 	// inverting, so that we do 1 loop over digests, and for each digest an
@@ -470,7 +554,8 @@ cl_batch_job_compile(cl_batch_job* _this, const char* ns,
 	// I'd rather keep the compile methods looking like those in the C client.
 
 	for (int n = 0; n < _this->n_node_reqs; n++) {
-		if (! cl_batch_node_req_compile(_this->node_reqs[n], ns, ns_len,
+		if (! cl_batch_node_req_compile(_this->node_reqs[n], nsh->ns,
+				(size_t)nsh->ns_len,
 				digests, _this->n_digests, bins, n_bins, get_bin_data, nodes)) {
 			cf_error("can't compile batch node request %d", n);
 			return false;
@@ -501,28 +586,41 @@ cl_batch_job_start(cl_batch_job* _this)
 		cl_batch_node_req_start(_this->node_reqs[n]);
 	}
 
-	// Cross-threaded batch transactions must block the event callback thread
-	// until the original non-blocking call is complete, which is now.
-	if (_this->cross_thread_lock) {
-		_this->cross_thread_locked = false;
-		MUTEX_UNLOCK(_this->cross_thread_lock);
+	// Cross-threaded batch transactions make events in the callback thread
+	// wait until the original non-blocking call is complete, which is now.
+	if (_this->start_state != CL_START_DONE) {
+		cl_start_end(&_this->start_state, true);
 		// Events are now free to proceed (and may even destroy this object).
 	}
 
 	return true;
 }
 
+//------------------------------------------------
+// Clean up when the non-blocking call fails after
+// the timeout event is added. Cross-threaded, the
+// timer may have fired and be waiting for us, so
+// leave it to the timeout event to destroy this.
+//
+static void
+cl_batch_job_abort(cl_batch_job* _this)
+{
+	if (_this->start_state != CL_START_DONE) {
+		cl_start_end(&_this->start_state, false);
+		return;
+	}
+
+	cl_batch_job_destroy(_this);
+}
+
 //------------------------------------------------
 // Cross-threaded transaction events must be sure
 // original non-blocking call is complete.
 //
-static inline void
+static inline uint32_t
 cl_batch_job_cross_thread_check(cl_batch_job* _this)
 {
-	if (_this->cross_thread_lock) {
-		MUTEX_LOCK(_this->cross_thread_lock);
-		MUTEX_UNLOCK(_this->cross_thread_lock);
-	}
+	return cl_start_wait(&_this->start_state);
 }
 
 //------------------------------------------------
@@ -587,10 +685,16 @@ cl_batch_job_timeout_event(evutil_socket_t fd, short event, void* pv_this)
 {
 	cl_batch_job* _this = (cl_batch_job*)pv_this;
 
-	cl_batch_job_cross_thread_check(_this);
+	uint32_t start_state = cl_batch_job_cross_thread_check(_this);
 
 	_this->timer_event_added = false;
 
+	if (start_state == CL_START_FAILED) {
+		// The non-blocking call failed, and left us to clean up.
+		cl_batch_job_destroy(_this);
+		return;
+	}
+
 	// Make the user callback. This reports partial results from any node
 	// requests that finished.
 	(*_this->user_cb)(EV2CITRUSLEAF_FAIL_TIMEOUT, _this->recs, _this->n_recs,
@@ -803,7 +907,7 @@ static bool
 cl_batch_node_req_get_fd(cl_batch_node_req* _this)
 {
 	while (_this->fd == -1) {
-		_this->fd = cl_cluster_node_fd_get(_this->p_node);
+		_this->fd = cl_cluster_node_fd_get(_this->p_node, false, NULL);
 		// Note - apparently 0 is a legitimate fd value.
 
 		if (_this->fd < -1) {
@@ -935,20 +1039,55 @@ cl_batch_node_req_handle_send(cl_batch_node_req* _this)
 static bool
 cl_batch_node_req_handle_recv(cl_batch_node_req* _this)
 {
+	bool drained = false;
+
 	while (true) {
 		// Loop until everything is read from socket or we get would-block.
 
-		if (_this->hbuf_pos < sizeof(cl_proto)) {
-			// Read proto header.
+		if (_this->ra_pos == _this->ra_len) {
+			// Nothing left in read-ahead buffer.
+
+			if (drained) {
+				// Last read didn't fill the buffer - wait for the next event.
+				break;
+			}
+
+			int rv;
+			size_t want;
 
-			int rv = recv(_this->fd,
-					(cf_socket_data_t*)&_this->hbuf[_this->hbuf_pos],
-					(cf_socket_size_t)(sizeof(cl_proto) - _this->hbuf_pos),
-					MSG_DONTWAIT | MSG_NOSIGNAL);
+			if (_this->rbuf &&
+					_this->rbuf_size - _this->rbuf_pos >= BATCH_READ_AHEAD) {
+				// Big body - read it directly, skipping the read-ahead buffer.
+				want = _this->rbuf_size - _this->rbuf_pos;
+
+				rv = recv(_this->fd,
+						(cf_socket_data_t*)&_this->rbuf[_this->rbuf_pos],
+						(cf_socket_size_t)want,
+						MSG_DONTWAIT | MSG_NOSIGNAL);
+
+				if (rv > 0) {
+					_this->rbuf_pos += rv;
+				}
+			}
+			else {
+				// Read proto header, or rest of body, and whatever follows.
+				want = sizeof(_this->ra_buf);
+
+				rv = recv(_this->fd,
+						(cf_socket_data_t*)_this->ra_buf,
+						(cf_socket_size_t)want,
+						MSG_DONTWAIT | MSG_NOSIGNAL);
+
+				if (rv > 0) {
+					_this->ra_pos = 0;
+					_this->ra_len = (size_t)rv;
+				}
+			}
+
+			cf_atomic_int_incr(&_this->p_node->asc->n_recv_calls);
 
 			if (rv > 0) {
-				_this->hbuf_pos += rv;
-				// Loop, read more header or start reading body.
+				drained = (size_t)rv < want;
 			}
 			else if (rv == 0) {
 				// Connection has been closed by the server.
@@ -966,88 +1105,91 @@ cl_batch_node_req_handle_recv(cl_batch_node_req* _this)
 				break;
 			}
 		}
-		else {
-			// Done with header, read corresponding body.
 
-			// Allocate the read buffer if we haven't yet.
-			if (! _this->rbuf) {
-				cl_proto* proto = (cl_proto*)_this->hbuf;
+		const uint8_t* p_read = _this->ra_buf + _this->ra_pos;
+		size_t avail = _this->ra_len - _this->ra_pos;
+		size_t n;
 
-				cl_proto_swap(proto);
+		if (_this->hbuf_pos < sizeof(cl_proto)) {
+			// Copy proto header.
+			n = sizeof(cl_proto) - _this->hbuf_pos;
+			n = n < avail ? n : avail;
 
-				_this->rbuf_size = proto->sz;
-				_this->rbuf = (uint8_t*)malloc(_this->rbuf_size);
+			memcpy(&_this->hbuf[_this->hbuf_pos], p_read, n);
+			_this->hbuf_pos += n;
+			_this->ra_pos += n;
 
-				if (! _this->rbuf) {
-					cf_error("batch node request rbuf allocation failed");
-					cl_batch_node_req_done(_this,
-							EV2CITRUSLEAF_FAIL_CLIENT_ERROR);
-					return true;
-				}
+			if (_this->hbuf_pos < sizeof(cl_proto)) {
+				// Loop, read more header.
+				continue;
 			}
 
-			if (_this->rbuf_pos >= _this->rbuf_size) {
-				cf_error("unexpected read event");
-				cl_batch_node_req_done(_this, EV2CITRUSLEAF_FAIL_CLIENT_ERROR);
-				return true;
-			}
+			// Done with header, allocate read buffer for corresponding body.
 
-			int rv = recv(_this->fd,
-					(cf_socket_data_t*)&_this->rbuf[_this->rbuf_pos],
-					(cf_socket_size_t)(_this->rbuf_size - _this->rbuf_pos),
-					MSG_DONTWAIT | MSG_NOSIGNAL);
+			cl_proto* proto = (cl_proto*)_this->hbuf;
 
-			if (rv > 0) {
-				_this->rbuf_pos += rv;
-
-				if (_this->rbuf_pos == _this->rbuf_size) {
-					// Done with proto body.
-
-					bool is_last;
-					int result = cl_batch_node_req_parse_proto_body(_this,
-							&is_last);
-
-					if (is_last || result != EV2CITRUSLEAF_OK) {
-						// Done with last proto (or parse error).
-						cl_batch_node_req_done(_this, result);
-						return true;
-					}
-					else {
-						// We expect another proto - reset read buffers but save
-						// proto body buffer, since blob records point directly
-						// into it. It is freed after the app callback is made.
-						_this->hbuf_pos = 0;
-						_this->pbuf = _this->rbuf;
-						_this->rbuf = NULL;
-						_this->rbuf_size = 0;
-						_this->rbuf_pos = 0;
-					}
-				}
+			cl_proto_swap(proto);
 
-				// Loop, read more body or next header.
-			}
-			else if (rv == 0) {
-				// Connection has been closed by the server.
-				cf_debug("recv connection closed: fd %d", _this->fd);
-				cl_batch_node_req_done(_this, EV2CITRUSLEAF_FAIL_UNKNOWN);
-				return true;
-			}
-			else if (errno != EAGAIN && errno != EWOULDBLOCK) {
-				cf_debug("recv failed: rv %d errno %d", rv, errno);
-				cl_batch_node_req_done(_this, EV2CITRUSLEAF_FAIL_UNKNOWN);
+			_this->rbuf_size = proto->sz;
+			_this->rbuf = (uint8_t*)malloc(_this->rbuf_size);
+
+			if (! _this->rbuf) {
+				cf_error("batch node request rbuf allocation failed");
+				cl_batch_node_req_done(_this, EV2CITRUSLEAF_FAIL_CLIENT_ERROR);
 				return true;
 			}
-			else {
-				// Got would-block.
-				break;
-			}
 		}
+		else if (avail != 0) {
+			// Copy body.
+			n = _this->rbuf_size - _this->rbuf_pos;
+			n = n < avail ? n : avail;
+
+			memcpy(&_this->rbuf[_this->rbuf_pos], p_read, n);
+			_this->rbuf_pos += n;
+			_this->ra_pos += n;
+		}
+
+		if (_this->rbuf_pos == _this->rbuf_size &&
+				cl_batch_node_req_handle_proto_body(_this)) {
+			return true;
+		}
+
+		// Loop, read more body or next header.
 	}
 
 	// Will re-add event.
 	return false;
 }
 
+//------------------------------------------------
+// A whole proto body has been read - parse it.
+// Returns true if the transaction is done, in
+// which case the node request is destroyed.
+//
+static bool
+cl_batch_node_req_handle_proto_body(cl_batch_node_req* _this)
+{
+	bool is_last;
+	int result = cl_batch_node_req_parse_proto_body(_this, &is_last);
+
+	if (is_last || result != EV2CITRUSLEAF_OK) {
+		// Done with last proto (or parse error).
+		cl_batch_node_req_done(_this, result);
+		return true;
+	}
+
+	// We expect another proto - reset read buffers but save proto body
+	// buffer, since blob records point directly into it. It is freed after
+	// the app callback is made.
+	_this->hbuf_pos = 0;
+	_this->pbuf = _this->rbuf;
+	_this->rbuf = NULL;
+	_this->rbuf_size = 0;
+	_this->rbuf_pos = 0;
+
+	return false;
+}
+
 //------------------------------------------------
 // Parse messages in proto body. Report record
 // results to parent batch job.
@@ -1173,7 +1315,7 @@ cl_batch_node_req_parse_proto_body(cl_batch_node_req* _this, bool* p_is_last)
 				return EV2CITRUSLEAF_FAIL_UNKNOWN;
 			}
 
-			cl_set_value_particular(op, &p_rec->bins[i]);
+			cl_set_value_particular(op, &p_rec->bins[i], false);
 			op = next_op;
 		}
 
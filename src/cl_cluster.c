@@ -14,11 +14,15 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#ifndef CF_WINDOWS
+#include <sys/resource.h>
+#endif
 #include <event2/dns.h>
 #include <event2/event.h>
 
 #include "citrusleaf/cf_alloc.h"
 #include "citrusleaf/cf_atomic.h"
+#include "citrusleaf/cf_base64.h"
 #include "citrusleaf/cf_base_types.h"
 #include "citrusleaf/cf_byte_order.h"
 #include "citrusleaf/cf_clock.h"
@@ -49,6 +53,7 @@ extern void ev2citrusleaf_base_hop(cl_request *req);
 //
 struct timeval g_cluster_tend_timeout = {1,200000};
 struct timeval g_node_tend_timeout = {1,1};
+struct timeval g_node_warm_timeout = {1,0};
 
 
 // Forward references
@@ -58,28 +63,6 @@ void cluster_new_sockaddr(ev2citrusleaf_cluster *asc, struct sockaddr_in *new_si
 int ev2citrusleaf_cluster_add_host_internal(ev2citrusleaf_cluster *asc, char *host_in, short port_in);
 
 
-//
-// Utility for splitting a null-terminated string into a vector of sub-strings.
-// The vector will have pointers to all the (null-terminated) sub-strings.
-// This modifies the input string by inserting nulls.
-//
-static void
-str_split(char split_c, char *str, cf_vector *v)
-{
-	char *prev = str;
-	while (*str) {
-		if (split_c == *str) {
-			*str = 0;
-			cf_vector_append(v, &prev);
-			prev = str+1;
-		}
-		str++;
-	}
-	if (prev != str) {
-		cf_vector_append(v, &prev);
-	}
-}
-
 ev2citrusleaf_cluster *
 cluster_create()
 {
@@ -89,6 +72,7 @@ cluster_create()
 	MUTEX_ALLOC(asc->runtime_options.lock);
 	MUTEX_ALLOC(asc->node_v_lock);
 	MUTEX_ALLOC(asc->request_q_lock);
+	MUTEX_ALLOC(asc->ns_handles_lock);
 	return(asc);
 }
 
@@ -102,6 +86,7 @@ cluster_destroy(ev2citrusleaf_cluster *asc) {
 		event_base_free(asc->base);
 	}
 
+	MUTEX_FREE(asc->ns_handles_lock);
 	MUTEX_FREE(asc->request_q_lock);
 	MUTEX_FREE(asc->node_v_lock);
 	MUTEX_FREE(asc->runtime_options.lock);
@@ -120,13 +105,25 @@ cluster_get_timer_event(ev2citrusleaf_cluster *asc)
 cl_cluster_node*
 cluster_node_create()
 {
-	size_t size = sizeof(cl_cluster_node) + (2 * event_get_struct_event_size());
+	size_t size = sizeof(cl_cluster_node) +
+			((2 + NODE_WARM_MAX_CONNECTS) * event_get_struct_event_size());
 	cl_cluster_node* cn = (cl_cluster_node*)cf_client_rc_alloc(size);
 
-	if (cn) {
-		memset((void*)cn, 0, size);
+	if (! cn) {
+		return NULL;
+	}
+
+	memset((void*)cn, 0, size);
+
+	// The node itself isn't cache line aligned - stripes mustn't share lines.
+	if (posix_memalign((void**)&cn->fd_cache, 64,
+			FD_CACHE_STRIPES * sizeof(cl_fd_stripe)) != 0) {
+		cf_client_rc_free(cn);
+		return NULL;
 	}
 
+	memset((void*)cn->fd_cache, 0, FD_CACHE_STRIPES * sizeof(cl_fd_stripe));
+
 	return cn;
 }
 
@@ -142,6 +139,13 @@ cluster_node_get_info_event(cl_cluster_node* cn)
 	return (struct event*)(cn->event_space + event_get_struct_event_size());
 }
 
+static inline struct event*
+cluster_node_get_warm_event(cl_cluster_node* cn, uint32_t i)
+{
+	return (struct event*)(cn->event_space +
+			((2 + i) * event_get_struct_event_size()));
+}
+
 
 // List of all current clusters so the tender can maintain them
 cf_ll		cluster_ll;
@@ -160,6 +164,9 @@ cluster_timer_fn(evutil_socket_t fd, short event, void *udata)
 
 	cluster_tend(asc);
 
+	// Free partition map snapshots that readers have since moved on from.
+	cl_partition_table_reclaim(asc);
+
 	if (++asc->tender_intervals % CL_LOG_STATS_INTERVAL == 0) {
 		cl_partition_table_dump(asc);
 		cluster_print_stats(asc);
@@ -190,12 +197,27 @@ static void* run_cluster_mgr(void* base) {
 const ev2citrusleaf_cluster_runtime_options DEFAULT_RUNTIME_OPTIONS =
 {
 	300,	// socket_pool_max
+	0,		// min_idle_sockets
+	0,		// socket_idle_timeout_seconds
+	0,		// socket_max_age_seconds
 	false,	// read_master_only
+	CL_READ_REPLICA_RANDOM,	// read_replica_policy
 	false,	// throttle_reads
 	false,	// throttle_writes
 	2,		// throttle_threshold_failure_pct
 	15,		// throttle_window_seconds
-	10		// throttle_factor
+	10,		// throttle_factor
+	0,		// node_concurrency_max
+	0,		// node_latency_target_ms
+	false,	// circuit_breaker
+	false,	// hedge_reads
+	0,		// hedge_delay_ms
+	5,		// hedge_budget_pct
+	0,		// zero_copy_threshold
+	false,	// pipelining
+	16,		// pipeline_max_conns
+	64,		// pipeline_max_depth
+	false	// borrowed_results
 };
 
 int
@@ -208,8 +230,12 @@ ev2citrusleaf_cluster_get_runtime_options(ev2citrusleaf_cluster* asc,
 	}
 
 	opts->socket_pool_max = cf_atomic32_get(asc->runtime_options.socket_pool_max);
+	opts->min_idle_sockets = cf_atomic32_get(asc->runtime_options.min_idle_sockets);
+	opts->socket_idle_timeout_seconds = cf_atomic32_get(asc->runtime_options.socket_idle_timeout_seconds);
+	opts->socket_max_age_seconds = cf_atomic32_get(asc->runtime_options.socket_max_age_seconds);
 
 	opts->read_master_only = cf_atomic32_get(asc->runtime_options.read_master_only) != 0;
+	opts->read_replica_policy = (ev2citrusleaf_read_replica_policy)cf_atomic32_get(asc->runtime_options.read_replica_policy);
 
 	opts->throttle_reads = cf_atomic32_get(asc->runtime_options.throttle_reads) != 0;
 	opts->throttle_writes = cf_atomic32_get(asc->runtime_options.throttle_writes) != 0;
@@ -218,6 +244,22 @@ ev2citrusleaf_cluster_get_runtime_options(ev2citrusleaf_cluster* asc,
 	opts->throttle_window_seconds = asc->runtime_options.throttle_window_seconds;
 	opts->throttle_factor = asc->runtime_options.throttle_factor;
 
+	opts->node_concurrency_max = cf_atomic32_get(asc->runtime_options.node_concurrency_max);
+	opts->node_latency_target_ms = cf_atomic32_get(asc->runtime_options.node_latency_target_ms);
+
+	opts->circuit_breaker = cf_atomic32_get(asc->runtime_options.circuit_breaker) != 0;
+
+	opts->hedge_reads = cf_atomic32_get(asc->runtime_options.hedge_reads) != 0;
+	opts->hedge_delay_ms = cf_atomic32_get(asc->runtime_options.hedge_delay_ms);
+	opts->hedge_budget_pct = cf_atomic32_get(asc->runtime_options.hedge_budget_pct);
+
+	opts->zero_copy_threshold = cf_atomic32_get(asc->runtime_options.zero_copy_threshold);
+
+	opts->pipelining = cf_atomic32_get(asc->runtime_options.pipelining) != 0;
+	opts->pipeline_max_conns = cf_atomic32_get(asc->runtime_options.pipeline_max_conns);
+	opts->pipeline_max_depth = cf_atomic32_get(asc->runtime_options.pipeline_max_depth);
+	opts->borrowed_results = cf_atomic32_get(asc->runtime_options.borrowed_results) != 0;
+
 	return EV2CITRUSLEAF_OK;
 }
 
@@ -233,14 +275,21 @@ ev2citrusleaf_cluster_set_runtime_options(ev2citrusleaf_cluster* asc,
 	// Really basic sanity checks.
 	if (opts->throttle_threshold_failure_pct > 100 ||
 		opts->throttle_window_seconds == 0 ||
-		opts->throttle_window_seconds > MAX_THROTTLE_WINDOW) {
+		opts->throttle_window_seconds > MAX_THROTTLE_WINDOW ||
+		opts->node_concurrency_max > CL_LIMIT_MAX ||
+		opts->hedge_budget_pct > 100 ||
+		(uint32_t)opts->read_replica_policy > CL_READ_REPLICA_LOWEST_LATENCY) {
 		cf_warn("ev2citrusleaf_cluster_set_runtime_options() - illegal option");
 		return EV2CITRUSLEAF_FAIL_CLIENT_ERROR;
 	}
 
 	cf_atomic32_set(&asc->runtime_options.socket_pool_max, opts->socket_pool_max);
+	cf_atomic32_set(&asc->runtime_options.min_idle_sockets, opts->min_idle_sockets);
+	cf_atomic32_set(&asc->runtime_options.socket_idle_timeout_seconds, opts->socket_idle_timeout_seconds);
+	cf_atomic32_set(&asc->runtime_options.socket_max_age_seconds, opts->socket_max_age_seconds);
 
 	cf_atomic32_set(&asc->runtime_options.read_master_only, opts->read_master_only ? 1 : 0);
+	cf_atomic32_set(&asc->runtime_options.read_replica_policy, (uint32_t)opts->read_replica_policy);
 
 	cf_atomic32_set(&asc->runtime_options.throttle_reads, opts->throttle_reads ? 1 : 0);
 	cf_atomic32_set(&asc->runtime_options.throttle_writes, opts->throttle_writes ? 1 : 0);
@@ -253,10 +302,31 @@ ev2citrusleaf_cluster_set_runtime_options(ev2citrusleaf_cluster* asc,
 
 	MUTEX_UNLOCK(asc->runtime_options.lock);
 
+	cf_atomic32_set(&asc->runtime_options.node_concurrency_max, opts->node_concurrency_max);
+	cf_atomic32_set(&asc->runtime_options.node_latency_target_ms, opts->node_latency_target_ms);
+
+	cf_atomic32_set(&asc->runtime_options.circuit_breaker, opts->circuit_breaker ? 1 : 0);
+
+	cf_atomic32_set(&asc->runtime_options.hedge_reads, opts->hedge_reads ? 1 : 0);
+	cf_atomic32_set(&asc->runtime_options.hedge_delay_ms, opts->hedge_delay_ms);
+	cf_atomic32_set(&asc->runtime_options.hedge_budget_pct, opts->hedge_budget_pct);
+
+	cf_atomic32_set(&asc->runtime_options.zero_copy_threshold, opts->zero_copy_threshold);
+
+	cf_atomic32_set(&asc->runtime_options.pipelining, opts->pipelining ? 1 : 0);
+	cf_atomic32_set(&asc->runtime_options.pipeline_max_conns, opts->pipeline_max_conns);
+	cf_atomic32_set(&asc->runtime_options.pipeline_max_depth, opts->pipeline_max_depth);
+	cf_atomic32_set(&asc->runtime_options.borrowed_results, opts->borrowed_results ? 1 : 0);
+
 	cf_info("set runtime options:");
-	cf_info("   socket-pool-max %u", opts->socket_pool_max);
-	cf_info("   read-master-only %s",
-			opts->read_master_only ? "true" : "false");
+	cf_info("   socket-pool-max %u, min-idle-sockets %u", opts->socket_pool_max,
+			opts->min_idle_sockets);
+	cf_info("   socket-idle-timeout-seconds %u, max-age-seconds %u",
+			opts->socket_idle_timeout_seconds,
+			opts->socket_max_age_seconds);
+	cf_info("   read-master-only %s, read-replica-policy %d",
+			opts->read_master_only ? "true" : "false",
+			(int)opts->read_replica_policy);
 	cf_info("   throttle-reads %s, writes %s",
 			opts->throttle_reads ? "true" : "false",
 			opts->throttle_writes ? "true" : "false");
@@ -264,6 +334,21 @@ ev2citrusleaf_cluster_set_runtime_options(ev2citrusleaf_cluster* asc,
 			opts->throttle_threshold_failure_pct,
 			opts->throttle_window_seconds,
 			opts->throttle_factor);
+	cf_info("   node-concurrency-max %u, node-latency-target-ms %u",
+			opts->node_concurrency_max,
+			opts->node_latency_target_ms);
+	cf_info("   circuit-breaker %s", opts->circuit_breaker ? "true" : "false");
+	cf_info("   hedge-reads %s, delay-ms %u, budget-pct %u",
+			opts->hedge_reads ? "true" : "false",
+			opts->hedge_delay_ms,
+			opts->hedge_budget_pct);
+	cf_info("   zero-copy-threshold %u", opts->zero_copy_threshold);
+	cf_info("   pipelining %s, max-conns %u, max-depth %u",
+			opts->pipelining ? "true" : "false",
+			opts->pipeline_max_conns,
+			opts->pipeline_max_depth);
+	cf_info("   borrowed-results %s",
+			opts->borrowed_results ? "true" : "false");
 
 	return EV2CITRUSLEAF_OK;
 }
@@ -352,6 +437,44 @@ ev2citrusleaf_cluster_create(struct event_base *base,
 }
 
 
+ev2citrusleaf_namespace_handle*
+ev2citrusleaf_cluster_get_namespace(ev2citrusleaf_cluster* asc, const char* ns)
+{
+	if (! asc || asc->MAGIC != CLUSTER_MAGIC) {
+		cf_warn("get namespace on non-cluster object %p", asc);
+		return NULL;
+	}
+
+	MUTEX_LOCK(asc->ns_handles_lock);
+
+	ev2citrusleaf_namespace_handle* nsh = asc->ns_handles;
+
+	while (nsh && strcmp(ns, nsh->ns) != 0) {
+		nsh = nsh->next;
+	}
+
+	if (! nsh) {
+		nsh = (ev2citrusleaf_namespace_handle*)
+				malloc(sizeof(ev2citrusleaf_namespace_handle));
+
+		if (nsh && ! cl_namespace_init(nsh, asc, ns)) {
+			free(nsh);
+			nsh = NULL;
+		}
+
+		if (nsh) {
+			nsh->interned = true;
+			nsh->next = asc->ns_handles;
+			asc->ns_handles = nsh;
+		}
+	}
+
+	MUTEX_UNLOCK(asc->ns_handles_lock);
+
+	return nsh;
+}
+
+
 int
 ev2citrusleaf_cluster_get_active_node_count(ev2citrusleaf_cluster* asc)
 {
@@ -436,6 +559,7 @@ ev2citrusleaf_cluster_refresh_partition_tables(ev2citrusleaf_cluster *asc)
 }
 
 void node_info_req_cancel(cl_cluster_node* cn);
+void node_warm_cancel(cl_cluster_node* cn);
 
 void
 ev2citrusleaf_cluster_destroy(ev2citrusleaf_cluster *asc)
@@ -463,10 +587,11 @@ ev2citrusleaf_cluster_destroy(ev2citrusleaf_cluster *asc)
 	// Clear cluster manager timer.
 	event_del(cluster_get_timer_event(asc));
 
-	// Clear all node timers and node info requests.
+	// Clear all node timers, node info requests and warming sockets.
 	for (uint32_t i = 0; i < cf_vector_size(&asc->node_v); i++) {
 		cl_cluster_node *cn = (cl_cluster_node*)cf_vector_pointer_get(&asc->node_v, i);
 		node_info_req_cancel(cn);
+		node_warm_cancel(cn);
 		event_del(cluster_node_get_timer_event(cn));
 		// ... so the event_del() in cl_cluster_node_release() will be a no-op.
 	}
@@ -505,6 +630,7 @@ ev2citrusleaf_cluster_destroy(ev2citrusleaf_cluster *asc)
 	cf_vector_destroy(&asc->node_v);
 
 	cl_partition_table_destroy_all(asc);
+	cl_namespace_destroy_all(asc);
 
 	cf_ll_delete(&cluster_ll , (cf_ll_element *)asc);
 
@@ -576,6 +702,8 @@ const char INFO_STR_CHECK[] = "node\npartition-generation\nservices\n";
 const char INFO_STR_GET_REPLICAS[] = "partition-generation\nreplicas-all\n";
 
 void node_info_req_start(cl_cluster_node* cn, node_info_req_type req_type);
+void node_warm_start(cl_cluster_node* cn);
+void node_reap_idle(cl_cluster_node* cn);
 // The libevent2 event handler for node info socket events:
 void node_info_req_event(evutil_socket_t fd, short event, void* udata);
 
@@ -640,45 +768,6 @@ node_info_req_timeout(cl_cluster_node* cn)
 	cf_atomic_int_incr(&cn->asc->n_node_info_timeouts);
 }
 
-// TODO - should probably move base 64 stuff to cf_base so C client can use it.
-const uint8_t CF_BASE64_DECODE_ARRAY[] = {
-	    /*00*/ /*01*/ /*02*/ /*03*/ /*04*/ /*05*/ /*06*/ /*07*/   /*08*/ /*09*/ /*0A*/ /*0B*/ /*0C*/ /*0D*/ /*0E*/ /*0F*/
-/*00*/	    0,     0,     0,     0,     0,     0,     0,     0,       0,     0,     0,     0,     0,     0,     0,     0,
-/*10*/      0,     0,     0,     0,     0,     0,     0,     0,       0,     0,     0,     0,     0,     0,     0,     0,
-/*20*/	    0,     0,     0,     0,     0,     0,     0,     0,       0,     0,     0,    62,     0,     0,     0,    63,
-/*30*/	   52,    53,    54,    55,    56,    57,    58,    59,      60,    61,     0,     0,     0,     0,     0,     0,
-/*40*/	    0,     0,     1,     2,     3,     4,     5,     6,       7,     8,     9,    10,    11,    12,    13,    14,
-/*50*/	   15,    16,    17,    18,    19,    20,    21,    22,      23,    24,    25,     0,     0,     0,     0,     0,
-/*60*/	    0,    26,    27,    28,    29,    30,    31,    32,      33,    34,    35,    36,    37,    38,    39,    40,
-/*70*/	   41,    42,    43,    44,    45,    46,    47,    48,      49,    50,    51,     0,     0,     0,     0,     0,
-/*80*/	    0,     0,     0,     0,     0,     0,     0,     0,       0,     0,     0,     0,     0,     0,     0,     0,
-/*90*/	    0,     0,     0,     0,     0,     0,     0,     0,       0,     0,     0,     0,     0,     0,     0,     0,
-/*A0*/	    0,     0,     0,     0,     0,     0,     0,     0,       0,     0,     0,     0,     0,     0,     0,     0,
-/*B0*/	    0,     0,     0,     0,     0,     0,     0,     0,       0,     0,     0,     0,     0,     0,     0,     0,
-/*C0*/	    0,     0,     0,     0,     0,     0,     0,     0,       0,     0,     0,     0,     0,     0,     0,     0,
-/*D0*/	    0,     0,     0,     0,     0,     0,     0,     0,       0,     0,     0,     0,     0,     0,     0,     0,
-/*E0*/	    0,     0,     0,     0,     0,     0,     0,     0,       0,     0,     0,     0,     0,     0,     0,     0,
-/*F0*/	    0,     0,     0,     0,     0,     0,     0,     0,       0,     0,     0,     0,     0,     0,     0,     0
-};
-
-#define B64DA CF_BASE64_DECODE_ARRAY
-
-void
-cf_base64_decode(const char* in, int len, uint8_t* out)
-{
-	int i = 0;
-	int j = 0;
-
-	while (i < len) {
-		out[j + 0] = (B64DA[in[i + 0]] << 2) | (B64DA[in[i + 1]] >> 4);
-		out[j + 1] = (B64DA[in[i + 1]] << 4) | (B64DA[in[i + 2]] >> 2);
-		out[j + 2] = (B64DA[in[i + 2]] << 6) |  B64DA[in[i + 3]];
-
-		i += 4;
-		j += 3;
-	}
-}
-
 char*
 stop_at(char* p, char delimiter, bool* p_done)
 {
@@ -699,13 +788,14 @@ stop_at(char* p, char delimiter, bool* p_done)
 
 // For debugging purposes only.
 void
-log_ownership(const char* node, const char* ns, const char* repl, bool* owns)
+log_ownership(const char* node, const char* ns, const char* repl,
+		const uint8_t* owns)
 {
 	char owns_str[256];
 	char* p = owns_str;
 
 	for (int j = 0; j < 100; j++) {
-		*p++ = owns[j] ? '1' : '0';
+		*p++ = (owns[j >> 3] & (0x80 >> (j & 7))) != 0 ? '1' : '0';
 	}
 
 	*p = 0;
@@ -723,12 +813,16 @@ parse_and_apply_replicas_all(cl_cluster_node* cn, char* replicas_all)
 	int expected_encoded_len = ((bitmap_size + 2) / 3) * 4;
 
 	// Size allows for padding - is actual size rounded up to multiple of 3.
-	uint8_t* bitmap = (uint8_t*)alloca(((bitmap_size + 2) / 3) * 3);
+	size_t decoded_size = ((bitmap_size + 2) / 3) * 3;
+
+	// A bitmap per replica, master first - replicas beyond
+	// CL_PARTITION_REPLICAS are ignored.
+	uint8_t* decoded = (uint8_t*)alloca(CL_PARTITION_REPLICAS * decoded_size);
+	const uint8_t* bitmaps[CL_PARTITION_REPLICAS];
 
-	// For now we're still not properly supporting replication factor > 2.
-	size_t owns_size = n_partitions * sizeof(bool);
-	bool* masters = (bool*)alloca(owns_size);
-	bool* proles = (bool*)alloca(owns_size);
+	for (int r = 0; r < CL_PARTITION_REPLICAS; r++) {
+		bitmaps[r] = decoded + (r * decoded_size);
+	}
 
 	// Format: <namespace1>:<repl-factor>,<base 64 encoded bitmap>,...;<namespace2>:<repl-factor>,<base 64 encoded bitmap>,...; ...
 	// Warning: this method walks on string argument.
@@ -788,9 +882,8 @@ parse_and_apply_replicas_all(cl_cluster_node* cn, char* replicas_all)
 			continue; // to next namespace
 		}
 
-		// Prepare to collect partition ownership information.
-		memset((void*)masters, 0, owns_size);
-		memset((void*)proles, 0, owns_size);
+		// Replicas beyond the replication factor stay empty.
+		memset((void*)decoded, 0, CL_PARTITION_REPLICAS * decoded_size);
 
 		// Parse all the base 64 encoded bitmaps.
 		int n_max = n_repl - 1;
@@ -827,22 +920,14 @@ parse_and_apply_replicas_all(cl_cluster_node* cn, char* replicas_all)
 				break;
 			}
 
-			// Just ignore any extra replicas for now.
-			if (n > 1) {
+			// Ignore replicas we don't keep.
+			if (n >= CL_PARTITION_REPLICAS) {
 				continue; // to next encoded bitmap
 			}
 
 			// Decode to get the bitmap.
-			cf_base64_decode(p_encoded_bitmap, encoded_bitmap_len, bitmap);
-
-			// Expand the bitmap into appropriate ownership array.
-			bool* owns = n == 0 ? masters : proles;
-
-			for (int i = 0; i < n_partitions; i++) {
-				if ((bitmap[i >> 3] & (0x80 >> (i & 7))) != 0) {
-					owns[i] = true;
-				}
-			}
+			cf_base64_decode(p_encoded_bitmap, encoded_bitmap_len,
+					decoded + (n * decoded_size));
 		}
 
 		if (skip_ns) {
@@ -859,11 +944,11 @@ parse_and_apply_replicas_all(cl_cluster_node* cn, char* replicas_all)
 			continue; // to next namespace
 		}
 
-//		log_ownership(cn->name, p_ns, "masters", masters);
-//		log_ownership(cn->name, p_ns, " proles", proles);
+//		log_ownership(cn->name, p_ns, "masters", bitmaps[0]);
+//		log_ownership(cn->name, p_ns, " proles", bitmaps[1]);
 
 		// Apply this namespace's updates to the partition table.
-		cl_partition_table_update(cn, p_ns, masters, proles);
+		cl_partition_table_update(cn, p_ns, bitmaps);
 
 		if (done) {
 			return;
@@ -876,46 +961,31 @@ parse_and_apply_replicas_all(cl_cluster_node* cn, char* replicas_all)
 void
 node_info_req_parse_replicas(cl_cluster_node* cn)
 {
-	// Returned list format is name1\tvalue1\nname2\tvalue2\n...
-	cf_vector_define(lines_v, sizeof(void*), 0);
-	str_split('\n', (char*)cn->info_req.rbuf, &lines_v);
-
-	for (uint32_t j = 0; j < cf_vector_size(&lines_v); j++) {
-		char* line = (char*)cf_vector_pointer_get(&lines_v, j);
-
-		cf_vector_define(pair_v, sizeof(void*), 0);
-		str_split('\t', line, &pair_v);
-
-		if (cf_vector_size(&pair_v) != 2) {
-			// Will happen if a requested field is returned empty.
-			cf_vector_destroy(&pair_v);
-			continue;
-		}
+	char* pos = (char*)cn->info_req.rbuf;
+	cl_info_pair pair;
 
-		char* name = (char*)cf_vector_pointer_get(&pair_v, 0);
-		char* value = (char*)cf_vector_pointer_get(&pair_v, 1);
-
-		if (strcmp(name, "partition-generation") == 0) {
-			int gen = atoi(value);
+	while (cl_info_next_pair(&pos, &pair)) {
+		switch (pair.id) {
+		case CL_INFO_NAME_PARTITION_GENERATION: {
+			int gen = atoi(pair.value);
 
 			// Update to the new partition generation.
 			cf_atomic_int_set(&cn->partition_generation, (cf_atomic_int_t)gen);
 
 			cf_info("node %s got partition generation %d", cn->name, gen);
+			break;
 		}
-		else if (strcmp(name, "replicas-all") == 0) {
+		case CL_INFO_NAME_REPLICAS_ALL:
 			// Parse and apply the replicas info.
-			parse_and_apply_replicas_all(cn, value);
-		}
-		else {
-			cf_warn("node %s info replicas did not request %s", cn->name, name);
+			parse_and_apply_replicas_all(cn, pair.value);
+			break;
+		default:
+			cf_warn("node %s info replicas did not request %s", cn->name,
+					pair.name);
+			break;
 		}
-
-		cf_vector_destroy(&pair_v);
 	}
 
-	cf_vector_destroy(&lines_v);
-
 	node_info_req_done(cn);
 }
 
@@ -923,20 +993,27 @@ node_info_req_parse_replicas(cl_cluster_node* cn)
 static uint32_t
 cluster_services_parse(ev2citrusleaf_cluster *asc, char *services)
 {
-	cf_vector_define(host_str_v, sizeof(void*), 0);
-	str_split(';', services, &host_str_v);
+	uint32_t n_services = 0;
+	char *p = services;
+	bool done;
+
+	while (*p) {
+		char *host_s = p;
 
-	uint32_t n_services = cf_vector_size(&host_str_v);
+		p = stop_at(p, ';', &done);
 
-	for (uint32_t i = 0; i < n_services; i++) {
-		char *host_str = (char*)cf_vector_pointer_get(&host_str_v, i);
+		if (! done) {
+			p++;
+		}
+
+		n_services++;
 
-		cf_vector_define(host_port_v, sizeof(void*), 0);
-		str_split(':', host_str, &host_port_v);
+		// Skip entries that aren't host:port.
+		char *port_s = strchr(host_s, ':');
+
+		if (port_s && port_s[1] && ! strchr(port_s + 1, ':')) {
+			*port_s++ = 0;
 
-		if (cf_vector_size(&host_port_v) == 2) {
-			char *host_s = (char*)cf_vector_pointer_get(&host_port_v, 0);
-			char *port_s = (char*)cf_vector_pointer_get(&host_port_v, 1);
 			int port = atoi(port_s);
 			struct sockaddr_in sin;
 
@@ -951,12 +1028,8 @@ cluster_services_parse(ev2citrusleaf_cluster *asc, char *services)
 				ev2citrusleaf_cluster_add_host_internal(asc, host_s, port);
 			}
 		}
-
-		cf_vector_destroy(&host_port_v);
 	}
 
-	cf_vector_destroy(&host_str_v);
-
 	return n_services;
 }
 
@@ -987,36 +1060,21 @@ node_info_req_parse_check(cl_cluster_node* cn)
 	bool get_replicas = false;
 	uint32_t n_services = 0;
 
-	cf_vector_define(lines_v, sizeof(void*), 0);
-	str_split('\n', (char*)cn->info_req.rbuf, &lines_v);
-
-	for (uint32_t i = 0; i < cf_vector_size(&lines_v); i++) {
-		char* line = (char*)cf_vector_pointer_get(&lines_v, i);
-
-		cf_vector_define(pair_v, sizeof(void*), 0);
-		str_split('\t', line, &pair_v);
-
-		if (cf_vector_size(&pair_v) != 2) {
-			// Will happen if a requested field is returned empty.
-			cf_vector_destroy(&pair_v);
-			continue;
-		}
+	char* pos = (char*)cn->info_req.rbuf;
+	cl_info_pair pair;
 
-		char* name = (char*)cf_vector_pointer_get(&pair_v, 0);
-		char* value = (char*)cf_vector_pointer_get(&pair_v, 1);
-
-		if (strcmp(name, "node") == 0) {
-			if (strcmp(value, cn->name) != 0) {
-				cf_warn("node name changed from %s to %s", cn->name, value);
-				cf_vector_destroy(&pair_v);
-				cf_vector_destroy(&lines_v);
+	while (cl_info_next_pair(&pos, &pair)) {
+		switch (pair.id) {
+		case CL_INFO_NAME_NODE:
+			if (strcmp(pair.value, cn->name) != 0) {
+				cf_warn("node name changed from %s to %s", cn->name, pair.value);
 				node_info_req_fail(cn, true);
 				return;
 			}
-		}
-		else if (strcmp(name, "partition-generation") == 0) {
+			break;
+		case CL_INFO_NAME_PARTITION_GENERATION: {
 			int client_gen = (int)cf_atomic_int_get(cn->partition_generation);
-			int server_gen = atoi(value);
+			int server_gen = atoi(pair.value);
 
 			// If generations don't match, flag for replicas request.
 			if (client_gen != server_gen) {
@@ -1025,20 +1083,19 @@ node_info_req_parse_check(cl_cluster_node* cn)
 				cf_info("node %s partition generation %d needs update to %d",
 						cn->name, client_gen, server_gen);
 			}
+			break;
 		}
-		else if (strcmp(name, "services") == 0) {
+		case CL_INFO_NAME_SERVICES:
 			// This can spawn an independent info request.
-			n_services = cluster_services_parse(cn->asc, value);
-		}
-		else {
-			cf_warn("node %s info check did not request %s", cn->name, name);
+			n_services = cluster_services_parse(cn->asc, pair.value);
+			break;
+		default:
+			cf_warn("node %s info check did not request %s", cn->name,
+					pair.name);
+			break;
 		}
-
-		cf_vector_destroy(&pair_v);
 	}
 
-	cf_vector_destroy(&lines_v);
-
 	node_info_req_done(cn);
 
 	if (get_replicas && ! node_is_split_from_cluster(cn, n_services)) {
@@ -1093,6 +1150,29 @@ node_info_req_handle_send(cl_cluster_node* cn)
 	return false;
 }
 
+void
+node_info_req_handle_response(cl_cluster_node* cn)
+{
+	node_info_req* ir = &cn->info_req;
+
+	// Done with proto body - assume no more protos.
+
+	switch (ir->type) {
+	case INFO_REQ_CHECK:
+		// May start a INFO_REQ_GET_REPLICAS request!
+		node_info_req_parse_check(cn);
+		break;
+	case INFO_REQ_GET_REPLICAS:
+		node_info_req_parse_replicas(cn);
+		break;
+	default:
+		// Since we can't assert:
+		cf_error("node info request invalid type %d", ir->type);
+		node_info_req_fail(cn, false);
+		break;
+	}
+}
+
 bool
 node_info_req_handle_recv(cl_cluster_node* cn)
 {
@@ -1102,16 +1182,65 @@ node_info_req_handle_recv(cl_cluster_node* cn)
 		// Loop until everything is read from socket or we get would-block.
 
 		if (ir->hbuf_pos < sizeof(cl_proto)) {
-			// Read proto header.
+			// Read proto header, and as much of the body as fits.
+
+			size_t want = sizeof(ir->hbuf) - ir->hbuf_pos;
 
 			int rv = recv(cn->info_fd,
 					(cf_socket_data_t*)&ir->hbuf[ir->hbuf_pos],
-					(cf_socket_size_t)(sizeof(cl_proto) - ir->hbuf_pos),
+					(cf_socket_size_t)want,
 					MSG_DONTWAIT | MSG_NOSIGNAL);
 
+			cf_atomic_int_incr(&cn->asc->n_recv_calls);
+
 			if (rv > 0) {
 				ir->hbuf_pos += rv;
-				// Loop, read more header or start reading body.
+
+				if (ir->hbuf_pos < sizeof(cl_proto)) {
+					// Loop, read more header.
+					continue;
+				}
+
+				cl_proto* proto = (cl_proto*)ir->hbuf;
+
+				cl_proto_swap(proto);
+
+				ir->rbuf_size = proto->sz;
+				ir->rbuf = (uint8_t*)malloc(ir->rbuf_size + 1);
+
+				if (! ir->rbuf) {
+					cf_error("node info request rbuf allocation failed");
+					node_info_req_fail(cn, false);
+					return true;
+				}
+
+				// Null-terminate this buffer for easier text parsing.
+				ir->rbuf[ir->rbuf_size] = 0;
+
+				// Move whatever body we read ahead into the read buffer.
+				size_t body_got = ir->hbuf_pos - sizeof(cl_proto);
+
+				if (body_got > ir->rbuf_size) {
+					cf_warn("node info response has %zu extra bytes",
+							body_got - ir->rbuf_size);
+					node_info_req_fail(cn, true);
+					return true;
+				}
+
+				memcpy(ir->rbuf, &ir->hbuf[sizeof(cl_proto)], body_got);
+				ir->rbuf_pos = body_got;
+
+				if (ir->rbuf_pos == ir->rbuf_size) {
+					node_info_req_handle_response(cn);
+					return true;
+				}
+
+				if ((size_t)rv < want) {
+					// Socket's drained - wait for the next event.
+					break;
+				}
+
+				// Loop, read more body.
 			}
 			else if (rv == 0) {
 				// Connection has been closed by the server.
@@ -1132,25 +1261,6 @@ node_info_req_handle_recv(cl_cluster_node* cn)
 		else {
 			// Done with header, read corresponding body.
 
-			// Allocate the read buffer if we haven't yet.
-			if (! ir->rbuf) {
-				cl_proto* proto = (cl_proto*)ir->hbuf;
-
-				cl_proto_swap(proto);
-
-				ir->rbuf_size = proto->sz;
-				ir->rbuf = (uint8_t*)malloc(ir->rbuf_size + 1);
-
-				if (! ir->rbuf) {
-					cf_error("node info request rbuf allocation failed");
-					node_info_req_fail(cn, false);
-					return true;
-				}
-
-				// Null-terminate this buffer for easier text parsing.
-				ir->rbuf[ir->rbuf_size] = 0;
-			}
-
 			if (ir->rbuf_pos >= ir->rbuf_size) {
 				cf_error("unexpected read event");
 				node_info_req_fail(cn, false);
@@ -1162,27 +1272,13 @@ node_info_req_handle_recv(cl_cluster_node* cn)
 					(cf_socket_size_t)(ir->rbuf_size - ir->rbuf_pos),
 					MSG_DONTWAIT | MSG_NOSIGNAL);
 
+			cf_atomic_int_incr(&cn->asc->n_recv_calls);
+
 			if (rv > 0) {
 				ir->rbuf_pos += rv;
 
 				if (ir->rbuf_pos == ir->rbuf_size) {
-					// Done with proto body - assume no more protos.
-
-					switch (ir->type) {
-					case INFO_REQ_CHECK:
-						// May start a INFO_REQ_GET_REPLICAS request!
-						node_info_req_parse_check(cn);
-						break;
-					case INFO_REQ_GET_REPLICAS:
-						node_info_req_parse_replicas(cn);
-						break;
-					default:
-						// Since we can't assert:
-						cf_error("node info request invalid type %d", ir->type);
-						node_info_req_fail(cn, false);
-						break;
-					}
-
+					node_info_req_handle_response(cn);
 					return true;
 				}
 
@@ -1437,6 +1533,8 @@ node_throttle_control(cl_cluster_node* cn)
 	cf_atomic32_set(&cn->throttle_pct, throttle_pct);
 }
 
+static uint32_t circuit_get(cl_cluster_node* cn);
+
 // The libevent2 event handler for node periodic timer events:
 void
 node_timer_fn(evutil_socket_t fd, short event, void* udata)
@@ -1467,6 +1565,7 @@ node_timer_fn(evutil_socket_t fd, short event, void* udata)
 
 		// If there's still a node info request in progress, cancel it.
 		node_info_req_cancel(cn);
+		node_warm_cancel(cn);
 
 		// Remove this node object from the cluster list, if there.
 		bool deleted = false;
@@ -1503,6 +1602,9 @@ node_timer_fn(evutil_socket_t fd, short event, void* udata)
 
 	node_throttle_control(cn);
 
+	// Re-open a half-open circuit left unresolved, even with no traffic.
+	circuit_get(cn);
+
 	if (cn->info_req.type != INFO_REQ_NONE) {
 		// There's still a node info request in progress. If it's taking too
 		// long, cancel it and start over.
@@ -1528,6 +1630,9 @@ node_timer_fn(evutil_socket_t fd, short event, void* udata)
 		node_info_req_start(cn, INFO_REQ_CHECK);
 	}
 
+	node_reap_idle(cn);
+	node_warm_start(cn);
+
 	if (0 != event_add(cluster_node_get_timer_event(cn), &g_node_tend_timeout)) {
 		// Serious - stops periodic timer! TODO - remove node?
 		cf_error("node %s timer event add failed", cn->name);
@@ -1567,9 +1672,14 @@ cl_cluster_node_create(const char* name, ev2citrusleaf_cluster* asc)
 
 	cn->MAGIC = CLUSTER_NODE_MAGIC;
 	strcpy(cn->name, name);
+
+	for (int i = 0; i < NODE_WARM_MAX_CONNECTS; i++) {
+		cn->warm_fds[i] = -1;
+	}
+
 	cf_vector_init(&cn->sockaddr_in_v, sizeof(struct sockaddr_in), 5, VECTOR_FLAG_BIGLOCK);
 	cn->asc = asc;
-	cn->conn_q = cf_queue_create(sizeof(int), true);
+	cn->conn_q = cf_queue_create(sizeof(cl_idle_fd), true);
 
 	if (! cn->conn_q) {
 		cf_warn("node %s can't create file descriptor queue", name);
@@ -1580,6 +1690,8 @@ cl_cluster_node_create(const char* name, ev2citrusleaf_cluster* asc)
 	cn->partition_generation = (cf_atomic_int_t)-1;
 	cn->info_fd = -1;
 
+	MUTEX_ALLOC(cn->pipe_lock);
+
 	// Start node's periodic timer.
 	cl_cluster_node_reserve(cn, "L+");
 	evtimer_assign(cluster_node_get_timer_event(cn), asc->base, node_timer_fn, cn);
@@ -1610,8 +1722,7 @@ cl_cluster_node_release(cl_cluster_node *cn, char *msg)
 	// O:  original alloc
 	// L:  node timer loop
 	// C:  cluster node list
-	// PR: partition table, read
-	// PW: partition table, write
+	// PS: partition map snapshot
 	// T:  transaction
 
 #ifdef DEBUG_NODE_REF_COUNT
@@ -1624,6 +1735,7 @@ cl_cluster_node_release(cl_cluster_node *cn, char *msg)
 		cf_atomic_int_incr(&cn->asc->n_nodes_destroyed);
 
 		node_info_req_cancel(cn);
+		node_warm_cancel(cn);
 
 		// AKG
 		// If we call event_del() before assigning the event - possible in some
@@ -1636,17 +1748,38 @@ cl_cluster_node_release(cl_cluster_node *cn, char *msg)
 
 		event_del(cluster_node_get_timer_event(cn));
 
+		cl_pipe_node_destroy(cn);
+		MUTEX_FREE(cn->pipe_lock);
+
+		cl_partition_table_ownership_free(cn);
+
 		if (cn->conn_q) {
-			int fd;
+			cl_idle_fd idle_fd;
 
-			while (cf_queue_pop(cn->conn_q, &fd, CF_QUEUE_NOWAIT) == CF_QUEUE_OK) {
-				cf_close(fd);
+			while (cf_queue_pop(cn->conn_q, &idle_fd, CF_QUEUE_NOWAIT) == CF_QUEUE_OK) {
+				cf_close(idle_fd.fd);
 				cf_atomic32_decr(&cn->n_fds_open);
 			}
 
 			cf_queue_destroy(cn->conn_q);
 		}
 
+		for (int i = 0; i < FD_CACHE_STRIPES; i++) {
+			cl_fd_stripe* stripe = &cn->fd_cache[i];
+
+			for (int j = 0; j < FD_CACHE_SLOTS; j++) {
+				if (stripe->slots[j].fd != 0) {
+					cf_close((int)stripe->slots[j].fd - 1);
+					cf_atomic32_decr(&cn->n_fds_open);
+				}
+			}
+
+			cf_atomic_int_add(&cn->asc->n_fd_cache_hits, stripe->n_hits);
+			cf_atomic_int_add(&cn->asc->n_fd_cache_misses, stripe->n_misses);
+		}
+
+		free(cn->fd_cache);
+
 		cf_vector_destroy(&cn->sockaddr_in_v);
 
 		// Be safe and destroy the magic.
@@ -1663,8 +1796,7 @@ cl_cluster_node_reserve(cl_cluster_node *cn, char *msg)
 	// O:  original alloc
 	// L:  node timer loop
 	// C:  cluster node list
-	// PR: partition table, read
-	// PW: partition table, write
+	// PS: partition map snapshot
 	// T:  transaction
 
 #ifdef DEBUG_NODE_REF_COUNT
@@ -1712,7 +1844,8 @@ cl_cluster_node_get_random(ev2citrusleaf_cluster *asc)
 			return(0);
 		}
 
-		if (cf_atomic32_get(cn->throttle_pct) != 0) {
+		if (cf_atomic32_get(cn->throttle_pct) != 0 ||
+				cl_cluster_node_circuit_avoid(cn)) {
 			cn = 0;
 		}
 
@@ -1727,14 +1860,15 @@ cl_cluster_node_get_random(ev2citrusleaf_cluster *asc)
 	return(cn);
 }
 
+// pt may be NULL if the namespace's partition table doesn't exist (yet).
 cl_cluster_node *
-cl_cluster_node_get(ev2citrusleaf_cluster *asc, const char *ns, const cf_digest *d, bool write)
+cl_cluster_node_get(ev2citrusleaf_cluster *asc, cl_partition_table *pt, const cf_digest *d, bool write)
 {
 	cl_cluster_node *cn = 0;
 
 	if (asc->n_partitions) {
 		// first, try to get one that matches this digest
-		cn = cl_partition_table_get(asc, ns, cl_partition_getid(asc->n_partitions, d) , write);
+		cn = cl_partition_table_get(asc, pt, cl_partition_getid(asc->n_partitions, d) , write);
 
 		if (cn && cn->MAGIC != CLUSTER_NODE_MAGIC) {
 			// TODO - is this really happening any more?
@@ -1772,90 +1906,782 @@ cl_cluster_node_put(cl_cluster_node *cn)
 }
 
 
-// Return values:
-// -1 try again right away
-// -2 don't try again right away
-int
-cl_cluster_node_fd_get(cl_cluster_node *cn)
-{
-	int fd;
-	int rv = cf_queue_pop(cn->conn_q, &fd, CF_QUEUE_NOWAIT);
-
-	if (rv == CF_QUEUE_OK) {
-		// Check to see if existing fd is still connected.
-		int rv2 = ev2citrusleaf_is_connected(fd);
+//
+// Idle sockets - each thread uses a stripe of the node's lock-free fd cache,
+// and moves sockets to and from the shared (locked) conn_q only in batches.
+//
 
-		switch (rv2) {
-			case CONNECTED:
-				// It's still good.
-				return fd;
-			case CONNECTED_NOT:
-				// Can't use it - the remote end closed it.
-			case CONNECTED_ERROR:
-				// Some other problem, could have to do with remote end.
-				cf_close(fd);
-				cf_atomic32_decr(&cn->n_fds_open);
-				return -1;
-			case CONNECTED_BADFD:
-				// Local problem, don't try closing.
-				cf_warn("bad file descriptor in queue: fd %d", fd);
-				return -1;
-			default:
-				// Since we can't assert:
-				cf_error("bad return value from ev2citrusleaf_is_connected");
-				cf_close(fd);
-				cf_atomic32_decr(&cn->n_fds_open);
-				return -2;
-		}
-	}
-	else if (rv != CF_QUEUE_EMPTY) {
-		// Since we can't assert:
-		cf_error("bad return value from cf_queue_pop");
-		return -2;
-	}
+// When each node socket was opened, indexed by fd, for max-age rotation.
+// Sized by the process fd limit, up to FD_OPEN_MS_MAX - sockets beyond it are
+// never rotated. (Not used on Windows, where sockets aren't small integers.)
+#define FD_OPEN_MS_MAX (1024 * 1024)
 
-	// Queue was empty, open a new socket and (start) connect.
+static cf_atomic32* g_fd_open_ms = NULL;
+static uint32_t g_fd_open_ms_size = 0;
 
-	if (cf_vector_size(&cn->sockaddr_in_v) == 0) {
-		cf_warn("node %s has no sockaddrs", cn->name);
-		return -2;
-	}
+static void
+fd_open_ms_init()
+{
+#ifndef CF_WINDOWS
+	struct rlimit rl;
 
-	if (-1 == (fd = cf_socket_create_nb())) {
-		// Local problem.
-		return -2;
+	if (g_fd_open_ms || getrlimit(RLIMIT_NOFILE, &rl) != 0) {
+		return;
 	}
 
-	cf_debug("new socket: fd %d node %s", fd, cn->name);
-
-	// Try socket addresses until we connect.
-	for (uint32_t i = 0; i < cf_vector_size(&cn->sockaddr_in_v); i++) {
-		struct sockaddr_in sa_in;
+	uint32_t size = rl.rlim_cur == RLIM_INFINITY || rl.rlim_cur > FD_OPEN_MS_MAX ?
+			FD_OPEN_MS_MAX : (uint32_t)rl.rlim_cur;
 
-		cf_vector_get(&cn->sockaddr_in_v, i, &sa_in);
+	// Pages are only touched as fds are used.
+	g_fd_open_ms = (cf_atomic32*)calloc(size, sizeof(cf_atomic32));
 
-		if (0 == cf_socket_start_connect_nb(fd, &sa_in)) {
-			cf_atomic32_incr(&cn->n_fds_open);
-			return fd;
-		}
-		// TODO - else remove this sockaddr from the list?
+	if (g_fd_open_ms) {
+		g_fd_open_ms_size = size;
 	}
-
-	cf_close(fd);
-
-	return -2;
+#endif
 }
 
-void
-cl_cluster_node_fd_put(cl_cluster_node *cn, int fd)
+static void
+fd_open_ms_free()
 {
-	if (! cf_queue_push_limit(cn->conn_q, &fd,
-			cf_atomic32_get(cn->asc->runtime_options.socket_pool_max))) {
+	if (g_fd_open_ms) {
+		g_fd_open_ms_size = 0;
+		free((void*)g_fd_open_ms);
+		g_fd_open_ms = NULL;
+	}
+}
+
+static inline void
+fd_open_ms_set(int fd, uint32_t now)
+{
+	if (fd >= 0 && (uint32_t)fd < g_fd_open_ms_size) {
+		cf_atomic32_set(&g_fd_open_ms[fd], now);
+	}
+}
+
+// Is this socket older than max_age_ms? (If max_age_ms is 0, never.)
+static inline bool
+fd_too_old(int fd, uint32_t max_age_ms, uint32_t now)
+{
+	return max_age_ms != 0 && fd >= 0 && (uint32_t)fd < g_fd_open_ms_size &&
+			now - (uint32_t)cf_atomic32_get(g_fd_open_ms[fd]) > max_age_ms;
+}
+
+// Source of threads' stripes - first value handed out is 1.
+static cf_atomic32 g_fd_cache_stripe_counter = 0;
+
+// This thread's stripe, 0 until the thread first uses an fd cache.
+static CL_THREAD_LOCAL uint32_t g_fd_cache_stripe = 0;
+
+static inline uint32_t
+fd_cache_stripe()
+{
+	if (g_fd_cache_stripe == 0) {
+		g_fd_cache_stripe =
+				(uint32_t)cf_atomic32_incr(&g_fd_cache_stripe_counter);
+	}
+
+	return g_fd_cache_stripe % FD_CACHE_STRIPES;
+}
+
+// Racing threads may leave a slot's stamp a little off - the worst that does
+// is cost a needless check, or a retry.
+
+static inline int
+fd_cache_take(cl_cluster_node* cn, uint32_t s, uint32_t* p_put_ms)
+{
+	cl_fd_slot* slots = cn->fd_cache[s].slots;
+
+	for (int i = 0; i < FD_CACHE_SLOTS; i++) {
+		uint32_t v = cf_atomic32_get(slots[i].fd);
+
+		if (v == 0) {
+			continue;
+		}
+
+		uint32_t put_ms = slots[i].put_ms;
+
+		if ((uint32_t)cf_atomic32_cas(&slots[i].fd, v, 0) == v) {
+			*p_put_ms = put_ms;
+			return (int)v - 1;
+		}
+	}
+
+	return -1;
+}
+
+static inline bool
+fd_cache_give(cl_cluster_node* cn, uint32_t s, int fd, uint32_t put_ms)
+{
+	cl_fd_slot* slots = cn->fd_cache[s].slots;
+
+	for (int i = 0; i < FD_CACHE_SLOTS; i++) {
+		if (cf_atomic32_get(slots[i].fd) != 0) {
+			continue;
+		}
+
+		slots[i].put_ms = put_ms;
+
+		if (cf_atomic32_cas(&slots[i].fd, 0, fd + 1) == 0) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+// Push idle sockets to conn_q - they're already counted in n_fds_idle. The
+// push is all or nothing, so if it fails none of them are queued.
+static void
+fd_pool_push(cl_cluster_node* cn, cl_idle_fd* idle_fds, uint32_t n)
+{
+	if (cf_queue_push_n(cn->conn_q, idle_fds, n) != 0) {
+		cf_warn("node %s can't pool %u sockets", cn->name, n);
+
+		for (uint32_t i = 0; i < n; i++) {
+			cf_close(idle_fds[i].fd);
+			cf_atomic32_decr(&cn->n_fds_idle);
+			cf_atomic32_decr(&cn->n_fds_open);
+		}
+	}
+}
+
+// Get an idle socket from this thread's stripe, refilling the stripe from
+// conn_q if it's empty. Returns -1 if there are no idle sockets.
+static int
+fd_idle_get(cl_cluster_node* cn, uint32_t* p_put_ms)
+{
+	uint32_t s = fd_cache_stripe();
+	int fd = fd_cache_take(cn, s, p_put_ms);
+
+	if (fd != -1) {
+		cf_atomic_int_incr(&cn->fd_cache[s].n_hits);
+		cf_atomic32_decr(&cn->n_fds_idle);
+		return fd;
+	}
+
+	cf_atomic_int_incr(&cn->fd_cache[s].n_misses);
+
+	cl_idle_fd idle_fds[FD_CACHE_BATCH];
+	uint32_t n = cf_queue_pop_n(cn->conn_q, idle_fds, FD_CACHE_BATCH);
+
+	if (n == 0) {
+		return -1;
+	}
+
+	cf_atomic_int_incr(&cn->asc->n_fd_cache_refills);
+
+	// Keep the rest for this thread's next transactions.
+	for (uint32_t i = 1; i < n; i++) {
+		if (! fd_cache_give(cn, s, idle_fds[i].fd, idle_fds[i].put_ms)) {
+			// Another thread on this stripe filled it meanwhile.
+			fd_pool_push(cn, &idle_fds[i], n - i);
+			break;
+		}
+	}
+
+	cf_atomic32_decr(&cn->n_fds_idle);
+	*p_put_ms = idle_fds[0].put_ms;
+
+	return idle_fds[0].fd;
+}
+
+// Return values:
+// -1 try again right away
+// -2 don't try again right away
+// If trust_recent is true, an idle socket used within FD_TRUST_MS is returned
+// without checking whether the remote end closed it - the caller must retry
+// if such a socket turns out to be dead.
+// If p_pooled is not null, it's set true when the fd returned is an already
+// connected socket from the pool, false when it's a new socket still
+// connecting.
+static int node_fd_connect(cl_cluster_node *cn);
+
+int
+cl_cluster_node_fd_get(cl_cluster_node *cn, bool trust_recent, bool *p_pooled)
+{
+	uint32_t put_ms;
+	int fd = fd_idle_get(cn, &put_ms);
+
+	if (p_pooled) {
+		*p_pooled = false;
+	}
+
+	if (fd != -1 && trust_recent &&
+			(uint32_t)cf_getms() - put_ms < FD_TRUST_MS) {
+		cf_atomic_int_incr(&cn->asc->n_fd_checks_skipped);
+
+		if (p_pooled) {
+			*p_pooled = true;
+		}
+
+		return fd;
+	}
+
+	if (fd != -1) {
+		cf_atomic_int_incr(&cn->asc->n_fd_checks);
+
+		// Check to see if existing fd is still connected.
+		int rv2 = ev2citrusleaf_is_connected(fd);
+
+		switch (rv2) {
+			case CONNECTED:
+				// It's still good.
+				if (p_pooled) {
+					*p_pooled = true;
+				}
+				return fd;
+			case CONNECTED_NOT:
+				// Can't use it - the remote end closed it.
+			case CONNECTED_ERROR:
+				// Some other problem, could have to do with remote end.
+				cf_close(fd);
+				cf_atomic32_decr(&cn->n_fds_open);
+				return -1;
+			case CONNECTED_BADFD:
+				// Local problem, don't try closing.
+				cf_warn("bad file descriptor in queue: fd %d", fd);
+				return -1;
+			default:
+				// Since we can't assert:
+				cf_error("bad return value from ev2citrusleaf_is_connected");
+				cf_close(fd);
+				cf_atomic32_decr(&cn->n_fds_open);
+				return -2;
+		}
+	}
+
+	// No idle sockets, open a new socket and (start) connect.
+	return node_fd_connect(cn);
+}
+
+// Open a new socket and start connecting it to the node.
+static int
+node_fd_connect(cl_cluster_node *cn)
+{
+	int fd;
+
+	if (cf_vector_size(&cn->sockaddr_in_v) == 0) {
+		cf_warn("node %s has no sockaddrs", cn->name);
+		return -2;
+	}
+
+	if (-1 == (fd = cf_socket_create_nb())) {
+		// Local problem.
+		return -2;
+	}
+
+	cf_debug("new socket: fd %d node %s", fd, cn->name);
+
+	// Try socket addresses until we connect.
+	for (uint32_t i = 0; i < cf_vector_size(&cn->sockaddr_in_v); i++) {
+		struct sockaddr_in sa_in;
+
+		cf_vector_get(&cn->sockaddr_in_v, i, &sa_in);
+
+		if (0 == cf_socket_start_connect_nb(fd, &sa_in)) {
+			cf_atomic32_incr(&cn->n_fds_open);
+			fd_open_ms_set(fd, (uint32_t)cf_getms());
+			return fd;
+		}
+		// TODO - else remove this sockaddr from the list?
+	}
+
+	cf_close(fd);
+
+	return -2;
+}
+
+// Count a socket as idle, unless the pool is full - if so, close it.
+static bool
+fd_idle_reserve(cl_cluster_node *cn, int fd)
+{
+	if ((uint32_t)cf_atomic32_incr(&cn->n_fds_idle) >
+			cf_atomic32_get(cn->asc->runtime_options.socket_pool_max)) {
+		cf_atomic32_decr(&cn->n_fds_idle);
+		cf_close(fd);
+		cf_atomic32_decr(&cn->n_fds_open);
+		return false;
+	}
+
+	return true;
+}
+
+void
+cl_cluster_node_fd_put(cl_cluster_node *cn, int fd)
+{
+	uint32_t now = (uint32_t)cf_getms();
+
+	if (fd_too_old(fd, cf_atomic32_get(
+			cn->asc->runtime_options.socket_max_age_seconds) * 1000, now)) {
+		cf_close(fd);
+		cf_atomic32_decr(&cn->n_fds_open);
+		cf_atomic_int_incr(&cn->asc->n_fds_rotated);
+		return;
+	}
+
+	if (! fd_idle_reserve(cn, fd)) {
+		return;
+	}
+
+	uint32_t s = fd_cache_stripe();
+
+	if (fd_cache_give(cn, s, fd, now)) {
+		return;
+	}
+
+	// This thread's stripe is full - spill a batch, this socket and some
+	// from the stripe, to conn_q.
+	cl_idle_fd idle_fds[FD_CACHE_BATCH];
+	uint32_t n = 0;
+
+	idle_fds[n].fd = fd;
+	idle_fds[n++].put_ms = now;
+
+	while (n < FD_CACHE_BATCH &&
+			(fd = fd_cache_take(cn, s, &idle_fds[n].put_ms)) != -1) {
+		idle_fds[n++].fd = fd;
+	}
+
+	fd_pool_push(cn, idle_fds, n);
+	cf_atomic_int_incr(&cn->asc->n_fd_cache_spills);
+}
+
+
+//==========================================================
+// Reaping idle sockets.
+//
+// Each node timer event, idle sockets unused for socket_idle_timeout_seconds
+// are closed, down to min_idle_sockets, and idle sockets open longer than
+// socket_max_age_seconds are closed regardless (warming replaces them).
+//
+
+// Close those of n idle sockets that should go, compacting the rest to the
+// front of idle_fds. Returns how many are kept.
+static uint32_t
+fd_reap(cl_cluster_node* cn, cl_idle_fd* idle_fds, uint32_t n,
+		uint32_t idle_ms, uint32_t max_age_ms, uint32_t min_idle, uint32_t now)
+{
+	uint32_t n_kept = 0;
+
+	for (uint32_t i = 0; i < n; i++) {
+		int fd = idle_fds[i].fd;
+
+		if (fd_too_old(fd, max_age_ms, now)) {
+			cf_atomic_int_incr(&cn->asc->n_fds_rotated);
+		}
+		else if (idle_ms != 0 && now - idle_fds[i].put_ms > idle_ms &&
+				cf_atomic32_get(cn->n_fds_idle) > min_idle) {
+			cf_atomic_int_incr(&cn->asc->n_fds_reaped);
+		}
+		else {
+			idle_fds[n_kept++] = idle_fds[i];
+			continue;
+		}
+
 		cf_close(fd);
+		cf_atomic32_decr(&cn->n_fds_idle);
 		cf_atomic32_decr(&cn->n_fds_open);
 	}
+
+	return n_kept;
 }
 
+void
+node_reap_idle(cl_cluster_node* cn)
+{
+	threadsafe_runtime_options* p_opts = &cn->asc->runtime_options;
+
+	uint32_t idle_ms = cf_atomic32_get(p_opts->socket_idle_timeout_seconds) * 1000;
+	uint32_t max_age_ms = cf_atomic32_get(p_opts->socket_max_age_seconds) * 1000;
+
+	if (idle_ms == 0 && max_age_ms == 0) {
+		return;
+	}
+
+	uint32_t min_idle = cf_atomic32_get(p_opts->min_idle_sockets);
+	uint32_t now = (uint32_t)cf_getms();
+	cl_idle_fd idle_fds[FD_CACHE_SLOTS];
+
+	// Sweep each stripe - take all its sockets and give back those kept. (If
+	// other threads fill the stripe meanwhile, the rest go to conn_q.)
+	for (uint32_t s = 0; s < FD_CACHE_STRIPES; s++) {
+		uint32_t n = 0;
+		int fd;
+
+		while (n < FD_CACHE_SLOTS &&
+				(fd = fd_cache_take(cn, s, &idle_fds[n].put_ms)) != -1) {
+			idle_fds[n++].fd = fd;
+		}
+
+		n = fd_reap(cn, idle_fds, n, idle_ms, max_age_ms, min_idle, now);
+
+		for (uint32_t i = 0; i < n; i++) {
+			if (! fd_cache_give(cn, s, idle_fds[i].fd, idle_fds[i].put_ms)) {
+				fd_pool_push(cn, &idle_fds[i], n - i);
+				break;
+			}
+		}
+	}
+
+	// Sweep conn_q once through - kept sockets go back on the tail.
+	int n_left = cf_queue_sz(cn->conn_q);
+
+	while (n_left > 0) {
+		uint32_t n = cf_queue_pop_n(cn->conn_q, idle_fds, FD_CACHE_SLOTS);
+
+		if (n == 0) {
+			break;
+		}
+
+		n_left -= (int)n;
+		n = fd_reap(cn, idle_fds, n, idle_ms, max_age_ms, min_idle, now);
+
+		if (n != 0) {
+			fd_pool_push(cn, idle_fds, n);
+		}
+	}
+}
+
+
+//==========================================================
+// Keeping idle sockets topped up.
+//
+// Sockets are connected ahead of demand, a few at a time, by a node's timer
+// event (and when a node is first found), so the first transactions to a node
+// - or those after a burst drains the pool - find sockets ready. The events
+// all run in the cluster management event base.
+//
+
+void node_warm_start(cl_cluster_node* cn);
+
+// The libevent2 event handler for warming socket events:
+void
+node_warm_event(evutil_socket_t fd, short event, void* udata)
+{
+	cl_cluster_node* cn = (cl_cluster_node*)udata;
+
+	for (uint32_t i = 0; i < NODE_WARM_MAX_CONNECTS; i++) {
+		if (cn->warm_fds[i] == fd) {
+			cn->warm_fds[i] = -1;
+			cn->n_warm_fds--;
+			break;
+		}
+	}
+
+	if ((event & EV_WRITE) && ev2citrusleaf_is_connected(fd) == CONNECTED) {
+		cf_atomic_int_incr(&cn->asc->n_warm_connects);
+
+		// Connected - now it's just another idle socket. Put it straight in
+		// conn_q, since no transactions get sockets from this thread's stripe.
+		if (fd_idle_reserve(cn, fd)) {
+			cl_idle_fd idle_fd = { fd, (uint32_t)cf_getms() };
+
+			fd_pool_push(cn, &idle_fd, 1);
+		}
+
+		// Keep going until we're topped up.
+		node_warm_start(cn);
+		return;
+	}
+
+	// Timed out or failed to connect - the next timer event will try again.
+	cf_close(fd);
+	cf_atomic32_decr(&cn->n_fds_open);
+	cf_atomic_int_incr(&cn->asc->n_warm_connect_failures);
+}
+
+void
+node_warm_start(cl_cluster_node* cn)
+{
+	threadsafe_runtime_options* p_opts = &cn->asc->runtime_options;
+
+	uint32_t min_idle = cf_atomic32_get(p_opts->min_idle_sockets);
+	uint32_t pool_max = cf_atomic32_get(p_opts->socket_pool_max);
+
+	if (min_idle > pool_max) {
+		min_idle = pool_max;
+	}
+
+	// Count sockets already connecting, so we don't overshoot.
+	uint32_t n_idle = cf_atomic32_get(cn->n_fds_idle) + cn->n_warm_fds;
+
+	for (uint32_t i = 0; i < NODE_WARM_MAX_CONNECTS && n_idle < min_idle; i++) {
+		if (cn->warm_fds[i] != -1) {
+			continue;
+		}
+
+		int fd = node_fd_connect(cn);
+
+		if (fd < 0) {
+			cf_atomic_int_incr(&cn->asc->n_warm_connect_failures);
+			return;
+		}
+
+		struct event* ev = cluster_node_get_warm_event(cn, i);
+
+		event_assign(ev, cn->asc->base, fd, EV_WRITE, node_warm_event, cn);
+
+		if (0 != event_add(ev, &g_node_warm_timeout)) {
+			cf_error("node %s warming socket add event failed", cn->name);
+			cf_close(fd);
+			cf_atomic32_decr(&cn->n_fds_open);
+			return;
+		}
+
+		cn->warm_fds[i] = fd;
+		cn->n_warm_fds++;
+		n_idle++;
+	}
+}
+
+void
+node_warm_cancel(cl_cluster_node* cn)
+{
+	for (uint32_t i = 0; i < NODE_WARM_MAX_CONNECTS; i++) {
+		if (cn->warm_fds[i] != -1) {
+			event_del(cluster_node_get_warm_event(cn, i));
+			cf_close(cn->warm_fds[i]);
+			cn->warm_fds[i] = -1;
+			cf_atomic32_decr(&cn->n_fds_open);
+		}
+	}
+
+	cn->n_warm_fds = 0;
+}
+
+
+// Fold a transaction's latency into the node's smoothed latency - alpha is
+// 1/8 - and its 95th percentile estimate. The estimate steps up 19 units for
+// a sample above it and down 1 for a sample below, so it settles where 1 in
+// 20 samples are above. The unit scales with the estimate. Racing threads may
+// lose a sample, which doesn't matter.
+void
+cl_cluster_node_latency_add(cl_cluster_node* cn, uint64_t latency_us)
+{
+	if (latency_us > INT32_MAX) {
+		latency_us = INT32_MAX;
+	}
+
+	int64_t ewma = (int64_t)(uint32_t)cf_atomic32_get(cn->latency_us);
+
+	if (ewma == 0) {
+		ewma = (int64_t)latency_us;
+	}
+	else {
+		ewma += ((int64_t)latency_us - ewma) / 8;
+	}
+
+	int64_t p95 = (int64_t)(uint32_t)cf_atomic32_get(cn->latency_p95_us);
+
+	if (p95 == 0) {
+		p95 = (int64_t)latency_us;
+	}
+	else {
+		int64_t unit = (p95 / 256) + 1;
+
+		if ((int64_t)latency_us > p95) {
+			p95 += 19 * unit;
+
+			if (p95 > (int64_t)latency_us) {
+				p95 = (int64_t)latency_us;
+			}
+		}
+		else if ((int64_t)latency_us < p95) {
+			p95 -= unit;
+		}
+
+		if (p95 > INT32_MAX) {
+			p95 = INT32_MAX;
+		}
+	}
+
+	// Keep 0 meaning no samples yet.
+	cf_atomic32_set(&cn->latency_us, ewma == 0 ? 1 : (uint32_t)ewma);
+	cf_atomic32_set(&cn->latency_p95_us, p95 <= 0 ? 1 : (uint32_t)p95);
+}
+
+// A transaction (or connect) on this node had a problem - add its score, and
+// open the node's circuit if the score since the last success is too high. A
+// problem while probing re-opens the circuit straight away.
+void
+cl_cluster_node_dun(cl_cluster_node* cn, uint32_t score)
+{
+	uint32_t dun_score = (uint32_t)cf_atomic32_add(&cn->dun_score, (int32_t)score);
+	uint32_t circuit = cf_atomic32_get(cn->circuit);
+
+	if (circuit == CL_CIRCUIT_OPEN ||
+			cf_atomic32_get(cn->asc->runtime_options.circuit_breaker) == 0 ||
+			(circuit == CL_CIRCUIT_CLOSED && dun_score < CL_NODE_DUN_THRESHOLD)) {
+		return;
+	}
+
+	cf_atomic32_set(&cn->circuit_opened_ms, (uint32_t)cf_getms());
+
+	if ((uint32_t)cf_atomic32_cas(&cn->circuit, circuit, CL_CIRCUIT_OPEN) == circuit) {
+		cf_atomic_int_incr(&cn->asc->n_circuits_opened);
+		cf_warn("node %s circuit open, problem score %u", cn->name, dun_score);
+	}
+}
+
+// A transaction on this node succeeded - clear the problem score, and if
+// enough probes have now succeeded, close the node's circuit.
+void
+cl_cluster_node_ok(cl_cluster_node* cn)
+{
+	// Only write if needed - this is on every transaction's path.
+	if (cf_atomic32_get(cn->dun_score) != 0) {
+		cf_atomic32_set(&cn->dun_score, 0);
+	}
+
+	if (cf_atomic32_get(cn->circuit) == CL_CIRCUIT_HALF_OPEN &&
+			(uint32_t)cf_atomic32_incr(&cn->n_probe_successes) >= CL_CIRCUIT_PROBES &&
+			cf_atomic32_cas(&cn->circuit, CL_CIRCUIT_HALF_OPEN, CL_CIRCUIT_CLOSED) ==
+					CL_CIRCUIT_HALF_OPEN) {
+		cf_atomic_int_incr(&cn->asc->n_circuits_closed);
+		cf_info("node %s circuit closed", cn->name);
+	}
+}
+
+static inline bool
+circuit_cooling(cl_cluster_node* cn)
+{
+	return (uint32_t)cf_getms() - (uint32_t)cf_atomic32_get(cn->circuit_opened_ms) <
+			CL_CIRCUIT_COOL_MS;
+}
+
+// Get the node's circuit state. A half-open circuit whose probes haven't
+// closed it within CL_CIRCUIT_COOL_MS re-opens, to cool down again - probes
+// may have been lost, or the node is still bad but slow to show it.
+static uint32_t
+circuit_get(cl_cluster_node* cn)
+{
+	uint32_t circuit = cf_atomic32_get(cn->circuit);
+
+	if (circuit != CL_CIRCUIT_HALF_OPEN) {
+		return circuit;
+	}
+
+	uint32_t now = (uint32_t)cf_getms();
+	uint32_t since = (uint32_t)cf_atomic32_get(cn->circuit_opened_ms);
+
+	if (now - since < CL_CIRCUIT_COOL_MS) {
+		return circuit;
+	}
+
+	// Only whoever restarts the clock re-opens the circuit. The clock goes
+	// first, so no one sees the circuit open with the old time.
+	if ((uint32_t)cf_atomic32_cas(&cn->circuit_opened_ms, since, now) == since &&
+			cf_atomic32_cas(&cn->circuit, CL_CIRCUIT_HALF_OPEN, CL_CIRCUIT_OPEN) ==
+					CL_CIRCUIT_HALF_OPEN) {
+		cf_atomic_int_incr(&cn->asc->n_circuits_opened);
+		cf_warn("node %s circuit open, probes unresolved", cn->name);
+	}
+
+	return cf_atomic32_get(cn->circuit);
+}
+
+// May a transaction be started on this node? While the circuit is open, no,
+// until it cools down - then up to CL_CIRCUIT_PROBES may be in flight, as
+// probes. If this transaction is a probe, *p_probe is set, and the caller
+// must give its slot back with cl_cluster_node_probe_done() whatever happens.
+bool
+cl_cluster_node_circuit_allow(cl_cluster_node* cn, bool* p_probe)
+{
+	*p_probe = false;
+
+	if (cf_atomic32_get(cn->asc->runtime_options.circuit_breaker) == 0) {
+		return true;
+	}
+
+	uint32_t circuit = circuit_get(cn);
+
+	if (circuit == CL_CIRCUIT_CLOSED) {
+		return true;
+	}
+
+	if (circuit == CL_CIRCUIT_OPEN) {
+		uint32_t now = (uint32_t)cf_getms();
+		uint32_t opened = (uint32_t)cf_atomic32_get(cn->circuit_opened_ms);
+
+		if (now - opened < CL_CIRCUIT_COOL_MS) {
+			return false;
+		}
+
+		// Only whoever restarts the clock - which then times the probes -
+		// resets the probe successes and goes half-open.
+		if ((uint32_t)cf_atomic32_cas(&cn->circuit_opened_ms, opened, now) ==
+				opened) {
+			cf_atomic32_set(&cn->n_probe_successes, 0);
+			cf_atomic32_cas(&cn->circuit, CL_CIRCUIT_OPEN, CL_CIRCUIT_HALF_OPEN);
+		}
+
+		circuit = cf_atomic32_get(cn->circuit);
+
+		if (circuit != CL_CIRCUIT_HALF_OPEN) {
+			return circuit == CL_CIRCUIT_CLOSED;
+		}
+	}
+
+	if ((uint32_t)cf_atomic32_incr(&cn->n_probes) > CL_CIRCUIT_PROBES) {
+		cf_atomic32_decr(&cn->n_probes);
+		return false;
+	}
+
+	*p_probe = true;
+
+	return true;
+}
+
+// A probe is done with this node - succeeded, failed, or dropped.
+void
+cl_cluster_node_probe_done(cl_cluster_node* cn)
+{
+	cf_atomic32_decr(&cn->n_probes);
+}
+
+// Should transactions that have a choice of node avoid this one?
+bool
+cl_cluster_node_circuit_avoid(cl_cluster_node* cn)
+{
+	if (cf_atomic32_get(cn->asc->runtime_options.circuit_breaker) == 0) {
+		return false;
+	}
+
+	uint32_t circuit = circuit_get(cn);
+
+	if (circuit == CL_CIRCUIT_CLOSED) {
+		return false;
+	}
+
+	if (circuit == CL_CIRCUIT_OPEN) {
+		return circuit_cooling(cn);
+	}
+
+	return (uint32_t)cf_atomic32_get(cn->n_probes) >= CL_CIRCUIT_PROBES;
+}
+
+// Lock-free per-thread PRNG (xorshift64*) - rand() takes a global lock.
+static CL_THREAD_LOCAL uint64_t g_rand_state = 0;
+
+static inline uint32_t
+cl_rand32()
+{
+	uint64_t x = g_rand_state;
+
+	if (x == 0) {
+		// Seed from the time and this thread's state address - never 0.
+		x = (cf_getus() << 16) ^ (uint64_t)(uintptr_t)&g_rand_state;
+		x |= 1;
+	}
+
+	x ^= x >> 12;
+	x ^= x << 25;
+	x ^= x >> 27;
+	g_rand_state = x;
+
+	return (uint32_t)((x * 0x2545F4914F6CDD1DULL) >> 32);
+}
 
 bool
 cl_cluster_node_throttle_drop(cl_cluster_node* cn)
@@ -1866,7 +2692,95 @@ cl_cluster_node_throttle_drop(cl_cluster_node* cn)
 		return false;
 	}
 
-	return ((uint32_t)rand() % 100) < throttle_pct;
+	return cl_rand32() % 100 < throttle_pct;
+}
+
+// Current limit, in transactions.
+static inline uint32_t
+node_limit_get(cl_cluster_node* cn, uint32_t limit_max)
+{
+	uint32_t limit = (uint32_t)cf_atomic32_get(cn->limit) >> CL_LIMIT_SHIFT;
+
+	// The max may have been lowered since the limit was last changed.
+	return limit == 0 || limit > limit_max ? limit_max : limit;
+}
+
+// Count a transaction in flight on this node - if may_reject is true and the
+// node is at its limit, don't, and return false. (If limit_max is 0, there's
+// no limit.)
+bool
+cl_cluster_node_limit_admit(cl_cluster_node* cn, uint32_t limit_max,
+		bool may_reject)
+{
+	uint32_t n = (uint32_t)cf_atomic32_incr(&cn->n_in_flight);
+
+	if (may_reject && limit_max != 0 && n > node_limit_get(cn, limit_max)) {
+		cf_atomic32_decr(&cn->n_in_flight);
+		return false;
+	}
+
+	return true;
+}
+
+// A transaction counted in flight on this node is done with it - adjust the
+// limit according to signal.
+void
+cl_cluster_node_limit_release(cl_cluster_node* cn, uint32_t limit_max,
+		cl_limit_signal signal)
+{
+	cf_atomic32_decr(&cn->n_in_flight);
+
+	if (limit_max == 0) {
+		// Not limiting.
+		return;
+	}
+
+	uint32_t max_fp = limit_max << CL_LIMIT_SHIFT;
+
+	if (signal == CL_LIMIT_GOOD) {
+		// Additive increase - about one per limit's worth of transactions. If
+		// we lose a race, just skip this increment.
+		uint32_t fp = (uint32_t)cf_atomic32_get(cn->limit);
+
+		if (fp == 0) {
+			// Already at max.
+			return;
+		}
+
+		uint32_t new_fp = fp + (uint32_t)(((uint64_t)CL_LIMIT_ONE << CL_LIMIT_SHIFT) / fp);
+
+		cf_atomic32_cas(&cn->limit, fp, new_fp >= max_fp ? 0 : new_fp);
+	}
+	else if (signal == CL_LIMIT_CONGESTED) {
+		// Multiplicative decrease - a burst of timeouts is one signal, so
+		// only the first in each period cuts.
+		uint32_t now = (uint32_t)cf_getms();
+		uint32_t cut_ms = (uint32_t)cf_atomic32_get(cn->limit_cut_ms);
+
+		if (now - cut_ms < CL_LIMIT_CUT_MS ||
+				(uint32_t)cf_atomic32_cas(&cn->limit_cut_ms, cut_ms, now) != cut_ms) {
+			return;
+		}
+
+		uint32_t fp = (uint32_t)cf_atomic32_get(cn->limit);
+
+		if (fp == 0 || fp > max_fp) {
+			fp = max_fp;
+		}
+
+		uint64_t new_fp = ((uint64_t)fp * CL_LIMIT_CUT_PCT) / 100;
+
+		if (new_fp < (CL_LIMIT_MIN << CL_LIMIT_SHIFT)) {
+			new_fp = CL_LIMIT_MIN << CL_LIMIT_SHIFT;
+		}
+
+		cf_atomic32_set(&cn->limit, (uint32_t)new_fp);
+		cf_atomic_int_incr(&cn->asc->n_limit_cuts);
+
+		cf_debug("node %s concurrency limit cut to %u (%u in flight)", cn->name,
+				(uint32_t)(new_fp >> CL_LIMIT_SHIFT),
+				cf_atomic32_get(cn->n_in_flight));
+	}
 }
 
 
@@ -1907,7 +2821,7 @@ cluster_dump(ev2citrusleaf_cluster *asc)
 		char str[INET_ADDRSTRLEN];
 		inet_ntop(AF_INET, &(sa_in.sin_addr), str, INET_ADDRSTRLEN);
 		cf_debug(" %d %s : %s:%d (%d conns)", i, cn->name, str,
-			(int)ntohs(sa_in.sin_port), cf_queue_sz(cn->conn_q));
+			(int)ntohs(sa_in.sin_port), cf_atomic32_get(cn->n_fds_idle));
 	}
 	MUTEX_UNLOCK(asc->node_v_lock);
 
@@ -1949,37 +2863,34 @@ cluster_ping_node_fn(int return_value, char *values, size_t values_len, void *ud
 
 	cf_atomic_int_incr(&asc->n_ping_successes);
 
-	cf_vector_define(lines_v, sizeof(void *), 0);
-	str_split('\n',values,&lines_v);
-	for (uint32_t i=0;i<cf_vector_size(&lines_v);i++) {
-		char *line = (char*)cf_vector_pointer_get(&lines_v, i);
-		cf_vector_define(pair_v, sizeof(void *), 0);
-		str_split('\t',line, &pair_v);
+	char *pos = values;
+	cl_info_pair pair;
 
-		if (cf_vector_size(&pair_v) == 2) {
-			char *name = (char*)cf_vector_pointer_get(&pair_v, 0);
-			char *value = (char*)cf_vector_pointer_get(&pair_v, 1);
+	while (cl_info_next_pair(&pos, &pair)) {
+		if (pair.id == CL_INFO_NAME_NODE) {
 
-			if (strcmp(name, "node") == 0) {
+			// make sure this host already exists, create & add if not
+			cl_cluster_node *cn = cl_cluster_node_get_byname(asc, pair.value);
+			bool created = false;
+			if (!cn) {
+				cn = cl_cluster_node_create(pair.value /*nodename*/, asc);
+				created = true;
+			}
 
-				// make sure this host already exists, create & add if not
-				cl_cluster_node *cn = cl_cluster_node_get_byname(asc, value);
-				if (!cn) {
-					cn = cl_cluster_node_create(value /*nodename*/, asc);
-				}
+			if (cn) {
+				// add this address to node list
+				cf_vector_append_unique(&cn->sockaddr_in_v,&pnd->sa_in);
 
-				if (cn) {
-					// add this address to node list
-					cf_vector_append_unique(&cn->sockaddr_in_v,&pnd->sa_in);
+				// don't wait for the node timer to open idle sockets
+				if (created) {
+					node_warm_start(cn);
 				}
 			}
-			else if (strcmp(name, "partitions")==0) {
-				asc->n_partitions = atoi(value);
-			}
 		}
-		cf_vector_destroy(&pair_v);
+		else if (pair.id == CL_INFO_NAME_PARTITIONS) {
+			asc->n_partitions = atoi(pair.value);
+		}
 	}
-	cf_vector_destroy(&lines_v);
 
 	if (values) free(values);
 	free(pnd);
@@ -2131,6 +3042,8 @@ int citrusleaf_cluster_init()
 	// I'm going to leave this linked list for the moment; it's good for debugging
 	cf_ll_init(&cluster_ll, 0, false);
 
+	fd_open_ms_init();
+
 	return(0);
 }
 
@@ -2147,6 +3060,8 @@ int citrusleaf_cluster_shutdown()
 		ev2citrusleaf_cluster_destroy(asc);
 	}
 
+	fd_open_ms_free();
+
 	return(0);
 }
 
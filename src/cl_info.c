@@ -58,6 +58,92 @@ info_request_get_network_event(cl_info_request *cir)
 	return( (struct event *) &cir->event_space[0] );
 }
 
+//==========================================================
+// Info response parsing.
+//
+// Responses have the form name1\tvalue1\nname2\tvalue2\n... and are parsed in
+// place, inserting nulls - nothing is allocated. The names we act on all have
+// different lengths, so the length picks the only candidate and one memcmp()
+// confirms it.
+//
+
+static cl_info_name
+info_name_id(const char* name, size_t len)
+{
+	const char* known;
+	cl_info_name id;
+
+	switch (len) {
+	case sizeof("node") - 1:
+		known = "node";
+		id = CL_INFO_NAME_NODE;
+		break;
+	case sizeof("services") - 1:
+		known = "services";
+		id = CL_INFO_NAME_SERVICES;
+		break;
+	case sizeof("partitions") - 1:
+		known = "partitions";
+		id = CL_INFO_NAME_PARTITIONS;
+		break;
+	case sizeof("replicas-all") - 1:
+		known = "replicas-all";
+		id = CL_INFO_NAME_REPLICAS_ALL;
+		break;
+	case sizeof("partition-generation") - 1:
+		known = "partition-generation";
+		id = CL_INFO_NAME_PARTITION_GENERATION;
+		break;
+	default:
+		return CL_INFO_NAME_UNKNOWN;
+	}
+
+	return memcmp(name, known, len) == 0 ? id : CL_INFO_NAME_UNKNOWN;
+}
+
+//
+// Get the next name/value pair, and move *p_pos past it. Returns false when
+// there are no more. Lines with no value are skipped - the server returns a
+// name alone if it has nothing for it.
+//
+bool
+cl_info_next_pair(char** p_pos, cl_info_pair* pair)
+{
+	char* p = *p_pos;
+
+	while (*p) {
+		char* name = p;
+		char* eol = strchr(p, '\n');
+
+		if (eol) {
+			p = eol + 1;
+		}
+		else {
+			eol = p + strlen(p);
+			p = eol;
+		}
+
+		char* tab = (char*)memchr(name, '\t', eol - name);
+
+		if (! tab || tab + 1 == eol) {
+			continue;
+		}
+
+		*tab = 0;
+		*eol = 0;
+
+		pair->id = info_name_id(name, tab - name);
+		pair->name = name;
+		pair->value = tab + 1;
+
+		*p_pos = p;
+		return true;
+	}
+
+	*p_pos = p;
+	return false;
+}
+
 /*
 ** when you expect a single result back, info result into just that string
 */
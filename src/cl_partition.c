@@ -9,6 +9,7 @@
  * All rights reserved
  */
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -22,53 +23,331 @@
 
 
 
+//==========================================================
+// Partition map snapshots.
+//
+// Transaction threads read a namespace's current snapshot without locks. To
+// do so, a thread counts itself in its stripe's readers around the read (and
+// its node reserve). An update builds a new snapshot, swaps it in, and puts
+// the old one on the retired list. Any thread that could have the old one
+// was counted in its stripe before the swap, so once each stripe has been
+// seen with no readers since the swap, the old snapshot can be freed.
+//
+
+static cf_atomic32 g_pmap_reader_stripe_counter = 0;
+
+// Starts at 0 meaning not yet assigned.
+static CL_THREAD_LOCAL uint32_t g_pmap_reader_stripe = 0;
+
+static inline uint32_t
+pmap_reader_stripe()
+{
+	if (g_pmap_reader_stripe == 0) {
+		g_pmap_reader_stripe =
+				(uint32_t)cf_atomic32_incr(&g_pmap_reader_stripe_counter);
+	}
+
+	return g_pmap_reader_stripe % CL_PMAP_READER_STRIPES;
+}
+
+// Start reading a snapshot. The atomic increment is a full barrier, so the
+// snapshot pointer is loaded after we're counted.
+static inline cf_atomic32*
+pmap_read_begin(ev2citrusleaf_cluster* asc)
+{
+	cf_atomic32* p_n = &asc->pmap_readers[pmap_reader_stripe()].n;
+
+	cf_atomic32_incr(p_n);
+
+	return p_n;
+}
+
+static inline void
+pmap_read_end(cf_atomic32* p_n)
+{
+	cf_atomic32_decr(p_n);
+}
+
+static inline cl_partition_map*
+pmap_get(cl_partition_table* pt)
+{
+	return (cl_partition_map*)cf_atomic_p_get(pt->map);
+}
+
+// Make an unpublished copy of a snapshot (or an empty snapshot). It holds no
+// node references until published.
+static cl_partition_map*
+pmap_create(ev2citrusleaf_cluster* asc, const cl_partition_map* from)
+{
+	size_t size = sizeof(cl_partition_map) +
+			(CL_PARTITION_REPLICAS * (size_t)asc->n_partitions);
+	cl_partition_map* map = (cl_partition_map*)malloc(size);
+
+	if (! map) {
+		cf_warn("partition map allocation failed");
+		return NULL;
+	}
+
+	if (from) {
+		memcpy((void*)map, (const void*)from, size);
+		map->version++;
+	}
+	else {
+		memset((void*)map, 0, size);
+		map->n_slots = 1;
+	}
+
+	map->retired_next = NULL;
+	map->busy_stripes = 0;
+
+	return map;
+}
+
+static void
+pmap_release_nodes(cl_partition_map* map)
+{
+	for (uint32_t i = 1; i < map->n_slots; i++) {
+		if (map->slots[i]) {
+			cl_cluster_node_release(map->slots[i], "PS-");
+		}
+	}
+}
+
+// Get a node's slot index in an unpublished snapshot, adding the node if
+// add is set. Returns 0 if the node isn't there (or there's no room).
+static uint8_t
+pmap_slot(cl_partition_map* map, cl_cluster_node* node, bool add)
+{
+	uint32_t free_slot = 0;
+
+	for (uint32_t i = 1; i < map->n_slots; i++) {
+		if (map->slots[i] == node) {
+			return (uint8_t)i;
+		}
+
+		if (! map->slots[i] && free_slot == 0) {
+			free_slot = i;
+		}
+	}
+
+	if (! add) {
+		return 0;
+	}
+
+	if (free_slot == 0) {
+		if (map->n_slots == CL_PARTITION_MAP_SLOTS) {
+			cf_warn("partition map full - can't add node %s", node->name);
+			return 0;
+		}
+
+		free_slot = map->n_slots++;
+	}
+
+	map->slots[free_slot] = node;
+
+	return (uint8_t)free_slot;
+}
+
+// Empty the slots of nodes no partition refers to any more.
+static void
+pmap_trim_slots(ev2citrusleaf_cluster* asc, cl_partition_map* map)
+{
+	bool used[CL_PARTITION_MAP_SLOTS] = { false };
+	size_t n_replicas = CL_PARTITION_REPLICAS * (size_t)asc->n_partitions;
+
+	for (size_t i = 0; i < n_replicas; i++) {
+		used[map->replicas[i]] = true;
+	}
+
+	for (uint32_t i = 1; i < map->n_slots; i++) {
+		if (! used[i]) {
+			map->slots[i] = NULL;
+		}
+	}
+
+	while (map->n_slots > 1 && ! map->slots[map->n_slots - 1]) {
+		map->n_slots--;
+	}
+}
+
+// Make a new snapshot current - it takes references to its nodes, and the
+// one it replaces is retired.
+static void
+pmap_publish(ev2citrusleaf_cluster* asc, cl_partition_table* pt,
+		cl_partition_map* map)
+{
+	pmap_trim_slots(asc, map);
+
+	for (uint32_t i = 1; i < map->n_slots; i++) {
+		if (map->slots[i]) {
+			cl_cluster_node_reserve(map->slots[i], "PS+");
+		}
+	}
+
+	cl_partition_map* old = pmap_get(pt);
+
+	// Make sure the snapshot is filled in before it's visible.
+	CL_COMPILER_BARRIER();
+	cf_atomic_p_set(&pt->map, (cf_atomic_p)map);
+
+	// Make sure the swap is visible before reclaim checks the readers.
+	smb_mb();
+
+	pt->was_dumped = false;
+
+	if (old) {
+		old->busy_stripes = (uint32_t)-1;
+		old->retired_next = asc->pmap_retired;
+		asc->pmap_retired = old;
+	}
+
+	cl_partition_table_reclaim(asc);
+}
+
+// Free retired snapshots no thread can be reading. Called on publishing, and
+// every cluster tend, so readers never hold up an update.
+void
+cl_partition_table_reclaim(ev2citrusleaf_cluster* asc)
+{
+	if (! asc->pmap_retired) {
+		return;
+	}
+
+	uint32_t idle_stripes = 0;
+
+	for (uint32_t s = 0; s < CL_PMAP_READER_STRIPES; s++) {
+		if (cf_atomic32_get(asc->pmap_readers[s].n) == 0) {
+			idle_stripes |= 1u << s;
+		}
+	}
+
+	cl_partition_map** pp = &asc->pmap_retired;
+
+	while (*pp) {
+		cl_partition_map* map = *pp;
+
+		map->busy_stripes &= ~idle_stripes;
+
+		if (map->busy_stripes != 0) {
+			pp = &map->retired_next;
+			continue;
+		}
+
+		*pp = map->retired_next;
+		pmap_release_nodes(map);
+		free(map);
+	}
+}
+
+//
+// END - Partition map snapshots.
+//==========================================================
+
+
+//==========================================================
+// Node ownership - what each node's last applied replicas-all said, so an
+// update need only apply partitions whose ownership changed.
+//
+
+static inline size_t
+bitmap_size(ev2citrusleaf_cluster* asc)
+{
+	return ((size_t)asc->n_partitions + 7) / 8;
+}
+
+static cl_node_ownership*
+ownership_get(cl_cluster_node* node, const char* ns)
+{
+	cl_node_ownership* own = node->ownership;
+
+	while (own) {
+		if (strcmp(ns, own->ns) == 0) {
+			return own;
+		}
+
+		own = own->next;
+	}
+
+	size_t size = sizeof(cl_node_ownership) +
+			(CL_PARTITION_REPLICAS * bitmap_size(node->asc));
+
+	if (! (own = (cl_node_ownership*)malloc(size))) {
+		cf_warn("node ownership allocation failed");
+		return NULL;
+	}
+
+	memset((void*)own, 0, size);
+	strcpy(own->ns, ns);
+
+	own->next = node->ownership;
+	node->ownership = own;
+
+	return own;
+}
+
+// The node's ownership no longer matches the partition table - make its next
+// updates apply every partition.
+static void
+ownership_invalidate(cl_cluster_node* node)
+{
+	for (cl_node_ownership* own = node->ownership; own; own = own->next) {
+		own->valid = false;
+	}
+}
+
+// When the node is destroyed.
+void
+cl_partition_table_ownership_free(cl_cluster_node* node)
+{
+	while (node->ownership) {
+		cl_node_ownership* own = node->ownership;
+
+		node->ownership = own->next;
+		free(own);
+	}
+}
+
+//
+// END - Node ownership.
+//==========================================================
+
+
 cl_partition_table*
 cl_partition_table_create(ev2citrusleaf_cluster* asc, const char* ns)
 {
-	int n_partitions = (int)asc->n_partitions;
-	size_t size = sizeof(cl_partition_table) +
-			(sizeof(cl_partition) * n_partitions);
-	cl_partition_table* pt = (cl_partition_table*)malloc(size);
+	cl_partition_table* pt =
+			(cl_partition_table*)malloc(sizeof(cl_partition_table));
 
 	if (! pt) {
 		return NULL;
 	}
 
-	memset((void*)pt, 0, size);
+	memset((void*)pt, 0, sizeof(cl_partition_table));
 	strcpy(pt->ns, ns);
 
 	pt->next = asc->partition_table_head;
-	asc->partition_table_head = pt;
 
-	for (int pid = 0; pid < n_partitions; pid++) {
-		MUTEX_ALLOC(pt->partitions[pid].lock);
-	}
+	// Transaction threads walk the list without locks - make sure the table
+	// is filled in before it's visible.
+	CL_COMPILER_BARRIER();
+	asc->partition_table_head = pt;
 
 	return pt;
 }
 
 
+// Only when the cluster is destroyed - there are no readers.
 void
 cl_partition_table_destroy_all(ev2citrusleaf_cluster* asc)
 {
-	int n_partitions = (int)asc->n_partitions;
 	cl_partition_table* pt = asc->partition_table_head;
 
 	while (pt) {
-		for (int pid = 0; pid < n_partitions; pid++) {
-			cl_partition* p = &pt->partitions[pid];
-
-			if (p->master) {
-				cl_cluster_node_release(p->master, "PM-");
-				p->master = NULL;
-			}
+		cl_partition_map* map = pmap_get(pt);
 
-			if (p->prole) {
-				cl_cluster_node_release(p->prole, "PP-");
-				p->prole = NULL;
-			}
-
-			MUTEX_FREE(p->lock);
+		if (map) {
+			pmap_release_nodes(map);
+			free(map);
 		}
 
 		cl_partition_table* next = pt->next;
@@ -76,6 +355,16 @@ cl_partition_table_destroy_all(ev2citrusleaf_cluster* asc)
 		free(pt);
 		pt = next;
 	}
+
+	asc->partition_table_head = NULL;
+
+	while (asc->pmap_retired) {
+		cl_partition_map* map = asc->pmap_retired;
+
+		asc->pmap_retired = map->retired_next;
+		pmap_release_nodes(map);
+		free(map);
+	}
 }
 
 
@@ -96,51 +385,84 @@ cl_partition_table_get_by_ns(ev2citrusleaf_cluster* asc, const char* ns)
 }
 
 
-bool
-cl_partition_table_is_node_present(cl_cluster_node* node)
+// Keep the nodes' partition counts in step with a replica change in an
+// unpublished snapshot. Every snapshot changed this way gets published.
+static inline void
+count_replica(cl_partition_map* map, uint8_t was, uint8_t now, bool master)
 {
-	ev2citrusleaf_cluster* asc = node->asc;
-	int n_partitions = (int)asc->n_partitions;
-	cl_partition_table* pt = asc->partition_table_head;
+	if (was == now) {
+		return;
+	}
 
-	while (pt) {
-		for (int pid = 0; pid < n_partitions; pid++) {
-			cl_partition* p = &pt->partitions[pid];
+	if (was != 0) {
+		if (master) {
+			map->slots[was]->n_master_partitions--;
+		}
+		else {
+			map->slots[was]->n_prole_partitions--;
+		}
+	}
 
-			MUTEX_LOCK(p->lock);
+	if (now != 0) {
+		if (master) {
+			map->slots[now]->n_master_partitions++;
+		}
+		else {
+			map->slots[now]->n_prole_partitions++;
+		}
+	}
+}
 
-			// Assuming a legitimate node must be master of some partitions,
-			// this is all we need to check.
-			if (node == p->master) {
-				MUTEX_UNLOCK(p->lock);
-				return true;
-			}
 
-			MUTEX_UNLOCK(p->lock);
-		}
+bool
+cl_partition_table_is_node_present(cl_cluster_node* node)
+{
+	// Assuming a legitimate node must be master of some partitions, this is
+	// all we need to check.
+	if (node->n_master_partitions != 0) {
+		return true;
+	}
 
-		pt = pt->next;
+	if (node->n_prole_partitions == 0) {
+		return false;
 	}
 
 	// The node is master of no partitions - it's effectively gone from the
 	// cluster. The node shouldn't be present as prole, but it's possible it's
 	// not completely overwritten as prole yet, so just remove it here.
 
-	pt = asc->partition_table_head;
+	ev2citrusleaf_cluster* asc = node->asc;
+	int n_partitions = (int)asc->n_partitions;
+	cl_partition_table* pt = asc->partition_table_head;
+
+	// In the manager thread, which is the only one to change snapshots, so
+	// the current ones need no protection.
 
 	while (pt) {
-		for (int pid = 0; pid < n_partitions; pid++) {
-			cl_partition* p = &pt->partitions[pid];
+		cl_partition_map* map = pmap_get(pt);
+
+		// Only the node's slot need be checked - if it has one, it's a prole.
+		if (map && pmap_slot(map, node, false) != 0) {
+			cl_partition_map* new_map = pmap_create(asc, map);
 
-			MUTEX_LOCK(p->lock);
+			if (new_map) {
+				uint8_t slot = pmap_slot(new_map, node, false);
 
-			if (node == p->prole) {
-				cl_cluster_node_release(node, "PP-");
-				p->prole = NULL;
-				pt->was_dumped = false;
+				for (int pid = 0; pid < n_partitions; pid++) {
+					uint8_t* replicas = cl_partition_map_replicas(new_map, pid);
+
+					for (int r = 1; r < CL_PARTITION_REPLICAS; r++) {
+						if (replicas[r] == slot) {
+							count_replica(new_map, slot, 0, false);
+							replicas[r] = 0;
+						}
+					}
+				}
+
+				pmap_publish(asc, pt, new_map);
 			}
 
-			MUTEX_UNLOCK(p->lock);
+			ownership_invalidate(node);
 		}
 
 		pt = pt->next;
@@ -154,11 +476,57 @@ static inline void
 force_replicas_refresh(cl_cluster_node* node)
 {
 	cf_atomic_int_set(&node->partition_generation, (cf_atomic_int_t)-1);
+
+	// The node must reassert all its ownership, not just what changed.
+	ownership_invalidate(node);
 }
 
+// Apply a node's ownership of a partition - replica is the node's index in the
+// partition's replicas, or -1 if it has none. Returns true if it changed.
+static bool
+apply_ownership(cl_partition_map* map, cl_partition_id pid, uint8_t slot,
+		int replica)
+{
+	uint8_t* replicas = cl_partition_map_replicas(map, pid);
+	uint8_t was[CL_PARTITION_REPLICAS];
+
+	memcpy((void*)was, (const void*)replicas, CL_PARTITION_REPLICAS);
+
+	// Logic is simpler if we remove this node as a replica first.
+	for (int r = 0; r < CL_PARTITION_REPLICAS; r++) {
+		if (replicas[r] == slot) {
+			replicas[r] = 0;
+		}
+	}
+
+	if (replica >= 0) {
+		// This node is the new (or still) replica at this index.
+
+		if (replicas[replica] != 0) {
+			// Replacing another node.
+			force_replicas_refresh(map->slots[replicas[replica]]);
+		}
+
+		replicas[replica] = slot;
+	}
+
+	bool changed = false;
+
+	for (int r = 0; r < CL_PARTITION_REPLICAS; r++) {
+		if (replicas[r] != was[r]) {
+			count_replica(map, was[r], replicas[r], r == 0);
+			changed = true;
+		}
+	}
+
+	return changed;
+}
+
+// Bitmaps are as in replicas-all, CL_PARTITION_REPLICAS of them, master first.
+// Those for replicas the namespace doesn't have must be empty.
 void
-cl_partition_table_update(cl_cluster_node* node, const char* ns, bool* masters,
-		bool* proles)
+cl_partition_table_update(cl_cluster_node* node, const char* ns,
+		const uint8_t** bitmaps)
 {
 	ev2citrusleaf_cluster* asc = node->asc;
 	cl_partition_table* pt = cl_partition_table_get_by_ns(asc, ns);
@@ -171,110 +539,286 @@ cl_partition_table_update(cl_cluster_node* node, const char* ns, bool* masters,
 		}
 	}
 
-	int n_partitions = (int)asc->n_partitions;
+	cl_node_ownership* own = ownership_get(node, ns);
 
-	for (int pid = 0; pid < n_partitions; pid++) {
-		cl_partition* p = &pt->partitions[pid];
+	if (! own) {
+		return;
+	}
 
-		MUTEX_LOCK(p->lock);
+	size_t size = bitmap_size(asc);
+	bool all = ! own->valid || ! pmap_get(pt);
 
-		// Logic is simpler if we remove this node as master and prole first.
-		// (Don't worry, these releases won't cause node destruction.)
+	// Usually nothing has changed for this node.
+	if (! all) {
+		int r = 0;
 
-		if (node == p->master) {
-			cl_cluster_node_release(node, "PM-");
-			p->master = NULL;
+		while (r < CL_PARTITION_REPLICAS &&
+				memcmp(bitmaps[r], own->bitmaps + (r * size), size) == 0) {
+			r++;
 		}
 
-		if (node == p->prole) {
-			cl_cluster_node_release(node, "PP-");
-			p->prole = NULL;
+		if (r == CL_PARTITION_REPLICAS) {
+			return;
 		}
+	}
 
-		if (masters[pid]) {
-			// This node is the new (or still) master for this partition.
+	cl_partition_map* map = pmap_create(asc, pmap_get(pt));
 
-			if (p->master) {
-				// Replacing another master.
-				force_replicas_refresh(p->master);
-				cl_cluster_node_release(p->master, "PM-");
-			}
+	if (! map) {
+		return;
+	}
+
+	uint8_t slot = pmap_slot(map, node, true);
+
+	if (slot == 0) {
+		free(map);
+		return;
+	}
+
+	int n_partitions = (int)asc->n_partitions;
+	bool changed = false;
+
+	for (size_t b = 0; b < size; b++) {
+		uint8_t diff = all ? 0xFF : 0;
 
-			p->master = node;
-			cl_cluster_node_reserve(node, "PM+");
+		for (int r = 0; ! all && r < CL_PARTITION_REPLICAS; r++) {
+			diff |= bitmaps[r][b] ^ own->bitmaps[(r * size) + b];
 		}
-		else if (proles[pid]) {
-			// This node is the new (or still) prole for this partition.
 
-			if (p->prole) {
-				// Replacing another prole.
-				force_replicas_refresh(p->prole);
-				cl_cluster_node_release(p->prole, "PP-");
+		for (int k = 0; diff != 0 && k < 8; k++) {
+			uint8_t bit = 0x80 >> k;
+			int pid = ((int)b * 8) + k;
+
+			if ((diff & bit) == 0 || pid >= n_partitions) {
+				continue;
+			}
+
+			int replica = 0;
+
+			while (replica < CL_PARTITION_REPLICAS &&
+					(bitmaps[replica][b] & bit) == 0) {
+				replica++;
 			}
 
-			p->prole = node;
-			cl_cluster_node_reserve(node, "PP+");
+			if (apply_ownership(map, (cl_partition_id)pid, slot,
+					replica < CL_PARTITION_REPLICAS ? replica : -1)) {
+				changed = true;
+			}
 		}
+	}
 
-		MUTEX_UNLOCK(p->lock);
+	for (int r = 0; r < CL_PARTITION_REPLICAS; r++) {
+		memcpy(own->bitmaps + (r * size), bitmaps[r], size);
 	}
 
-	// Just assume something changed...
-	pt->was_dumped = false;
+	own->valid = true;
+
+	if (! changed && pmap_get(pt)) {
+		free(map);
+		return;
+	}
+
+	pmap_publish(asc, pt, map);
 }
 
 
 static cf_atomic32 g_randomizer = 0;
 
-cl_cluster_node*
-cl_partition_table_get(ev2citrusleaf_cluster* asc, const char* ns,
-		cl_partition_id pid, bool write)
+// When choosing by lowest latency, pick at random one time in this many, so
+// slower nodes' latencies are kept up to date. Must be a power of 2.
+#define READ_REPLICA_EXPLORE 32
+
+// Keep only the candidates whose bits are set in keep - unless that's none of
+// them, in which case keep them all.
+static inline uint32_t
+read_replicas_narrow(cl_cluster_node** nodes, uint32_t n_nodes, uint32_t keep)
 {
-	cl_partition_table* pt = cl_partition_table_get_by_ns(asc, ns);
+	if (keep == 0) {
+		return n_nodes;
+	}
 
-	if (! pt) {
-		return NULL;
+	uint32_t n = 0;
+
+	for (uint32_t i = 0; i < n_nodes; i++) {
+		if ((keep & (1u << i)) != 0) {
+			nodes[n++] = nodes[i];
+		}
 	}
 
-	cl_cluster_node* node;
-	cl_partition* p = &pt->partitions[pid];
+	return n;
+}
 
-	MUTEX_LOCK(p->lock);
+// Choose which of a partition's replicas a read goes to. Returns NULL if the
+// partition has none.
+static cl_cluster_node*
+read_replica_choose(ev2citrusleaf_cluster* asc, cl_partition_map* map,
+		const uint8_t* replicas)
+{
+	cl_cluster_node* nodes[CL_PARTITION_REPLICAS];
+	uint32_t n_nodes = 0;
 
-	if (write || cf_atomic32_get(asc->runtime_options.read_master_only) != 0 ||
-			! p->prole) {
-		node = p->master;
+	for (int r = 0; r < CL_PARTITION_REPLICAS; r++) {
+		if (replicas[r] != 0) {
+			nodes[n_nodes++] = map->slots[replicas[r]];
+		}
 	}
-	else if (! p->master) {
-		node = p->prole;
+
+	if (n_nodes <= 1) {
+		return n_nodes == 0 ? NULL : nodes[0];
 	}
-	else {
-		uint32_t master_throttle = cf_atomic32_get(p->master->throttle_pct);
-		uint32_t prole_throttle = cf_atomic32_get(p->prole->throttle_pct);
 
-		if (master_throttle == 0 && prole_throttle != 0) {
-			node = p->master;
+	// Avoid nodes with open circuits, then nodes being throttled, if others
+	// aren't.
+
+	uint32_t keep = 0;
+
+	for (uint32_t i = 0; i < n_nodes; i++) {
+		if (! cl_cluster_node_circuit_avoid(nodes[i])) {
+			keep |= 1u << i;
 		}
-		else if (prole_throttle == 0 && master_throttle != 0) {
-			node = p->prole;
+	}
+
+	n_nodes = read_replicas_narrow(nodes, n_nodes, keep);
+	keep = 0;
+
+	for (uint32_t i = 0; i < n_nodes; i++) {
+		if (cf_atomic32_get(nodes[i]->throttle_pct) == 0) {
+			keep |= 1u << i;
 		}
-		else {
-			// Both throttling or both ok - roll the dice.
-			uint32_t r = (uint32_t)cf_atomic32_incr(&g_randomizer);
+	}
+
+	n_nodes = read_replicas_narrow(nodes, n_nodes, keep);
+
+	// Then apply the read replica policy.
 
-			node = (r & 1) ? p->master : p->prole;
+	uint32_t r = (uint32_t)cf_atomic32_incr(&g_randomizer);
+	uint32_t start = r % n_nodes;
+	bool by_latency;
+
+	switch (cf_atomic32_get(asc->runtime_options.read_replica_policy)) {
+	case CL_READ_REPLICA_LEAST_LOADED:
+		by_latency = false;
+		break;
+	case CL_READ_REPLICA_LOWEST_LATENCY:
+		if (((r / n_nodes) & (READ_REPLICA_EXPLORE - 1)) == 0) {
+			return nodes[start];
 		}
+
+		by_latency = true;
+		break;
+	default:
+		return nodes[start];
+	}
+
+	// Ties go to the random pick, or the first tied node after it.
+	cl_cluster_node* best = NULL;
+	uint32_t best_value = 0;
+
+	for (uint32_t k = 0; k < n_nodes; k++) {
+		cl_cluster_node* node = nodes[(start + k) % n_nodes];
+		uint32_t value = by_latency ?
+				cf_atomic32_get(node->latency_us) :
+				cf_atomic32_get(node->n_in_flight);
+
+		if (! best || value < best_value) {
+			best = node;
+			best_value = value;
+		}
+	}
+
+	return best;
+}
+
+cl_cluster_node*
+cl_partition_table_get(ev2citrusleaf_cluster* asc, cl_partition_table* pt,
+		cl_partition_id pid, bool write)
+{
+	if (! pt) {
+		return NULL;
+	}
+
+	cf_atomic32* p_readers = pmap_read_begin(asc);
+	cl_partition_map* map = pmap_get(pt);
+
+	if (! map) {
+		pmap_read_end(p_readers);
+		return NULL;
+	}
+
+	cl_cluster_node* node;
+	const uint8_t* replicas = cl_partition_map_replicas(map, pid);
+
+	if (write || cf_atomic32_get(asc->runtime_options.read_master_only) != 0 ||
+			cf_atomic32_get(asc->runtime_options.read_replica_policy) ==
+					CL_READ_REPLICA_MASTER_ONLY) {
+		node = map->slots[replicas[0]];
+	}
+	else {
+		node = read_replica_choose(asc, map, replicas);
 	}
 
 	if (node) {
 		cl_cluster_node_reserve(node, "T+");
 	}
 
-	MUTEX_UNLOCK(p->lock);
+	pmap_read_end(p_readers);
 
 	return node;
 }
 
+// Get the partition's next replica after the specified node, walking the
+// replicas in order and wrapping around, for a hedged or retried read. If the
+// node isn't a replica (the partition has moved) start at the master. Nodes
+// being avoided are skipped. Returns NULL if there's no other replica.
+cl_cluster_node*
+cl_partition_table_get_other(ev2citrusleaf_cluster* asc,
+		cl_partition_table* pt, cl_partition_id pid,
+		const cl_cluster_node* node)
+{
+	if (! pt) {
+		return NULL;
+	}
+
+	cf_atomic32* p_readers = pmap_read_begin(asc);
+	cl_partition_map* map = pmap_get(pt);
+
+	if (! map) {
+		pmap_read_end(p_readers);
+		return NULL;
+	}
+
+	const uint8_t* replicas = cl_partition_map_replicas(map, pid);
+	int start = 0;
+
+	for (int r = 0; r < CL_PARTITION_REPLICAS; r++) {
+		if (replicas[r] != 0 && map->slots[replicas[r]] == node) {
+			start = r + 1;
+			break;
+		}
+	}
+
+	cl_cluster_node* other = NULL;
+
+	for (int k = 0; k < CL_PARTITION_REPLICAS; k++) {
+		cl_cluster_node* candidate =
+				map->slots[replicas[(start + k) % CL_PARTITION_REPLICAS]];
+
+		if (candidate && candidate != node &&
+				! cl_cluster_node_circuit_avoid(candidate)) {
+			other = candidate;
+			break;
+		}
+	}
+
+	if (other) {
+		cl_cluster_node_reserve(other, "T+");
+	}
+
+	pmap_read_end(p_readers);
+
+	return other;
+}
+
 
 static inline const char*
 safe_node_name(cl_cluster_node* node)
@@ -296,20 +840,104 @@ cl_partition_table_dump(ev2citrusleaf_cluster* asc)
 	}
 
 	while (pt) {
-		cf_debug("--- CLUSTER MAP for %s ---", pt->ns);
+		cl_partition_map* map = pmap_get(pt);
 
-		for (int pid = 0; pid < asc->n_partitions; pid++) {
-			cl_partition* p = &pt->partitions[pid];
+		cf_debug("--- CLUSTER MAP for %s (version %u) ---", pt->ns,
+				map ? map->version : 0);
 
-			MUTEX_LOCK(p->lock);
+		for (int pid = 0; map && pid < asc->n_partitions; pid++) {
+			const uint8_t* replicas = cl_partition_map_replicas(map, pid);
+			char names[CL_PARTITION_REPLICAS * 21];
+			char* p = names;
 
-			cf_debug("%4d: %s %s", pid, safe_node_name(p->master),
-					safe_node_name(p->prole));
+			for (int r = 0; r < CL_PARTITION_REPLICAS; r++) {
+				p += sprintf(p, r == 0 ? "%s" : " %s",
+						safe_node_name(map->slots[replicas[r]]));
+			}
 
-			MUTEX_UNLOCK(p->lock);
+			cf_debug("%4d: %s", pid, names);
 		}
 
 		pt->was_dumped = true;
 		pt = pt->next;
 	}
 }
+
+
+//==========================================================
+// Namespace handles.
+//
+
+// Fill in a handle - interned handles are then only changed to cache the
+// partition table. Returns false if the name is too long.
+bool
+cl_namespace_init(ev2citrusleaf_namespace_handle* nsh,
+		ev2citrusleaf_cluster* asc, const char* ns)
+{
+	size_t ns_len = strlen(ns);
+
+	if (ns_len >= sizeof(nsh->ns)) {
+		cf_warn("namespace %s too long", ns);
+		return false;
+	}
+
+	nsh->next = NULL;
+	nsh->asc = asc;
+	nsh->interned = false;
+
+	memcpy(nsh->ns, ns, ns_len + 1);
+	nsh->ns_len = (int)ns_len;
+
+	cl_msg_field* mf = (cl_msg_field*)nsh->field;
+
+	mf->type = CL_MSG_FIELD_TYPE_NAMESPACE;
+	mf->field_sz = (uint32_t)ns_len + 1;
+	memcpy(mf->data, ns, ns_len);
+	cl_msg_swap_field(mf);
+
+	nsh->field_size = sizeof(cl_msg_field) + ns_len;
+	nsh->pt = 0;
+
+	return true;
+}
+
+// Get the namespace's partition table, or NULL if it doesn't exist yet. An
+// interned handle looks the table up by name only until it exists.
+cl_partition_table*
+cl_namespace_get_table(const ev2citrusleaf_namespace_handle* nsh)
+{
+	cl_partition_table* pt = (cl_partition_table*)cf_atomic_p_get(nsh->pt);
+
+	if (pt) {
+		return pt;
+	}
+
+	pt = cl_partition_table_get_by_ns(nsh->asc, nsh->ns);
+
+	if (pt && nsh->interned) {
+		// Any thread may cache it - they'd all cache the same table.
+		cf_atomic_p_set((cf_atomic_p*)&nsh->pt, (cf_atomic_p)pt);
+	}
+
+	return pt;
+}
+
+// Only when the cluster is destroyed - the app may not use handles any more.
+void
+cl_namespace_destroy_all(ev2citrusleaf_cluster* asc)
+{
+	ev2citrusleaf_namespace_handle* nsh = asc->ns_handles;
+
+	while (nsh) {
+		ev2citrusleaf_namespace_handle* next = nsh->next;
+
+		free(nsh);
+		nsh = next;
+	}
+
+	asc->ns_handles = NULL;
+}
+
+//
+// END - Namespace handles.
+//==========================================================
@@ -0,0 +1,832 @@
+/*
+ * cl_libevent2/src/cl_pipe.c
+ *
+ * Pipelined transactions - many requests in flight on one node socket.
+ *
+ * Citrusleaf, 2013.
+ * All rights reserved.
+ */
+
+
+//==========================================================
+// Includes
+//
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <event2/event.h>
+
+#include "citrusleaf/cf_atomic.h"
+#include "citrusleaf/cf_base_types.h"
+#include "citrusleaf/cf_errno.h"
+#include "citrusleaf/cf_log_internal.h"
+#include "citrusleaf/cf_socket.h"
+#include "citrusleaf/proto.h"
+
+#include "citrusleaf_event2/cl_cluster.h"
+#include "citrusleaf_event2/ev2citrusleaf.h"
+#include "citrusleaf_event2/ev2citrusleaf-internal.h"
+
+
+//==========================================================
+// Constants
+//
+
+// Most iovecs gathered into one writev() call.
+#define PIPE_IOV_MAX 64
+
+// Size of each connection's read-ahead buffer. Response bodies with at least
+// this much left to read are read directly into the request.
+#define PIPE_READ_AHEAD (16 * 1024)
+
+
+//==========================================================
+// cl_pipe_conn Class Header
+//
+
+//------------------------------------------------
+// Function Declarations
+//
+
+static cl_pipe_conn* cl_pipe_conn_create(cl_cluster_node* p_node,
+		struct event_base* base);
+static void cl_pipe_conn_destroy(cl_pipe_conn* _this);
+static void cl_pipe_conn_unlink(cl_pipe_conn* _this);
+static inline struct event* cl_pipe_conn_get_read_event(cl_pipe_conn* _this);
+static inline struct event* cl_pipe_conn_get_write_event(cl_pipe_conn* _this);
+static cl_pipe_conn* cl_pipe_conn_find(cl_cluster_node* p_node,
+		struct event_base* base);
+static bool cl_pipe_conn_add_request(cl_pipe_conn* _this, cl_request* req);
+static void cl_pipe_conn_fail(cl_pipe_conn* _this, cl_request* p_skip_req);
+// The libevent2 event handlers:
+static void cl_pipe_conn_write_event(evutil_socket_t fd, short event,
+		void* pv_this);
+static void cl_pipe_conn_read_event(evutil_socket_t fd, short event,
+		void* pv_this);
+static bool cl_pipe_conn_handle_send(cl_pipe_conn* _this);
+static bool cl_pipe_conn_handle_recv(cl_pipe_conn* _this);
+static bool cl_pipe_conn_consume(cl_pipe_conn* _this, bool* p_idle);
+static bool cl_pipe_conn_complete_head(cl_pipe_conn* _this);
+
+//------------------------------------------------
+// Data
+//
+
+struct cl_pipe_conn_s {
+	// Next connection in the node's list.
+	cl_pipe_conn*				next;
+
+	// The node this connection is to. Not reserved - the node can't go away
+	// while there are requests on the connection since each request reserves
+	// the node, and idle connections are closed when the node is destroyed.
+	cl_cluster_node*			p_node;
+
+	// All events use this base, and the connection is only used in the
+	// thread running the base.
+	struct event_base*			p_event_base;
+
+	// This connection's socket.
+	int							fd;
+
+	// Requests in order sent - responses come back in the same order.
+	cl_request*					p_head_req;
+	cl_request*					p_tail_req;
+	uint32_t					n_reqs;
+
+	// First request in the list not completely sent, if any.
+	cl_request*					p_write_req;
+
+	// Read event is persistent, and added only while there are requests.
+	bool						read_event_added;
+	bool						write_event_added;
+
+	// Set while a request's callback is running. If the connection is
+	// destroyed meanwhile (e.g. the callback's new request fails on it) it's
+	// only closed, and freed once the callback returns.
+	bool						in_callback;
+	bool						closed;
+
+	// Bytes read from the socket but not yet copied to requests - may span
+	// several responses.
+	size_t						ra_pos;
+	size_t						ra_len;
+	uint8_t						ra_buf[PIPE_READ_AHEAD];
+
+	uint8_t						event_space[];
+};
+
+
+//==========================================================
+// Public API (internal to library)
+//
+
+//------------------------------------------------
+// Queue a request on a pipelined connection to
+// its node, opening a new connection if needed.
+// Returns false if the caps are reached or we
+// can't connect - caller should then use the
+// normal one-request-per-socket path.
+//
+bool
+cl_pipe_add(cl_request* req)
+{
+	cl_cluster_node* p_node = req->node;
+	ev2citrusleaf_cluster* asc = p_node->asc;
+
+	cl_pipe_conn* p_conn = cl_pipe_conn_find(p_node, req->base);
+
+	if (! p_conn) {
+		return false;
+	}
+
+	if (! cl_pipe_conn_add_request(p_conn, req)) {
+		cl_pipe_conn_fail(p_conn, req);
+		return false;
+	}
+
+	cf_atomic_int_incr(&asc->n_pipe_requests);
+
+	return true;
+}
+
+//------------------------------------------------
+// A request on a pipelined connection timed out
+// (or is otherwise being failed by its owner).
+// The connection's response stream can't be
+// trusted now, so close it, and retry or fail the
+// connection's other requests.
+//
+void
+cl_pipe_request_abort(cl_request* req)
+{
+	cl_pipe_conn* p_conn = req->pipe;
+
+	if (! p_conn) {
+		return;
+	}
+
+	cl_pipe_conn_fail(p_conn, req);
+}
+
+//------------------------------------------------
+// Close all of a node's pipelined connections.
+// Called when the node is destroyed - there are
+// no requests left, so no events are added.
+//
+void
+cl_pipe_node_destroy(cl_cluster_node* p_node)
+{
+	cl_pipe_conn* p_conn = p_node->pipe_conns;
+
+	while (p_conn) {
+		cl_pipe_conn* p_next = p_conn->next;
+
+		if (p_conn->n_reqs != 0) {
+			// Since we can't assert:
+			cf_error("node %s pipe connection has %u requests on destroy",
+					p_node->name, p_conn->n_reqs);
+		}
+
+		cl_pipe_conn_destroy(p_conn);
+		p_conn = p_next;
+	}
+
+	p_node->pipe_conns = NULL;
+	p_node->n_pipe_conns = 0;
+}
+
+
+//==========================================================
+// cl_pipe_conn Class Function Definitions
+//
+
+//------------------------------------------------
+// Create a cl_pipe_conn object, with a connected
+// (or connecting) socket.
+//
+static cl_pipe_conn*
+cl_pipe_conn_create(cl_cluster_node* p_node, struct event_base* base)
+{
+	int fd = -1;
+
+	while (fd == -1) {
+		fd = cl_cluster_node_fd_get(p_node, false, NULL);
+	}
+
+	if (fd < -1) {
+		return NULL;
+	}
+
+	size_t size = sizeof(cl_pipe_conn) + (2 * event_get_struct_event_size());
+	cl_pipe_conn* _this = (cl_pipe_conn*)malloc(size);
+
+	if (! _this) {
+		cf_error("pipe connection allocation failed");
+		cf_close(fd);
+		cf_atomic32_decr(&p_node->n_fds_open);
+		return NULL;
+	}
+
+	memset((void*)_this, 0, size);
+
+	_this->p_node = p_node;
+	_this->p_event_base = base;
+	_this->fd = fd;
+
+	event_assign(cl_pipe_conn_get_read_event(_this), base, fd,
+			EV_READ | EV_PERSIST, cl_pipe_conn_read_event, _this);
+	event_assign(cl_pipe_conn_get_write_event(_this), base, fd, EV_WRITE,
+			cl_pipe_conn_write_event, _this);
+
+	cf_atomic_int_incr(&p_node->asc->n_pipe_conns_opened);
+
+	return _this;
+}
+
+//------------------------------------------------
+// Destroy a cl_pipe_conn object. The caller must
+// have unlinked it from the node, and dealt with
+// any requests. If we're inside a request callback
+// on this connection, only close it - it's freed
+// when the callback returns.
+//
+static void
+cl_pipe_conn_destroy(cl_pipe_conn* _this)
+{
+	if (_this->read_event_added) {
+		event_del(cl_pipe_conn_get_read_event(_this));
+		_this->read_event_added = false;
+	}
+
+	if (_this->write_event_added) {
+		event_del(cl_pipe_conn_get_write_event(_this));
+		_this->write_event_added = false;
+	}
+
+	cf_close(_this->fd);
+	cf_atomic32_decr(&_this->p_node->n_fds_open);
+
+	if (_this->in_callback) {
+		_this->closed = true;
+		return;
+	}
+
+	free(_this);
+}
+
+//------------------------------------------------
+// Take this connection out of the node's list.
+//
+static void
+cl_pipe_conn_unlink(cl_pipe_conn* _this)
+{
+	cl_cluster_node* p_node = _this->p_node;
+
+	MUTEX_LOCK(p_node->pipe_lock);
+
+	for (cl_pipe_conn** pp = &p_node->pipe_conns; *pp; pp = &(*pp)->next) {
+		if (*pp == _this) {
+			*pp = _this->next;
+			p_node->n_pipe_conns--;
+			break;
+		}
+	}
+
+	MUTEX_UNLOCK(p_node->pipe_lock);
+}
+
+//------------------------------------------------
+// Member access functions.
+//
+static inline struct event*
+cl_pipe_conn_get_read_event(cl_pipe_conn* _this)
+{
+	return (struct event*)_this->event_space;
+}
+
+static inline struct event*
+cl_pipe_conn_get_write_event(cl_pipe_conn* _this)
+{
+	return (struct event*)(_this->event_space + event_get_struct_event_size());
+}
+
+//------------------------------------------------
+// Find the least loaded connection to this node
+// on this base, or make a new one if they're all
+// full and the node's cap allows. The node's
+// lock only covers the list - socket calls are
+// made without it.
+//
+static cl_pipe_conn*
+cl_pipe_conn_find(cl_cluster_node* p_node, struct event_base* base)
+{
+	ev2citrusleaf_cluster* asc = p_node->asc;
+	uint32_t max_conns = cf_atomic32_get(asc->runtime_options.pipeline_max_conns);
+	uint32_t max_depth = cf_atomic32_get(asc->runtime_options.pipeline_max_depth);
+
+	MUTEX_LOCK(p_node->pipe_lock);
+
+	cl_pipe_conn* p_best = NULL;
+
+	// Only this thread touches connections on this base, so it's safe to look
+	// at their request counts - and to keep using the one we pick after
+	// unlocking, since no other thread will destroy it.
+	for (cl_pipe_conn* p_conn = p_node->pipe_conns; p_conn;
+			p_conn = p_conn->next) {
+		if (p_conn->p_event_base == base &&
+				(! p_best || p_conn->n_reqs < p_best->n_reqs)) {
+			p_best = p_conn;
+		}
+	}
+
+	MUTEX_UNLOCK(p_node->pipe_lock);
+
+	if (p_best && p_best->n_reqs == 0 &&
+			ev2citrusleaf_is_connected(p_best->fd) != CONNECTED) {
+		// Idle connection was closed (probably by the server) - ditch it.
+		cl_pipe_conn_unlink(p_best);
+		cl_pipe_conn_destroy(p_best);
+		p_best = NULL;
+	}
+
+	if (p_best && p_best->n_reqs < max_depth) {
+		return p_best;
+	}
+
+	// Reserve a place under the cap before connecting, so threads racing to
+	// open connections can't overshoot it.
+	MUTEX_LOCK(p_node->pipe_lock);
+
+	if (p_node->n_pipe_conns >= max_conns) {
+		MUTEX_UNLOCK(p_node->pipe_lock);
+		return NULL;
+	}
+
+	p_node->n_pipe_conns++;
+
+	MUTEX_UNLOCK(p_node->pipe_lock);
+
+	cl_pipe_conn* p_conn = cl_pipe_conn_create(p_node, base);
+
+	MUTEX_LOCK(p_node->pipe_lock);
+
+	if (p_conn) {
+		p_conn->next = p_node->pipe_conns;
+		p_node->pipe_conns = p_conn;
+	}
+	else {
+		p_node->n_pipe_conns--;
+	}
+
+	MUTEX_UNLOCK(p_node->pipe_lock);
+
+	return p_conn;
+}
+
+//------------------------------------------------
+// Append a request to this connection. It will
+// be sent (with any others added in this event
+// loop iteration) when the socket is writable.
+//
+static bool
+cl_pipe_conn_add_request(cl_pipe_conn* _this, cl_request* req)
+{
+	req->pipe = _this;
+	req->pipe_next = NULL;
+
+	if (_this->p_tail_req) {
+		_this->p_tail_req->pipe_next = req;
+	}
+	else {
+		_this->p_head_req = req;
+	}
+
+	_this->p_tail_req = req;
+	_this->n_reqs++;
+
+	if (! _this->p_write_req) {
+		_this->p_write_req = req;
+	}
+
+	if (! _this->write_event_added) {
+		if (0 != event_add(cl_pipe_conn_get_write_event(_this), 0)) {
+			cf_warn("pipe connection add write event failed");
+			return false;
+		}
+
+		_this->write_event_added = true;
+	}
+
+	if (! _this->read_event_added) {
+		if (0 != event_add(cl_pipe_conn_get_read_event(_this), 0)) {
+			cf_warn("pipe connection add read event failed");
+			return false;
+		}
+
+		_this->read_event_added = true;
+	}
+
+	return true;
+}
+
+//------------------------------------------------
+// Close this connection and take it away from the
+// node. Requests on it (except p_skip_req, which
+// the caller deals with) are retried if that's
+// safe, otherwise completed as failures.
+//
+static void
+cl_pipe_conn_fail(cl_pipe_conn* _this, cl_request* p_skip_req)
+{
+	ev2citrusleaf_cluster* asc = _this->p_node->asc;
+
+	cl_pipe_conn_unlink(_this);
+
+	cl_request* req = _this->p_head_req;
+
+	// In case we're inside a callback and the object outlives this call.
+	_this->p_head_req = NULL;
+	_this->p_tail_req = NULL;
+	_this->p_write_req = NULL;
+	_this->n_reqs = 0;
+
+	cl_pipe_conn_destroy(_this);
+	cf_atomic_int_incr(&asc->n_pipe_conns_failed);
+
+	while (req) {
+		cl_request* p_next = req->pipe_next;
+
+		req->pipe = NULL;
+		req->pipe_next = NULL;
+
+		if (req != p_skip_req) {
+			if (req->pipe_discard) {
+				// Abandoned - nothing to retry.
+				cl_request_discard_done(req, CL_LIMIT_NONE);
+			}
+			else if (req->wpol == CL_WRITE_ONESHOT && req->wr_buf_pos != 0) {
+				cf_info("ev2citrusleaf: write oneshot with network error, terminating now");
+				ev2citrusleaf_request_complete(req, true);
+			}
+			else {
+				req->failed_node = req->node;
+				cl_request_node_done(req, req->node, CL_LIMIT_NONE);
+				cl_cluster_node_put(req->node);
+				req->node = 0;
+
+				cf_atomic_int_incr(&asc->n_internal_retries);
+				ev2citrusleaf_restart(req, false, false);
+			}
+		}
+
+		req = p_next;
+	}
+}
+
+//------------------------------------------------
+// The libevent2 write event callback function.
+//
+static void
+cl_pipe_conn_write_event(evutil_socket_t fd, short event, void* pv_this)
+{
+	cl_pipe_conn* _this = (cl_pipe_conn*)pv_this;
+
+	_this->write_event_added = false;
+
+	if (! cl_pipe_conn_handle_send(_this)) {
+		cl_pipe_conn_fail(_this, NULL);
+		return;
+	}
+
+	if (_this->p_write_req) {
+		// There's more to send, re-add event.
+		if (0 != event_add(cl_pipe_conn_get_write_event(_this), 0)) {
+			cf_error("pipe connection add write event failed");
+			cl_pipe_conn_fail(_this, NULL);
+			return;
+		}
+
+		_this->write_event_added = true;
+	}
+}
+
+//------------------------------------------------
+// The libevent2 (persistent) read event callback
+// function.
+//
+static void
+cl_pipe_conn_read_event(evutil_socket_t fd, short event, void* pv_this)
+{
+	cl_pipe_conn* _this = (cl_pipe_conn*)pv_this;
+
+	if (! cl_pipe_conn_handle_recv(_this)) {
+		cl_pipe_conn_fail(_this, NULL);
+	}
+}
+
+//------------------------------------------------
+// Send as much of the unsent requests as the
+// socket will take, gathering them into as few
+// writev() calls as possible. Returns false on
+// socket error.
+//
+static bool
+cl_pipe_conn_handle_send(cl_pipe_conn* _this)
+{
+	while (_this->p_write_req) {
+		// Loop until everything is sent or we get would-block.
+
+		struct iovec iov[PIPE_IOV_MAX];
+		int n_iov = 0;
+
+		for (cl_request* req = _this->p_write_req;
+				req && n_iov < PIPE_IOV_MAX; req = req->pipe_next) {
+			if (req->wr_iov_n == 0) {
+				iov[n_iov].iov_base = (void*)&req->wr_buf[req->wr_buf_pos];
+				iov[n_iov].iov_len = req->wr_buf_size - req->wr_buf_pos;
+				n_iov++;
+				continue;
+			}
+
+			// Zero-copy request - skip what's already been sent.
+			size_t skip = req->wr_buf_pos;
+
+			for (int i = 0; i < req->wr_iov_n && n_iov < PIPE_IOV_MAX; i++) {
+				if (skip >= req->wr_iov[i].iov_len) {
+					skip -= req->wr_iov[i].iov_len;
+					continue;
+				}
+
+				iov[n_iov].iov_base = (uint8_t*)req->wr_iov[i].iov_base + skip;
+				iov[n_iov].iov_len = req->wr_iov[i].iov_len - skip;
+				n_iov++;
+				skip = 0;
+			}
+		}
+
+		ssize_t rv = writev(_this->fd, iov, n_iov);
+
+		if (rv > 0) {
+			size_t sent = (size_t)rv;
+
+			// Move the write position past what was sent.
+			while (sent != 0) {
+				cl_request* req = _this->p_write_req;
+				size_t left = req->wr_buf_size - req->wr_buf_pos;
+
+				if (sent < left) {
+					req->wr_buf_pos += sent;
+					break;
+				}
+
+				req->wr_buf_pos = req->wr_buf_size;
+				sent -= left;
+				_this->p_write_req = req->pipe_next;
+			}
+
+			// Loop, send what's left.
+		}
+		else if (rv == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+			cf_debug("pipe writev failed: fd %d rv %zd errno %d", _this->fd,
+					rv, errno);
+			return false;
+		}
+		else {
+			// Got would-block.
+			break;
+		}
+	}
+
+	return true;
+}
+
+//------------------------------------------------
+// Read responses and complete the requests they
+// belong to, in order. Reads go into the read-
+// ahead buffer so one recv() can pick up several
+// small responses. Returns false on socket error,
+// or if we get a response we don't expect.
+//
+static bool
+cl_pipe_conn_handle_recv(cl_pipe_conn* _this)
+{
+	bool first = true;
+
+	while (true) {
+		// Loop until everything is read from socket or we get would-block.
+
+		cl_request* req = _this->p_head_req;
+
+		if (! first && (! req || req == _this->p_write_req)) {
+			// Nothing more should come back until the next request is sent.
+			break;
+		}
+
+		first = false;
+
+		int rv;
+		bool drained;
+
+		if (req && req != _this->p_write_req &&
+				req->rd_header_pos == sizeof(cl_proto) &&
+				req->rd_buf_size - req->rd_buf_pos >= PIPE_READ_AHEAD) {
+			// Big body - read it directly, skipping the read-ahead buffer.
+			size_t want = req->rd_buf_size - req->rd_buf_pos;
+
+			rv = recv(_this->fd,
+					(cf_socket_data_t*)&req->rd_buf[req->rd_buf_pos],
+					(cf_socket_size_t)want, MSG_DONTWAIT | MSG_NOSIGNAL);
+			cf_atomic_int_incr(&_this->p_node->asc->n_recv_calls);
+
+			if (rv > 0) {
+				req->rd_buf_pos += rv;
+
+				if (req->rd_buf_pos == req->rd_buf_size &&
+						! cl_pipe_conn_complete_head(_this)) {
+					// Connection went idle - don't touch it again.
+					return true;
+				}
+
+				if ((size_t)rv < want) {
+					break;
+				}
+
+				// Loop, read next response.
+				continue;
+			}
+		}
+		else {
+			rv = recv(_this->fd, (cf_socket_data_t*)_this->ra_buf,
+					(cf_socket_size_t)PIPE_READ_AHEAD,
+					MSG_DONTWAIT | MSG_NOSIGNAL);
+			cf_atomic_int_incr(&_this->p_node->asc->n_recv_calls);
+
+			if (rv > 0) {
+				_this->ra_pos = 0;
+				_this->ra_len = (size_t)rv;
+
+				// If the socket gave us less than we asked for, don't bother
+				// trying again until the next event.
+				drained = (size_t)rv < PIPE_READ_AHEAD;
+
+				bool idle = false;
+
+				if (! cl_pipe_conn_consume(_this, &idle)) {
+					return false;
+				}
+
+				if (idle || drained) {
+					return true;
+				}
+
+				// Loop, read more.
+				continue;
+			}
+		}
+
+		if (rv == 0) {
+			// Connection has been closed by the server.
+			cf_debug("pipe recv connection closed: fd %d", _this->fd);
+			return false;
+		}
+
+		if (errno != EAGAIN && errno != EWOULDBLOCK) {
+			cf_debug("pipe recv failed: rv %d errno %d", rv, errno);
+			return false;
+		}
+
+		// Got would-block.
+		break;
+	}
+
+	return true;
+}
+
+//------------------------------------------------
+// Copy everything in the read-ahead buffer into
+// the waiting requests, completing them as their
+// responses fill. Returns false if the data is
+// not expected. Sets *p_idle if the connection
+// went idle or was closed, in which case the
+// caller must not touch the connection again.
+//
+static bool
+cl_pipe_conn_consume(cl_pipe_conn* _this, bool* p_idle)
+{
+	while (_this->ra_pos < _this->ra_len) {
+		cl_request* req = _this->p_head_req;
+
+		if (! req || req == _this->p_write_req) {
+			// Nothing should come back until the next request is sent.
+			cf_warn("pipe connection read with no request waiting");
+			return false;
+		}
+
+		const uint8_t* p_read = _this->ra_buf + _this->ra_pos;
+		size_t avail = _this->ra_len - _this->ra_pos;
+		size_t n;
+
+		if (req->rd_header_pos < sizeof(cl_proto)) {
+			// Proto header goes at the start of rd_tmp.
+			n = sizeof(cl_proto) - req->rd_header_pos;
+			n = n < avail ? n : avail;
+
+			memcpy(&req->rd_tmp[req->rd_header_pos], p_read, n);
+			req->rd_header_pos += n;
+			_this->ra_pos += n;
+
+			if (req->rd_header_pos < sizeof(cl_proto)) {
+				continue;
+			}
+
+			if (! cl_request_rd_buf_init(req)) {
+				return false;
+			}
+		}
+		else {
+			n = req->rd_buf_size - req->rd_buf_pos;
+			n = n < avail ? n : avail;
+
+			memcpy(&req->rd_buf[req->rd_buf_pos], p_read, n);
+			req->rd_buf_pos += n;
+			_this->ra_pos += n;
+		}
+
+		if (req->rd_buf_pos == req->rd_buf_size &&
+				! cl_pipe_conn_complete_head(_this)) {
+			*p_idle = true;
+			return true;
+		}
+	}
+
+	return true;
+}
+
+//------------------------------------------------
+// The head request's response is all in - take
+// the request off the list and complete it.
+// Returns false if that left the connection idle
+// or closed it, in which case the caller must not
+// touch the connection again, since the callback
+// may have reused it.
+//
+static bool
+cl_pipe_conn_complete_head(cl_pipe_conn* _this)
+{
+	cl_request* req = _this->p_head_req;
+
+	_this->p_head_req = req->pipe_next;
+	_this->n_reqs--;
+
+	if (! _this->p_head_req) {
+		_this->p_tail_req = NULL;
+	}
+
+	req->pipe = NULL;
+	req->pipe_next = NULL;
+
+	bool idle = _this->n_reqs == 0;
+
+	if (idle) {
+		event_del(cl_pipe_conn_get_read_event(_this));
+		_this->read_event_added = false;
+
+		if (_this->ra_pos != _this->ra_len) {
+			// We read past the last response - the stream is garbage.
+			cf_warn("pipe connection read %zu bytes with no request waiting",
+					_this->ra_len - _this->ra_pos);
+			cl_pipe_conn_fail(_this, NULL);
+
+			if (req->pipe_discard) {
+				cl_request_discard_done(req, CL_LIMIT_GOOD);
+			}
+			else {
+				ev2citrusleaf_request_complete(req, false); // frees the req
+			}
+
+			return false;
+		}
+	}
+
+	if (req->pipe_discard) {
+		// The request was abandoned (a hedge won) - drop the response.
+		cf_atomic_int_incr(&_this->p_node->asc->n_pipe_discards);
+		cl_request_discard_done(req, CL_LIMIT_GOOD);
+		return ! idle;
+	}
+
+	// The callback may queue a request that fails on this connection - if so
+	// the connection is only closed, and we free it here.
+	_this->in_callback = true;
+	ev2citrusleaf_request_complete(req, false); // frees the req
+	_this->in_callback = false;
+
+	if (_this->closed) {
+		free(_this);
+		return false;
+	}
+
+	return ! idle;
+}
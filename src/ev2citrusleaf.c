@@ -27,6 +27,7 @@
 #include "citrusleaf/cf_ll.h"
 #include "citrusleaf/cf_log_internal.h"
 #include "citrusleaf/cf_queue.h"
+#include "citrusleaf/cf_ripemd160.h"
 #include "citrusleaf/cf_socket.h"
 #include "citrusleaf/cf_vector.h"
 #include "citrusleaf/proto.h"
@@ -191,6 +192,51 @@ ev2citrusleaf_bins_free(ev2citrusleaf_bin *bins, int n_bins) {
 	return;
 }
 
+int
+ev2citrusleaf_bins_copy(ev2citrusleaf_bin *dst, const ev2citrusleaf_bin *src, int n_bins)
+{
+	for (int i = 0; i < n_bins; i++) {
+		const ev2citrusleaf_object *so = &src[i].object;
+		ev2citrusleaf_object *o = &dst[i].object;
+
+		memcpy(dst[i].bin_name, src[i].bin_name, sizeof(dst[i].bin_name));
+		*o = *so;
+		o->free = 0;
+
+		switch (so->type) {
+			case CL_STR:
+				// Borrowed strings aren't null-terminated - add one.
+				o->free = o->u.str = (char*)malloc(so->size + 1);
+				if (! o->free) break;
+				memcpy(o->u.str, so->u.str, so->size);
+				o->u.str[so->size] = 0;
+				break;
+
+			case CL_BLOB:
+			case CL_JAVA_BLOB:
+			case CL_CSHARP_BLOB:
+			case CL_PYTHON_BLOB:
+			case CL_RUBY_BLOB:
+				o->free = o->u.blob = malloc(so->size ? so->size : 1);
+				if (! o->free) break;
+				memcpy(o->u.blob, so->u.blob, so->size);
+				break;
+
+			default:
+				// Value is in the object itself.
+				continue;
+		}
+
+		if (! o->free) {
+			cf_error("bins copy: malloc fail");
+			ev2citrusleaf_bins_free(dst, i);
+			return(-1);
+		}
+	}
+
+	return(0);
+}
+
 
 //
 // Debug calls for printing the buffers. Very useful for debugging....
@@ -230,7 +276,7 @@ dump_buf(char *info, uint8_t *buf, size_t buf_len)
 //
 // Forward reference
 //
-bool ev2citrusleaf_restart(cl_request* req, bool may_throttle);
+bool ev2citrusleaf_restart(cl_request* req, bool may_throttle, bool first_try);
 
 
 //
@@ -267,20 +313,328 @@ cl_write_header(uint8_t* buf, size_t msg_size, int info1, int info2,
 // cl_request
 //
 
+// Free cl_request objects are cached per thread, so the allocation is normally
+// a pop off a list this thread alone touches. A thread whose pool is full
+// hands freed requests to a shared stack kept per event base instead, and a
+// thread whose pool is empty takes that base's whole stack in one go. In the
+// cross-threaded model app threads allocate and base threads free, so this is
+// how requests get back to the app threads.
+
+// Default maximum number of free cl_request objects cached per thread, and per
+// event base shared stack.
+#define CL_REQUEST_POOL_MAX_DEFAULT 128
+
+// Number of event bases that can have shared stacks. Once all are claimed, a
+// new base takes over the stack of a base unused for CL_REQUEST_POOL_IDLE_MS -
+// pooled requests aren't tied to a base, so whatever is on it is still good.
+// If none is idle, requests on the new base are just freed when the freeing
+// thread's pool is full, and counted in req_pool_no_stack.
+#define CL_REQUEST_POOL_N_BASES 64
+#define CL_REQUEST_POOL_IDLE_MS 10000
+
+// Pooled requests are chained through their first bytes - this also clobbers
+// MAGIC, so stale events on a pooled request are caught as usual.
+typedef struct cl_request_pool_elem_s {
+	struct cl_request_pool_elem_s* next;
+} cl_request_pool_elem;
+
+// Only this thread writes its pool - the stats dump reads n_free and n_hits
+// from other threads, through the list of registered pools.
+typedef struct cl_request_pool_s {
+	cl_request_pool_elem*	head;
+	uint32_t				n_free;
+	bool					key_set;
+	uint64_t				n_hits;
+	struct cl_request_pool_s*	next;
+	struct cl_request_pool_s*	prev;
+} cl_request_pool;
+
+// Requests are only ever pushed one at a time or taken all at once, so a
+// plain compare-and-swap on the head is safe from ABA.
+typedef struct cl_request_pool_shared_s {
+	cf_atomic_p		base;		// struct event_base*, 0 if entry unused
+	cf_atomic_p		head;		// cl_request_pool_elem*
+	cf_atomic32		n_free;
+	cf_atomic32		used_ms;	// when last pushed to or taken from
+} __attribute__ ((aligned(64))) cl_request_pool_shared;
+
+static CL_THREAD_LOCAL cl_request_pool g_request_pool = { NULL, 0, false, 0, NULL, NULL };
+
+// Registered thread pools, for stats, and hits of pools whose threads exited.
+static cl_request_pool* g_request_pools = NULL;
+static pthread_mutex_t g_request_pools_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t g_request_pools_exited_hits = 0;
+
+static cl_request_pool_shared g_request_pool_shared[CL_REQUEST_POOL_N_BASES];
+
+static cf_atomic32 g_request_pool_max = CL_REQUEST_POOL_MAX_DEFAULT;
+
+static pthread_key_t g_request_pool_key;
+static pthread_once_t g_request_pool_key_once = PTHREAD_ONCE_INIT;
+
+static inline size_t
+cl_request_size()
+{
+	return sizeof(cl_request) + (3 * event_get_struct_event_size());
+}
+
+static void
+request_pool_list_free(cl_request_pool_elem* e)
+{
+	while (e) {
+		cl_request_pool_elem* next = e->next;
+
+		free(e);
+		cf_atomic_int_incr(&g_cl_stats.req_pool_frees);
+		e = next;
+	}
+}
+
+// Called on thread exit, frees anything left in that thread's pool.
+static void
+request_pool_thread_exit(void* pv_pool)
+{
+	cl_request_pool* pool = (cl_request_pool*)pv_pool;
+
+	pthread_mutex_lock(&g_request_pools_lock);
+
+	if (pool->prev) {
+		pool->prev->next = pool->next;
+	}
+	else {
+		g_request_pools = pool->next;
+	}
+
+	if (pool->next) {
+		pool->next->prev = pool->prev;
+	}
+
+	g_request_pools_exited_hits += pool->n_hits;
+	pool->n_free = 0;
+
+	pthread_mutex_unlock(&g_request_pools_lock);
+
+	request_pool_list_free(pool->head);
+	pool->head = NULL;
+}
+
+static void
+request_pool_key_create()
+{
+	pthread_key_create(&g_request_pool_key, request_pool_thread_exit);
+}
+
+// Make sure this thread's pool is freed when the thread exits, and counted
+// in stats until then.
+static inline void
+request_pool_register(cl_request_pool* pool)
+{
+	if (! pool->key_set) {
+		pthread_once(&g_request_pool_key_once, request_pool_key_create);
+		pthread_setspecific(g_request_pool_key, pool);
+		pool->key_set = true;
+
+		pthread_mutex_lock(&g_request_pools_lock);
+
+		pool->prev = NULL;
+		pool->next = g_request_pools;
+
+		if (g_request_pools) {
+			g_request_pools->prev = pool;
+		}
+
+		g_request_pools = pool;
+
+		pthread_mutex_unlock(&g_request_pools_lock);
+	}
+}
+
+// Pool hits, and bytes held in thread pools and shared stacks. Reads other
+// threads' counts without synchronizing - good enough for stats.
+static void
+request_pool_stats(uint64_t* p_hits, uint64_t* p_bytes_held)
+{
+	uint64_t n_hits = 0;
+	uint64_t n_held = 0;
+
+	pthread_mutex_lock(&g_request_pools_lock);
+
+	n_hits = g_request_pools_exited_hits;
+
+	for (cl_request_pool* pool = g_request_pools; pool; pool = pool->next) {
+		n_hits += *(volatile uint64_t*)&pool->n_hits;
+		n_held += *(volatile uint32_t*)&pool->n_free;
+	}
+
+	pthread_mutex_unlock(&g_request_pools_lock);
+
+	for (uint32_t i = 0; i < CL_REQUEST_POOL_N_BASES; i++) {
+		n_held += (uint32_t)cf_atomic32_get(g_request_pool_shared[i].n_free);
+	}
+
+	*p_hits = n_hits;
+	*p_bytes_held = n_held * cl_request_size();
+}
+
+// All shared stacks are claimed - take over one unused for a while.
+static cl_request_pool_shared*
+request_pool_shared_steal(struct event_base* base)
+{
+	uint32_t now = (uint32_t)cf_getms();
+
+	for (uint32_t i = 0; i < CL_REQUEST_POOL_N_BASES; i++) {
+		cl_request_pool_shared* shared = &g_request_pool_shared[i];
+		cf_atomic_p b = cf_atomic_p_get(shared->base);
+
+		if (now - (uint32_t)cf_atomic32_get(shared->used_ms) <
+				CL_REQUEST_POOL_IDLE_MS) {
+			continue;
+		}
+
+		cf_atomic32_set(&shared->used_ms, now);
+
+		// Pushes and refills racing this only move requests to the wrong
+		// base's stack, which is harmless.
+		if ((cf_atomic_p)cf_atomic_p_cas(&shared->base, b, (cf_atomic_p)base) == b) {
+			return shared;
+		}
+	}
+
+	cf_atomic_int_incr(&g_cl_stats.req_pool_no_stack);
+
+	return NULL;
+}
+
+// Find the shared stack for this base, claiming an unused entry if asked to.
+// Entries are never unclaimed (just taken over), so a lookup can stop at the
+// first unclaimed entry.
+static cl_request_pool_shared*
+request_pool_shared_get(struct event_base* base, bool claim)
+{
+	if (! base) {
+		return NULL;
+	}
+
+	uint32_t i = (uint32_t)(((uintptr_t)base >> 6) * 2654435761u) %
+			CL_REQUEST_POOL_N_BASES;
+
+	for (uint32_t n = 0; n < CL_REQUEST_POOL_N_BASES; n++) {
+		cl_request_pool_shared* shared = &g_request_pool_shared[i];
+		cf_atomic_p b = cf_atomic_p_get(shared->base);
+
+		if (b == (cf_atomic_p)base) {
+			return shared;
+		}
+
+		if (b == 0) {
+			if (! claim) {
+				return NULL;
+			}
+
+			b = cf_atomic_p_cas(&shared->base, 0, (cf_atomic_p)base);
+
+			// Either we claimed it, or somebody claimed it for this base.
+			if (b == 0 || b == (cf_atomic_p)base) {
+				if (b == 0) {
+					cf_atomic32_set(&shared->used_ms, (uint32_t)cf_getms());
+				}
+
+				return shared;
+			}
+		}
+
+		i = (i + 1) % CL_REQUEST_POOL_N_BASES;
+	}
+
+	return claim ? request_pool_shared_steal(base) : NULL;
+}
+
+// This thread's pool is empty - take everything freed onto the base's stack.
+static void
+request_pool_refill(cl_request_pool* pool, struct event_base* base)
+{
+	cl_request_pool_shared* shared = request_pool_shared_get(base, false);
+
+	if (! shared || cf_atomic_p_get(shared->head) == 0) {
+		return;
+	}
+
+	cf_atomic_p head;
+	cf_atomic_p prior;
+
+	do {
+		head = cf_atomic_p_get(shared->head);
+		prior = cf_atomic_p_cas(&shared->head, head, 0);
+	} while (prior != head);
+
+	uint32_t n = 0;
+
+	for (cl_request_pool_elem* e = (cl_request_pool_elem*)head; e; e = e->next) {
+		n++;
+	}
+
+	cf_atomic32_sub(&shared->n_free, n);
+	cf_atomic32_set(&shared->used_ms, (uint32_t)cf_getms());
+
+	request_pool_register(pool);
+	pool->head = (cl_request_pool_elem*)head;
+	pool->n_free = n;
+}
+
+// Only done at shutdown, when nothing should be freeing requests.
+static void
+request_pool_shared_free_all()
+{
+	for (uint32_t i = 0; i < CL_REQUEST_POOL_N_BASES; i++) {
+		cl_request_pool_shared* shared = &g_request_pool_shared[i];
+
+		request_pool_list_free(
+				(cl_request_pool_elem*)cf_atomic_p_get(shared->head));
+		cf_atomic_p_set(&shared->head, 0);
+		cf_atomic32_set(&shared->n_free, 0);
+		cf_atomic32_set(&shared->used_ms, 0);
+		cf_atomic_p_set(&shared->base, 0);
+	}
+}
+
+void
+ev2citrusleaf_request_pool_set_max(uint32_t max_per_thread)
+{
+	cf_atomic32_set(&g_request_pool_max, max_per_thread);
+	cf_info("set request-pool-max %u", max_per_thread);
+}
+
 cl_request*
 cl_request_create(ev2citrusleaf_cluster* asc, struct event_base* base,
 		int timeout_ms, ev2citrusleaf_write_parameters* wparam,
 		ev2citrusleaf_callback cb, void* udata)
 {
-	size_t size = sizeof(cl_request) + (2 * event_get_struct_event_size());
-	cl_request* r = (cl_request*)malloc(size);
+	cl_request_pool* pool = &g_request_pool;
+	cl_request* r;
 
-	if (! r) {
-		cf_error("request allocation failed");
-		return NULL;
+	if (! pool->head) {
+		request_pool_refill(pool, base);
 	}
 
-	memset((void*)r, 0, size);
+	if (pool->head) {
+		r = (cl_request*)pool->head;
+		pool->head = pool->head->next;
+		pool->n_free--;
+		pool->n_hits++;
+	}
+	else {
+		r = (cl_request*)malloc(cl_request_size());
+
+		if (! r) {
+			cf_error("request allocation failed");
+			return NULL;
+		}
+
+		cf_atomic_int_incr(&g_cl_stats.req_pool_misses);
+	}
+
+	// The scratch buffers and event space don't need to be zeroed.
+	memset((void*)r, 0, offsetof(cl_request, wr_tmp));
 
 	r->MAGIC = CL_REQUEST_MAGIC;
 	r->fd = -1;
@@ -302,19 +656,86 @@ cl_request_destroy(cl_request* r)
 		free(r->wr_buf);
 	}
 
-	if (r->rd_buf_size && r->rd_buf != r->rd_tmp) {
-		free(r->rd_buf);
+	cl_request_rd_buf_free(r);
+
+	if (r->wr_iov_n && r->wr_iov != r->wr_iov_tmp) {
+		free(r->wr_iov);
 	}
 
-	if (r->cross_thread_lock) {
-		if (r->cross_thread_locked) {
-			MUTEX_UNLOCK(r->cross_thread_lock);
-		}
+	cl_request_pool* pool = &g_request_pool;
+	uint32_t max = cf_atomic32_get(g_request_pool_max);
+	cl_request_pool_elem* e = (cl_request_pool_elem*)r;
+
+	if (pool->n_free < max) {
+		request_pool_register(pool);
+
+		e->next = pool->head;
+		pool->head = e;
+		pool->n_free++;
+		return;
+	}
+
+	cl_request_pool_shared* shared = max == 0 ?
+			NULL : request_pool_shared_get(r->base, true);
+
+	if (shared && (uint32_t)cf_atomic32_get(shared->n_free) < max) {
+		cf_atomic32_incr(&shared->n_free);
+		cf_atomic32_set(&shared->used_ms, (uint32_t)cf_getms());
 
-		MUTEX_FREE(r->cross_thread_lock);
+		cf_atomic_p head;
+		cf_atomic_p prior;
+
+		do {
+			head = cf_atomic_p_get(shared->head);
+			e->next = (cl_request_pool_elem*)head;
+			prior = cf_atomic_p_cas(&shared->head, head, (cf_atomic_p)e);
+		} while (prior != head);
+
+		return;
 	}
 
 	free(r);
+	cf_atomic_int_incr(&g_cl_stats.req_pool_frees);
+}
+
+// The proto header has been read into the start of rd_tmp - set up rd_buf for
+// the body. Bodies that fit go in rd_tmp right after the header.
+bool
+cl_request_rd_buf_init(cl_request* r)
+{
+	cl_proto proto;
+
+	memcpy((void*)&proto, (void*)r->rd_tmp, sizeof(cl_proto));
+	cl_proto_swap(&proto);
+
+	if (proto.sz <= sizeof(r->rd_tmp) - sizeof(cl_proto)) {
+		r->rd_buf = cl_request_rd_tmp_body(r);
+	}
+	else {
+		r->rd_buf = (uint8_t*)malloc(proto.sz);
+
+		if (! r->rd_buf) {
+			cf_error("malloc fail");
+			return false;
+		}
+	}
+
+	r->rd_buf_pos = 0;
+	r->rd_buf_size = proto.sz;
+
+	return true;
+}
+
+void
+cl_request_rd_buf_free(cl_request* r)
+{
+	if (r->rd_buf && r->rd_buf != cl_request_rd_tmp_body(r)) {
+		free(r->rd_buf);
+	}
+
+	r->rd_buf = NULL;
+	r->rd_buf_pos = 0;
+	r->rd_buf_size = 0;
 }
 
 struct event *
@@ -329,7 +750,62 @@ cl_request_get_timeout_event(cl_request *r)
 	return( (struct event *) &r->event_space[ event_get_struct_event_size() ] );
 }
 
+struct event *
+cl_request_get_hedge_event(cl_request *r)
+{
+	return( (struct event *) &r->event_space[ 2 * event_get_struct_event_size() ] );
+}
+
+
+
+//
+// set up the parts of a key as it's laid out for digesting - type byte and
+// value bytes follow the set name. write_key_fields() sends the type and value
+// parts as the key field, so the two can't get out of sync.
+//
+
+static inline bool
+key_digest_parts(const char* set, size_t set_len,
+		const ev2citrusleaf_object* key, uint8_t* p_type, uint64_t* p_swapped,
+		cf_ripemd160_part* parts)
+{
+	const void* value;
+	size_t value_len;
+
+	switch (key->type) {
+		case CL_STR:
+			value = key->u.str;
+			value_len = key->size;
+			break;
+		case CL_INT:
+			*p_swapped = htonll((uint64_t)key->u.i64);
+			value = p_swapped;
+			value_len = sizeof(uint64_t);
+			break;
+		case CL_BLOB:
+		case CL_JAVA_BLOB:
+		case CL_CSHARP_BLOB:
+		case CL_PYTHON_BLOB:
+		case CL_RUBY_BLOB:
+			value = key->u.blob;
+			value_len = key->size;
+			break;
+		default:
+			cf_warn("transmit key: unknown citrusleaf type %d", key->type);
+			return false;
+	}
+
+	*p_type = (uint8_t)key->type;
 
+	parts[0].data = set;
+	parts[0].len = set_len;
+	parts[1].data = p_type;
+	parts[1].len = 1;
+	parts[2].data = value;
+	parts[2].len = value_len;
+
+	return true;
+}
 
 //
 // lay out a request into a buffer
@@ -338,22 +814,20 @@ cl_request_get_timeout_event(cl_request *r)
 //
 // FIELDS WILL BE SWAPED INTO NETWORK ORDER
 
+static uint8_t* write_key_fields(uint8_t* buf, const char* set, int set_len,
+		const ev2citrusleaf_object* key, const cf_digest* d, cf_digest* d_ret);
+
 static uint8_t*
-write_fields(uint8_t* buf, const char* ns, int ns_len, const char* set,
-		int set_len, const ev2citrusleaf_object* key, const cf_digest* d,
-		cf_digest* d_ret)
+write_fields(uint8_t* buf, const ev2citrusleaf_namespace_handle* nsh,
+		const char* set, int set_len, const ev2citrusleaf_object* key,
+		const cf_digest* d, cf_digest* d_ret)
 {
 
-	// lay out the fields
-	cl_msg_field *mf = (cl_msg_field *) buf;
-	cl_msg_field *mf_tmp;
+	// lay out the fields - the namespace field is already in network order
+	memcpy(buf, nsh->field, nsh->field_size);
 
-	mf->type = CL_MSG_FIELD_TYPE_NAMESPACE;
-	mf->field_sz = ns_len + 1;
-	memcpy(mf->data, ns, ns_len);
-	mf_tmp = cl_msg_field_get_next(mf);
-	cl_msg_swap_field(mf);
-	mf = mf_tmp;
+	cl_msg_field *mf = (cl_msg_field *) (buf + nsh->field_size);
+	cl_msg_field *mf_tmp;
 
 	if (set) {
 		mf->type = CL_MSG_FIELD_TYPE_SET;
@@ -364,38 +838,41 @@ write_fields(uint8_t* buf, const char* ns, int ns_len, const char* set,
 		mf = mf_tmp;
 	}
 
+	return write_key_fields((uint8_t*)mf, set, set_len, key, d, d_ret);
+}
+
+//
+// lay out the key or digest field, if any - for a key, also compute the digest
+// if d_ret is passed
+//
+
+static uint8_t*
+write_key_fields(uint8_t* buf, const char* set, int set_len,
+		const ev2citrusleaf_object* key, const cf_digest* d, cf_digest* d_ret)
+{
+	cl_msg_field *mf = (cl_msg_field *) buf;
+	cl_msg_field *mf_tmp = mf;
+
 	if (key) {
-		mf->type = CL_MSG_FIELD_TYPE_KEY;
-		// make a function call here, similar to our prototype code in the server
-		if (key->type == CL_STR) {
-			mf->field_sz = (uint32_t)key->size + 2;
-			uint8_t *fd = (uint8_t *) &mf->data;
-			fd[0] = CL_PARTICLE_TYPE_STRING;
-			memcpy(&fd[1], key->u.str, key->size);
-		}
-		else if (key->type == CL_BLOB) {
-			mf->field_sz = (uint32_t)key->size + 2;
-			uint8_t *fd = (uint8_t *) &mf->data;
-			fd[0] = CL_PARTICLE_TYPE_BLOB;
-			memcpy(&fd[1], key->u.blob, key->size);
-		}
-		else if (key->type == CL_INT) {
-			mf->field_sz = sizeof(int64_t) + 2;
-			uint8_t *fd = (uint8_t *) &mf->data;
-			fd[0] = CL_PARTICLE_TYPE_INTEGER;
-			uint64_t swapped = htonll((uint64_t)key->u.i64);
-			memcpy(&fd[1], &swapped, sizeof(swapped));
-		}
-		else {
-			cf_warn("unknown citrusleaf type %d", key->type);
+		uint8_t type;
+		uint64_t swapped;
+		cf_ripemd160_part parts[3];
+
+		if (! key_digest_parts(set, set_len, key, &type, &swapped, parts)) {
 			return(0);
 		}
+
+		mf->type = CL_MSG_FIELD_TYPE_KEY;
+		mf->field_sz = (uint32_t)parts[2].len + 2;
+		uint8_t *fd = (uint8_t *) &mf->data;
+		fd[0] = type;
+		memcpy(&fd[1], parts[2].data, parts[2].len);
 		mf_tmp = cl_msg_field_get_next(mf);
 		cl_msg_swap_field(mf);
-	}
 
-	if (d_ret && key)
-		cf_digest_compute2( set, set_len, mf->data, key->size + 1, d_ret);
+		if (d_ret)
+			cf_ripemd160(parts, 3, (uint8_t *) d_ret);
+	}
 
 	if (d) {
 		mf->type = CL_MSG_FIELD_TYPE_DIGEST_RIPE;
@@ -450,39 +927,44 @@ value_to_op_float(double value, uint8_t *data)
 extern int
 ev2citrusleaf_calculate_digest(const char *set, const ev2citrusleaf_object *key, cf_digest *digest)
 {
-	int set_len = set ? (int)strlen(set) : 0;
+	uint8_t type;
+	uint64_t swapped;
+	cf_ripemd160_part parts[3];
 
-	// make the key as it's laid out for digesting
-	// THIS IS A STRIPPED DOWN VERSION OF THE CODE IN write_fields ABOVE
-	// MUST STAY IN SYNC!!!
-	uint8_t* k = (uint8_t*)alloca(key->size + 1);
-	switch (key->type) {
-		case CL_STR:
-			k[0] = key->type;
-			memcpy(&k[1], key->u.str, key->size);
-			break;
-		case CL_INT:
-			{
-			uint64_t swapped;
-			k[0] = key->type;
-			swapped = htonll((uint64_t)key->u.i64);
-			memcpy(&k[1], &swapped, sizeof(swapped)); // THIS MUST LEAD TO A WRONG LENGTH CALCULATION BELOW
-			}
-			break;
-		case CL_BLOB:
-		case CL_JAVA_BLOB:
-		case CL_CSHARP_BLOB:
-		case CL_PYTHON_BLOB:
-		case CL_RUBY_BLOB:
-			k[0] = key->type;
-			memcpy(&k[1], key->u.blob, key->size);
-			break;
-		default:
-			cf_warn("transmit key: unknown citrusleaf type %d", key->type);
-			return(-1);
+	if (! key_digest_parts(set, set ? strlen(set) : 0, key, &type, &swapped,
+			parts)) {
+		return(-1);
 	}
 
-	cf_digest_compute2((char *)set, set_len, k, key->size + 1, digest);
+	cf_ripemd160(parts, 3, digest->digest);
+
+	return(0);
+}
+
+// Keys per cf_ripemd160_many() call - bounds the stack used.
+#define DIGEST_CHUNK 64
+
+extern int
+ev2citrusleaf_calculate_digests(const char *set, const ev2citrusleaf_object *keys, int n_keys, cf_digest *digests)
+{
+	size_t set_len = set ? strlen(set) : 0;
+	uint8_t types[DIGEST_CHUNK];
+	uint64_t swapped[DIGEST_CHUNK];
+	cf_ripemd160_part parts[DIGEST_CHUNK * 3];
+
+	for (int i = 0; i < n_keys; i += DIGEST_CHUNK) {
+		int n = n_keys - i < DIGEST_CHUNK ? n_keys - i : DIGEST_CHUNK;
+
+		for (int k = 0; k < n; k++) {
+			if (! key_digest_parts(set, set_len, &keys[i + k], &types[k],
+					&swapped[k], &parts[k * 3])) {
+				return(-1);
+			}
+		}
+
+		// cf_digest is just the digest bytes, so an array of them is packed.
+		cf_ripemd160_many(parts, 3, n, digests[i].digest);
+	}
 
 	return(0);
 }
@@ -589,11 +1071,45 @@ value_to_op_get_size(const ev2citrusleaf_object *v, size_t *sz)
 
 
 
-void
-bin_to_op(int operation, const ev2citrusleaf_bin *v, cl_msg_op *op)
+// write operation - must copy the value, unless it's sent in place
+
+static void
+value_to_op(const ev2citrusleaf_object *o, cl_msg_op *op, bool copy_value)
 {
-	int	bin_len = (int)strlen(v->bin_name);
-	op->op_sz = sizeof(cl_msg_op) + bin_len - sizeof(uint32_t);
+	uint8_t *data = cl_msg_op_get_value_p(op);
+	switch(o->type) {
+		case CL_NULL:
+			op->particle_type = CL_PARTICLE_TYPE_NULL;
+			break;
+		case CL_INT:
+			op->particle_type = CL_PARTICLE_TYPE_INTEGER;
+			op->op_sz += value_to_op_int(o->u.i64, data);
+			break;
+		case CL_FLOAT:
+			op->particle_type = CL_PARTICLE_TYPE_FLOAT;
+			op->op_sz += value_to_op_float(o->u.f64, data);
+			break;
+		case CL_STR:
+			op->op_sz += (uint32_t)o->size;
+			op->particle_type = CL_PARTICLE_TYPE_STRING;
+			if (copy_value) memcpy(data, o->u.str, o->size);
+			break;
+		case CL_BLOB:
+			op->op_sz += (uint32_t)o->size;
+			op->particle_type = CL_PARTICLE_TYPE_BLOB;
+			if (copy_value) memcpy(data, o->u.blob, o->size);
+			break;
+		default:
+			cf_warn("internal error value_to_op has unknown value type");
+			return;
+	}
+}
+
+void
+bin_to_op(int operation, const ev2citrusleaf_bin *v, cl_msg_op *op, bool copy_value)
+{
+	int	bin_len = (int)strlen(v->bin_name);
+	op->op_sz = sizeof(cl_msg_op) + bin_len - sizeof(uint32_t);
 	op->op = operation;
 	op->version = 0;
 	op->name_sz = bin_len;
@@ -603,44 +1119,18 @@ bin_to_op(int operation, const ev2citrusleaf_bin *v, cl_msg_op *op)
 	if (operation == CL_MSG_OP_READ) {
 		op->particle_type = 0; // reading - it's unknown
 	}
-	// write operation - must copy the value
 	else {
-		uint8_t *data = cl_msg_op_get_value_p(op);
-		switch(v->object.type) {
-			case CL_NULL:
-				op->particle_type = CL_PARTICLE_TYPE_NULL;
-				break;
-			case CL_INT:
-				op->particle_type = CL_PARTICLE_TYPE_INTEGER;
-				op->op_sz += value_to_op_int(v->object.u.i64, data);
-				break;
-			case CL_FLOAT:
-				op->particle_type = CL_PARTICLE_TYPE_FLOAT;
-				op->op_sz += value_to_op_float(v->object.u.f64, data);
-				break;
-			case CL_STR:
-				op->op_sz += (uint32_t)v->object.size;
-				op->particle_type = CL_PARTICLE_TYPE_STRING;
-				memcpy(data, v->object.u.str, v->object.size);
-				break;
-			case CL_BLOB:
-				op->op_sz += (uint32_t)v->object.size;
-				op->particle_type = CL_PARTICLE_TYPE_BLOB;
-				memcpy(data, v->object.u.blob, v->object.size);
-				break;
-			default:
-				cf_warn("internal error value_to_op has unknown value type");
-				return;
-		}
+		value_to_op(&v->object, op, copy_value);
 	}
 
 }
 
 void
-operation_to_op(const ev2citrusleaf_operation *v, cl_msg_op *op)
+operation_to_op(const ev2citrusleaf_operation *v, cl_msg_op *op, bool copy_value)
 {
 	int	bin_len = (int)strlen(v->bin_name);
 	op->op_sz = sizeof(cl_msg_op) + bin_len - sizeof(uint32_t);
+	op->version = 0;
 	op->name_sz = bin_len;
 	memcpy(op->name, v->bin_name, bin_len);
 
@@ -662,63 +1152,120 @@ operation_to_op(const ev2citrusleaf_operation *v, cl_msg_op *op)
 	if (v->op == CL_OP_READ) {
 		op->particle_type = 0; // reading - it's unknown
 	}
-	// write operation - must copy the value
 	else {
-		uint8_t *data = cl_msg_op_get_value_p(op);
-		switch(v->object.type) {
-			case CL_NULL:
-				op->particle_type = CL_PARTICLE_TYPE_NULL;
-				break;
-			case CL_INT:
-				op->particle_type = CL_PARTICLE_TYPE_INTEGER;
-				op->op_sz += value_to_op_int(v->object.u.i64, data);
-				break;
-			case CL_FLOAT:
-				op->particle_type = CL_PARTICLE_TYPE_FLOAT;
-				op->op_sz += value_to_op_float(v->object.u.f64, data);
-				break;
-			case CL_STR:
-				op->op_sz += (uint32_t)v->object.size;
-				op->particle_type = CL_PARTICLE_TYPE_STRING;
-				memcpy(data, v->object.u.str, v->object.size);
-				break;
-			case CL_BLOB:
-				op->op_sz += (uint32_t)v->object.size;
-				op->particle_type = CL_PARTICLE_TYPE_BLOB;
-				memcpy(data, v->object.u.blob, v->object.size);
-				break;
-			default:
-				cf_warn("internal error value_to_op has unknown value type");
-				return;
+		value_to_op(&v->object, op, copy_value);
+	}
+
+}
+
+
+//
+// Values sent in place (zero-copy) are not laid out in the request buffer -
+// instead the packet is described by an iovec array alternating buffer
+// segments and app value buffers.
+//
+
+static inline bool
+value_is_external(const ev2citrusleaf_object* o, uint32_t zc_threshold)
+{
+	return zc_threshold != 0 && (o->type == CL_STR || o->type == CL_BLOB) &&
+			o->size >= zc_threshold;
+}
+
+// If there are external values, point *iov_r at enough iovecs for them - the
+// caller passes in a temp array of CL_REQUEST_IOV_TMP, and we malloc if that's
+// too small. Returns false only if malloc fails.
+static bool
+iov_prepare(int n_ext, struct iovec** iov_r, int* n_iov_r)
+{
+	*n_iov_r = 0;
+
+	if (n_ext == 0) {
+		return true;
+	}
+
+	int n_iov_max = (2 * n_ext) + 1;
+
+	if (n_iov_max > CL_REQUEST_IOV_TMP) {
+		struct iovec* iov = (struct iovec*)malloc(n_iov_max * sizeof(struct iovec));
+
+		if (! iov) {
+			return false;
 		}
+
+		*iov_r = iov;
 	}
 
+	return true;
+}
+
+// The op at op has been laid out without its value - close the current buffer
+// segment, add the value, and return where the next op goes in the buffer.
+static inline uint8_t*
+iov_add_external(cl_msg_op* op, const ev2citrusleaf_object* o,
+		struct iovec* iov, int* n_iov_r, uint8_t** seg_r)
+{
+	uint8_t* data = cl_msg_op_get_value_p(op);
+	int n_iov = *n_iov_r;
+
+	iov[n_iov].iov_base = (void*)*seg_r;
+	iov[n_iov].iov_len = data - *seg_r;
+	n_iov++;
+
+	iov[n_iov].iov_base = o->type == CL_STR ? (void*)o->u.str : o->u.blob;
+	iov[n_iov].iov_len = o->size;
+	n_iov++;
+
+	*n_iov_r = n_iov;
+	*seg_r = data;
+
+	return data;
+}
+
+static inline void
+iov_finish(struct iovec* iov, int* n_iov_r, uint8_t* seg, uint8_t* end)
+{
+	if (*n_iov_r != 0 && end > seg) {
+		iov[*n_iov_r].iov_base = (void*)seg;
+		iov[*n_iov_r].iov_len = end - seg;
+		(*n_iov_r)++;
+	}
 }
 
+static inline void
+iov_free(struct iovec* iov, struct iovec* iov_tmp)
+{
+	if (iov != iov_tmp) {
+		free(iov);
+	}
+}
 
 //
 // n_values can be passed in 0, and then values is undefined / probably 0.
 //
 static int
-compile(int info1, int info2, const char* ns, const char* set,
+compile(int info1, int info2, const ev2citrusleaf_namespace_handle* nsh,
+		const char* set,
 		const ev2citrusleaf_object* key, const cf_digest* digest,
 		const ev2citrusleaf_write_parameters* wparam, uint32_t timeout,
 		const ev2citrusleaf_bin* values, int n_values, uint8_t** buf_r,
-		size_t* buf_size_r, cf_digest* digest_r)
+		size_t* buf_size_r, cf_digest* digest_r, uint32_t zc_threshold,
+		struct iovec** iov_r, int* n_iov_r)
 {
 	// I hate strlen
-	int		ns_len = (int)strlen(ns);
 	int		set_len = set ? (int)strlen(set) : 0;
 	int		i;
 
 	// determine the size
 	size_t	msg_size = sizeof(as_msg); // header
 	// fields
-	if (ns) msg_size += ns_len + sizeof(cl_msg_field);
+	msg_size += nsh->field_size;
 	if (set) msg_size += set_len + sizeof(cl_msg_field);
 	if (key) msg_size += sizeof(cl_msg_field) + 1 + key->size;
-	if (digest) msg_size += sizeof(cl_msg_field) + 1 + sizeof(cf_digest);
+	if (digest) msg_size += sizeof(cl_msg_field) + sizeof(cf_digest);
 	// ops
+	size_t	ext_size = 0;
+	int		n_ext = 0;
 	for (i=0;i<n_values;i++) {
 		msg_size += sizeof(cl_msg_op) + strlen(values[i].bin_name);
 		if (info2 & CL_MSG_INFO2_WRITE) {
@@ -726,20 +1273,34 @@ compile(int info1, int info2, const char* ns, const char* set,
 				cf_warn("bad operation, writing with unknown type");
 				return(-1);
 			}
+			if (value_is_external(&values[i].object, zc_threshold)) {
+				ext_size += values[i].object.size;
+				n_ext++;
+			}
 		}
 	}
 
+	struct iovec *iov_tmp = *iov_r;
+	if (! iov_prepare(n_ext, iov_r, n_iov_r)) {
+		return(-1);
+	}
+
 	// size too small? malloc!
+	size_t	buf_size = msg_size - ext_size;
 	uint8_t	*buf;
 	uint8_t *mbuf = 0;
-	if ((*buf_r) && (msg_size > *buf_size_r)) {
-		mbuf = buf = (uint8_t*)malloc(msg_size);
-		if (!buf) 			return(-1);
+	if ((*buf_r) && (buf_size > *buf_size_r)) {
+		mbuf = buf = (uint8_t*)malloc(buf_size);
+		if (!buf) {
+			iov_free(*iov_r, iov_tmp);
+			return(-1);
+		}
 		*buf_r = buf;
 	}
 	else
 		buf = *buf_r;
 	*buf_size_r = msg_size;
+	uint8_t *seg = buf;
 
 	// lay out the header
 	uint32_t generation;
@@ -755,13 +1316,14 @@ compile(int info1, int info2, const char* ns, const char* set,
 		generation = expiration = 0;
 	}
 
-	int n_fields = ( ns ? 1 : 0 ) + (set ? 1 : 0) + (key ? 1 : 0) + (digest ? 1 : 0);
+	int n_fields = 1 + (set ? 1 : 0) + (key ? 1 : 0) + (digest ? 1 : 0);
 	buf = cl_write_header(buf, msg_size, info1, info2, generation,expiration, timeout, n_fields, n_values);
 
 	// now the fields
-	buf = write_fields(buf, ns, ns_len, set, set_len, key, digest, digest_r);
+	buf = write_fields(buf, nsh, set, set_len, key, digest, digest_r);
 	if (!buf) {
 		if (mbuf)	free(mbuf);
+		iov_free(*iov_r, iov_tmp);
 		return(-1);
 	}
 
@@ -772,14 +1334,21 @@ compile(int info1, int info2, const char* ns, const char* set,
 		cl_msg_op *op = (cl_msg_op *) buf;
 		cl_msg_op *op_tmp;
 		for (i = 0; i< n_values;i++) {
+			bool external = operation == CL_MSG_OP_WRITE &&
+					value_is_external(&values[i].object, zc_threshold);
 
-			bin_to_op(operation, &values[i], op);
+			bin_to_op(operation, &values[i], op, ! external);
 
-			op_tmp = cl_msg_op_get_next(op);
+			op_tmp = external ?
+					(cl_msg_op *)iov_add_external(op, &values[i].object, *iov_r, n_iov_r, &seg) :
+					cl_msg_op_get_next(op);
 			cl_msg_swap_op(op);
 			op = op_tmp;
 		}
 	}
+
+	iov_finish(*iov_r, n_iov_r, seg, *buf_r + buf_size);
+
 	return(0);
 }
 
@@ -788,33 +1357,40 @@ compile(int info1, int info2, const char* ns, const char* set,
 // The operation is compiled by looking at the internal ops
 //
 static int
-compile_ops(const char* ns, const char* set, const ev2citrusleaf_object* key,
+compile_ops(const ev2citrusleaf_namespace_handle* nsh, const char* set,
+		const ev2citrusleaf_object* key,
 		const cf_digest* digest, const ev2citrusleaf_operation* ops, int n_ops,
 		const ev2citrusleaf_write_parameters* wparam, uint8_t** buf_r,
-		size_t* buf_size_r, cf_digest* digest_r, bool* write)
+		size_t* buf_size_r, cf_digest* digest_r, bool* write,
+		uint32_t zc_threshold, struct iovec** iov_r, int* n_iov_r)
 {
 	int info1 = 0;
 	int info2 = 0;
 
 	// I hate strlen
-	int		ns_len = (int)strlen(ns);
-	int		set_len = (int)strlen(set);
+	int		set_len = set ? (int)strlen(set) : 0;
 	int		i;
 
 	// determine the size
 	size_t	msg_size = sizeof(as_msg); // header
 	// fields
-	if (ns) msg_size += ns_len + sizeof(cl_msg_field);
+	msg_size += nsh->field_size;
 	if (set) msg_size += set_len + sizeof(cl_msg_field);
 	if (key) msg_size += sizeof(cl_msg_field) + 1 + key->size;
-	if (digest) msg_size += sizeof(cl_msg_field) + 1 + sizeof(cf_digest);
+	if (digest) msg_size += sizeof(cl_msg_field) + sizeof(cf_digest);
 
 	// ops
+	size_t	ext_size = 0;
+	int		n_ext = 0;
 	for (i=0;i<n_ops;i++) {
 		msg_size += sizeof(cl_msg_op) + strlen(ops[i].bin_name);
 		if ((ops[i].op == CL_OP_WRITE) || (ops[i].op == CL_OP_ADD)) {
 			value_to_op_get_size(&ops[i].object, &msg_size);
 			info2 |= CL_MSG_INFO2_WRITE;
+			if (value_is_external(&ops[i].object, zc_threshold)) {
+				ext_size += ops[i].object.size;
+				n_ext++;
+			}
 		}
 		if (ops[i].op == CL_OP_READ) {
 			info1 |= CL_MSG_INFO1_READ;
@@ -822,17 +1398,27 @@ compile_ops(const char* ns, const char* set, const ev2citrusleaf_object* key,
 	}
 	if (write) { *write = info2 & CL_MSG_INFO2_WRITE ? true : false; }
 
+	struct iovec *iov_tmp = *iov_r;
+	if (! iov_prepare(n_ext, iov_r, n_iov_r)) {
+		return(-1);
+	}
+
 	// size too small? malloc!
+	size_t	buf_size = msg_size - ext_size;
 	uint8_t	*buf;
 	uint8_t *mbuf = 0;
-	if ((*buf_r) && (msg_size > *buf_size_r)) {
-		mbuf = buf = (uint8_t*)malloc(msg_size);
-		if (!buf) 			return(-1);
+	if ((*buf_r) && (buf_size > *buf_size_r)) {
+		mbuf = buf = (uint8_t*)malloc(buf_size);
+		if (!buf) {
+			iov_free(*iov_r, iov_tmp);
+			return(-1);
+		}
 		*buf_r = buf;
 	}
 	else
 		buf = *buf_r;
 	*buf_size_r = msg_size;
+	uint8_t *seg = buf;
 
 	// lay out the header
 	uint32_t generation;
@@ -848,13 +1434,14 @@ compile_ops(const char* ns, const char* set, const ev2citrusleaf_object* key,
 		generation = expiration = 0;
 	}
 
-	int n_fields = ( ns ? 1 : 0 ) + (set ? 1 : 0) + (key ? 1 : 0) + (digest ? 1 : 0);
+	int n_fields = 1 + (set ? 1 : 0) + (key ? 1 : 0) + (digest ? 1 : 0);
 	buf = cl_write_header(buf, msg_size, info1, info2, generation, expiration, expiration, n_fields, n_ops);
 
 	// now the fields
-	buf = write_fields(buf, ns, ns_len, set, set_len, key, digest,digest_r);
+	buf = write_fields(buf, nsh, set, set_len, key, digest,digest_r);
 	if (!buf) {
 		if (mbuf)	free(mbuf);
+		iov_free(*iov_r, iov_tmp);
 		return(-1);
 	}
 
@@ -864,14 +1451,350 @@ compile_ops(const char* ns, const char* set, const ev2citrusleaf_object* key,
 		cl_msg_op *op = (cl_msg_op *) buf;
 		cl_msg_op *op_tmp;
 		for (i = 0; i< n_ops;i++) {
+			bool external = ops[i].op != CL_OP_READ &&
+					value_is_external(&ops[i].object, zc_threshold);
 
-			operation_to_op(&ops[i], op);
+			operation_to_op(&ops[i], op, ! external);
 
-			op_tmp = cl_msg_op_get_next(op);
+			op_tmp = external ?
+					(cl_msg_op *)iov_add_external(op, &ops[i].object, *iov_r, n_iov_r, &seg) :
+					cl_msg_op_get_next(op);
 			cl_msg_swap_op(op);
 			op = op_tmp;
 		}
 	}
+
+	iov_finish(*iov_r, n_iov_r, seg, *buf_r + buf_size);
+
+	return(0);
+}
+
+
+//
+// Prepared transactions - the namespace and set fields, and op headers and
+// names are laid out once, in network order. Compiling a prepared transaction
+// writes the header, copies these, and adds the key or digest field and values.
+//
+
+typedef struct cl_prepared_op_s {
+	size_t					hdr_size; // op header plus name
+	uint8_t					op;
+	uint8_t					name_sz;
+	bool					write;
+	ev2citrusleaf_bin_name	name;
+} cl_prepared_op;
+
+struct ev2citrusleaf_prepared_s {
+	int				info1;
+	int				info2;
+	bool			write;
+	char			ns[33];
+
+	// Set name, pointing into the set field (not null-terminated).
+	const char*		set;
+	int				set_len;
+
+	// Namespace and set fields.
+	uint8_t*		tmpl;
+	size_t			tmpl_ns_size;
+	size_t			tmpl_size;
+	int				n_fields;
+
+	// Ops - op headers and names are in ops_tmpl, op_sz as if no value.
+	cl_prepared_op*	ops;
+	int				n_ops;
+	uint8_t*		ops_tmpl;
+	size_t			ops_size;
+};
+
+static ev2citrusleaf_prepared*
+prepared_create(int info1, int info2, const char* ns, const char* set,
+		const cl_prepared_op* ops, int n_ops)
+{
+	ev2citrusleaf_namespace_handle nsh;
+	size_t set_len = set ? strlen(set) : 0;
+
+	// Not for any cluster - only the field is used.
+	if (! cl_namespace_init(&nsh, NULL, ns)) {
+		return NULL;
+	}
+
+	size_t tmpl_ns_size = nsh.field_size;
+	size_t tmpl_size = tmpl_ns_size + (set ? sizeof(cl_msg_field) + set_len : 0);
+	size_t ops_size = 0;
+
+	for (int i = 0; i < n_ops; i++) {
+		ops_size += ops[i].hdr_size;
+	}
+
+	size_t size = sizeof(ev2citrusleaf_prepared) +
+			(n_ops * sizeof(cl_prepared_op)) + tmpl_size + ops_size;
+
+	ev2citrusleaf_prepared* p = (ev2citrusleaf_prepared*)malloc(size);
+
+	if (! p) {
+		cf_error("prepare: malloc fail");
+		return NULL;
+	}
+
+	p->info1 = info1;
+	p->info2 = info2;
+	p->write = (info2 & CL_MSG_INFO2_WRITE) != 0;
+	strcpy(p->ns, ns);
+
+	p->ops = (cl_prepared_op*)(p + 1);
+	p->n_ops = n_ops;
+	memcpy(p->ops, ops, n_ops * sizeof(cl_prepared_op));
+
+	p->tmpl = (uint8_t*)(p->ops + n_ops);
+	p->tmpl_ns_size = tmpl_ns_size;
+	p->tmpl_size = tmpl_size;
+	p->n_fields = set ? 2 : 1;
+
+	uint8_t* end = write_fields(p->tmpl, &nsh, set, (int)set_len, NULL, NULL,
+			NULL);
+
+	p->set = set ? (const char*)(end - set_len) : NULL;
+	p->set_len = (int)set_len;
+
+	p->ops_tmpl = end;
+	p->ops_size = ops_size;
+
+	cl_msg_op* op = (cl_msg_op*)p->ops_tmpl;
+
+	for (int i = 0; i < n_ops; i++) {
+		op->op_sz = sizeof(cl_msg_op) + ops[i].name_sz - sizeof(uint32_t);
+		op->op = ops[i].op;
+		op->particle_type = 0; // reading - it's unknown
+		op->version = 0;
+		op->name_sz = ops[i].name_sz;
+		memcpy(op->name, ops[i].name, ops[i].name_sz);
+
+		cl_msg_op* op_tmp = cl_msg_op_get_next(op);
+		cl_msg_swap_op(op);
+		op = op_tmp;
+	}
+
+	return p;
+}
+
+static bool
+prepared_op_init(cl_prepared_op* pop, const char* bin_name, uint8_t op,
+		bool write)
+{
+	size_t len = strlen(bin_name);
+
+	if (len >= sizeof(pop->name)) {
+		cf_warn("prepare: bin name %s too long", bin_name);
+		return false;
+	}
+
+	pop->hdr_size = sizeof(cl_msg_op) + len;
+	pop->op = op;
+	pop->name_sz = (uint8_t)len;
+	pop->write = write;
+	memcpy(pop->name, bin_name, len);
+
+	return true;
+}
+
+ev2citrusleaf_prepared*
+ev2citrusleaf_prepare_get(const char* ns, const char* set, const char** bins,
+		int n_bins)
+{
+	cl_prepared_op* ops = (cl_prepared_op*)alloca(n_bins * sizeof(cl_prepared_op));
+
+	for (int i = 0; i < n_bins; i++) {
+		if (! prepared_op_init(&ops[i], bins[i], CL_MSG_OP_READ, false)) {
+			return NULL;
+		}
+	}
+
+	int info1 = CL_MSG_INFO1_READ | (n_bins == 0 ? CL_MSG_INFO1_GET_ALL : 0);
+
+	return prepared_create(info1, 0, ns, set, ops, n_bins);
+}
+
+ev2citrusleaf_prepared*
+ev2citrusleaf_prepare_put(const char* ns, const char* set, const char** bins,
+		int n_bins)
+{
+	cl_prepared_op* ops = (cl_prepared_op*)alloca(n_bins * sizeof(cl_prepared_op));
+
+	for (int i = 0; i < n_bins; i++) {
+		if (! prepared_op_init(&ops[i], bins[i], CL_MSG_OP_WRITE, true)) {
+			return NULL;
+		}
+	}
+
+	return prepared_create(0, CL_MSG_INFO2_WRITE, ns, set, ops, n_bins);
+}
+
+ev2citrusleaf_prepared*
+ev2citrusleaf_prepare_operate(const char* ns, const char* set,
+		const ev2citrusleaf_operation* ops, int n_ops)
+{
+	cl_prepared_op* pops = (cl_prepared_op*)alloca(n_ops * sizeof(cl_prepared_op));
+	int info1 = 0;
+	int info2 = 0;
+
+	for (int i = 0; i < n_ops; i++) {
+		uint8_t op;
+
+		switch (ops[i].op) {
+			case CL_OP_WRITE:
+				op = CL_MSG_OP_WRITE;
+				info2 |= CL_MSG_INFO2_WRITE;
+				break;
+			case CL_OP_READ:
+				op = CL_MSG_OP_READ;
+				info1 |= CL_MSG_INFO1_READ;
+				break;
+			case CL_OP_ADD:
+				op = CL_MSG_OP_INCR;
+				info2 |= CL_MSG_INFO2_WRITE;
+				break;
+			default:
+				cf_warn("prepare: unknown operation type %d", ops[i].op);
+				return NULL;
+		}
+
+		if (! prepared_op_init(&pops[i], ops[i].bin_name, op, op != CL_MSG_OP_READ)) {
+			return NULL;
+		}
+	}
+
+	return prepared_create(info1, info2, ns, set, pops, n_ops);
+}
+
+void
+ev2citrusleaf_prepared_destroy(ev2citrusleaf_prepared* p)
+{
+	free(p);
+}
+
+//
+// The compile function for prepared transactions. Pass key, or NULL key and a
+// digest. values has an entry for every prepared op, but only those for write
+// ops are used.
+//
+static int
+compile_prepared(const ev2citrusleaf_prepared* p,
+		const ev2citrusleaf_object* key, const cf_digest* digest,
+		const ev2citrusleaf_object* values,
+		const ev2citrusleaf_write_parameters* wparam, uint32_t timeout,
+		uint8_t** buf_r, size_t* buf_size_r, cf_digest* digest_r,
+		uint32_t zc_threshold, struct iovec** iov_r, int* n_iov_r)
+{
+	int info2 = p->info2;
+	int i;
+
+	// Like the non-prepared digest calls, send no set field with a digest.
+	size_t tmpl_size = key ? p->tmpl_size : p->tmpl_ns_size;
+	int n_fields = key ? p->n_fields + 1 : 2;
+
+	// determine the size
+	size_t	msg_size = sizeof(as_msg) + tmpl_size + p->ops_size;
+	if (key) msg_size += sizeof(cl_msg_field) + 1 + key->size;
+	else msg_size += sizeof(cl_msg_field) + sizeof(cf_digest);
+
+	size_t	ext_size = 0;
+	int		n_ext = 0;
+	if (p->write) {
+		for (i=0;i<p->n_ops;i++) {
+			if (! p->ops[i].write) {
+				continue;
+			}
+			if (0 != value_to_op_get_size(&values[i], &msg_size)) {
+				cf_warn("bad operation, writing with unknown type");
+				return(-1);
+			}
+			if (value_is_external(&values[i], zc_threshold)) {
+				ext_size += values[i].size;
+				n_ext++;
+			}
+		}
+	}
+
+	struct iovec *iov_tmp = *iov_r;
+	if (! iov_prepare(n_ext, iov_r, n_iov_r)) {
+		return(-1);
+	}
+
+	// size too small? malloc!
+	size_t	buf_size = msg_size - ext_size;
+	uint8_t	*buf;
+	uint8_t *mbuf = 0;
+	if ((*buf_r) && (buf_size > *buf_size_r)) {
+		mbuf = buf = (uint8_t*)malloc(buf_size);
+		if (!buf) {
+			iov_free(*iov_r, iov_tmp);
+			return(-1);
+		}
+		*buf_r = buf;
+	}
+	else
+		buf = *buf_r;
+	*buf_size_r = msg_size;
+	uint8_t *seg = buf;
+
+	// write the header, and copy the namespace and set fields
+	uint32_t generation = 0;
+	uint32_t expiration = 0;
+	if (wparam) {
+		if (wparam->use_generation) {
+			info2 |= CL_MSG_INFO2_GENERATION;
+			generation = wparam->generation;
+		}
+		expiration = wparam->expiration;
+	}
+
+	buf = cl_write_header(buf, msg_size, p->info1, info2, generation,
+			expiration, timeout, n_fields, p->n_ops);
+	memcpy(buf, p->tmpl, tmpl_size);
+
+	// add the key or digest
+	buf = write_key_fields(buf + tmpl_size, p->set, p->set_len, key, digest, digest_r);
+	if (!buf) {
+		if (mbuf)	free(mbuf);
+		iov_free(*iov_r, iov_tmp);
+		return(-1);
+	}
+
+	// lay out the ops - if there are no values, just copy them
+	if (! p->write) {
+		memcpy(buf, p->ops_tmpl, p->ops_size);
+		return(0);
+	}
+
+	const uint8_t *tmpl_op = p->ops_tmpl;
+	cl_msg_op *op = (cl_msg_op *) buf;
+	cl_msg_op *op_tmp;
+	for (i = 0; i < p->n_ops; i++) {
+		const cl_prepared_op *pop = &p->ops[i];
+
+		memcpy(op, tmpl_op, pop->hdr_size);
+		tmpl_op += pop->hdr_size;
+
+		if (! pop->write) {
+			op = (cl_msg_op *)((uint8_t *)op + pop->hdr_size);
+			continue;
+		}
+
+		bool external = value_is_external(&values[i], zc_threshold);
+
+		op->op_sz = pop->hdr_size - sizeof(uint32_t);
+		value_to_op(&values[i], op, ! external);
+
+		op_tmp = external ?
+				(cl_msg_op *)iov_add_external(op, &values[i], *iov_r, n_iov_r, &seg) :
+				cl_msg_op_get_next(op);
+		op->op_sz = htonl(op->op_sz);
+		op = op_tmp;
+	}
+
+	iov_finish(*iov_r, n_iov_r, seg, *buf_r + buf_size);
+
 	return(0);
 }
 
@@ -879,8 +1802,11 @@ compile_ops(const char* ns, const char* set, const ev2citrusleaf_object* key,
 
 // 0 if OK, -1 if fail
 
+// If borrow is set, string and blob values point into the op, which must
+// outlive obj.
+
 int
-set_object(cl_msg_op *op, ev2citrusleaf_object *obj)
+set_object(cl_msg_op *op, ev2citrusleaf_object *obj, bool borrow)
 {
 	obj->type = (ev2citrusleaf_type)op->particle_type;
 
@@ -903,6 +1829,12 @@ set_object(cl_msg_op *op, ev2citrusleaf_object *obj)
 		// regrettably, we have to add the null. I hate null termination.
 		case CL_PARTICLE_TYPE_STRING:
 			obj->size = cl_msg_op_get_value_sz(op);
+			if (borrow) {
+				// ... unless the app wants it borrowed.
+				obj->u.str = (char*)cl_msg_op_get_value_p(op);
+				obj->free = 0;
+				break;
+			}
 			obj->free = obj->u.str = (char*)malloc(obj->size+1);
 			if (obj->free == 0) return(-1);
 			memcpy(obj->u.str, cl_msg_op_get_value_p(op), obj->size);
@@ -949,7 +1881,7 @@ set_value_search(cl_msg_op *op, ev2citrusleaf_bin *values, int n_values)
 	}
 
 	// copy
-	set_object(op, &values[i].object);
+	set_object(op, &values[i].object, false);
 	return(0);
 }
 
@@ -957,7 +1889,7 @@ set_value_search(cl_msg_op *op, ev2citrusleaf_bin *values, int n_values)
 //
 // Copy this particular operation to that particular value
 void
-cl_set_value_particular(cl_msg_op *op, ev2citrusleaf_bin *value)
+cl_set_value_particular(cl_msg_op *op, ev2citrusleaf_bin *value, bool borrow)
 {
 	if (op->name_sz > sizeof(value->bin_name)) {
 		cf_warn("Set Value Particular: bad response from server");
@@ -966,7 +1898,7 @@ cl_set_value_particular(cl_msg_op *op, ev2citrusleaf_bin *value)
 
 	memcpy(value->bin_name, op->name, op->name_sz);
 	value->bin_name[op->name_sz] = 0;
-	set_object(op, &value->object);
+	set_object(op, &value->object, borrow);
 }
 
 
@@ -990,7 +1922,7 @@ parse_get_maxbins(uint8_t *buf, size_t buf_len)
 
 int
 parse(uint8_t *buf, size_t buf_len, ev2citrusleaf_bin *values, int n_values,
-		int *result_code, uint32_t *generation, uint32_t *p_expiration)
+		int *result_code, uint32_t *generation, uint32_t *p_expiration, bool borrow)
 {
 	int i;
 	cl_msg	*msg = (cl_msg *)buf;
@@ -1034,7 +1966,7 @@ parse(uint8_t *buf, size_t buf_len, ev2citrusleaf_bin *values, int n_values,
 
 		cl_msg_swap_op(op);
 
-		cl_set_value_particular(op, &values[i]);
+		cl_set_value_particular(op, &values[i], borrow);
 
 		op = cl_msg_op_get_next(op);
 	}
@@ -1042,36 +1974,173 @@ parse(uint8_t *buf, size_t buf_len, ev2citrusleaf_bin *values, int n_values,
 	return(0);
 }
 
-
+// The request is done with this node - uncount it from the node's in-flight
+// transactions, and give back its circuit probe slot if it has one. If it completed (signal isn't CL_LIMIT_NONE), record its
+// latency, and tell the node's limiter how it went - a good completion that
+// was too slow counts as congestion.
 void
-ev2citrusleaf_request_complete(cl_request *req, bool timedout)
+cl_request_node_done(cl_request* req, cl_cluster_node* node, int signal)
 {
-//	dump_buf("request complete :", req->rd_buf, req->rd_buf_size);
-
-	if (req->timeout_set) {
-		evtimer_del(cl_request_get_timeout_event(req));
+	if (! req->in_flight) {
+		return;
 	}
 
-	// critical to close this before the file descriptor associated, for some
-	// reason
-	if (req->network_set) {
-		event_del(cl_request_get_network_event(req));
+	req->in_flight = false;
+
+	if (req->probe) {
+		req->probe = false;
+		cl_cluster_node_probe_done(node);
 	}
 
-	// Reuse or close the socket, if it's open.
-	if (req->fd > -1) {
-		if (req->node) {
-			if (! timedout) {
-				cl_cluster_node_fd_put(req->node, req->fd);
-			}
-			else {
-				cf_close(req->fd);
-				cf_atomic32_decr(&req->node->n_fds_open);
-			}
+	if (signal != CL_LIMIT_NONE) {
+		uint64_t latency_us = cf_getus() - req->node_start_us;
+		uint32_t target_ms =
+				cf_atomic32_get(req->asc->runtime_options.node_latency_target_ms);
 
-			req->fd = -1;
+		cl_cluster_node_latency_add(node, latency_us);
+
+		if (target_ms != 0 && latency_us > (uint64_t)target_ms * 1000) {
+			signal = CL_LIMIT_CONGESTED;
 		}
-		else {
+	}
+
+	cl_cluster_node_limit_release(node,
+			cf_atomic32_get(req->asc->runtime_options.node_concurrency_max),
+			(cl_limit_signal)signal);
+}
+
+// Abandon a request that lost a hedged read race, without a callback. Its
+// socket may yet get a response, so close it rather than pool it. An original
+// request restarted onto a pipelined connection since its hedge went out stays
+// on the connection, to have its response dropped - closing the connection
+// would fail every other request on it.
+static void
+req_abandon(cl_request* req)
+{
+	if (req->hedge_timer_set) {
+		evtimer_del(cl_request_get_hedge_event(req));
+		req->hedge_timer_set = false;
+	}
+
+	if (req->pipe) {
+		// Keep the timeout - if the response never comes, the connection's
+		// response stream can't be trusted, and the timeout closes it.
+		req->pipe_discard = true;
+		req->hedge = NULL;
+		return;
+	}
+
+	if (req->timeout_set) {
+		evtimer_del(cl_request_get_timeout_event(req));
+		req->timeout_set = false;
+	}
+
+	// Note - using network event slot for base-hop event.
+	if (req->network_set || req->base_hop_set) {
+		event_del(cl_request_get_network_event(req));
+	}
+
+	if (! req->node) {
+		// Could be in the cluster's pending queue. Scrub it out.
+		MUTEX_LOCK(req->asc->request_q_lock);
+		cf_queue_delete(req->asc->request_q, &req, true /*onlyone*/);
+		MUTEX_UNLOCK(req->asc->request_q_lock);
+	}
+
+	if (req->fd > -1) {
+		cf_close(req->fd);
+		req->fd = -1;
+
+		if (req->node) {
+			cf_atomic32_decr(&req->node->n_fds_open);
+		}
+	}
+
+	if (req->node) {
+		// The node has been at least this slow - keep its latency honest.
+		if (req->in_flight) {
+			cl_cluster_node_latency_add(req->node,
+					cf_getus() - req->node_start_us);
+		}
+
+		cl_request_node_done(req, req->node, CL_LIMIT_NONE);
+		cl_cluster_node_put(req->node);
+		req->node = 0;
+	}
+
+	cl_request_destroy(req);
+}
+
+// A request abandoned on a pipelined connection is done with it - its response
+// was read and dropped, or the connection went. Release it, without a callback.
+void
+cl_request_discard_done(cl_request* req, int signal)
+{
+	if (req->timeout_set) {
+		evtimer_del(cl_request_get_timeout_event(req));
+		req->timeout_set = false;
+	}
+
+	cl_request_node_done(req, req->node, signal);
+	cl_cluster_node_put(req->node);
+	req->node = 0;
+
+	cl_request_destroy(req);
+}
+
+void
+ev2citrusleaf_request_complete(cl_request *req, bool timedout)
+{
+//	dump_buf("request complete :", req->rd_buf, req->rd_buf_size);
+
+	if (req->timeout_set) {
+		evtimer_del(cl_request_get_timeout_event(req));
+	}
+
+	if (req->hedge_timer_set) {
+		evtimer_del(cl_request_get_hedge_event(req));
+	}
+
+	if (req->hedge) {
+		// Done (or timed out) before our hedge - abandon the hedge.
+		req_abandon(req->hedge);
+		req->hedge = NULL;
+		cf_atomic_int_incr(&req->asc->n_hedges_wasted);
+	}
+	else if (req->hedge_of) {
+		// A hedge done first - abandon the original request, and complete in
+		// its place.
+		req_abandon(req->hedge_of);
+		req->hedge_of = NULL;
+		cf_atomic_int_incr(&req->asc->n_hedges_won);
+	}
+
+	// If this request is still on a pipelined connection, the connection has
+	// to go - other requests on it are retried.
+	if (req->pipe) {
+		cl_pipe_request_abort(req);
+	}
+
+	// critical to close this before the file descriptor associated, for some
+	// reason
+	if (req->network_set) {
+		event_del(cl_request_get_network_event(req));
+	}
+
+	// Reuse or close the socket, if it's open.
+	if (req->fd > -1) {
+		if (req->node) {
+			if (! timedout) {
+				cl_cluster_node_fd_put(req->node, req->fd);
+			}
+			else {
+				cf_close(req->fd);
+				cf_atomic32_decr(&req->node->n_fds_open);
+			}
+
+			req->fd = -1;
+		}
+		else {
 			// Since we can't assert:
 			cf_error("request has open fd but null node");
 		}
@@ -1089,7 +2158,11 @@ ev2citrusleaf_request_complete(cl_request *req, bool timedout)
 		uint32_t	generation;
 		uint32_t	expiration;
 
-		parse(req->rd_buf, req->rd_buf_size, bins, n_bins, &return_code, &generation, &expiration);
+		// If borrowing, bin values point into rd_buf, which lasts until after
+		// the callback.
+		bool borrow = cf_atomic32_get(req->asc->runtime_options.borrowed_results) != 0;
+
+		parse(req->rd_buf, req->rd_buf_size, bins, n_bins, &return_code, &generation, &expiration, borrow);
 
 		// For simplicity & backwards-compatibility, convert server-side
 		// timeouts to the usual timeout return-code:
@@ -1098,6 +2171,14 @@ ev2citrusleaf_request_complete(cl_request *req, bool timedout)
 			cf_debug("server-side timeout");
 		}
 
+		// Free the node's concurrency limit slot before the callback, which
+		// may well start another transaction.
+		if (req->node) {
+			cl_request_node_done(req, req->node,
+					return_code == EV2CITRUSLEAF_FAIL_TIMEOUT ?
+							CL_LIMIT_CONGESTED : CL_LIMIT_GOOD);
+		}
+
 		// Call the callback
 		(req->user_cb) (return_code ,bins, n_bins, generation, expiration, req->user_data);
 
@@ -1105,11 +2186,13 @@ ev2citrusleaf_request_complete(cl_request *req, bool timedout)
 			switch (return_code) {
 			// TODO - any other server return codes to consider as failures?
 			case EV2CITRUSLEAF_FAIL_TIMEOUT:
+				cl_cluster_node_dun(req->node, CL_NODE_DUN_TIMEOUT);
 				cl_cluster_node_had_failure(req->node);
 				cf_atomic_int_incr(&req->asc->n_req_timeouts);
 				cf_atomic_int_incr(&req->asc->n_req_failures);
 				break;
 			default:
+				cl_cluster_node_ok(req->node);
 				cl_cluster_node_had_success(req->node);
 				cf_atomic_int_incr(&req->asc->n_req_successes);
 				break;
@@ -1136,10 +2219,15 @@ ev2citrusleaf_request_complete(cl_request *req, bool timedout)
 			event_del(cl_request_get_network_event(req));
 		}
 
+		if (req->node) {
+			cl_request_node_done(req, req->node, CL_LIMIT_CONGESTED);
+		}
+
 		// call with a timeout specifier
 		(req->user_cb) (EV2CITRUSLEAF_FAIL_TIMEOUT , 0, 0, 0, 0, req->user_data);
 
 		if (req->node) {
+			cl_cluster_node_dun(req->node, CL_NODE_DUN_TIMEOUT);
 			cl_cluster_node_had_failure(req->node);
 		}
 
@@ -1194,36 +2282,69 @@ ev2citrusleaf_is_connected(int fd)
 
 
 static inline void
-req_cross_thread_init_and_lock(cl_request* req)
+req_cross_thread_start(cl_request* req)
 {
 	if (req->asc->static_options.cross_threaded) {
-		MUTEX_ALLOC(req->cross_thread_lock);
-		MUTEX_LOCK(req->cross_thread_lock);
-		req->cross_thread_locked = true;
+		cl_start_begin(&req->start_state);
 	}
 }
 
 static inline void
-req_cross_thread_unlock(cl_request* req)
+req_cross_thread_done(cl_request* req)
 {
-	if (req->cross_thread_lock) {
-		req->cross_thread_locked = false;
-		MUTEX_UNLOCK(req->cross_thread_lock);
+	if (req->start_state != CL_START_DONE) {
+		cl_start_end(&req->start_state, true);
+		// Events are now free to proceed (and may even destroy the request).
 	}
 }
 
-static inline void
+static inline uint32_t
 event_cross_thread_check(cl_request* req)
 {
 	// In cross-threaded transaction models, events firing in the callback
 	// thread need to be sure the original non-blocking call is complete.
-	if (req->cross_thread_lock) {
-		MUTEX_LOCK(req->cross_thread_lock);
-		MUTEX_UNLOCK(req->cross_thread_lock);
-	}
+	return cl_start_wait(&req->start_state);
 }
 
 
+//
+// Send as much of the request as the socket will take.
+//
+static int
+req_send(cl_request* req, int fd)
+{
+#ifndef CF_WINDOWS
+	if (req->wr_iov_n != 0) {
+		// Skip what's already been sent.
+		struct iovec iov[req->wr_iov_n];
+		size_t skip = req->wr_buf_pos;
+		int n_iov = 0;
+
+		for (int i = 0; i < req->wr_iov_n; i++) {
+			if (skip >= req->wr_iov[i].iov_len) {
+				skip -= req->wr_iov[i].iov_len;
+				continue;
+			}
+
+			iov[n_iov].iov_base = (uint8_t*)req->wr_iov[i].iov_base + skip;
+			iov[n_iov].iov_len = req->wr_iov[i].iov_len - skip;
+			n_iov++;
+			skip = 0;
+		}
+
+		struct msghdr msg;
+
+		memset((void*)&msg, 0, sizeof(msg));
+		msg.msg_iov = iov;
+		msg.msg_iovlen = n_iov;
+
+		return (int)sendmsg(fd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+	}
+#endif
+
+	return send(fd, (cf_socket_data_t*)&req->wr_buf[req->wr_buf_pos], (cf_socket_size_t)(req->wr_buf_size - req->wr_buf_pos), MSG_DONTWAIT | MSG_NOSIGNAL);
+}
+
 //
 // Got an event on one of our file descriptors. DTRT.
 // NETWORK EVENTS ONLY
@@ -1247,7 +2368,7 @@ ev2citrusleaf_event(evutil_socket_t fd, short event, void *udata)
 
 	if (event & EV_WRITE) {
 		if (req->wr_buf_pos < req->wr_buf_size) {
-			rv = send(fd, (cf_socket_data_t*)&req->wr_buf[req->wr_buf_pos], (cf_socket_size_t)(req->wr_buf_size - req->wr_buf_pos), MSG_DONTWAIT | MSG_NOSIGNAL);
+			rv = req_send(req, fd);
 
 			if (rv > 0) {
 				req->wr_buf_pos += rv;
@@ -1269,11 +2390,40 @@ ev2citrusleaf_event(evutil_socket_t fd, short event, void *udata)
 	}
 
 	if (event & EV_READ) {
-		if (req->rd_header_pos < sizeof(cl_proto) ) {
-			rv = recv(fd, (cf_socket_data_t*)&req->rd_header_buf[req->rd_header_pos], (cf_socket_size_t)(sizeof(cl_proto) - req->rd_header_pos), MSG_DONTWAIT | MSG_NOSIGNAL);
+		bool drained = false;
+
+		if (req->rd_header_pos < sizeof(cl_proto)) {
+			// Read ahead into rd_tmp - this usually gets the whole response in
+			// one recv().
+			size_t want = sizeof(req->rd_tmp) - req->rd_header_pos;
+
+			rv = recv(fd, (cf_socket_data_t*)&req->rd_tmp[req->rd_header_pos], (cf_socket_size_t)want, MSG_DONTWAIT | MSG_NOSIGNAL);
+			cf_atomic_int_incr(&req->asc->n_recv_calls);
 
 			if (rv > 0) {
+				drained = (size_t)rv < want;
 				req->rd_header_pos += rv;
+
+				if (req->rd_header_pos >= sizeof(cl_proto)) {
+					size_t body_got = req->rd_header_pos - sizeof(cl_proto);
+
+					req->rd_header_pos = sizeof(cl_proto);
+
+					if (! cl_request_rd_buf_init(req)) {
+						goto Fail;
+					}
+
+					if (body_got > req->rd_buf_size) {
+						cf_warn("ev2citrusleaf read: got %zu bytes for %zu byte response: fd %d", body_got, req->rd_buf_size, fd);
+						goto Fail;
+					}
+
+					if (req->rd_buf != cl_request_rd_tmp_body(req)) {
+						memcpy(req->rd_buf, cl_request_rd_tmp_body(req), body_got);
+					}
+
+					req->rd_buf_pos = body_got;
+				}
 			}
 			else if (rv == 0) {
 				// connection has been closed by the server. A normal occurrance, perhaps.
@@ -1289,35 +2439,14 @@ ev2citrusleaf_event(evutil_socket_t fd, short event, void *udata)
 		}
 
 		if (req->rd_header_pos == sizeof(cl_proto)) {
-			// initialize the read buffer
-			if (req->rd_buf_size == 0) {
-				// calculate msg size
-				cl_proto *proto = (cl_proto *) req->rd_header_buf;
-				cl_proto_swap(proto);
-
-				// set up the read buffer
-				if (proto->sz <= sizeof(req->rd_tmp))
-					req->rd_buf = req->rd_tmp;
-				else {
-					req->rd_buf = (uint8_t*)malloc(proto->sz);
-					if (!req->rd_buf) {
-						cf_error("malloc fail");
-						goto Fail;
-					}
-				}
-				req->rd_buf_pos = 0;
-				req->rd_buf_size = proto->sz;
-			}
-			if (req->rd_buf_pos < req->rd_buf_size) {
+			// If the read-ahead didn't fill rd_tmp the socket's drained - wait
+			// for the next event rather than recv() again now.
+			if (req->rd_buf_pos < req->rd_buf_size && ! drained) {
 				rv = recv(fd, (cf_socket_data_t*)&req->rd_buf[req->rd_buf_pos], (cf_socket_size_t)(req->rd_buf_size - req->rd_buf_pos), MSG_DONTWAIT | MSG_NOSIGNAL);
+				cf_atomic_int_incr(&req->asc->n_recv_calls);
 
 				if (rv > 0) {
 					req->rd_buf_pos += rv;
-					if (req->rd_buf_pos == req->rd_buf_size) {
-						ev2citrusleaf_request_complete(req, false); // frees the req
-						req = 0;
-						return;
-					}
 				}
 				else if (rv == 0) {
 					// connection has been closed by the server. Errno is invalid. A normal occurrance, perhaps.
@@ -1329,11 +2458,13 @@ ev2citrusleaf_event(evutil_socket_t fd, short event, void *udata)
 					goto Fail;
 				}
 			}
-		}
-		else {
-			cf_debug("ev2citrusleaf event: received read while not expecting fd %d", fd);
-		}
 
+			if (req->rd_buf_pos == req->rd_buf_size) {
+				ev2citrusleaf_request_complete(req, false); // frees the req
+				req = 0;
+				return;
+			}
+		}
 	}
 
 	if (req) {
@@ -1352,14 +2483,33 @@ Fail:
 	cf_close(fd);
 	req->fd = -1;
 
+	if (req->fd_trusted) {
+		// Perhaps the remote end closed this socket while it was pooled - the
+		// restart below retries on a checked socket.
+		req->fd_trust_failed = true;
+	}
+
 	if (req->node) {
 		cf_atomic32_decr(&req->node->n_fds_open);
+
+		// Don't blame the node for a stale pooled socket.
+		if (! req->fd_trusted) {
+			cl_cluster_node_dun(req->node, CL_NODE_DUN_NET_ERROR);
+		}
 	}
 	else {
 		// Since we can't assert:
 		cf_error("request network event has null node");
 	}
 
+	if (req->hedge_of) {
+		// A failed hedge isn't retried - the original request carries on.
+		req->hedge_of->hedge = NULL;
+		cf_atomic_int_incr(&req->asc->n_hedges_wasted);
+		req_abandon(req);
+		return;
+	}
+
 	if (req->wpol == CL_WRITE_ONESHOT) {
 		cf_info("ev2citrusleaf: write oneshot with network error, terminating now");
 		// So far we're not distinguishing whether the failure was a local or
@@ -1371,13 +2521,15 @@ Fail:
 		cf_debug("ev2citrusleaf failed a request, calling restart");
 
 		if (req->node) {
+			req->failed_node = req->node;
+			cl_request_node_done(req, req->node, CL_LIMIT_NONE);
 			cl_cluster_node_put(req->node);
 			req->node = 0;
 		}
 		// else - already "asserted".
 
 		cf_atomic_int_incr(&req->asc->n_internal_retries);
-		ev2citrusleaf_restart(req, false);
+		ev2citrusleaf_restart(req, false, false);
 	}
 
 	delta =  cf_getms() - _s;
@@ -1400,18 +2552,22 @@ ev2citrusleaf_timer_expired(evutil_socket_t fd, short event, void *udata)
 
 	uint64_t _s = cf_getms();
 
-	event_cross_thread_check(req);
-
-	if (req->cross_thread_lock && ! req->timeout_set) {
-		// In the cross-threaded model, if the non-blocking call fails we use
-		// the timeout_set flag (double-purposed!) to tell this event to just
-		// destroy the cl_request and stop.
+	if (event_cross_thread_check(req) == CL_START_FAILED) {
+		// In the cross-threaded model, if the non-blocking call fails this
+		// event just destroys the cl_request and stops.
 		cl_request_destroy(req);
 		return;
 	}
 
 	req->timeout_set = false;
 
+	if (req->pipe_discard) {
+		// Lost a hedged read race, and its response never came.
+		cl_pipe_request_abort(req);
+		cl_request_discard_done(req, CL_LIMIT_NONE);
+		return;
+	}
+
 	cf_atomic_int_incr(&req->asc->n_req_timeouts);
 	ev2citrusleaf_request_complete(req, true /*timedout*/); // frees the req
 
@@ -1437,7 +2593,7 @@ ev2citrusleaf_base_hop_event(evutil_socket_t fd, short event, void *udata)
 	cf_debug("have node now, restart request %p", req);
 
 	cf_atomic_int_incr(&req->asc->n_internal_retries_off_q);
-	ev2citrusleaf_restart(req, false);
+	ev2citrusleaf_restart(req, false, false);
 }
 
 
@@ -1459,11 +2615,83 @@ ev2citrusleaf_base_hop(cl_request *req)
 }
 
 
+// Hand a request its node and socket, and start sending.
+static void
+req_start_on_node(cl_request* req, cl_cluster_node* node, int fd, bool pooled)
+{
+	req->node = node;
+	req->fd = fd;
+
+	short what = EV_WRITE;
+
+	// A pooled socket is connected and almost always writable - try sending
+	// right away rather than waiting a loop iteration for the write event. If
+	// it all goes, we only need to wait for the response. Partial sends,
+	// would-blocks and errors are all left to the write event to sort out.
+	if (pooled) {
+		int rv = req_send(req, fd);
+
+		if (rv > 0) {
+			req->wr_buf_pos += rv;
+
+			if (req->wr_buf_pos == req->wr_buf_size) {
+				what = EV_READ;
+			}
+		}
+	}
+
+	event_assign(cl_request_get_network_event(req), req->base, fd, what,
+			ev2citrusleaf_event, req);
+
+	req->network_set = true;
+
+	if (0 != event_add(cl_request_get_network_event(req), 0 /*timeout*/)) {
+		cf_warn("unable to add event for request %p: will time out", req);
+		req->network_set = false;
+	}
+}
+
+
+static inline cl_partition_table*
+req_partition_table(cl_request* req)
+{
+	return req->nsh ?
+			cl_namespace_get_table(req->nsh) :
+			cl_partition_table_get_by_ns(req->asc, req->ns);
+}
+
+//
+// Get a node for the request. A read retried after a node failed walks on to
+// the partition's next replica, if there is one.
+//
+static cl_cluster_node*
+req_node_get(cl_request* req)
+{
+	ev2citrusleaf_cluster* asc = req->asc;
+
+	if (req->failed_node && ! req->write && asc->n_partitions != 0) {
+		cl_cluster_node* node = cl_partition_table_get_other(asc,
+				req_partition_table(req),
+				cl_partition_getid(asc->n_partitions, &req->d),
+				(const cl_cluster_node*)req->failed_node);
+
+		if (node) {
+			return node;
+		}
+	}
+
+	return cl_cluster_node_get(asc, req_partition_table(req), &req->d,
+			req->write);
+}
+
 // Return values:
 // true  - success, or will time out, or queued for internal retry
-// false - throttled
+// false - throttled, over node's concurrency limit, or node's circuit is open
+//
+// Only a first try (from the public API) may fail on a node's concurrency
+// limit or open circuit - internal retries carry on regardless.
 bool
-ev2citrusleaf_restart(cl_request* req, bool may_throttle)
+ev2citrusleaf_restart(cl_request* req, bool may_throttle, bool first_try)
 {
 	// If we've already timed out, don't bother adding the network event, just
 	// let the timeout event (which no doubt is about to fire) clean up.
@@ -1471,117 +2699,453 @@ ev2citrusleaf_restart(cl_request* req, bool may_throttle)
 		return true;
 	}
 
-	// Set/reset state to beginning of transaction.
-	req->wr_buf_pos = 0;
-	req->rd_buf_pos = 0;
-	req->rd_header_pos = 0;
+	// Set/reset state to beginning of transaction.
+	req->wr_buf_pos = 0;
+	req->rd_header_pos = 0;
+	cl_request_rd_buf_free(req);
+
+	// Sanity checks.
+	if (req->node) {
+		cf_error("req has node %s on restart", req->node->name);
+	}
+
+	if (req->fd != -1) {
+		cf_error("req has fd %d on restart", req->fd);
+	}
+
+	req->node = 0;
+	req->fd = -1;
+
+	cl_cluster_node* node;
+	int fd;
+	bool pooled;
+	int i;
+
+	bool pipelining = ! req->asc->static_options.cross_threaded &&
+			cf_atomic32_get(req->asc->runtime_options.pipelining) != 0;
+
+	for (i = 0; i < 5; i++) {
+		node = req_node_get(req);
+
+		if (! node) {
+			cf_queue_push(req->asc->request_q, &req);
+			return true;
+		}
+
+		// Throttle before bothering to get the socket.
+		if (may_throttle && cl_cluster_node_throttle_drop(node)) {
+			// Randomly dropping this transaction in order to throttle.
+			cf_atomic_int_incr(&req->asc->n_req_throttles);
+			cl_cluster_node_put(node);
+			return false;
+		}
+
+		bool probe = false;
+
+		if (first_try && ! cl_cluster_node_circuit_allow(node, &probe)) {
+			// Node's circuit is open and we had no other choice - fail fast.
+			cf_atomic_int_incr(&req->asc->n_req_circuit_rejects);
+			cl_cluster_node_put(node);
+			return false;
+		}
+
+		uint32_t limit_max =
+				cf_atomic32_get(req->asc->runtime_options.node_concurrency_max);
+
+		if (! cl_cluster_node_limit_admit(node, limit_max, first_try)) {
+			// Over this node's concurrency limit - fail fast.
+			if (probe) {
+				cl_cluster_node_probe_done(node);
+			}
+
+			cf_atomic_int_incr(&req->asc->n_req_limited);
+			cl_cluster_node_put(node);
+			return false;
+		}
+
+		req->in_flight = true;
+		req->probe = probe;
+		req->node_start_us = cf_getus();
+
+		if (pipelining) {
+			req->node = node;
+
+			if (cl_pipe_add(req)) {
+				return true;
+			}
+
+			// Pipelined connections maxed out - use a socket of our own.
+			req->node = 0;
+		}
+
+		// Skip checking recently used sockets for remote close, unless we
+		// can't safely retry, or already had to.
+		bool trust_recent = req->wpol != CL_WRITE_ONESHOT &&
+				! req->fd_trust_failed;
+
+		fd = -1;
+
+		while (fd == -1) {
+			fd = cl_cluster_node_fd_get(node, trust_recent, &pooled);
+		}
+
+		req->fd_trusted = pooled && trust_recent;
+
+		if (fd > -1) {
+			// Got a good socket.
+			break;
+		}
+
+		if (fd < -1) {
+			cl_cluster_node_dun(node, CL_NODE_DUN_CONNECT);
+		}
+
+		// Couldn't get a socket, try again from scratch. Probably we'll get the
+		// same node, but for normal reads or if we got a random node we could
+		// get a different node.
+		req->failed_node = node;
+		cl_request_node_done(req, node, CL_LIMIT_NONE);
+		cl_cluster_node_put(node);
+	}
+
+	// Safety - don't retry from scratch forever.
+	if (i == 5) {
+		cf_info("request restart loop quit after 5 tries");
+		cf_queue_push(req->asc->request_q, &req);
+		return true;
+	}
+
+	// Go ahead, using the good node and socket.
+	req_start_on_node(req, node, fd, pooled);
+
+	return true;
+}
+
+
+
+void
+start_failed(cl_request* req)
+{
+	if (! req->timeout_set) {
+		cl_request_destroy(req);
+		return;
+	}
+
+	if (req->start_state != CL_START_DONE) {
+		// Unfortunately, in the cross-threaded model we have no idea whether
+		// the timer has fired (and is waiting for us) or not, so we can't just
+		// destroy - the destroy would race the fired timer. The only way to
+		// safely destroy is to let the timer event do it.
+
+		// Tell the timer event that the non-blocking call failed ...
+		cl_start_end(&req->start_state, false);
+		// ... and don't destroy - the timer event will do it.
+	}
+	else {
+		event_del(cl_request_get_timeout_event(req));
+		cl_request_destroy(req);
+	}
+}
+
+
+static inline uint32_t
+zero_copy_threshold(ev2citrusleaf_cluster* asc)
+{
+#ifndef CF_WINDOWS
+	return cf_atomic32_get(asc->runtime_options.zero_copy_threshold);
+#else
+	// No sendmsg() - always copy values.
+	return 0;
+#endif
+}
+
+//
+// Add an (assigned) timer event. Transactions mostly share a few timeout
+// values, so use a libevent common timeout per value - events with the same
+// duration then sit in one O(1) queue instead of each taking a slot in the
+// base's timer heap. libevent finds the base's existing common timeout for a
+// duration, and allows only so many per base, after which we use the heap.
+//
+int
+cl_timer_add(struct event* ev, int timeout_ms)
+{
+	struct timeval tv;
+
+	tv.tv_sec = timeout_ms / 1000;
+	tv.tv_usec = (timeout_ms % 1000) * 1000;
+
+	const struct timeval* p_tv =
+			event_base_init_common_timeout(event_get_base(ev), &tv);
+
+	if (p_tv) {
+		cf_atomic_int_incr(&g_cl_stats.timers_common);
+	}
+	else {
+		p_tv = &tv;
+		cf_atomic_int_incr(&g_cl_stats.timers_heap);
+	}
+
+	return evtimer_add(ev, p_tv);
+}
+
+//
+// To implement timeout, add timer event in parallel to network event chain.
+// Destroys the request and returns false on failure.
+//
+static bool
+start_timeout(cl_request* req)
+{
+	if (req->timeout_ms) {
+		if (req->timeout_ms < 0) {
+			cf_warn("timeout < 0");
+			cl_request_destroy(req);
+			return false;
+		}
+
+		if (req->timeout_ms > 1000 * 60) {
+			cf_info("timeout > 60 seconds");
+		}
+
+		evtimer_assign(cl_request_get_timeout_event(req), req->base,
+				ev2citrusleaf_timer_expired, req);
+
+		if (0 != cl_timer_add(cl_request_get_timeout_event(req),
+				req->timeout_ms)) {
+			cf_warn("request add timer failed");
+			cl_request_destroy(req);
+			return false;
+		}
+
+		req->timeout_set = true;
+	}
+	// else there's no timeout - supported, but a bit dangerous.
+
+	return true;
+}
+
+//
+// Hedged reads.
+//
+
+// Most unused hedge credits kept - enough for a burst of 10 hedges.
+#define HEDGE_CREDITS_MAX (100 * 10)
+
+static bool
+hedge_credit_take(ev2citrusleaf_cluster* asc)
+{
+	uint32_t credits;
+
+	do {
+		credits = cf_atomic32_get(asc->hedge_credits);
+
+		if (credits < 100) {
+			return false;
+		}
+	} while ((uint32_t)cf_atomic32_cas(&asc->hedge_credits, credits,
+			credits - 100) != credits);
+
+	return true;
+}
+
+//
+// Send a slow read to the partition's other replica too. Whichever response
+// comes first completes the transaction.
+//
+static void
+req_hedge(cl_request* req)
+{
+	ev2citrusleaf_cluster* asc = req->asc;
+
+	// Skip if the request is between nodes, or has gone pipelined (abandoning
+	// it would fail the whole connection).
+	if (! req->node || req->pipe || req->hedge || asc->n_partitions == 0) {
+		return;
+	}
+
+	cl_cluster_node* node = cl_partition_table_get_other(asc,
+			req_partition_table(req),
+			cl_partition_getid(asc->n_partitions, &req->d), req->node);
+
+	if (! node) {
+		return;
+	}
+
+	if (! hedge_credit_take(asc)) {
+		cf_atomic_int_incr(&asc->n_hedges_no_budget);
+		cl_cluster_node_put(node);
+		return;
+	}
+
+	// A hedge is optional - don't push the node over its concurrency limit.
+	if (! cl_cluster_node_limit_admit(node,
+			cf_atomic32_get(asc->runtime_options.node_concurrency_max), true)) {
+		cl_cluster_node_put(node);
+		return;
+	}
+
+	cl_request* hedge = cl_request_create(asc, req->base, 0, NULL,
+			req->user_cb, req->user_data);
+
+	if (! hedge) {
+		cl_cluster_node_limit_release(node,
+				cf_atomic32_get(asc->runtime_options.node_concurrency_max),
+				CL_LIMIT_NONE);
+		cl_cluster_node_put(node);
+		return;
+	}
+
+	hedge->in_flight = true;
+	hedge->node_start_us = cf_getus();
+	hedge->start_time = req->start_time;
+	hedge->wpol = req->wpol;
+	hedge->nsh = req->nsh;
+
+	if (! req->nsh) {
+		strcpy(hedge->ns, req->ns);
+	}
+
+	hedge->d = req->d;
+
+	// Reads have no values sent in place - the packet is all in wr_buf.
+	if (req->wr_buf_size <= sizeof(hedge->wr_tmp)) {
+		hedge->wr_buf = hedge->wr_tmp;
+	}
+	else if (! (hedge->wr_buf = (uint8_t*)malloc(req->wr_buf_size))) {
+		cf_error("hedge request allocation failed");
+		cl_request_node_done(hedge, node, CL_LIMIT_NONE);
+		cl_cluster_node_put(node);
+		cl_request_destroy(hedge);
+		return;
+	}
+
+	memcpy(hedge->wr_buf, req->wr_buf, req->wr_buf_size);
+	hedge->wr_buf_size = req->wr_buf_size;
+
+	// Check pooled sockets for remote close - a hedge isn't retried.
+	bool pooled;
+	int fd = -1;
+
+	while (fd == -1) {
+		fd = cl_cluster_node_fd_get(node, false, &pooled);
+	}
+
+	if (fd < -1) {
+		cl_cluster_node_dun(node, CL_NODE_DUN_CONNECT);
+		cl_request_node_done(hedge, node, CL_LIMIT_NONE);
+		cl_cluster_node_put(node);
+		cl_request_destroy(hedge);
+		return;
+	}
+
+	hedge->hedge_of = req;
+	req->hedge = hedge;
+
+	req_start_on_node(hedge, node, fd, pooled);
+	cf_atomic_int_incr(&asc->n_hedges);
+}
 
-	// Sanity checks.
-	if (req->node) {
-		cf_error("req has node %s on restart", req->node->name);
-	}
+static void
+ev2citrusleaf_hedge_event(evutil_socket_t fd, short event, void* udata)
+{
+	cl_request* req = (cl_request*)udata;
 
-	if (req->fd != -1) {
-		cf_error("req has fd %d on restart", req->fd);
+	if (req->MAGIC != CL_REQUEST_MAGIC)	{
+		cf_error("hedge event: BAD MAGIC");
+		return;
 	}
 
-	req->node = 0;
-	req->fd = -1;
+	// The timer is only added once the start has succeeded.
+	event_cross_thread_check(req);
 
-	cl_cluster_node* node;
-	int fd;
-	int i;
+	req->hedge_timer_set = false;
 
-	for (i = 0; i < 5; i++) {
-		node = cl_cluster_node_get(req->asc, req->ns, &req->d, req->write);
+	req_hedge(req);
+}
 
-		if (! node) {
-			cf_queue_push(req->asc->request_q, &req);
-			return true;
-		}
+//
+// If hedging reads, add a timer to hedge this read if it's slow. Reads that
+// are queued, or pipelined, aren't hedged. Budget credits accrue here.
+//
+static void
+req_hedge_arm(cl_request* req)
+{
+	ev2citrusleaf_cluster* asc = req->asc;
 
-		// Throttle before bothering to get the socket.
-		if (may_throttle && cl_cluster_node_throttle_drop(node)) {
-			// Randomly dropping this transaction in order to throttle.
-			cf_atomic_int_incr(&req->asc->n_req_throttles);
-			cl_cluster_node_put(node);
-			return false;
-		}
+	if (cf_atomic32_get(asc->runtime_options.hedge_reads) == 0 ||
+			req->write || req->wr_iov_n != 0 || ! req->node || req->pipe) {
+		return;
+	}
 
-		fd = -1;
+	if (cf_atomic32_get(asc->hedge_credits) < HEDGE_CREDITS_MAX) {
+		cf_atomic32_add(&asc->hedge_credits,
+				cf_atomic32_get(asc->runtime_options.hedge_budget_pct));
+	}
 
-		while (fd == -1) {
-			fd = cl_cluster_node_fd_get(node);
-		}
+	uint32_t delay_ms = cf_atomic32_get(asc->runtime_options.hedge_delay_ms);
+	bool fixed = delay_ms != 0;
 
-		if (fd > -1) {
-			// Got a good socket.
-			break;
+	if (! fixed) {
+		uint32_t p95_us = cf_atomic32_get(req->node->latency_p95_us);
+
+		if (p95_us == 0) {
+			// No latency samples yet.
+			return;
 		}
 
-		// Couldn't get a socket, try again from scratch. Probably we'll get the
-		// same node, but for normal reads or if we got a random node we could
-		// get a different node.
-		cl_cluster_node_put(node);
+		delay_ms = (p95_us + 999) / 1000;
 	}
 
-	// Safety - don't retry from scratch forever.
-	if (i == 5) {
-		cf_info("request restart loop quit after 5 tries");
-		cf_queue_push(req->asc->request_q, &req);
-		return true;
+	if (req->timeout_ms > 0 && delay_ms >= (uint32_t)req->timeout_ms) {
+		return;
 	}
 
-	// Go ahead, using the good node and socket.
-	req->node = node;
-	req->fd = fd;
+	struct event* ev = cl_request_get_hedge_event(req);
 
-	event_assign(cl_request_get_network_event(req), req->base, fd, EV_WRITE,
-			ev2citrusleaf_event, req);
+	evtimer_assign(ev, req->base, ev2citrusleaf_hedge_event, req);
 
-	req->network_set = true;
+	int rv;
 
-	if (0 != event_add(cl_request_get_network_event(req), 0 /*timeout*/)) {
-		cf_warn("unable to add event for request %p: will time out", req);
-		req->network_set = false;
+	// A fixed delay can share a common timeout, but a varying one would use
+	// them all up.
+	if (fixed) {
+		rv = cl_timer_add(ev, (int)delay_ms);
 	}
+	else {
+		struct timeval tv;
 
-	return true;
-}
+		tv.tv_sec = delay_ms / 1000;
+		tv.tv_usec = (delay_ms % 1000) * 1000;
 
+		rv = evtimer_add(ev, &tv);
+	}
 
-void
-start_failed(cl_request* req)
-{
-	if (! req->timeout_set) {
-		cl_request_destroy(req);
+	if (rv != 0) {
+		cf_warn("request add hedge timer failed");
 		return;
 	}
 
-	if (req->cross_thread_lock) {
-		// Unfortunately, in the cross-threaded model we have no idea whether
-		// the timer has fired (and is waiting at the lock) or not, so we can't
-		// just unlock and destroy - the destroy would race the fired timer. The
-		// only way to safely destroy is to let the timer event do it.
+	req->hedge_timer_set = true;
+}
 
-		// Tell the timer event that the non-blocking call failed.
-		req->timeout_set = false;
-		req_cross_thread_unlock(req);
-		// ... and don't destroy - the timer event will do it.
+// Interned handles outlast the request - other handles are on the caller's
+// stack, so copy the name.
+static inline void
+req_set_namespace(cl_request* req, const ev2citrusleaf_namespace_handle* nsh)
+{
+	if (nsh->interned) {
+		req->nsh = nsh;
 	}
 	else {
-		event_del(cl_request_get_timeout_event(req));
-		cl_request_destroy(req);
+		memcpy(req->ns, nsh->ns, nsh->ns_len + 1);
 	}
 }
 
-
 //
 // Omnibus internal function used by public transactions API.
 //
 int
-ev2citrusleaf_start(cl_request* req, int info1, int info2, const char* ns,
-		const char* set, const ev2citrusleaf_object* key,
+ev2citrusleaf_start(cl_request* req, int info1, int info2,
+		const ev2citrusleaf_namespace_handle* nsh, const char* set, const ev2citrusleaf_object* key,
 		const cf_digest* digest, const ev2citrusleaf_write_parameters* wparam,
 		const ev2citrusleaf_bin* bins, int n_bins)
 {
@@ -1589,47 +3153,25 @@ ev2citrusleaf_start(cl_request* req, int info1, int info2, const char* ns,
 		return EV2CITRUSLEAF_FAIL_CLIENT_ERROR;
 	}
 
-	req_cross_thread_init_and_lock(req);
-
-	// To implement timeout, add timer event in parallel to network event chain.
-	if (req->timeout_ms) {
-		if (req->timeout_ms < 0) {
-			cf_warn("timeout < 0");
-			cl_request_destroy(req);
-			return EV2CITRUSLEAF_FAIL_CLIENT_ERROR;
-		}
-
-		if (req->timeout_ms > 1000 * 60) {
-			cf_info("timeout > 60 seconds");
-		}
-
-		evtimer_assign(cl_request_get_timeout_event(req), req->base,
-				ev2citrusleaf_timer_expired, req);
-
-		struct timeval tv;
-		tv.tv_sec = req->timeout_ms / 1000;
-		tv.tv_usec = (req->timeout_ms % 1000) * 1000;
-
-		if (0 != evtimer_add(cl_request_get_timeout_event(req), &tv)) {
-			cf_warn("request add timer failed");
-			cl_request_destroy(req);
-			return EV2CITRUSLEAF_FAIL_CLIENT_ERROR;
-		}
+	req_cross_thread_start(req);
 
-		req->timeout_set = true;
+	if (! start_timeout(req)) {
+		return EV2CITRUSLEAF_FAIL_CLIENT_ERROR;
 	}
-	// else there's no timeout - supported, but a bit dangerous.
 
     req->start_time = cf_getms();
 	req->wr_buf = req->wr_tmp;
 	req->wr_buf_size = sizeof(req->wr_tmp);
 	req->write = (info2 & CL_MSG_INFO2_WRITE) ? true : false;
-	strcpy(req->ns, ns);
+	req_set_namespace(req, nsh);
+
+	req->wr_iov = req->wr_iov_tmp;
 
 	// Fill out the request write buffer.
-	if (0 != compile(info1, info2, ns, set, key, digest, wparam,
+	if (0 != compile(info1, info2, nsh, set, key, digest, wparam,
 			req->timeout_ms, bins, n_bins, &req->wr_buf, &req->wr_buf_size,
-			&req->d)) {
+			&req->d, zero_copy_threshold(req->asc), &req->wr_iov,
+			&req->wr_iov_n)) {
 		start_failed(req);
 		return EV2CITRUSLEAF_FAIL_CLIENT_ERROR;
 	}
@@ -1642,13 +3184,15 @@ ev2citrusleaf_start(cl_request* req, int info1, int info2, const char* ns,
 			cf_atomic32_get(req->asc->runtime_options.throttle_reads) != 0;
 
 	// Initial restart - get node and socket and initiate network event chain.
-	if (! ev2citrusleaf_restart(req, may_throttle)) {
+	if (! ev2citrusleaf_restart(req, may_throttle, true)) {
 		start_failed(req);
 		return EV2CITRUSLEAF_FAIL_THROTTLED;
 	}
 
+	req_hedge_arm(req);
+
 	cf_atomic_int_incr(&req->asc->requests_in_progress);
-	req_cross_thread_unlock(req);
+	req_cross_thread_done(req);
 
 	return EV2CITRUSLEAF_OK;
 }
@@ -1658,7 +3202,8 @@ ev2citrusleaf_start(cl_request* req, int info1, int info2, const char* ns,
 // Internal function used by public operate transaction API.
 //
 int
-ev2citrusleaf_start_op(cl_request* req, const char* ns, const char* set,
+ev2citrusleaf_start_op(cl_request* req,
+		const ev2citrusleaf_namespace_handle* nsh, const char* set,
 		const ev2citrusleaf_object* key, const cf_digest* digest,
 		const ev2citrusleaf_operation* ops, int n_ops,
 		const ev2citrusleaf_write_parameters* wparam)
@@ -1667,59 +3212,94 @@ ev2citrusleaf_start_op(cl_request* req, const char* ns, const char* set,
 		return EV2CITRUSLEAF_FAIL_CLIENT_ERROR;
 	}
 
-	req_cross_thread_init_and_lock(req);
+	req_cross_thread_start(req);
 
-	// To implement timeout, add timer event in parallel to network event chain.
-	if (req->timeout_ms) {
-		if (req->timeout_ms < 0) {
-			cf_warn("timeout < 0");
-			cl_request_destroy(req);
-			return EV2CITRUSLEAF_FAIL_CLIENT_ERROR;
-		}
+	if (! start_timeout(req)) {
+		return EV2CITRUSLEAF_FAIL_CLIENT_ERROR;
+	}
 
-		if (req->timeout_ms > 1000 * 60) {
-			cf_info("timeout > 60 seconds");
-		}
+    req->start_time = cf_getms();
+	req->wr_buf = req->wr_tmp;
+	req->wr_buf_size = sizeof(req->wr_tmp);
+	req_set_namespace(req, nsh);
 
-		evtimer_assign(cl_request_get_timeout_event(req), req->base,
-				ev2citrusleaf_timer_expired, req);
+	req->wr_iov = req->wr_iov_tmp;
 
-		struct timeval tv;
-		tv.tv_sec = req->timeout_ms / 1000;
-		tv.tv_usec = (req->timeout_ms % 1000) * 1000;
+	// Fill out the request write buffer.
+	if (0 != compile_ops(nsh, set, key, digest, ops, n_ops, wparam, &req->wr_buf,
+			&req->wr_buf_size, &req->d, &req->write,
+			zero_copy_threshold(req->asc), &req->wr_iov, &req->wr_iov_n)) {
+		start_failed(req);
+		return EV2CITRUSLEAF_FAIL_CLIENT_ERROR;
+	}
 
-		if (0 != evtimer_add(cl_request_get_timeout_event(req), &tv)) {
-			cf_warn("request add timer failed");
-			cl_request_destroy(req);
-			return EV2CITRUSLEAF_FAIL_CLIENT_ERROR;
-		}
+//	dump_buf("sending request to cluster:", req->wr_buf, req->wr_buf_size);
 
-		req->timeout_set = true;
+	// Initial restart - get node and socket and initiate network event chain.
+	if (! ev2citrusleaf_restart(req, false, true)) {
+		start_failed(req);
+		return EV2CITRUSLEAF_FAIL_THROTTLED;
+	}
+
+	req_hedge_arm(req);
+
+	cf_atomic_int_incr(&req->asc->requests_in_progress);
+	req_cross_thread_done(req);
+
+	return EV2CITRUSLEAF_OK;
+}
+
+
+//
+// Internal function used by public prepared transaction API.
+//
+int
+ev2citrusleaf_start_prepared(cl_request* req, const ev2citrusleaf_prepared* p,
+		const ev2citrusleaf_object* key, const cf_digest* digest,
+		const ev2citrusleaf_object* values,
+		const ev2citrusleaf_write_parameters* wparam)
+{
+	if (! req) {
+		return EV2CITRUSLEAF_FAIL_CLIENT_ERROR;
+	}
+
+	req_cross_thread_start(req);
+
+	if (! start_timeout(req)) {
+		return EV2CITRUSLEAF_FAIL_CLIENT_ERROR;
 	}
-	// else there's no timeout - supported, but a bit dangerous.
 
     req->start_time = cf_getms();
 	req->wr_buf = req->wr_tmp;
 	req->wr_buf_size = sizeof(req->wr_tmp);
-	strcpy(req->ns, ns);
+	req->write = p->write;
+	strcpy(req->ns, p->ns);
+
+	req->wr_iov = req->wr_iov_tmp;
 
 	// Fill out the request write buffer.
-	if (0 != compile_ops(ns, set, key, digest, ops, n_ops, wparam, &req->wr_buf,
-			&req->wr_buf_size, &req->d, &req->write)) {
+	if (0 != compile_prepared(p, key, digest, values, wparam, req->timeout_ms,
+			&req->wr_buf, &req->wr_buf_size, &req->d,
+			zero_copy_threshold(req->asc), &req->wr_iov, &req->wr_iov_n)) {
 		start_failed(req);
 		return EV2CITRUSLEAF_FAIL_CLIENT_ERROR;
 	}
 
-//	dump_buf("sending request to cluster:", req->wr_buf, req->wr_buf_size);
+	// Determine whether we may throttle.
+	bool may_throttle = req->write ?
+			cf_atomic32_get(req->asc->runtime_options.throttle_writes) != 0 :
+			cf_atomic32_get(req->asc->runtime_options.throttle_reads) != 0;
 
 	// Initial restart - get node and socket and initiate network event chain.
-	if (! ev2citrusleaf_restart(req, false)) {
+	if (! ev2citrusleaf_restart(req, may_throttle, true)) {
 		start_failed(req);
 		return EV2CITRUSLEAF_FAIL_THROTTLED;
 	}
 
+	req_hedge_arm(req);
+
 	cf_atomic_int_incr(&req->asc->requests_in_progress);
-	req_cross_thread_unlock(req);
+	req_cross_thread_done(req);
 
 	return EV2CITRUSLEAF_OK;
 }
@@ -1730,22 +3310,46 @@ ev2citrusleaf_start_op(cl_request* req, const char* ns, const char* set,
 // head functions
 //
 
+// Calls passing a namespace name use a handle on the stack.
+#define NAMESPACE_HANDLE_INIT(__nsh, __cl, __ns) \
+	if (! cl_namespace_init(&__nsh, __cl, __ns)) { \
+		return EV2CITRUSLEAF_FAIL_CLIENT_ERROR; \
+	}
+
+static inline bool
+namespace_handle_ok(ev2citrusleaf_cluster* cl,
+		const ev2citrusleaf_namespace_handle* nsh)
+{
+	if (! nsh || nsh->asc != cl) {
+		cf_warn("namespace handle %p not from cluster %p", nsh, cl);
+		return false;
+	}
+
+	return true;
+}
+
 int
 ev2citrusleaf_get_all(ev2citrusleaf_cluster *cl, char *ns, char *set, ev2citrusleaf_object *key,
 	int timeout_ms, ev2citrusleaf_callback cb, void *udata, struct event_base *base)
 {
+	ev2citrusleaf_namespace_handle nsh;
+	NAMESPACE_HANDLE_INIT(nsh, cl, ns);
+
 	cl_request* req = cl_request_create(cl, base, timeout_ms, NULL, cb, udata);
 
-	return ev2citrusleaf_start(req, CL_MSG_INFO1_READ | CL_MSG_INFO1_GET_ALL, 0, ns, set, key, 0/*digest*/, 0, 0, 0);
+	return ev2citrusleaf_start(req, CL_MSG_INFO1_READ | CL_MSG_INFO1_GET_ALL, 0, &nsh, set, key, 0/*digest*/, 0, 0, 0);
 }
 
 int
 ev2citrusleaf_get_all_digest(ev2citrusleaf_cluster *cl, char *ns, cf_digest *digest,
 	int timeout_ms, ev2citrusleaf_callback cb, void *udata, struct event_base *base)
 {
+	ev2citrusleaf_namespace_handle nsh;
+	NAMESPACE_HANDLE_INIT(nsh, cl, ns);
+
 	cl_request* req = cl_request_create(cl, base, timeout_ms, NULL, cb, udata);
 
-	return ev2citrusleaf_start(req, CL_MSG_INFO1_READ | CL_MSG_INFO1_GET_ALL, 0, ns, 0/*set*/, 0/*key*/, digest, 0, 0, 0);
+	return ev2citrusleaf_start(req, CL_MSG_INFO1_READ | CL_MSG_INFO1_GET_ALL, 0, &nsh, 0/*set*/, 0/*key*/, digest, 0, 0, 0);
 }
 
 int
@@ -1753,9 +3357,25 @@ ev2citrusleaf_put(ev2citrusleaf_cluster *cl, char *ns, char *set, ev2citrusleaf_
 	ev2citrusleaf_bin *bins, int n_bins, ev2citrusleaf_write_parameters *wparam, int timeout_ms,
 	ev2citrusleaf_callback cb, void *udata, struct event_base *base)
 {
+	ev2citrusleaf_namespace_handle nsh;
+	NAMESPACE_HANDLE_INIT(nsh, cl, ns);
+
+	return ev2citrusleaf_put_h(cl, &nsh, set, key, bins, n_bins, wparam, timeout_ms, cb, udata, base);
+}
+
+int
+ev2citrusleaf_put_h(ev2citrusleaf_cluster *cl, const ev2citrusleaf_namespace_handle *nsh,
+	char *set, ev2citrusleaf_object *key, ev2citrusleaf_bin *bins, int n_bins,
+	ev2citrusleaf_write_parameters *wparam, int timeout_ms, ev2citrusleaf_callback cb,
+	void *udata, struct event_base *base)
+{
+	if (! namespace_handle_ok(cl, nsh)) {
+		return EV2CITRUSLEAF_FAIL_CLIENT_ERROR;
+	}
+
 	cl_request* req = cl_request_create(cl, base, timeout_ms, wparam, cb, udata);
 
-	return ev2citrusleaf_start(req, 0, CL_MSG_INFO2_WRITE, ns, set, key, 0/*digest*/, wparam, bins, n_bins);
+	return ev2citrusleaf_start(req, 0, CL_MSG_INFO2_WRITE, nsh, set, key, 0/*digest*/, wparam, bins, n_bins);
 }
 
 int
@@ -1763,9 +3383,24 @@ ev2citrusleaf_put_digest(ev2citrusleaf_cluster *cl, char *ns, cf_digest *digest,
 	ev2citrusleaf_bin *bins, int n_bins, ev2citrusleaf_write_parameters *wparam, int timeout_ms,
 	ev2citrusleaf_callback cb, void *udata, struct event_base *base)
 {
+	ev2citrusleaf_namespace_handle nsh;
+	NAMESPACE_HANDLE_INIT(nsh, cl, ns);
+
+	return ev2citrusleaf_put_digest_h(cl, &nsh, digest, bins, n_bins, wparam, timeout_ms, cb, udata, base);
+}
+
+int
+ev2citrusleaf_put_digest_h(ev2citrusleaf_cluster *cl, const ev2citrusleaf_namespace_handle *nsh,
+	cf_digest *digest, ev2citrusleaf_bin *bins, int n_bins, ev2citrusleaf_write_parameters *wparam,
+	int timeout_ms, ev2citrusleaf_callback cb, void *udata, struct event_base *base)
+{
+	if (! namespace_handle_ok(cl, nsh)) {
+		return EV2CITRUSLEAF_FAIL_CLIENT_ERROR;
+	}
+
 	cl_request* req = cl_request_create(cl, base, timeout_ms, wparam, cb, udata);
 
-	return ev2citrusleaf_start(req, 0, CL_MSG_INFO2_WRITE, ns, 0/*set*/, 0/*key*/, digest, wparam, bins, n_bins);
+	return ev2citrusleaf_start(req, 0, CL_MSG_INFO2_WRITE, nsh, 0/*set*/, 0/*key*/, digest, wparam, bins, n_bins);
 }
 
 int
@@ -1773,6 +3408,21 @@ ev2citrusleaf_get(ev2citrusleaf_cluster *cl, char *ns, char *set, ev2citrusleaf_
 	const char **bin_names, int n_bin_names, int timeout_ms, ev2citrusleaf_callback cb, void *udata,
 	struct event_base *base)
 {
+	ev2citrusleaf_namespace_handle nsh;
+	NAMESPACE_HANDLE_INIT(nsh, cl, ns);
+
+	return ev2citrusleaf_get_h(cl, &nsh, set, key, bin_names, n_bin_names, timeout_ms, cb, udata, base);
+}
+
+int
+ev2citrusleaf_get_h(ev2citrusleaf_cluster *cl, const ev2citrusleaf_namespace_handle *nsh,
+	char *set, ev2citrusleaf_object *key, const char **bin_names, int n_bin_names, int timeout_ms,
+	ev2citrusleaf_callback cb, void *udata, struct event_base *base)
+{
+	if (! namespace_handle_ok(cl, nsh)) {
+		return EV2CITRUSLEAF_FAIL_CLIENT_ERROR;
+	}
+
 	ev2citrusleaf_bin* bins = (ev2citrusleaf_bin*)alloca(n_bin_names * sizeof(ev2citrusleaf_bin));
 
 	for (int i = 0; i < n_bin_names; i++) {
@@ -1782,7 +3432,7 @@ ev2citrusleaf_get(ev2citrusleaf_cluster *cl, char *ns, char *set, ev2citrusleaf_
 
 	cl_request* req = cl_request_create(cl, base, timeout_ms, NULL, cb, udata);
 
-	return ev2citrusleaf_start(req, CL_MSG_INFO1_READ, 0, ns, set, key, 0/*digest*/, 0, bins, n_bin_names);
+	return ev2citrusleaf_start(req, CL_MSG_INFO1_READ, 0, nsh, set, key, 0/*digest*/, 0, bins, n_bin_names);
 }
 
 int
@@ -1790,6 +3440,21 @@ ev2citrusleaf_get_digest(ev2citrusleaf_cluster *cl, char *ns, cf_digest *digest,
 	const char **bin_names, int n_bin_names, int timeout_ms, ev2citrusleaf_callback cb, void *udata,
 	struct event_base *base)
 {
+	ev2citrusleaf_namespace_handle nsh;
+	NAMESPACE_HANDLE_INIT(nsh, cl, ns);
+
+	return ev2citrusleaf_get_digest_h(cl, &nsh, digest, bin_names, n_bin_names, timeout_ms, cb, udata, base);
+}
+
+int
+ev2citrusleaf_get_digest_h(ev2citrusleaf_cluster *cl, const ev2citrusleaf_namespace_handle *nsh,
+	cf_digest *digest, const char **bin_names, int n_bin_names, int timeout_ms,
+	ev2citrusleaf_callback cb, void *udata, struct event_base *base)
+{
+	if (! namespace_handle_ok(cl, nsh)) {
+		return EV2CITRUSLEAF_FAIL_CLIENT_ERROR;
+	}
+
 	ev2citrusleaf_bin* bins = (ev2citrusleaf_bin*)alloca(n_bin_names * sizeof(ev2citrusleaf_bin));
 
 	for (int i = 0; i < n_bin_names; i++) {
@@ -1799,7 +3464,7 @@ ev2citrusleaf_get_digest(ev2citrusleaf_cluster *cl, char *ns, cf_digest *digest,
 
 	cl_request* req = cl_request_create(cl, base, timeout_ms, NULL, cb, udata);
 
-	return ev2citrusleaf_start(req, CL_MSG_INFO1_READ, 0, ns, 0/*set*/, 0/*key*/, digest, 0, bins, n_bin_names);
+	return ev2citrusleaf_start(req, CL_MSG_INFO1_READ, 0, nsh, 0/*set*/, 0/*key*/, digest, 0, bins, n_bin_names);
 }
 
 int
@@ -1807,9 +3472,12 @@ ev2citrusleaf_delete(ev2citrusleaf_cluster *cl, char *ns, char *set, ev2citrusle
 	ev2citrusleaf_write_parameters *wparam, int timeout_ms, ev2citrusleaf_callback cb, void *udata,
 	struct event_base *base)
 {
+	ev2citrusleaf_namespace_handle nsh;
+	NAMESPACE_HANDLE_INIT(nsh, cl, ns);
+
 	cl_request* req = cl_request_create(cl, base, timeout_ms, wparam, cb, udata);
 
-	return ev2citrusleaf_start(req, 0, CL_MSG_INFO2_WRITE | CL_MSG_INFO2_DELETE, ns, set, key, 0/*digest*/, wparam, 0, 0);
+	return ev2citrusleaf_start(req, 0, CL_MSG_INFO2_WRITE | CL_MSG_INFO2_DELETE, &nsh, set, key, 0/*digest*/, wparam, 0, 0);
 }
 
 int
@@ -1817,9 +3485,12 @@ ev2citrusleaf_delete_digest(ev2citrusleaf_cluster *cl, char *ns, cf_digest *dige
 	ev2citrusleaf_write_parameters *wparam, int timeout_ms, ev2citrusleaf_callback cb, void *udata,
 	struct event_base *base)
 {
+	ev2citrusleaf_namespace_handle nsh;
+	NAMESPACE_HANDLE_INIT(nsh, cl, ns);
+
 	cl_request* req = cl_request_create(cl, base, timeout_ms, wparam, cb, udata);
 
-	return ev2citrusleaf_start(req, 0, CL_MSG_INFO2_WRITE | CL_MSG_INFO2_DELETE, ns, 0/*set*/, 0/*key*/, digest, wparam, 0, 0);
+	return ev2citrusleaf_start(req, 0, CL_MSG_INFO2_WRITE | CL_MSG_INFO2_DELETE, &nsh, 0/*set*/, 0/*key*/, digest, wparam, 0, 0);
 }
 
 int
@@ -1827,9 +3498,25 @@ ev2citrusleaf_operate(ev2citrusleaf_cluster *cl, char *ns, char *set, ev2citrusl
 	ev2citrusleaf_operation *ops, int n_ops, ev2citrusleaf_write_parameters *wparam,
 	int timeout_ms, ev2citrusleaf_callback cb, void *udata, struct event_base *base)
 {
+	ev2citrusleaf_namespace_handle nsh;
+	NAMESPACE_HANDLE_INIT(nsh, cl, ns);
+
+	return ev2citrusleaf_operate_h(cl, &nsh, set, key, ops, n_ops, wparam, timeout_ms, cb, udata, base);
+}
+
+int
+ev2citrusleaf_operate_h(ev2citrusleaf_cluster *cl, const ev2citrusleaf_namespace_handle *nsh,
+	char *set, ev2citrusleaf_object *key, ev2citrusleaf_operation *ops, int n_ops,
+	ev2citrusleaf_write_parameters *wparam, int timeout_ms, ev2citrusleaf_callback cb,
+	void *udata, struct event_base *base)
+{
+	if (! namespace_handle_ok(cl, nsh)) {
+		return EV2CITRUSLEAF_FAIL_CLIENT_ERROR;
+	}
+
 	cl_request* req = cl_request_create(cl, base, timeout_ms, wparam, cb, udata);
 
-	return ev2citrusleaf_start_op(req, ns, set, key, 0/*digest*/, ops, n_ops, wparam);
+	return ev2citrusleaf_start_op(req, nsh, set, key, 0/*digest*/, ops, n_ops, wparam);
 }
 
 int
@@ -1837,9 +3524,45 @@ ev2citrusleaf_operate_digest(ev2citrusleaf_cluster *cl, char *ns, cf_digest *dig
 	ev2citrusleaf_operation *ops, int n_ops, ev2citrusleaf_write_parameters *wparam,
 	int timeout_ms, ev2citrusleaf_callback cb, void *udata, struct event_base *base)
 {
+	ev2citrusleaf_namespace_handle nsh;
+	NAMESPACE_HANDLE_INIT(nsh, cl, ns);
+
+	return ev2citrusleaf_operate_digest_h(cl, &nsh, digest, ops, n_ops, wparam, timeout_ms, cb, udata, base);
+}
+
+int
+ev2citrusleaf_operate_digest_h(ev2citrusleaf_cluster *cl, const ev2citrusleaf_namespace_handle *nsh,
+	cf_digest *digest, ev2citrusleaf_operation *ops, int n_ops, ev2citrusleaf_write_parameters *wparam,
+	int timeout_ms, ev2citrusleaf_callback cb, void *udata, struct event_base *base)
+{
+	if (! namespace_handle_ok(cl, nsh)) {
+		return EV2CITRUSLEAF_FAIL_CLIENT_ERROR;
+	}
+
+	cl_request* req = cl_request_create(cl, base, timeout_ms, wparam, cb, udata);
+
+	return ev2citrusleaf_start_op(req, nsh, 0/*set*/, 0/*key*/, digest, ops, n_ops, wparam);
+}
+
+int
+ev2citrusleaf_prepared_start(ev2citrusleaf_cluster *cl, const ev2citrusleaf_prepared *p,
+	ev2citrusleaf_object *key, cf_digest *digest, ev2citrusleaf_object *values,
+	ev2citrusleaf_write_parameters *wparam, int timeout_ms, ev2citrusleaf_callback cb,
+	void *udata, struct event_base *base)
+{
+	if (! key && ! digest) {
+		cf_warn("prepared start: need key or digest");
+		return EV2CITRUSLEAF_FAIL_CLIENT_ERROR;
+	}
+
+	if (p->write && p->n_ops != 0 && ! values) {
+		cf_warn("prepared start: need values");
+		return EV2CITRUSLEAF_FAIL_CLIENT_ERROR;
+	}
+
 	cl_request* req = cl_request_create(cl, base, timeout_ms, wparam, cb, udata);
 
-	return ev2citrusleaf_start_op(req, ns, 0/*set*/, 0/*key*/, digest, ops, n_ops, wparam);
+	return ev2citrusleaf_start_prepared(req, p, key, digest, values, wparam);
 }
 
 
@@ -1886,6 +3609,7 @@ void
 ev2citrusleaf_shutdown(bool fail_requests)
 {
 	citrusleaf_cluster_shutdown();
+	request_pool_shared_free_all();
 	g_ev2citrusleaf_initialized = false;
 }
 
@@ -1910,17 +3634,29 @@ cluster_print_stats(ev2citrusleaf_cluster* asc)
 	uint32_t n_nodes = cf_vector_size(&asc->node_v);
 	uint32_t n_fds_open = 0;
 	uint32_t n_fds_pooled = 0;
+	uint64_t n_fd_cache_hits = asc->n_fd_cache_hits;
+	uint64_t n_fd_cache_misses = asc->n_fd_cache_misses;
 
 	for (uint32_t i = 0; i < n_nodes; i++) {
 		cl_cluster_node* cn = (cl_cluster_node*)
 				cf_vector_pointer_get(&asc->node_v, i);
 
 		n_fds_open += cf_atomic32_get(cn->n_fds_open);
-		n_fds_pooled += cf_queue_sz(cn->conn_q);
+		n_fds_pooled += cf_atomic32_get(cn->n_fds_idle);
+
+		for (int s = 0; s < FD_CACHE_STRIPES; s++) {
+			n_fd_cache_hits += cn->fd_cache[s].n_hits;
+			n_fd_cache_misses += cn->fd_cache[s].n_misses;
+		}
 	}
 
 	MUTEX_UNLOCK(asc->node_v_lock);
 
+	uint64_t req_pool_hits;
+	uint64_t req_pool_bytes_held;
+
+	request_pool_stats(&req_pool_hits, &req_pool_bytes_held);
+
 	// Most of the stats below are cf_atomic_int, and should be accessed with
 	// cf_atomic_int_get(), but since I know that's a no-op wrapper I'm being
 	// lazy and leaving the code below as-is -- AKG.
@@ -1928,6 +3664,8 @@ cluster_print_stats(ev2citrusleaf_cluster* asc)
 	// Global (non cluster-related) stats first.
 	cf_info("stats :: global ::");
 	cf_info("      :: app-info %lu", g_cl_stats.app_info_requests);
+	cf_info("      :: req-pool : hits %lu mallocs %lu frees %lu held-bytes %lu no-stack %lu", req_pool_hits, g_cl_stats.req_pool_misses, g_cl_stats.req_pool_frees, req_pool_bytes_held, g_cl_stats.req_pool_no_stack);
+	cf_info("      :: timers : common %lu heap %lu", g_cl_stats.timers_common, g_cl_stats.timers_heap);
 
 	// Cluster stats.
 	cf_info("stats :: cluster %p ::", asc);
@@ -1935,9 +3673,31 @@ cluster_print_stats(ev2citrusleaf_cluster* asc)
 	cf_info("      :: tend-pings : success %lu fail %lu", asc->n_ping_successes, asc->n_ping_failures);
 	cf_info("      :: node-info-reqs : success %lu fail %lu timeout %lu", asc->n_node_info_successes, asc->n_node_info_failures, asc->n_node_info_timeouts);
 	cf_info("      :: reqs : success %lu fail %lu timeout %lu throttle %lu in-progress %lu", asc->n_req_successes, asc->n_req_failures, asc->n_req_timeouts, asc->n_req_throttles, asc->requests_in_progress);
+	cf_info("      :: limiter : rejected %lu cuts %lu", asc->n_req_limited, asc->n_limit_cuts);
+	cf_info("      :: circuits : opened %lu closed %lu rejected %lu", asc->n_circuits_opened, asc->n_circuits_closed, asc->n_req_circuit_rejects);
+	cf_info("      :: hedges : sent %lu won %lu wasted %lu no-budget %lu", asc->n_hedges, asc->n_hedges_won, asc->n_hedges_wasted, asc->n_hedges_no_budget);
 	cf_info("      :: req-retries : direct %lu off-q %lu : on-q %d", asc->n_internal_retries, asc->n_internal_retries_off_q, cf_queue_sz(asc->request_q));
+	cf_info("      :: pipeline : reqs %lu conns-opened %lu conns-failed %lu discards %lu", asc->n_pipe_requests, asc->n_pipe_conns_opened, asc->n_pipe_conns_failed, asc->n_pipe_discards);
 	cf_info("      :: batch-node-reqs : success %lu fail %lu timeout %lu", asc->n_batch_node_successes, asc->n_batch_node_failures, asc->n_batch_node_timeouts);
 	cf_info("      :: fds : open %u pooled %u", n_fds_open, n_fds_pooled);
+	cf_info("      :: fd-cache : hits %lu misses %lu spills %lu refills %lu", n_fd_cache_hits, n_fd_cache_misses, asc->n_fd_cache_spills, asc->n_fd_cache_refills);
+	cf_info("      :: fd-checks : done %lu skipped %lu", asc->n_fd_checks, asc->n_fd_checks_skipped);
+	cf_info("      :: fd-warming : connected %lu failed %lu", asc->n_warm_connects, asc->n_warm_connect_failures);
+	cf_info("      :: fd-reaping : reaped %lu rotated %lu", asc->n_fds_reaped, asc->n_fds_rotated);
+	cf_info("      :: syscalls : recv %lu", asc->n_recv_calls);
+
+	// Per-node load and latency.
+	MUTEX_LOCK(asc->node_v_lock);
+
+	for (uint32_t i = 0; i < cf_vector_size(&asc->node_v); i++) {
+		cl_cluster_node* cn = (cl_cluster_node*)
+				cf_vector_pointer_get(&asc->node_v, i);
+
+		cf_info("      :: node %s : in-flight %u latency-us %u", cn->name,
+				cf_atomic32_get(cn->n_in_flight), cf_atomic32_get(cn->latency_us));
+	}
+
+	MUTEX_UNLOCK(asc->node_v_lock);
 }
 
 // TODO - deprecate cluster list and add cluster param to this API call?
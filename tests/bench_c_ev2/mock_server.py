@@ -0,0 +1,151 @@
+# Mock server for the benchmarks - a tiny in-memory subset of the wire protocol.
+# Serves info requests, single-record reads/writes/deletes/increments, and batch
+# gets, on one or more local ports ("nodes"), each owning a share of the
+# partitions. Configured through the environment:
+#   PORTS=3000,3001       ports to listen on, one node each [default 3000]
+#   RF=2                  replication factor [default 2]
+#   NAMESPACES=test       comma-separated namespaces [default test]
+#   DELAYS=3001:0.005     per-port delay before answering, in seconds
+#   STALLS=3001:0.01:0.5  per-port probability of stalling, and stall seconds
+#   IDLE_CLOSE=5          close connections idle this many seconds
+#   KILL_PORT=3001        port that goes silent on SIGUSR1 (SIGUSR2 revives),
+#                         or on a "kill" info request to another port ("revive"
+#                         revives)
+# Prints connection and message stats every 5 seconds. The "replica-reads" info
+# name gives reads served so far by replica index, e.g. "r0=10;r1=9;r2=11" (r0
+# is the master).
+import asyncio, base64, hashlib, os, random, signal, struct
+
+NPART = 4096
+ports = [int(p) for p in os.environ.get("PORTS", "3000").split(",")]
+delays = {int(k): float(v) for k, v in (x.split(":") for x in os.environ.get("DELAYS", "").split(",") if x)}
+IDLE_CLOSE = float(os.environ.get("IDLE_CLOSE", "0"))
+RF = int(os.environ.get("RF", "2"))
+KILL_PORT = int(os.environ.get("KILL_PORT", "0"))
+stalls = {int(a): (float(b), float(c)) for a, b, c in (x.split(":") for x in os.environ.get("STALLS", "").split(",") if x)}
+killed = [False]
+names = {p: "BB9%013X" % p for p in ports}
+store = {}
+stats = {"conns": 0, "msgs": 0}
+per_port = {}
+replica_reads = {}
+
+def bitmap(owner_fn):
+    b = bytearray((NPART + 7) // 8)
+    for p in range(NPART):
+        if owner_fn(p):
+            b[p >> 3] |= 0x80 >> (p & 7)
+    return base64.b64encode(bytes(b)).decode()
+
+def replicas_all(port):
+    n = len(ports); i = ports.index(port)
+    rf = min(RF, n)
+    maps = [bitmap(lambda p, r=r: ports[(p + r) % n] == port) for r in range(rf)]
+    return ";".join("%s:%d,%s" % (ns, rf, ",".join(maps)) for ns in os.environ.get("NAMESPACES", "test").split(","))
+
+def info(port, body):
+    out = []
+    for name in body.decode().split("\n"):
+        if not name: continue
+        if name == "node": v = names[port]
+        elif name == "partitions": v = str(NPART)
+        elif name == "partition-generation": v = "1"
+        elif name == "services": v = ";".join("127.0.0.1:%d" % p for p in ports if p != port)
+        elif name == "replicas-all": v = replicas_all(port)
+        elif name in ("kill", "revive"):
+            killed[0] = name == "kill"; v = str(KILL_PORT)
+            print(name, KILL_PORT, flush=True)
+        elif name == "replica-reads": v = ";".join("r%d=%d" % (r, replica_reads.get(r, 0)) for r in range(min(RF, len(ports))))
+        else: v = ""
+        out.append("%s\t%s\n" % (name, v))
+    return "".join(out).encode()
+
+def proto(t, body):
+    return struct.pack(">Q", (2 << 56) | (t << 48) | len(body)) + body
+
+def msg(result, gen, fields, ops, info3=0):
+    hdr = struct.pack(">BBBBBBIIIHH", 22, 0, 0, info3, 0, result, gen, 0, 0, len(fields), len(ops))
+    b = hdr
+    for t, d in fields: b += struct.pack(">IB", len(d) + 1, t) + d
+    for name, ptype, val in ops:
+        b += struct.pack(">IBBBB", 4 + len(name) + len(val), 1, ptype, 0, len(name)) + name + val
+    return b
+
+def handle_msg(body, port=0):
+    h = struct.unpack(">BBBBBBIIIHH", body[:22])
+    info1, info2, nf, no = h[1], h[2], h[9], h[10]
+    pos = 22; fields = {}
+    for _ in range(nf):
+        sz, t = struct.unpack(">IB", body[pos:pos+5]); fields[t] = body[pos+5:pos+4+sz]; pos += 4 + sz
+    ops = []
+    for _ in range(no):
+        sz, op, pt, ver, nsz = struct.unpack(">IBBBB", body[pos:pos+8])
+        name = body[pos+8:pos+8+nsz]; val = body[pos+8+nsz:pos+4+sz]; pos += 4 + sz
+        ops.append((op, name, pt, val))
+    if 6 in fields:  # batch
+        ds = fields[6]; out = b""
+        for i in range(0, len(ds), 20):
+            d = ds[i:i+20]; rec = store.get(d)
+            if rec is None: out += msg(2, 0, [(4, d)], [])
+            else: out += msg(0, rec[0], [(4, d)], [(n, t, v) for n, (t, v) in rec[1].items()] if not (info1 & 32) else [])
+        return [proto(3, out), proto(3, msg(0, 0, [], [], info3=1))]
+    key = fields.get(4)
+    if key is None:
+        s = fields.get(1, b""); k = fields.get(2, b"")
+        key = hashlib.new("ripemd160", s + k).digest()
+    if port and not (info2 & 1):
+        pid = int.from_bytes(key[:2], "little") & (NPART - 1)
+        rank = (ports.index(port) - pid) % len(ports)
+        replica_reads[rank] = replica_reads.get(rank, 0) + 1
+    if info2 & 1:
+        if info2 & 2:
+            r = 0 if store.pop(key, None) else 2
+            return [proto(3, msg(r, 0, [], []))]
+        rec = store.setdefault(key, [0, {}]); rec[0] += 1
+        for op, name, pt, val in ops:
+            if op == 5:
+                cur = int.from_bytes(rec[1].get(name, (1, b"\0"))[1], "big", signed=True)
+                inc = int.from_bytes(val, "big", signed=True) if val else 0
+                rec[1][name] = (1, struct.pack(">q", cur + inc))
+            elif op == 2: rec[1][name] = (pt, val)
+        reads = [(n, rec[1][n][0], rec[1][n][1]) for op, n, pt, v in ops if op == 1 and n in rec[1]]
+        return [proto(3, msg(0, rec[0], [], reads))]
+    rec = store.get(key)
+    if rec is None: return [proto(3, msg(2, 0, [], []))]
+    if info1 & 2 or not ops: out = [(n, t, v) for n, (t, v) in rec[1].items()]
+    else: out = [(n, rec[1][n][0], rec[1][n][1]) for op, n, pt, v in ops if n in rec[1]]
+    return [proto(3, msg(0, rec[0], [], out))]
+
+async def conn(reader, writer, port):
+    stats["conns"] += 1
+    try:
+        while True:
+            if IDLE_CLOSE: hdr = await asyncio.wait_for(reader.readexactly(8), IDLE_CLOSE)
+            else: hdr = await reader.readexactly(8)
+            v = struct.unpack(">Q", hdr)[0]; t = (v >> 48) & 0xff; sz = v & 0xffffffffffff
+            body = await reader.readexactly(sz)
+            stats["msgs"] += 1
+            if killed[0] and port == KILL_PORT: continue
+            if t == 1: writer.write(proto(1, info(port, body)))
+            else:
+                d = delays.get(port, 0)
+                if d: await asyncio.sleep(d)
+                st = stalls.get(port)
+                if st and random.random() < st[0]: await asyncio.sleep(st[1])
+                per_port[port] = per_port.get(port, 0) + 1
+                for chunk in handle_msg(body, port): writer.write(chunk)
+            await writer.drain()
+    except (asyncio.IncompleteReadError, ConnectionResetError, BrokenPipeError, asyncio.TimeoutError):
+        pass
+    writer.close()
+
+async def main():
+    asyncio.get_running_loop().add_signal_handler(signal.SIGUSR1, lambda: (killed.__setitem__(0, True), print("killed", KILL_PORT, flush=True)))
+    asyncio.get_running_loop().add_signal_handler(signal.SIGUSR2, lambda: killed.__setitem__(0, False))
+    for p in ports:
+        await asyncio.start_server(lambda r, w, p=p: conn(r, w, p), "127.0.0.1", p)
+    while True:
+        await asyncio.sleep(5)
+        print("stats", stats, per_port, {"r%d" % r: n for r, n in sorted(replica_reads.items())}, flush=True)
+
+asyncio.run(main())
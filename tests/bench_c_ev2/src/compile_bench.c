@@ -0,0 +1,149 @@
+/*
+ *  Citrusleaf Tools
+ *  compile_bench
+ *
+ * Times compiling requests the ordinary way against compiling prepared
+ * transactions. tests/unit_c_ev2 prepared_test checks they make the same
+ * bytes.
+ *
+ * No server needed.
+ */
+
+// Built with the library source, to reach the static compile functions.
+#include "ev2citrusleaf.c"
+
+#include <getopt.h>
+#include <stdio.h>
+
+static uint64_t
+now_ns()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static const char* BIN_NAMES[] = { "a", "bb", "ccc" };
+#define N_BINS 3
+
+typedef enum {
+	CASE_GET_KEY,
+	CASE_PUT_KEY,
+	CASE_PUT_DIGEST,
+	N_CASES
+} bench_case;
+
+static const char* CASE_NAMES[] = {
+	"get 3 bins by key",
+	"put 3 bins by key",
+	"put 3 bins by digest"
+};
+
+// Volatile sink so the compiles aren't optimized away.
+static volatile uint8_t g_sink;
+
+static double
+run(bench_case c, bool prepared, uint64_t n)
+{
+	ev2citrusleaf_namespace_handle nsh;
+
+	cl_namespace_init(&nsh, NULL, "test");
+
+	ev2citrusleaf_object key;
+	cf_digest digest;
+
+	ev2citrusleaf_object_init_str(&key, "user:0123456789");
+	ev2citrusleaf_calculate_digest("demo", &key, &digest);
+
+	ev2citrusleaf_object values[N_BINS];
+	ev2citrusleaf_bin bins[N_BINS];
+
+	ev2citrusleaf_object_init_int(&values[0], 42);
+	ev2citrusleaf_object_init_str(&values[1], "some string value");
+	ev2citrusleaf_object_init_blob(&values[2], (void*)"0123456789abcdef", 16);
+
+	bool write = c != CASE_GET_KEY;
+
+	for (int i = 0; i < N_BINS; i++) {
+		strcpy(bins[i].bin_name, BIN_NAMES[i]);
+
+		if (write) {
+			bins[i].object = values[i];
+		}
+		else {
+			bins[i].object.type = CL_NULL;
+		}
+	}
+
+	ev2citrusleaf_prepared* p = write ?
+			ev2citrusleaf_prepare_put("test", "demo", BIN_NAMES, N_BINS) :
+			ev2citrusleaf_prepare_get("test", "demo", BIN_NAMES, N_BINS);
+
+	const ev2citrusleaf_object* k = c == CASE_PUT_DIGEST ? NULL : &key;
+	const cf_digest* d = c == CASE_PUT_DIGEST ? &digest : NULL;
+	int info1 = write ? 0 : CL_MSG_INFO1_READ;
+	int info2 = write ? CL_MSG_INFO2_WRITE : 0;
+
+	uint8_t tmp[1024];
+	struct iovec iov_tmp[CL_REQUEST_IOV_TMP];
+	cf_digest d_r;
+
+	uint64_t start = now_ns();
+
+	for (uint64_t i = 0; i < n; i++) {
+		uint8_t* buf = tmp;
+		size_t buf_size = sizeof(tmp);
+		struct iovec* iov = iov_tmp;
+		int n_iov = 0;
+
+		if (prepared) {
+			compile_prepared(p, k, d, values, NULL, 1000, &buf, &buf_size, &d_r,
+					0, &iov, &n_iov);
+		}
+		else {
+			compile(info1, info2, &nsh, k ? "demo" : NULL, k, d, NULL, 1000,
+					bins, N_BINS, &buf, &buf_size, &d_r, 0, &iov, &n_iov);
+		}
+
+		g_sink = buf[buf_size - 1];
+	}
+
+	uint64_t elapsed = now_ns() - start;
+
+	ev2citrusleaf_prepared_destroy(p);
+
+	return (double)elapsed / n;
+}
+
+int
+main(int argc, char* argv[])
+{
+	uint64_t n = 2000000;
+	int c;
+
+	while ((c = getopt(argc, argv, "n:")) != -1) {
+		switch (c) {
+		case 'n':
+			n = strtoull(optarg, NULL, 10);
+			break;
+		default:
+			fprintf(stderr, "Usage: compile_bench [-n compiles per case]\n");
+			return -1;
+		}
+	}
+
+	for (int i = 0; i < N_CASES; i++) {
+		// Warm up.
+		run((bench_case)i, false, n / 10);
+		run((bench_case)i, true, n / 10);
+
+		double plain_ns = run((bench_case)i, false, n);
+		double prepared_ns = run((bench_case)i, true, n);
+
+		printf("%-22s : compile %6.1f ns, prepared %6.1f ns\n", CASE_NAMES[i],
+				plain_ns, prepared_ns);
+	}
+
+	return 0;
+}
@@ -0,0 +1,286 @@
+/*
+ *  Citrusleaf Tools
+ *  partition_bench
+ *
+ * Cost of keeping partition maps up to date - decoding one replica bitmap
+ * with each base 64 decode version, and applying every node's replicas-all
+ * on a synthetic cluster, the first time, unchanged, and with a share of
+ * partitions migrated between applies. Checks routing against the expected
+ * owners at the end.
+ *
+ * No server needed.
+ */
+
+// Built with the library source, to reach each decode version.
+#include "cf_base64.c"
+
+#include <getopt.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <event2/event.h>
+
+#include "citrusleaf_event2/cl_cluster.h"
+#include "citrusleaf_event2/ev2citrusleaf.h"
+#include "citrusleaf_event2/ev2citrusleaf-internal.h"
+
+// Not in any header.
+extern cl_cluster_node* cl_cluster_node_create(const char* name,
+		ev2citrusleaf_cluster* asc);
+extern void parse_and_apply_replicas_all(cl_cluster_node* cn,
+		char* replicas_all);
+
+#define N_PARTITIONS 4096
+#define BITMAP_SIZE (N_PARTITIONS / 8)
+#define ENCODED_SIZE (((BITMAP_SIZE + 2) / 3) * 4)
+#define MAX_NODES 256
+#define RF 2
+
+static const char ALPHABET[] =
+		"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static uint32_t g_n_nodes = 100;
+static uint32_t g_n_reps = 100;
+
+static cl_cluster_node* g_nodes[MAX_NODES];
+static int g_owners[RF][N_PARTITIONS];
+static char g_replicas_all[MAX_NODES][16 + (RF * (ENCODED_SIZE + 1))];
+
+static uint64_t
+now_ns()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static char*
+encode(const uint8_t* in, int len, char* out)
+{
+	for (int i = 0; i < len; i += 3) {
+		uint32_t v = (in[i] << 16) | (i + 1 < len ? in[i + 1] << 8 : 0) |
+				(i + 2 < len ? in[i + 2] : 0);
+
+		*out++ = ALPHABET[v >> 18];
+		*out++ = ALPHABET[(v >> 12) & 63];
+		*out++ = i + 1 < len ? ALPHABET[(v >> 6) & 63] : '=';
+		*out++ = i + 2 < len ? ALPHABET[v & 63] : '=';
+	}
+
+	return out;
+}
+
+// What a node would say - "test:2,<master bitmap>,<prole bitmap>".
+static void
+build_replicas_all(uint32_t n)
+{
+	char* p = g_replicas_all[n] + sprintf(g_replicas_all[n], "test:%d", RF);
+
+	for (int r = 0; r < RF; r++) {
+		uint8_t bitmap[BITMAP_SIZE] = { 0 };
+
+		for (int pid = 0; pid < N_PARTITIONS; pid++) {
+			if (g_owners[r][pid] == (int)n) {
+				bitmap[pid >> 3] |= 0x80 >> (pid & 7);
+			}
+		}
+
+		*p++ = ',';
+		p = encode(bitmap, BITMAP_SIZE, p);
+	}
+
+	*p = 0;
+}
+
+// Apply every node's replicas-all, as the tend would. Returns microseconds
+// per pass over all nodes.
+static double
+apply_all(uint32_t reps)
+{
+	static char buf[sizeof(g_replicas_all[0])];
+	uint64_t start = now_ns();
+
+	for (uint32_t i = 0; i < reps; i++) {
+		for (uint32_t n = 0; n < g_n_nodes; n++) {
+			// Parsing walks on the string.
+			strcpy(buf, g_replicas_all[n]);
+			parse_and_apply_replicas_all(g_nodes[n], buf);
+		}
+	}
+
+	return (double)(now_ns() - start) / 1000 / reps;
+}
+
+static void
+bench_decode()
+{
+	uint8_t bitmap[BITMAP_SIZE];
+	char encoded[ENCODED_SIZE];
+	uint8_t out[BITMAP_SIZE + 64];
+
+	for (int i = 0; i < BITMAP_SIZE; i++) {
+		bitmap[i] = (uint8_t)(i * 37);
+	}
+
+	encode(bitmap, BITMAP_SIZE, encoded);
+
+	struct {
+		const char* name;
+		decode_fn fn;
+		bool ok;
+	} versions[] = {
+		{ "scalar", decode_scalar, true },
+#ifdef CF_BASE64_X86
+		{ "ssse3", decode_ssse3, __builtin_cpu_supports("ssse3") },
+		{ "avx2", decode_avx2, __builtin_cpu_supports("avx2") },
+#endif
+	};
+
+	const uint32_t n_decodes = 1000000;
+
+	for (size_t v = 0; v < sizeof(versions) / sizeof(versions[0]); v++) {
+		if (! versions[v].ok) {
+			continue;
+		}
+
+		uint64_t start = now_ns();
+
+		for (uint32_t i = 0; i < n_decodes; i++) {
+			versions[v].fn(encoded, ENCODED_SIZE, out);
+			CL_COMPILER_BARRIER();
+		}
+
+		double ns = (double)(now_ns() - start) / n_decodes;
+
+		printf("decode %d-char bitmap, %-6s : %6.1f ns%s\n", ENCODED_SIZE,
+				versions[v].name, ns,
+				memcmp(out, bitmap, BITMAP_SIZE) == 0 ? "" : " (WRONG)");
+	}
+}
+
+static void
+usage()
+{
+	fprintf(stderr, "Usage: partition_bench [-N nodes] [-r repetitions]\n");
+}
+
+int
+main(int argc, char* argv[])
+{
+	int c;
+
+	while ((c = getopt(argc, argv, "N:r:")) != -1) {
+		switch (c) {
+		case 'N':
+			g_n_nodes = atoi(optarg);
+			break;
+		case 'r':
+			g_n_reps = atoi(optarg);
+			break;
+		default:
+			usage();
+			return -1;
+		}
+	}
+
+	if (g_n_nodes < RF || g_n_nodes > MAX_NODES || g_n_reps == 0) {
+		usage();
+		return -1;
+	}
+
+	cf_set_log_level(CF_WARN);
+	ev2citrusleaf_init(NULL);
+
+#ifdef CF_BASE64_X86
+	__builtin_cpu_init();
+#endif
+
+	bench_decode();
+
+	// The base is never run - nothing but this bench touches the cluster.
+	struct event_base* base = event_base_new();
+	ev2citrusleaf_cluster* asc = ev2citrusleaf_cluster_create(base, NULL);
+
+	asc->n_partitions = N_PARTITIONS;
+
+	for (uint32_t n = 0; n < g_n_nodes; n++) {
+		char name[32];
+
+		sprintf(name, "BB9%013X", n);
+		g_nodes[n] = cl_cluster_node_create(name, asc);
+	}
+
+	for (int pid = 0; pid < N_PARTITIONS; pid++) {
+		g_owners[0][pid] = pid % g_n_nodes;
+		g_owners[1][pid] = (pid + 1) % g_n_nodes;
+	}
+
+	for (uint32_t n = 0; n < g_n_nodes; n++) {
+		build_replicas_all(n);
+	}
+
+	printf("%u nodes, %d partitions, rf %d\n", g_n_nodes, N_PARTITIONS, RF);
+	printf("apply all, first time    : %8.1f us\n", apply_all(1));
+	printf("apply all, unchanged     : %8.1f us\n", apply_all(g_n_reps));
+
+	// Move the masters of a different share of partitions to other nodes
+	// between applies.
+	uint32_t pcts[] = { 1, 5 };
+
+	for (int q = 0; q < 2; q++) {
+		double total_us = 0;
+
+		for (uint32_t i = 0; i < g_n_reps; i++) {
+			for (int pid = 0; pid < N_PARTITIONS; pid++) {
+				if ((uint32_t)((pid * 7) + i) % 100 < pcts[q]) {
+					int to = (g_owners[0][pid] + (g_n_nodes / 2)) % g_n_nodes;
+
+					// Keep master and prole distinct.
+					if (to == g_owners[1][pid]) {
+						to = (to + 1) % g_n_nodes;
+					}
+
+					g_owners[0][pid] = to;
+				}
+			}
+
+			for (uint32_t n = 0; n < g_n_nodes; n++) {
+				build_replicas_all(n);
+			}
+
+			total_us += apply_all(1);
+		}
+
+		printf("apply all, %u%% migrated   : %8.1f us\n", pcts[q],
+				total_us / g_n_reps);
+	}
+
+	// Writes go to the master - check each partition's.
+	cl_partition_table* pt = cl_partition_table_get_by_ns(asc, "test");
+	uint32_t n_wrong = 0;
+
+	for (int pid = 0; pid < N_PARTITIONS; pid++) {
+		cl_cluster_node* node = cl_partition_table_get(asc, pt,
+				(cl_partition_id)pid, true);
+
+		if (node != g_nodes[g_owners[0][pid]]) {
+			n_wrong++;
+		}
+
+		if (node) {
+			cl_cluster_node_put(node);
+		}
+	}
+
+	printf("routing mismatches       : %u\n", n_wrong);
+
+	ev2citrusleaf_cluster_destroy(asc);
+	event_base_free(base);
+	ev2citrusleaf_shutdown(true);
+
+	return n_wrong == 0 ? 0 : 1;
+}
@@ -0,0 +1,243 @@
+/*
+ *  Citrusleaf Tools
+ *  pool_bench
+ *
+ * Measures cl_request allocation cost with and without the request pool, both
+ * when requests are freed on the allocating thread and in the cross-threaded
+ * model, where app threads allocate and event base threads free.
+ *
+ * No server needed.
+ */
+#include <getopt.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <event2/event.h>
+
+#include "citrusleaf_event2/ev2citrusleaf.h"
+#include "citrusleaf_event2/ev2citrusleaf-internal.h"
+
+// Not in any header.
+extern cl_request* cl_request_create(ev2citrusleaf_cluster* asc,
+		struct event_base* base, int timeout_ms,
+		ev2citrusleaf_write_parameters* wparam, ev2citrusleaf_callback cb,
+		void* udata);
+extern void cl_request_destroy(cl_request* r);
+
+#define RING_SIZE 1024
+
+static uint64_t g_depth = 64;
+
+// Single producer, single consumer. At most g_depth requests are in flight.
+typedef struct ring_s {
+	cl_request*			slots[RING_SIZE];
+	uint64_t			head __attribute__ ((aligned(64)));
+	uint64_t			tail __attribute__ ((aligned(64)));
+} ring;
+
+typedef struct thread_arg_s {
+	struct event_base*	base;
+	ring*				q;
+	uint64_t			n_ops;
+	uint32_t			batch;
+} thread_arg;
+
+static uint64_t
+now_ns()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// Allocate a batch, then free it, all on this thread.
+static void*
+local_fn(void* pv)
+{
+	thread_arg* arg = (thread_arg*)pv;
+	cl_request* reqs[arg->batch];
+
+	for (uint64_t i = 0; i < arg->n_ops; i += arg->batch) {
+		for (uint32_t b = 0; b < arg->batch; b++) {
+			reqs[b] = cl_request_create(NULL, arg->base, 100, NULL, NULL, NULL);
+		}
+
+		for (uint32_t b = 0; b < arg->batch; b++) {
+			cl_request_destroy(reqs[b]);
+		}
+	}
+
+	return NULL;
+}
+
+// App thread - allocate and hand off to the base thread.
+static void*
+app_fn(void* pv)
+{
+	thread_arg* arg = (thread_arg*)pv;
+	ring* q = arg->q;
+
+	for (uint64_t i = 0; i < arg->n_ops; i++) {
+		cl_request* r = cl_request_create(NULL, arg->base, 100, NULL, NULL, NULL);
+
+		while (q->tail - __atomic_load_n(&q->head, __ATOMIC_ACQUIRE) >=
+				g_depth) {
+			sched_yield();
+		}
+
+		q->slots[q->tail % RING_SIZE] = r;
+		__atomic_store_n(&q->tail, q->tail + 1, __ATOMIC_RELEASE);
+	}
+
+	return NULL;
+}
+
+// Base thread - free what the app thread allocated.
+static void*
+base_fn(void* pv)
+{
+	thread_arg* arg = (thread_arg*)pv;
+	ring* q = arg->q;
+
+	for (uint64_t i = 0; i < arg->n_ops; i++) {
+		while (__atomic_load_n(&q->tail, __ATOMIC_ACQUIRE) == q->head) {
+			sched_yield();
+		}
+
+		cl_request_destroy(q->slots[q->head % RING_SIZE]);
+		__atomic_store_n(&q->head, q->head + 1, __ATOMIC_RELEASE);
+	}
+
+	return NULL;
+}
+
+// Requests malloc'd during the last run, per op.
+static double g_miss_rate;
+
+static double
+run(bool cross, uint32_t n_threads, uint64_t n_ops, uint32_t batch)
+{
+	pthread_t threads[n_threads * 2];
+	thread_arg args[n_threads];
+	struct event_base* bases[n_threads];
+	ring* rings = NULL;
+
+	if (cross && posix_memalign((void**)&rings, 64,
+			n_threads * sizeof(ring)) != 0) {
+		return 0;
+	}
+
+	for (uint32_t i = 0; i < n_threads; i++) {
+		bases[i] = event_base_new();
+		args[i].base = bases[i];
+		args[i].q = cross ? &rings[i] : NULL;
+		args[i].n_ops = n_ops;
+		args[i].batch = batch;
+
+		if (cross) {
+			memset(&rings[i], 0, sizeof(ring));
+		}
+	}
+
+	uint64_t misses = g_cl_stats.req_pool_misses;
+	uint64_t start = now_ns();
+
+	for (uint32_t i = 0; i < n_threads; i++) {
+		if (cross) {
+			pthread_create(&threads[i * 2], NULL, app_fn, &args[i]);
+			pthread_create(&threads[i * 2 + 1], NULL, base_fn, &args[i]);
+		}
+		else {
+			pthread_create(&threads[i], NULL, local_fn, &args[i]);
+		}
+	}
+
+	for (uint32_t i = 0; i < (cross ? n_threads * 2 : n_threads); i++) {
+		pthread_join(threads[i], NULL);
+	}
+
+	uint64_t elapsed = now_ns() - start;
+
+	g_miss_rate = (double)(g_cl_stats.req_pool_misses - misses) /
+			(n_ops * n_threads);
+
+	for (uint32_t i = 0; i < n_threads; i++) {
+		event_base_free(bases[i]);
+	}
+
+	free(rings);
+
+	// Per create + destroy pair, per thread.
+	return (double)elapsed / n_ops;
+}
+
+static void
+usage()
+{
+	fprintf(stderr, "Usage: pool_bench [-t threads] [-n ops per thread] [-b batch] "
+			"[-d cross-threaded depth]\n");
+}
+
+int
+main(int argc, char* argv[])
+{
+	uint32_t n_threads = 4;
+	uint64_t n_ops = 2000000;
+	uint32_t batch = 16;
+	int c;
+
+	while ((c = getopt(argc, argv, "t:n:b:d:")) != -1) {
+		switch (c) {
+		case 't':
+			n_threads = atoi(optarg);
+			break;
+		case 'n':
+			n_ops = strtoull(optarg, NULL, 10);
+			break;
+		case 'b':
+			batch = atoi(optarg);
+			break;
+		case 'd':
+			g_depth = strtoull(optarg, NULL, 10);
+			break;
+		default:
+			usage();
+			return -1;
+		}
+	}
+
+	if (n_threads == 0 || batch == 0 || g_depth == 0 || g_depth > RING_SIZE) {
+		usage();
+		return -1;
+	}
+
+	ev2citrusleaf_init(NULL);
+
+	printf("threads %u, ops per thread %lu, batch %u, depth %lu\n", n_threads,
+			(unsigned long)n_ops, batch, (unsigned long)g_depth);
+
+	uint32_t maxes[] = { 0, 128 };
+
+	for (int m = 0; m < 2; m++) {
+		ev2citrusleaf_request_pool_set_max(maxes[m]);
+
+		double local_ns = run(false, n_threads, n_ops, batch);
+		double local_misses = g_miss_rate;
+		double cross_ns = run(true, n_threads, n_ops, batch);
+
+		printf("pool max %3u : same thread %6.1f ns/op (%.3f mallocs/op), "
+				"cross-threaded %6.1f ns/op (%.3f mallocs/op)\n", maxes[m],
+				local_ns, local_misses, cross_ns, g_miss_rate);
+	}
+
+	ev2citrusleaf_shutdown(false);
+
+	return 0;
+}
@@ -0,0 +1,505 @@
+/*
+ *  Citrusleaf Tools
+ *  replica_bench
+ *
+ * Read throughput and latency under each read replica policy, against a
+ * cluster with replicas to choose between. Slow one node down (e.g. the mock
+ * server's DELAYS) to see how well each policy steers around it, or give the
+ * nodes equal speed to see how evenly reads spread. If the server counts reads
+ * by replica index (the mock server's "replica-reads" info), each policy's
+ * share of reads per replica is shown too.
+ *
+ * With -K, a node is silenced half way into each run (through the mock
+ * server's "kill" info) and revived after, to time how long reads take to
+ * reroute away from it - how long after the kill reads were still being sent
+ * to the node and failing.
+ *
+ * Needs a server - e.g. mock_server.py.
+ */
+#include <getopt.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <event2/event.h>
+
+#include "citrusleaf_event2/ev2citrusleaf.h"
+
+// Latency histogram, in microseconds - the last bucket catches the rest.
+#define HIST_BUCKETS 100000
+
+// Most replica indexes reported.
+#define MAX_REPLICAS 8
+
+static const char* POLICY_NAMES[] = {
+	"random", "master-only", "least-loaded", "lowest-latency"
+};
+#define N_POLICIES 4
+
+static char* g_host = "127.0.0.1";
+static int g_port = 3000;
+static char* g_ns = "test";
+static char* g_set = "set";
+static int g_n_nodes = 2;
+static int g_duration_s = 5;
+static int g_n_inflight = 32;
+static int g_timeout_ms = 1000;
+static bool g_kill = false;
+static bool g_circuit_breaker = false;
+
+static ev2citrusleaf_cluster* g_cluster;
+static struct event_base* g_base;
+
+static uint64_t g_start_us;
+static int g_n_outstanding;
+static int64_t g_key;
+static uint64_t g_n_ok;
+static uint64_t g_n_errors;
+static uint32_t g_hist[HIST_BUCKETS];
+
+// Fires to try again after a get fails to start.
+static struct event* g_retry_timer;
+
+// Kill mode - when the node was silenced, and the reads started since then
+// that failed, when the last of them started, and when it failed.
+static struct event* g_kill_timer;
+static uint64_t g_kill_us;
+static uint64_t g_n_kill_failed;
+static uint64_t g_last_failed_us;
+static uint64_t g_last_failure_us;
+
+static void issue();
+static void kill_failed(uint64_t issue_us);
+
+static uint64_t
+now_us()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+//------------------------------------------------
+// Reads served by replica index, from the server's "replica-reads" info.
+//
+
+typedef struct replica_reads_s {
+	int			n_replicas;
+	uint64_t	counts[MAX_REPLICAS];
+} replica_reads;
+
+static void
+replica_reads_cb(int return_value, char* response, size_t response_len,
+		void* udata)
+{
+	replica_reads* rr = (replica_reads*)udata;
+
+	// Response is "replica-reads\tr0=<n>;r1=<n>;...\n".
+	char* p = response && return_value == EV2CITRUSLEAF_OK ?
+			strchr(response, '\t') : NULL;
+
+	while (p && rr->n_replicas < MAX_REPLICAS) {
+		int index;
+		unsigned long count;
+
+		if (sscanf(p + 1, "r%d=%lu", &index, &count) != 2 ||
+				index != rr->n_replicas) {
+			break;
+		}
+
+		rr->counts[rr->n_replicas++] = count;
+		p = strchr(p + 1, ';');
+	}
+
+	if (response) {
+		free(response);
+	}
+
+	event_base_loopbreak(g_base);
+}
+
+// Returns false if the server doesn't count reads by replica.
+static bool
+replica_reads_get(replica_reads* rr)
+{
+	memset(rr, 0, sizeof(replica_reads));
+
+	if (ev2citrusleaf_info(g_base, NULL, g_host, (short)g_port,
+			"replica-reads", g_timeout_ms, replica_reads_cb, rr) != 0) {
+		return false;
+	}
+
+	event_base_dispatch(g_base);
+
+	return rr->n_replicas != 0;
+}
+
+// A read failed - if it was started since the node went down, it went to
+// the node (or had nowhere else to go), so reads hadn't rerouted yet.
+static void
+kill_failed(uint64_t issue_us)
+{
+	if (g_kill_us == 0 || issue_us < g_kill_us) {
+		return;
+	}
+
+	g_n_kill_failed++;
+
+	if (issue_us > g_last_failed_us) {
+		g_last_failed_us = issue_us;
+	}
+
+	g_last_failure_us = now_us();
+}
+
+static void
+info_cmd_cb(int return_value, char* response, size_t response_len,
+		void* udata)
+{
+	if (return_value != EV2CITRUSLEAF_OK) {
+		fprintf(stderr, "info %s failed\n", (const char*)udata);
+	}
+
+	if (response) {
+		free(response);
+	}
+
+	// The revive is waited for - the kill is sent mid-run.
+	if (strcmp((const char*)udata, "revive") == 0) {
+		event_base_loopbreak(g_base);
+	}
+}
+
+static void
+retry_timer_fn(evutil_socket_t fd, short event, void* udata)
+{
+	issue();
+}
+
+static void
+kill_timer_fn(evutil_socket_t fd, short event, void* udata)
+{
+	if (ev2citrusleaf_info(g_base, NULL, g_host, (short)g_port, "kill",
+			g_timeout_ms, info_cmd_cb, "kill") != 0) {
+		fprintf(stderr, "can't send kill\n");
+		return;
+	}
+
+	g_kill_us = now_us();
+}
+
+static void
+revive()
+{
+	if (ev2citrusleaf_info(g_base, NULL, g_host, (short)g_port, "revive",
+			g_timeout_ms, info_cmd_cb, "revive") == 0) {
+		event_base_dispatch(g_base);
+	}
+}
+
+static void
+replica_reads_print(const replica_reads* before, const replica_reads* after)
+{
+	uint64_t total = 0;
+
+	for (int r = 0; r < after->n_replicas; r++) {
+		total += after->counts[r] - before->counts[r];
+	}
+
+	if (total == 0) {
+		return;
+	}
+
+	printf("%-14s   reads by replica :", "");
+
+	for (int r = 0; r < after->n_replicas; r++) {
+		printf(" r%d %5.1f%%", r,
+				100.0 * (after->counts[r] - before->counts[r]) / total);
+	}
+
+	printf("\n");
+}
+
+static void
+get_cb(int result, ev2citrusleaf_bin* bins, int n_bins, uint32_t generation,
+		uint32_t expiration, void* udata)
+{
+	uint64_t issue_us = (uint64_t)(uintptr_t)udata;
+	uint64_t latency_us = now_us() - issue_us;
+
+	g_hist[latency_us < HIST_BUCKETS ? latency_us : HIST_BUCKETS - 1]++;
+
+	if (result == EV2CITRUSLEAF_OK || result == EV2CITRUSLEAF_FAIL_NOTFOUND) {
+		g_n_ok++;
+	}
+	else {
+		g_n_errors++;
+
+		kill_failed(issue_us);
+	}
+
+	if (bins) {
+		ev2citrusleaf_bins_free(bins, n_bins);
+	}
+
+	g_n_outstanding--;
+	issue();
+}
+
+// Keep g_n_inflight gets going until the run's time is up.
+static void
+issue()
+{
+	while (g_n_outstanding < g_n_inflight) {
+		if (now_us() - g_start_us > (uint64_t)g_duration_s * 1000000) {
+			if (g_n_outstanding == 0) {
+				event_base_loopbreak(g_base);
+			}
+
+			return;
+		}
+
+		ev2citrusleaf_object key;
+		const char* bin_names[] = { "b" };
+
+		ev2citrusleaf_object_init_int(&key, g_key++);
+
+		uint64_t issue_us = now_us();
+
+		if (ev2citrusleaf_get(g_cluster, g_ns, g_set, &key, bin_names, 1,
+				g_timeout_ms, get_cb, (void*)(uintptr_t)issue_us, g_base) != 0) {
+			// E.g. the node's circuit is open and there's no other replica.
+			// Try again shortly, rather than spin.
+			struct timeval tv = { 0, 1000 };
+
+			g_n_errors++;
+			kill_failed(issue_us);
+			evtimer_add(g_retry_timer, &tv);
+			return;
+		}
+
+		g_n_outstanding++;
+	}
+}
+
+static uint32_t
+percentile(uint64_t total, double pct)
+{
+	uint64_t threshold = (uint64_t)(total * pct / 100);
+	uint64_t count = 0;
+
+	for (uint32_t i = 0; i < HIST_BUCKETS; i++) {
+		count += g_hist[i];
+
+		if (count > threshold) {
+			return i;
+		}
+	}
+
+	return HIST_BUCKETS - 1;
+}
+
+static void
+run(ev2citrusleaf_read_replica_policy policy)
+{
+	ev2citrusleaf_cluster_runtime_options opts;
+
+	ev2citrusleaf_cluster_get_runtime_options(g_cluster, &opts);
+	opts.read_replica_policy = policy;
+	ev2citrusleaf_cluster_set_runtime_options(g_cluster, &opts);
+
+	replica_reads rr_before;
+	replica_reads rr_after;
+	bool by_replica = replica_reads_get(&rr_before);
+
+	memset(g_hist, 0, sizeof(g_hist));
+	g_n_ok = 0;
+	g_n_errors = 0;
+	g_kill_us = 0;
+	g_n_kill_failed = 0;
+	g_last_failed_us = 0;
+	g_last_failure_us = 0;
+	g_start_us = now_us();
+
+	if (g_kill) {
+		struct timeval tv = { g_duration_s / 2, (g_duration_s % 2) * 500000 };
+
+		evtimer_add(g_kill_timer, &tv);
+	}
+
+	issue();
+	event_base_dispatch(g_base);
+
+	if (g_kill) {
+		evtimer_del(g_kill_timer);
+	}
+
+	uint64_t total = 0;
+	double sum_us = 0;
+
+	for (uint32_t i = 0; i < HIST_BUCKETS; i++) {
+		total += g_hist[i];
+		sum_us += (double)i * g_hist[i];
+	}
+
+	if (total == 0) {
+		printf("%-14s : no gets completed\n", POLICY_NAMES[policy]);
+		return;
+	}
+
+	printf("%-14s : %6lu gets/s, mean %5.0f us, p50 %5u us, p99 %5u us, "
+			"p99.9 %5u us, errors %lu\n", POLICY_NAMES[policy],
+			(unsigned long)(g_n_ok / g_duration_s), sum_us / total,
+			percentile(total, 50), percentile(total, 99),
+			percentile(total, 99.9), (unsigned long)g_n_errors);
+
+	if (by_replica && replica_reads_get(&rr_after) &&
+			rr_after.n_replicas == rr_before.n_replicas) {
+		replica_reads_print(&rr_before, &rr_after);
+	}
+
+	if (g_kill_us != 0 && g_n_kill_failed == 0) {
+		printf("%-14s   reroute          : no reads failed\n", "");
+	}
+	else if (g_kill_us != 0) {
+		printf("%-14s   reroute          : last failed read sent %lu ms, "
+				"failed %lu ms after kill, %lu reads failed\n", "",
+				(unsigned long)((g_last_failed_us - g_kill_us) / 1000),
+				(unsigned long)((g_last_failure_us - g_kill_us) / 1000),
+				(unsigned long)g_n_kill_failed);
+	}
+
+	if (g_kill) {
+		// Revive the node, and let its circuit (if open) cool before the next
+		// run.
+		revive();
+		sleep(3);
+	}
+}
+
+static void
+usage()
+{
+	fprintf(stderr, "Usage: replica_bench [-h host] [-p port] [-n namespace] "
+			"[-s set] [-N nodes] [-d seconds per policy] [-i in flight] "
+			"[-m timeout ms] [-P policy] [-K] [-c]\n");
+}
+
+int
+main(int argc, char* argv[])
+{
+	int policy = -1;
+	int c;
+
+	while ((c = getopt(argc, argv, "h:p:n:s:N:d:i:m:P:Kc")) != -1) {
+		switch (c) {
+		case 'h':
+			g_host = optarg;
+			break;
+		case 'p':
+			g_port = atoi(optarg);
+			break;
+		case 'n':
+			g_ns = optarg;
+			break;
+		case 's':
+			g_set = optarg;
+			break;
+		case 'N':
+			g_n_nodes = atoi(optarg);
+			break;
+		case 'd':
+			g_duration_s = atoi(optarg);
+			break;
+		case 'i':
+			g_n_inflight = atoi(optarg);
+			break;
+		case 'm':
+			g_timeout_ms = atoi(optarg);
+			break;
+		case 'P':
+			for (policy = 0; policy < N_POLICIES; policy++) {
+				if (strcmp(optarg, POLICY_NAMES[policy]) == 0) {
+					break;
+				}
+			}
+
+			if (policy == N_POLICIES) {
+				usage();
+				return -1;
+			}
+
+			break;
+		case 'K':
+			g_kill = true;
+			break;
+		case 'c':
+			g_circuit_breaker = true;
+			break;
+		default:
+			usage();
+			return -1;
+		}
+	}
+
+	if (g_duration_s < 1 || g_n_inflight < 1 || g_n_nodes < 1) {
+		usage();
+		return -1;
+	}
+
+	cf_set_log_level(CF_WARN);
+	ev2citrusleaf_init(NULL);
+
+	g_base = event_base_new();
+	g_cluster = ev2citrusleaf_cluster_create(NULL, NULL);
+	g_kill_timer = evtimer_new(g_base, kill_timer_fn, NULL);
+	g_retry_timer = evtimer_new(g_base, retry_timer_fn, NULL);
+
+	if (g_circuit_breaker) {
+		ev2citrusleaf_cluster_runtime_options opts;
+
+		ev2citrusleaf_cluster_get_runtime_options(g_cluster, &opts);
+		opts.circuit_breaker = true;
+		ev2citrusleaf_cluster_set_runtime_options(g_cluster, &opts);
+	}
+	ev2citrusleaf_cluster_add_host(g_cluster, g_host, g_port);
+
+	for (int i = 0; i < 50 && ev2citrusleaf_cluster_get_active_node_count(
+			g_cluster) < g_n_nodes; i++) {
+		usleep(100 * 1000);
+	}
+
+	if (ev2citrusleaf_cluster_get_active_node_count(g_cluster) < g_n_nodes) {
+		fprintf(stderr, "fewer than %d nodes found at %s:%d\n", g_n_nodes,
+				g_host, g_port);
+		return -1;
+	}
+
+	// Let the partition maps arrive.
+	sleep(2);
+
+	printf("%d nodes, %d s per policy, %d gets in flight\n", g_n_nodes,
+			g_duration_s, g_n_inflight);
+
+	if (policy >= 0) {
+		run((ev2citrusleaf_read_replica_policy)policy);
+	}
+	else {
+		for (int p = 0; p < N_POLICIES; p++) {
+			run((ev2citrusleaf_read_replica_policy)p);
+		}
+	}
+
+	ev2citrusleaf_cluster_destroy(g_cluster);
+	event_free(g_kill_timer);
+	event_free(g_retry_timer);
+	event_base_free(g_base);
+	ev2citrusleaf_shutdown(true);
+
+	return 0;
+}
@@ -0,0 +1,245 @@
+/*
+ *  Citrusleaf Tools
+ *  route_bench
+ *
+ * Routing throughput against thread count - threads look up partitions'
+ * nodes in the partition map snapshot (as every transaction does) while the
+ * main thread keeps republishing the map, moving every partition's master
+ * back and forth between two nodes as the tend would on migrations. Runs with
+ * 1, 2, 4, ... threads up to the maximum.
+ *
+ * No server needed.
+ */
+#include <getopt.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <event2/event.h>
+
+#include "citrusleaf_event2/cl_cluster.h"
+#include "citrusleaf_event2/ev2citrusleaf.h"
+
+// Not in any header.
+extern cl_cluster_node* cl_cluster_node_create(const char* name,
+		ev2citrusleaf_cluster* asc);
+
+#define N_PARTITIONS 4096
+#define BITMAP_SIZE (N_PARTITIONS / 8)
+#define MAX_THREADS 256
+
+static uint32_t g_max_threads = 8;
+static uint32_t g_seconds = 2;
+static uint32_t g_publish_us = 1000;
+
+static ev2citrusleaf_cluster* g_asc;
+static cl_partition_table* g_pt;
+static cl_cluster_node* g_nodes[2];
+
+static uint8_t g_all[BITMAP_SIZE];
+static uint8_t g_none[BITMAP_SIZE];
+
+static volatile bool g_stop = false;
+
+// Each router's count on its own cache line.
+typedef struct router_s {
+	uint64_t			n_routes;
+	uint64_t			n_misses;
+} __attribute__ ((aligned(64))) router;
+
+static router g_routers[MAX_THREADS];
+
+static uint64_t
+now_ns()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// Make nodes[master] master, and the other node prole, of every partition.
+static void
+set_master(int master)
+{
+	for (int n = 0; n < 2; n++) {
+		const uint8_t* bitmaps[CL_PARTITION_REPLICAS] = {
+			n == master ? g_all : g_none,
+			n == master ? g_none : g_all,
+			g_none,
+			g_none
+		};
+
+		cl_partition_table_update(g_nodes[n], "test", bitmaps);
+	}
+}
+
+// Half reads, half writes, striding over the partitions.
+static void*
+router_fn(void* pv)
+{
+	router* r = (router*)pv;
+	uint32_t pid = (uint32_t)(r - g_routers) * 389;
+	uint64_t n_routes = 0;
+	uint64_t n_misses = 0;
+
+	while (! g_stop) {
+		for (int i = 0; i < 64; i++) {
+			pid = (pid + 97) % N_PARTITIONS;
+
+			cl_cluster_node* node = cl_partition_table_get(g_asc, g_pt,
+					(cl_partition_id)pid, (pid & 1) != 0);
+
+			if (node) {
+				cl_cluster_node_put(node);
+			}
+			else {
+				// Between the two nodes' updates a partition may have no
+				// master.
+				n_misses++;
+			}
+		}
+
+		n_routes += 64;
+	}
+
+	r->n_routes = n_routes;
+	r->n_misses = n_misses;
+
+	return NULL;
+}
+
+static void
+run(uint32_t n_threads)
+{
+	pthread_t threads[MAX_THREADS];
+
+	memset(g_routers, 0, sizeof(g_routers));
+	g_stop = false;
+
+	for (uint32_t i = 0; i < n_threads; i++) {
+		pthread_create(&threads[i], NULL, router_fn, &g_routers[i]);
+	}
+
+	uint64_t start = now_ns();
+	uint64_t end = start + (uint64_t)g_seconds * 1000000000;
+	uint64_t n_publishes = 0;
+
+	// Republish as the tend would - unlike the tend, as often as asked.
+	while (now_ns() < end) {
+		if (g_publish_us == 0) {
+			usleep(10000);
+			continue;
+		}
+
+		set_master((int)(n_publishes & 1));
+		cl_partition_table_reclaim(g_asc);
+		n_publishes++;
+
+		usleep(g_publish_us);
+	}
+
+	g_stop = true;
+
+	uint64_t n_routes = 0;
+	uint64_t n_misses = 0;
+
+	for (uint32_t i = 0; i < n_threads; i++) {
+		pthread_join(threads[i], NULL);
+		n_routes += g_routers[i].n_routes;
+		n_misses += g_routers[i].n_misses;
+	}
+
+	double secs = (double)(now_ns() - start) / 1000000000;
+
+	printf("%3u threads : %8.2f M routes/s, %7.2f M/s per thread, "
+			"%6lu publishes, %lu misses\n", n_threads,
+			(double)n_routes / secs / 1000000,
+			(double)n_routes / secs / 1000000 / n_threads,
+			(unsigned long)n_publishes, (unsigned long)n_misses);
+}
+
+static void
+usage()
+{
+	fprintf(stderr, "Usage: route_bench [-t max threads] [-d seconds] "
+			"[-u microseconds between publishes]\n");
+}
+
+int
+main(int argc, char* argv[])
+{
+	int c;
+
+	while ((c = getopt(argc, argv, "t:d:u:")) != -1) {
+		switch (c) {
+		case 't':
+			g_max_threads = atoi(optarg);
+			break;
+		case 'd':
+			g_seconds = atoi(optarg);
+			break;
+		case 'u':
+			g_publish_us = atoi(optarg);
+			break;
+		default:
+			usage();
+			return -1;
+		}
+	}
+
+	if (g_max_threads == 0 || g_max_threads > MAX_THREADS || g_seconds == 0) {
+		usage();
+		return -1;
+	}
+
+	cf_set_log_level(CF_WARN);
+	ev2citrusleaf_init(NULL);
+
+	// The base is never run - nothing but this bench touches the cluster.
+	struct event_base* base = event_base_new();
+
+	g_asc = ev2citrusleaf_cluster_create(base, NULL);
+	g_asc->n_partitions = N_PARTITIONS;
+
+	g_nodes[0] = cl_cluster_node_create("BB9000000000000A", g_asc);
+	g_nodes[1] = cl_cluster_node_create("BB9000000000000B", g_asc);
+
+	if (! g_nodes[0] || ! g_nodes[1]) {
+		fprintf(stderr, "can't create nodes\n");
+		return -1;
+	}
+
+	memset(g_all, 0xFF, sizeof(g_all));
+	memset(g_none, 0, sizeof(g_none));
+
+	set_master(0);
+	g_pt = cl_partition_table_get_by_ns(g_asc, "test");
+
+	if (g_publish_us == 0) {
+		printf("%d partitions, no republishing\n", N_PARTITIONS);
+	}
+	else {
+		printf("%d partitions, republished every %u us\n", N_PARTITIONS,
+				g_publish_us);
+	}
+
+	for (uint32_t n = 1; n <= g_max_threads; n *= 2) {
+		run(n);
+
+		if (n < g_max_threads && n * 2 > g_max_threads) {
+			run(g_max_threads);
+		}
+	}
+
+	ev2citrusleaf_cluster_destroy(g_asc);
+	event_base_free(base);
+	ev2citrusleaf_shutdown(true);
+
+	return 0;
+}
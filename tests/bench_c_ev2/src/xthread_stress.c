@@ -0,0 +1,321 @@
+/*
+ *  Citrusleaf Tools
+ *  xthread_stress
+ *
+ * Stresses the cross-threaded model - submitter threads start gets, puts and
+ * batch gets on event bases run by other threads, so events may fire while a
+ * start call is still pending (see cl_start_wait()). With a short timeout the
+ * timeout path is exercised too. Each submitter keeps a fixed number of
+ * transactions in flight, and every transaction must call back exactly once.
+ *
+ * Needs a server - e.g. mock_server.py.
+ */
+#include <getopt.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <event2/event.h>
+#include <event2/thread.h>
+
+#include "citrusleaf_event2/ev2citrusleaf.h"
+
+#define MAX_BASES 16
+#define MAX_SUBMITTERS 64
+#define BATCH_SIZE 8
+#define N_KEYS 1000
+
+typedef struct submitter_s {
+	sem_t				slots;
+	int					id;
+} submitter;
+
+static char* g_host = "127.0.0.1";
+static int g_port = 3000;
+static char* g_ns = "test";
+static char* g_set = "set";
+static int g_n_ops = 20000;
+static int g_n_inflight = 64;
+static int g_n_bases = 2;
+static int g_n_submitters = 4;
+static int g_timeout_ms = 1000;
+static bool g_batch = false;
+
+static ev2citrusleaf_cluster* g_cluster;
+static struct event_base* g_bases[MAX_BASES];
+static volatile bool g_stop = false;
+
+static pthread_mutex_t g_lock = PTHREAD_MUTEX_INITIALIZER;
+static int g_n_done = 0;
+static int g_n_timeouts = 0;
+static int g_n_errors = 0;
+
+static void
+transaction_done(submitter* s, int result)
+{
+	pthread_mutex_lock(&g_lock);
+
+	g_n_done++;
+
+	if (result == EV2CITRUSLEAF_FAIL_TIMEOUT) {
+		g_n_timeouts++;
+	}
+	else if (result != EV2CITRUSLEAF_OK &&
+			result != EV2CITRUSLEAF_FAIL_NOTFOUND) {
+		g_n_errors++;
+	}
+
+	pthread_mutex_unlock(&g_lock);
+
+	sem_post(&s->slots);
+}
+
+static void
+record_cb(int result, ev2citrusleaf_bin* bins, int n_bins, uint32_t generation,
+		uint32_t expiration, void* udata)
+{
+	if (bins) {
+		ev2citrusleaf_bins_free(bins, n_bins);
+	}
+
+	transaction_done((submitter*)udata, result);
+}
+
+static void
+batch_cb(int result, ev2citrusleaf_rec* recs, int n_recs, void* udata)
+{
+	for (int i = 0; i < n_recs; i++) {
+		if (recs[i].bins) {
+			ev2citrusleaf_bins_free(recs[i].bins, recs[i].n_bins);
+		}
+	}
+
+	transaction_done((submitter*)udata, result);
+}
+
+static void*
+base_fn(void* pv)
+{
+	struct event_base* base = (struct event_base*)pv;
+
+	while (! g_stop) {
+		event_base_loop(base, EVLOOP_ONCE);
+	}
+
+	return NULL;
+}
+
+static int
+start_batch(submitter* s, int i, struct event_base* base)
+{
+	ev2citrusleaf_object keys[BATCH_SIZE];
+	char key_strs[BATCH_SIZE][32];
+
+	for (int k = 0; k < BATCH_SIZE; k++) {
+		sprintf(key_strs[k], "k-%d-%d", s->id, (i + k) % N_KEYS);
+		ev2citrusleaf_object_init_str(&keys[k], key_strs[k]);
+	}
+
+	return ev2citrusleaf_get_many(g_cluster, g_ns, g_set, keys, BATCH_SIZE,
+			NULL, 0, g_timeout_ms, batch_cb, s, base);
+}
+
+static void*
+submitter_fn(void* pv)
+{
+	submitter* s = (submitter*)pv;
+	unsigned int seed = s->id;
+
+	for (int i = 0; i < g_n_ops; i++) {
+		sem_wait(&s->slots);
+
+		struct event_base* base = g_bases[rand_r(&seed) % g_n_bases];
+		char key_str[32];
+		ev2citrusleaf_object key;
+		int rv;
+
+		sprintf(key_str, "k-%d-%d", s->id, i % N_KEYS);
+		ev2citrusleaf_object_init_str(&key, key_str);
+
+		if (g_batch && i % 16 == 0) {
+			rv = start_batch(s, i, base);
+		}
+		else if (i & 1) {
+			ev2citrusleaf_bin bin;
+
+			strcpy(bin.bin_name, "b");
+			ev2citrusleaf_object_init_str(&bin.object, "v");
+
+			rv = ev2citrusleaf_put(g_cluster, g_ns, g_set, &key, &bin, 1, NULL,
+					g_timeout_ms, record_cb, s, base);
+		}
+		else {
+			const char* bin_names[] = { "b" };
+
+			rv = ev2citrusleaf_get(g_cluster, g_ns, g_set, &key, bin_names, 1,
+					g_timeout_ms, record_cb, s, base);
+		}
+
+		// A failed start never calls back - count it here.
+		if (rv != 0) {
+			fprintf(stderr, "start failed: %d\n", rv);
+			transaction_done(s, -100);
+		}
+	}
+
+	return NULL;
+}
+
+static void
+usage()
+{
+	fprintf(stderr, "Usage: xthread_stress [-h host] [-p port] [-n namespace] "
+			"[-s set] [-o ops per submitter] [-i in flight per submitter] "
+			"[-b bases] [-t submitters] [-m timeout ms] [-B]\n");
+}
+
+int
+main(int argc, char* argv[])
+{
+	int c;
+
+	while ((c = getopt(argc, argv, "h:p:n:s:o:i:b:t:m:B")) != -1) {
+		switch (c) {
+		case 'h':
+			g_host = optarg;
+			break;
+		case 'p':
+			g_port = atoi(optarg);
+			break;
+		case 'n':
+			g_ns = optarg;
+			break;
+		case 's':
+			g_set = optarg;
+			break;
+		case 'o':
+			g_n_ops = atoi(optarg);
+			break;
+		case 'i':
+			g_n_inflight = atoi(optarg);
+			break;
+		case 'b':
+			g_n_bases = atoi(optarg);
+			break;
+		case 't':
+			g_n_submitters = atoi(optarg);
+			break;
+		case 'm':
+			g_timeout_ms = atoi(optarg);
+			break;
+		case 'B':
+			g_batch = true;
+			break;
+		default:
+			usage();
+			return -1;
+		}
+	}
+
+	if (g_n_bases < 1 || g_n_bases > MAX_BASES || g_n_submitters < 1 ||
+			g_n_submitters > MAX_SUBMITTERS || g_n_inflight < 1) {
+		usage();
+		return -1;
+	}
+
+	evthread_use_pthreads();
+	cf_set_log_level(CF_WARN);
+	ev2citrusleaf_init(NULL);
+
+	ev2citrusleaf_cluster_static_options opts = { true };
+
+	g_cluster = ev2citrusleaf_cluster_create(NULL, &opts);
+	ev2citrusleaf_cluster_add_host(g_cluster, g_host, g_port);
+
+	for (int i = 0; i < 50 &&
+			ev2citrusleaf_cluster_get_active_node_count(g_cluster) < 1; i++) {
+		usleep(100 * 1000);
+	}
+
+	if (ev2citrusleaf_cluster_get_active_node_count(g_cluster) < 1) {
+		fprintf(stderr, "no nodes found at %s:%d\n", g_host, g_port);
+		return -1;
+	}
+
+	// Let the partition map arrive.
+	usleep(2500 * 1000);
+
+	pthread_t base_threads[MAX_BASES];
+	struct event* keepalive[MAX_BASES];
+
+	for (int i = 0; i < g_n_bases; i++) {
+		g_bases[i] = event_base_new();
+
+		// Keep the loop from returning early while a base has nothing to do.
+		struct timeval tv = { 3600, 0 };
+
+		keepalive[i] = event_new(g_bases[i], -1, EV_PERSIST, NULL, NULL);
+		event_add(keepalive[i], &tv);
+
+		pthread_create(&base_threads[i], NULL, base_fn, g_bases[i]);
+	}
+
+	submitter subs[MAX_SUBMITTERS];
+	pthread_t sub_threads[MAX_SUBMITTERS];
+	struct timespec start, end;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	for (int i = 0; i < g_n_submitters; i++) {
+		subs[i].id = i;
+		sem_init(&subs[i].slots, 0, g_n_inflight);
+		pthread_create(&sub_threads[i], NULL, submitter_fn, &subs[i]);
+	}
+
+	for (int i = 0; i < g_n_submitters; i++) {
+		pthread_join(sub_threads[i], NULL);
+	}
+
+	// Wait for everything in flight to call back.
+	for (int i = 0; i < g_n_submitters; i++) {
+		for (int k = 0; k < g_n_inflight; k++) {
+			sem_wait(&subs[i].slots);
+		}
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	double secs = (end.tv_sec - start.tv_sec) +
+			(end.tv_nsec - start.tv_nsec) / 1e9;
+
+	printf("done %d, timeouts %d, errors %d, %.3f s (%.0f tps)\n", g_n_done,
+			g_n_timeouts, g_n_errors, secs, g_n_done / secs);
+
+	g_stop = true;
+
+	for (int i = 0; i < g_n_bases; i++) {
+		event_base_loopbreak(g_bases[i]);
+		pthread_join(base_threads[i], NULL);
+		event_free(keepalive[i]);
+	}
+
+	ev2citrusleaf_cluster_destroy(g_cluster);
+
+	for (int i = 0; i < g_n_bases; i++) {
+		event_base_free(g_bases[i]);
+	}
+
+	ev2citrusleaf_shutdown(true);
+
+	bool ok = g_n_errors == 0 && g_n_done == g_n_ops * g_n_submitters;
+
+	printf("%s\n", ok ? "ok" : "FAILED");
+
+	return ok ? 0 : 1;
+}
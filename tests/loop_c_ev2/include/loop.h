@@ -45,6 +45,8 @@ extern void		atomic_int_set(atomic_int *ai, uint64_t val);
 extern void *start_counter_thread(atomic_int *reads, atomic_int *writes, atomic_int *deletes, atomic_int *keys);
 extern void stop_counter_thread(void *id);
 
+extern void latency_report(bool total);
+
 typedef struct config_s {
 	
 	char *host;
@@ -75,6 +77,9 @@ typedef struct config_s {
 	
 	uint		pseudo_seed;
 	uint		timeout_ms;
+
+	bool		latency;     // report latency percentiles
+	uint		duration_s;  // stop after this long, 0 means run forever
 	
 	struct event_base *base;
 	
@@ -103,6 +103,7 @@ typedef struct {
   uint32_t key;
   ev2citrusleaf_object key_o;
   uint64_t            start_ms; // last start time
+  uint64_t            op_start_us; // dispatch time of request in flight, if measuring latency
   char key_s[64];  // object points into here, ugly
 } transaction;
 
@@ -122,6 +123,73 @@ clear_start_ms(transaction *t) {
   pthread_mutex_unlock(&start_ms_lock);
 }
 
+//
+// Latency histogram - microseconds from dispatch to callback, in 10 us
+// buckets, anything over 100 ms in the last bucket. Also guarded by
+// start_ms_lock. The interval histogram is reset by each report.
+//
+
+#define LATENCY_BUCKET_US 10
+#define LATENCY_N_BUCKETS 10000
+
+static uint64_t latency_interval[LATENCY_N_BUCKETS];
+static uint64_t latency_total[LATENCY_N_BUCKETS];
+
+static inline void
+op_start(transaction *t) {
+  if (g_config.latency)
+    t->op_start_us = cf_getus();
+}
+
+static void
+latency_record(uint64_t us) {
+  uint64_t i = us / LATENCY_BUCKET_US;
+  if (i >= LATENCY_N_BUCKETS) i = LATENCY_N_BUCKETS - 1;
+  pthread_mutex_lock(&start_ms_lock);
+  latency_interval[i]++;
+  latency_total[i]++;
+  pthread_mutex_unlock(&start_ms_lock);
+}
+
+static uint64_t
+latency_percentile(uint64_t *hist, uint64_t n, uint64_t per_mille) {
+  uint64_t want = (n * per_mille + 999) / 1000;
+  uint64_t c = 0;
+  for (int i = 0; i < LATENCY_N_BUCKETS; i++) {
+    c += hist[i];
+    if (c >= want && c != 0) return((i + 1) * LATENCY_BUCKET_US);
+  }
+  return(0);
+}
+
+//
+// Print latency percentiles since the last report, or (if total) since the
+// start of the test. Upper bucket bounds, so accurate to 10 us.
+//
+void
+latency_report(bool total)
+{
+  if (! g_config.latency) return;
+
+  uint64_t *hist = total ? latency_total : latency_interval;
+  uint64_t n = 0;
+  double sum = 0;
+
+  pthread_mutex_lock(&start_ms_lock);
+  for (int i = 0; i < LATENCY_N_BUCKETS; i++) {
+    n += hist[i];
+    sum += (double)hist[i] * (i * LATENCY_BUCKET_US + LATENCY_BUCKET_US / 2);
+  }
+  if (n != 0) {
+    fprintf(stderr, "loopTest: %s latency: n %"PRIu64" mean %.0f us p50 %"PRIu64" us p90 %"PRIu64" us p99 %"PRIu64" us p99.9 %"PRIu64" us\n",
+            total ? "total" : "interval", n, sum / n,
+            latency_percentile(hist, n, 500), latency_percentile(hist, n, 900),
+            latency_percentile(hist, n, 990), latency_percentile(hist, n, 999));
+  }
+  if (! total) memset(latency_interval, 0, sizeof(latency_interval));
+  pthread_mutex_unlock(&start_ms_lock);
+}
+
 // forward reference
 void do_transaction(int return_value, ev2citrusleaf_bin *bins, int n_bins, uint32_t generation, uint32_t expiration, void *udata);
 
@@ -193,6 +261,7 @@ write_new_value(transaction *t)
 #endif
 
   int rv;
+  op_start(t);
   rv = ev2citrusleaf_put(g_config.asc, g_config.ns, g_config.set, &t->key_o, values, 1, 0,
                          g_config.timeout_ms, do_transaction, t, g_config.base);
   if (rv != 0) {
@@ -256,6 +325,11 @@ do_transaction(int return_value, ev2citrusleaf_bin *bins, int n_bins, uint32_t g
   fprintf(stderr, "do transaction: id %d state %s\n",t->transaction_id,state_string[t->state]);
 #endif
 
+  if (t->op_start_us) {
+    latency_record(cf_getus() - t->op_start_us);
+    t->op_start_us = 0;
+  }
+
   switch(t->state) {
     case START:
       get_new_key(t);
@@ -299,6 +373,7 @@ do_transaction(int return_value, ev2citrusleaf_bin *bins, int n_bins, uint32_t g
       update_start_ms(t);
 
       const char *bins[1] = { g_config.bin };
+      op_start(t);
       rv = ev2citrusleaf_get(g_config.asc, g_config.ns, g_config.set, &t->key_o,
                              bins, 1, g_config.timeout_ms, do_transaction, (void *) t, g_config.base);
       if (rv != EV2CITRUSLEAF_OK) {
@@ -339,6 +414,7 @@ do_transaction(int return_value, ev2citrusleaf_bin *bins, int n_bins, uint32_t g
       t->state = VALUE_DELETED_PUT;  // next state
       update_start_ms(t);
 
+      op_start(t);
       rv = ev2citrusleaf_get_all(g_config.asc, g_config.ns, g_config.set, &t->key_o,
                                  g_config.timeout_ms, do_transaction, (void *) t, g_config.base);
       if (rv != EV2CITRUSLEAF_OK) {
@@ -378,6 +454,7 @@ do_transaction(int return_value, ev2citrusleaf_bin *bins, int n_bins, uint32_t g
         update_start_ms(t);
 
         const char *bins[1] = { g_config.bin };
+        op_start(t);
         rv = ev2citrusleaf_get(g_config.asc, g_config.ns, g_config.set, &t->key_o,
                                bins, 1, g_config.timeout_ms, do_transaction, (void *) t, g_config.base);
         if (rv != EV2CITRUSLEAF_OK) {
@@ -418,6 +495,7 @@ do_transaction(int return_value, ev2citrusleaf_bin *bins, int n_bins, uint32_t g
 #endif
 
       const char *bins[1] = { g_config.bin };
+      op_start(t);
       rv = ev2citrusleaf_get(g_config.asc, g_config.ns, g_config.set, &t->key_o,
                              bins, 1, g_config.timeout_ms, do_transaction, (void *) t, g_config.base);
       if (rv != EV2CITRUSLEAF_OK) {
@@ -486,6 +564,7 @@ do_transaction(int return_value, ev2citrusleaf_bin *bins, int n_bins, uint32_t g
 
     case VALUE_KNOWN_DELETE: {
 
+      op_start(t);
       if (EV2CITRUSLEAF_OK !=
           ev2citrusleaf_delete(g_config.asc, g_config.ns, g_config.set, &t->key_o, 0, g_config.timeout_ms,
                                do_transaction, (void *) t , g_config.base)) {
@@ -538,6 +617,7 @@ Fail:
   abort();
 #endif
 
+  t->op_start_us = 0; // dispatch may have failed
   g_config.values[t->key] = VALUE_UNINIT;
   t->state = START;
   shash_delete(g_config.in_progress_hash, &t->key); // release key
@@ -645,6 +725,11 @@ do_loop_test ( )
 
   pthread_create(&trans_watcher_th, 0, trans_watcher_fn, t_array);
 
+  if (g_config.duration_s) {
+    struct timeval tv = { g_config.duration_s, 0 };
+    event_base_loopexit(g_config.base, &tv);
+  }
+
   // Event loop sinks in here - not sure the best way to signal out???
   fprintf(stderr, "event dispatch sink\n");
   event_base_dispatch(g_config.base);
@@ -657,5 +742,7 @@ do_loop_test ( )
 
   stop_counter_thread(counter_control);
 
-  return(-1);
+  latency_report(true);
+
+  return(g_config.duration_s ? 0 : -1);
 }
@@ -125,6 +125,7 @@ counter_fn(void *arg)
 		fprintf(stderr, "loopTest: reads %"PRIu64" writes %"PRIu64" deletes %"PRIu64" (total keys: %"PRIu64")\n",
 			atomic_int_get(ctc->reads), atomic_int_get(ctc->writes), atomic_int_get(ctc->deletes),
 			atomic_int_get(ctc->keys) );
+		latency_report(false);
                 ev2citrusleaf_print_stats();
 	}
 	return(0);
@@ -236,6 +237,8 @@ void usage(void) {
 	fprintf(stderr, "-m milliseconds timeout [default 200]\n");
 	fprintf(stderr, "-f do not follow cluster [default do follow]\n");
 	fprintf(stderr, "-I use integer for values [default is string]\n");
+	fprintf(stderr, "-L report latency percentiles [default off]\n");
+	fprintf(stderr, "-d seconds to run, then exit [default run forever]\n");
 	fprintf(stderr, "-v is verbose\n");
 }
 
@@ -272,7 +275,7 @@ main(int argc, char **argv)
 	
 	printf("testing the libevent C citrusleaf library\n");
 	
-	while ((c = getopt(argc, argv, "h:p:n:t:k:b:w:s:r:m:K:V:vfI")) != -1) 
+	while ((c = getopt(argc, argv, "h:p:n:t:k:b:w:s:r:m:K:V:vfILd:")) != -1) 
 	{
 		switch (c)
 		{
@@ -331,6 +334,14 @@ main(int argc, char **argv)
 		case 'I':
 			g_config.integer = true;
 			break;
+
+		case 'L':
+			g_config.latency = true;
+			break;
+
+		case 'd':
+			g_config.duration_s = atoi(optarg);
+			break;
 			
 		default:
 			usage();
@@ -0,0 +1,230 @@
+/*
+ *  Citrusleaf Tools
+ *  base64_test
+ *
+ * Checks each base 64 decode version this CPU runs against a plain reference
+ * decode - for random input of many lengths, with and without padding, with
+ * invalid characters, and at odd alignments. Also checks no version writes
+ * past the end of its output.
+ */
+
+// Built with the library source, to reach each decode version.
+#include "cf_base64.c"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_CHARS 1024
+#define GUARD_SIZE 64
+#define GUARD_BYTE 0xA5
+#define N_RANDOM 50000
+
+static const char ALPHABET[] =
+		"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+typedef struct version_s {
+	const char*		name;
+	decode_fn		fn;
+} version;
+
+static version g_versions[3];
+static int g_n_versions = 0;
+
+static int g_n_failed = 0;
+
+// Padding and invalid characters are 0 bits.
+static uint8_t
+reference_value(char c)
+{
+	const char* p = c != 0 ? strchr(ALPHABET, c) : NULL;
+
+	return p ? (uint8_t)(p - ALPHABET) : 0;
+}
+
+static void
+reference_decode(const char* in, int len, uint8_t* out)
+{
+	for (int i = 0, j = 0; i < len; i += 4, j += 3) {
+		uint32_t v = (reference_value(in[i]) << 18) |
+				(reference_value(in[i + 1]) << 12) |
+				(reference_value(in[i + 2]) << 6) |
+				reference_value(in[i + 3]);
+
+		out[j] = (uint8_t)(v >> 16);
+		out[j + 1] = (uint8_t)(v >> 8);
+		out[j + 2] = (uint8_t)v;
+	}
+}
+
+static void
+check(const char* what, const char* in, int len)
+{
+	int out_len = len / 4 * 3;
+	uint8_t expect[MAX_CHARS / 4 * 3];
+	uint8_t got[(MAX_CHARS / 4 * 3) + GUARD_SIZE];
+
+	reference_decode(in, len, expect);
+
+	for (int v = 0; v < g_n_versions; v++) {
+		memset(got, GUARD_BYTE, sizeof(got));
+		g_versions[v].fn(in, len, got);
+
+		if (memcmp(got, expect, out_len) != 0) {
+			printf("FAIL %s, %s: %d characters decode wrong\n", what,
+					g_versions[v].name, len);
+			g_n_failed++;
+			continue;
+		}
+
+		for (int i = out_len; i < out_len + GUARD_SIZE; i++) {
+			if (got[i] != GUARD_BYTE) {
+				printf("FAIL %s, %s: %d characters write past output\n", what,
+						g_versions[v].name, len);
+				g_n_failed++;
+				break;
+			}
+		}
+	}
+
+	// And whichever version the public call chose.
+	memset(got, GUARD_BYTE, sizeof(got));
+	cf_base64_decode(in, len, got);
+
+	if (memcmp(got, expect, out_len) != 0 || got[out_len] != GUARD_BYTE) {
+		printf("FAIL %s, cf_base64_decode: %d characters\n", what, len);
+		g_n_failed++;
+	}
+}
+
+static void
+test_vectors()
+{
+	static const struct {
+		const char* in;
+		const char* out;
+	} VECTORS[] = {
+		{ "TWFu", "Man" },
+		{ "TWE=", "Ma" },
+		{ "TQ==", "M" },
+		{ "Zm9vYmFy", "foobar" },
+		{ "Zm9vYg==", "foob" }
+	};
+
+	for (size_t i = 0; i < sizeof(VECTORS) / sizeof(VECTORS[0]); i++) {
+		uint8_t out[16] = { 0 };
+		size_t n = strlen(VECTORS[i].out);
+
+		cf_base64_decode(VECTORS[i].in, (int)strlen(VECTORS[i].in), out);
+
+		if (memcmp(out, VECTORS[i].out, n) != 0) {
+			printf("FAIL vector %s\n", VECTORS[i].in);
+			g_n_failed++;
+		}
+	}
+}
+
+// Every length up to the maximum, all valid characters - runs each version's
+// vector loops, and the scalar tails after them, through every length.
+static void
+test_lengths()
+{
+	char in[MAX_CHARS];
+
+	for (int i = 0; i < MAX_CHARS; i++) {
+		in[i] = ALPHABET[(i * 7) % 64];
+	}
+
+	for (int len = 0; len <= MAX_CHARS; len += 4) {
+		check("lengths", in, len);
+	}
+}
+
+// Each character in every position of a long run - makes sure each character
+// translates alike in every lane.
+static void
+test_alphabet()
+{
+	char in[128];
+
+	for (int shift = 0; shift < 64; shift++) {
+		for (int i = 0; i < 128; i++) {
+			in[i] = ALPHABET[(i + shift) % 64];
+		}
+
+		check("alphabet", in, 128);
+	}
+}
+
+static void
+test_random()
+{
+	// One extra byte so input can start at an odd address.
+	static char buf[MAX_CHARS + 1];
+
+	srand(1);
+
+	for (int n = 0; n < N_RANDOM; n++) {
+		char* in = buf + (rand() % 2);
+		int len = (rand() % ((MAX_CHARS / 4) + 1)) * 4;
+
+		for (int i = 0; i < len; i++) {
+			in[i] = ALPHABET[rand() % 64];
+		}
+
+		const char* what = "random";
+
+		if (len != 0 && rand() % 2 == 0) {
+			in[len - 1] = '=';
+
+			if (rand() % 2 == 0) {
+				in[len - 2] = '=';
+			}
+
+			what = "random padded";
+		}
+
+		if (len != 0 && rand() % 4 == 0) {
+			in[rand() % len] = (char)(rand() % 256);
+			what = "random invalid";
+		}
+
+		check(what, in, len);
+	}
+}
+
+int
+main(int argc, char* argv[])
+{
+	g_versions[g_n_versions].name = "scalar";
+	g_versions[g_n_versions++].fn = decode_scalar;
+
+#ifdef CF_BASE64_X86
+	__builtin_cpu_init();
+
+	if (__builtin_cpu_supports("ssse3")) {
+		g_versions[g_n_versions].name = "ssse3";
+		g_versions[g_n_versions++].fn = decode_ssse3;
+	}
+
+	if (__builtin_cpu_supports("avx2")) {
+		g_versions[g_n_versions].name = "avx2";
+		g_versions[g_n_versions++].fn = decode_avx2;
+	}
+#endif
+
+	test_vectors();
+	test_lengths();
+	test_alphabet();
+	test_random();
+
+	if (g_n_failed != 0) {
+		printf("%d base 64 checks failed\n", g_n_failed);
+		return -1;
+	}
+
+	printf("ok base 64, %d versions\n", g_n_versions);
+
+	return 0;
+}
@@ -0,0 +1,171 @@
+/*
+ *  Citrusleaf Tools
+ *  circuit_test
+ *
+ * Checks a node's circuit breaker can't get stuck - half-open lets at most
+ * CL_CIRCUIT_PROBES probes be in flight, a probe that's dropped gives its slot
+ * back, enough successes close the circuit, and a half-open circuit whose
+ * probes don't resolve in time re-opens and later probes again.
+ */
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <event2/event.h>
+
+#include "citrusleaf/cf_clock.h"
+#include "citrusleaf_event2/cl_cluster.h"
+#include "citrusleaf_event2/ev2citrusleaf.h"
+
+// Not in any header.
+extern cl_cluster_node* cl_cluster_node_create(const char* name,
+		ev2citrusleaf_cluster* asc);
+
+static int g_n_failed = 0;
+
+static void
+check(bool ok, const char* what)
+{
+	if (! ok) {
+		printf("FAIL %s\n", what);
+		g_n_failed++;
+	}
+}
+
+// Pile up problems until the circuit opens.
+static void
+open_circuit(cl_cluster_node* cn)
+{
+	for (int i = 0; i < 100 &&
+			cf_atomic32_get(cn->circuit) != CL_CIRCUIT_OPEN; i++) {
+		cl_cluster_node_dun(cn, CL_NODE_DUN_TIMEOUT);
+	}
+}
+
+// Open the circuit, and make it look like it opened a cool-down ago.
+static void
+open_cooled(cl_cluster_node* cn)
+{
+	open_circuit(cn);
+	cf_atomic32_set(&cn->circuit_opened_ms,
+			(uint32_t)cf_getms() - CL_CIRCUIT_COOL_MS);
+}
+
+static void
+test_probes(cl_cluster_node* cn)
+{
+	bool probes[CL_CIRCUIT_PROBES];
+	bool probe;
+
+	open_circuit(cn);
+	check(cf_atomic32_get(cn->circuit) == CL_CIRCUIT_OPEN, "dun: not open");
+	check(! cl_cluster_node_circuit_allow(cn, &probe) && ! probe,
+			"open: allowed while cooling");
+
+	open_cooled(cn);
+
+	for (int i = 0; i < CL_CIRCUIT_PROBES; i++) {
+		check(cl_cluster_node_circuit_allow(cn, &probes[i]) && probes[i],
+				"half-open: probe not allowed");
+	}
+
+	check(cf_atomic32_get(cn->circuit) == CL_CIRCUIT_HALF_OPEN,
+			"half-open: not half-open");
+	check(! cl_cluster_node_circuit_allow(cn, &probe) && ! probe,
+			"half-open: too many probes allowed");
+	check(cl_cluster_node_circuit_avoid(cn), "half-open: full, not avoided");
+
+	// Lose every probe - the slots must come back.
+	for (int i = 0; i < CL_CIRCUIT_PROBES; i++) {
+		cl_cluster_node_probe_done(cn);
+	}
+
+	check(! cl_cluster_node_circuit_avoid(cn), "half-open: lost probes kept");
+
+	// Now succeed - the circuit closes.
+	for (int i = 0; i < CL_CIRCUIT_PROBES; i++) {
+		check(cl_cluster_node_circuit_allow(cn, &probe) && probe,
+				"half-open: probe not allowed after losses");
+		cl_cluster_node_ok(cn);
+		cl_cluster_node_probe_done(cn);
+	}
+
+	check(cf_atomic32_get(cn->circuit) == CL_CIRCUIT_CLOSED,
+			"half-open: successes didn't close");
+	check(cf_atomic32_get(cn->n_probes) == 0, "closed: probes still counted");
+}
+
+static void
+test_unresolved(cl_cluster_node* cn)
+{
+	bool probe;
+
+	open_cooled(cn);
+	check(cl_cluster_node_circuit_allow(cn, &probe) && probe,
+			"unresolved: probe not allowed");
+
+	// Nothing comes back for a cool-down - the circuit re-opens.
+	cf_atomic32_set(&cn->circuit_opened_ms,
+			(uint32_t)cf_getms() - CL_CIRCUIT_COOL_MS);
+
+	check(cl_cluster_node_circuit_avoid(cn), "unresolved: not avoided");
+	check(cf_atomic32_get(cn->circuit) == CL_CIRCUIT_OPEN,
+			"unresolved: didn't re-open");
+	check(! cl_cluster_node_circuit_allow(cn, &probe),
+			"unresolved: allowed while cooling again");
+
+	// The old probe finally drops, and after another cool-down it probes
+	// again.
+	cl_cluster_node_probe_done(cn);
+	cf_atomic32_set(&cn->circuit_opened_ms,
+			(uint32_t)cf_getms() - CL_CIRCUIT_COOL_MS);
+
+	check(cl_cluster_node_circuit_allow(cn, &probe) && probe,
+			"unresolved: no probe after re-open");
+
+	// A failed probe re-opens straight away.
+	cl_cluster_node_dun(cn, CL_NODE_DUN_TIMEOUT);
+	cl_cluster_node_probe_done(cn);
+	check(cf_atomic32_get(cn->circuit) == CL_CIRCUIT_OPEN,
+			"unresolved: failed probe didn't re-open");
+	check(cf_atomic32_get(cn->n_probes) == 0, "unresolved: probes counted");
+}
+
+int
+main(int argc, char* argv[])
+{
+	cf_set_log_level(CF_ERROR);
+	ev2citrusleaf_init(NULL);
+
+	// The base is never run - nothing but this test touches the cluster.
+	struct event_base* base = event_base_new();
+	ev2citrusleaf_cluster* asc = ev2citrusleaf_cluster_create(base, NULL);
+	ev2citrusleaf_cluster_runtime_options opts;
+
+	ev2citrusleaf_cluster_get_runtime_options(asc, &opts);
+	opts.circuit_breaker = true;
+	ev2citrusleaf_cluster_set_runtime_options(asc, &opts);
+
+	cl_cluster_node* cn = cl_cluster_node_create("BB9000000000001", asc);
+
+	if (! cn) {
+		printf("FAIL node create\n");
+		return -1;
+	}
+
+	test_probes(cn);
+	test_unresolved(cn);
+
+	ev2citrusleaf_cluster_destroy(asc);
+	event_base_free(base);
+	ev2citrusleaf_shutdown(true);
+
+	if (g_n_failed != 0) {
+		printf("%d circuit checks failed\n", g_n_failed);
+		return -1;
+	}
+
+	printf("ok circuit probes\n");
+
+	return 0;
+}
@@ -0,0 +1,290 @@
+/*
+ *  Citrusleaf Tools
+ *  pmap_reclaim_test
+ *
+ * Checks partition map snapshot reclamation - a retired snapshot is kept
+ * while a reader that could hold it is still counted in its stripe, and is
+ * freed (releasing its node references) once the reader stripes drain. Also
+ * routes from several threads while ownership flips back and forth, then
+ * checks nothing is left retired and no node references leak.
+ */
+
+// Built with the library source, to reach the static snapshot functions.
+#include "cl_partition.c"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+
+#include <event2/event.h>
+
+#include "citrusleaf/cf_alloc.h"
+
+// Not in any header.
+extern cl_cluster_node* cl_cluster_node_create(const char* name,
+		ev2citrusleaf_cluster* asc);
+
+#define N_PARTITIONS 4096
+#define BITMAP_SIZE (N_PARTITIONS / 8)
+
+#define N_ROUTERS 4
+#define N_FLIPS 2000
+
+static int g_n_failed = 0;
+
+static ev2citrusleaf_cluster* g_asc;
+static cl_partition_table* g_pt;
+static cl_cluster_node* g_nodes[2];
+
+static uint8_t g_all[BITMAP_SIZE];
+static uint8_t g_none[BITMAP_SIZE];
+
+// Make nodes[master] master, and the other node prole, of every partition.
+static void
+set_master(int master)
+{
+	for (int n = 0; n < 2; n++) {
+		const uint8_t* bitmaps[CL_PARTITION_REPLICAS] = {
+			n == master ? g_all : g_none,
+			n == master ? g_none : g_all,
+			g_none,
+			g_none
+		};
+
+		cl_partition_table_update(g_nodes[n], "test", bitmaps);
+	}
+}
+
+static uint32_t
+n_retired()
+{
+	uint32_t n = 0;
+
+	for (cl_partition_map* map = g_asc->pmap_retired; map;
+			map = map->retired_next) {
+		n++;
+	}
+
+	return n;
+}
+
+static bool
+is_retired(const cl_partition_map* find)
+{
+	for (cl_partition_map* map = g_asc->pmap_retired; map;
+			map = map->retired_next) {
+		if (map == find) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static void
+check(bool ok, const char* what)
+{
+	if (! ok) {
+		printf("FAIL %s\n", what);
+		g_n_failed++;
+	}
+}
+
+//------------------------------------------------
+// A reader that holds a snapshot until told to let go.
+//
+
+static volatile int g_reader_step = 0;
+static cl_partition_map* g_reader_map = NULL;
+
+static void*
+reader_fn(void* pv)
+{
+	cf_atomic32* p_readers = pmap_read_begin(g_asc);
+
+	g_reader_map = pmap_get(g_pt);
+	g_reader_step = 1;
+
+	while (g_reader_step != 2) {
+		sched_yield();
+	}
+
+	pmap_read_end(p_readers);
+
+	return NULL;
+}
+
+static void
+test_held_reader()
+{
+	cf_atomic_int_t refs[2] = {
+		cf_client_rc_count(g_nodes[0]),
+		cf_client_rc_count(g_nodes[1])
+	};
+
+	pthread_t thread;
+
+	pthread_create(&thread, NULL, reader_fn, NULL);
+
+	while (g_reader_step != 1) {
+		sched_yield();
+	}
+
+	// Two updates swap the roles - each retires a snapshot.
+	set_master(1);
+
+	check(pmap_get(g_pt) != g_reader_map, "held reader: map not replaced");
+	check(is_retired(g_reader_map), "held reader: map freed while held");
+	check(n_retired() == 2, "held reader: not all retired maps kept");
+
+	cl_partition_table_reclaim(g_asc);
+
+	check(is_retired(g_reader_map), "held reader: map reclaimed while held");
+	check(cf_client_rc_count(g_nodes[0]) > refs[0] &&
+			cf_client_rc_count(g_nodes[1]) > refs[1],
+			"held reader: retired maps' node references dropped");
+
+	g_reader_step = 2;
+	pthread_join(thread, NULL);
+
+	cl_partition_table_reclaim(g_asc);
+
+	check(n_retired() == 0, "held reader: retired maps left after drain");
+	check(cf_client_rc_count(g_nodes[0]) == refs[0] &&
+			cf_client_rc_count(g_nodes[1]) == refs[1],
+			"held reader: node references leaked");
+
+	// With no readers, publishing frees the old snapshot right away.
+	set_master(0);
+
+	check(n_retired() == 0, "no readers: retired maps kept");
+
+	if (g_n_failed == 0) {
+		printf("ok held reader\n");
+	}
+}
+
+//------------------------------------------------
+// Routers running while ownership flips.
+//
+
+static volatile bool g_stop = false;
+
+static void*
+router_fn(void* pv)
+{
+	uint64_t* p_n_bad = (uint64_t*)pv;
+	uint32_t pid = 0;
+
+	while (! g_stop) {
+		pid = (pid + 97) % N_PARTITIONS;
+
+		cl_cluster_node* node = cl_partition_table_get(g_asc, g_pt,
+				(cl_partition_id)pid, (pid & 1) != 0);
+
+		// Between the two nodes' updates a partition may have no master - but
+		// a node we get must be one of ours.
+		if (node && node != g_nodes[0] && node != g_nodes[1]) {
+			(*p_n_bad)++;
+		}
+
+		if (node) {
+			cl_cluster_node_put(node);
+		}
+	}
+
+	return NULL;
+}
+
+static void
+test_routers()
+{
+	int n_failed = g_n_failed;
+	cf_atomic_int_t refs[2] = {
+		cf_client_rc_count(g_nodes[0]),
+		cf_client_rc_count(g_nodes[1])
+	};
+
+	pthread_t threads[N_ROUTERS];
+	uint64_t n_bad[N_ROUTERS] = { 0 };
+
+	for (int i = 0; i < N_ROUTERS; i++) {
+		pthread_create(&threads[i], NULL, router_fn, &n_bad[i]);
+	}
+
+	for (int i = 0; i < N_FLIPS; i++) {
+		set_master(i & 1);
+		cl_partition_table_reclaim(g_asc);
+
+		if (i % 64 == 0) {
+			sched_yield();
+		}
+	}
+
+	set_master(0);
+
+	g_stop = true;
+
+	for (int i = 0; i < N_ROUTERS; i++) {
+		pthread_join(threads[i], NULL);
+		check(n_bad[i] == 0, "routers: routed to a stray node");
+	}
+
+	cl_partition_table_reclaim(g_asc);
+
+	check(n_retired() == 0, "routers: retired maps left after drain");
+	check(cf_client_rc_count(g_nodes[0]) == refs[0] &&
+			cf_client_rc_count(g_nodes[1]) == refs[1],
+			"routers: node references leaked");
+
+	if (g_n_failed == n_failed) {
+		printf("ok routers, %d flips\n", N_FLIPS);
+	}
+}
+
+int
+main(int argc, char* argv[])
+{
+	cf_set_log_level(CF_WARN);
+	ev2citrusleaf_init(NULL);
+
+	// The base is never run - nothing but this test touches the cluster.
+	struct event_base* base = event_base_new();
+
+	g_asc = ev2citrusleaf_cluster_create(base, NULL);
+	g_asc->n_partitions = N_PARTITIONS;
+
+	g_nodes[0] = cl_cluster_node_create("BB9000000000000A", g_asc);
+	g_nodes[1] = cl_cluster_node_create("BB9000000000000B", g_asc);
+
+	if (! g_nodes[0] || ! g_nodes[1]) {
+		printf("FAIL node create\n");
+		return -1;
+	}
+
+	memset(g_all, 0xFF, sizeof(g_all));
+	memset(g_none, 0, sizeof(g_none));
+
+	set_master(0);
+
+	g_pt = cl_partition_table_get_by_ns(g_asc, "test");
+
+	check(g_pt && pmap_get(g_pt), "setup: no partition map");
+	check(n_retired() == 0, "setup: retired maps kept");
+
+	if (g_n_failed == 0) {
+		test_held_reader();
+		test_routers();
+	}
+
+	ev2citrusleaf_cluster_destroy(g_asc);
+	event_base_free(base);
+	ev2citrusleaf_shutdown(true);
+
+	if (g_n_failed != 0) {
+		printf("%d snapshot reclaim checks failed\n", g_n_failed);
+		return -1;
+	}
+
+	return 0;
+}
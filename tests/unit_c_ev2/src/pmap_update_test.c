@@ -0,0 +1,284 @@
+/*
+ *  Citrusleaf Tools
+ *  pmap_update_test
+ *
+ * Checks that applying only what changed in each node's ownership (the usual
+ * cl_partition_table_update() path) builds the same partition maps as
+ * applying every partition each time. Two clusters of the same nodes get the
+ * same rounds of updates - migrations, replication factor changes, nodes
+ * leaving and coming back - one cluster with its nodes' ownership invalidated
+ * before each update. After each round both maps must match what the nodes
+ * said, replica for replica, as must the nodes' partition counts.
+ */
+
+// Built with the library source, to reach the static ownership functions.
+#include "cl_partition.c"
+
+#include <stdio.h>
+
+#include <event2/event.h>
+
+// Not in any header.
+extern cl_cluster_node* cl_cluster_node_create(const char* name,
+		ev2citrusleaf_cluster* asc);
+
+#define N_PARTITIONS 4096
+#define BITMAP_SIZE (N_PARTITIONS / 8)
+#define N_NODES 6
+#define N_ROUNDS 200
+
+typedef struct test_cluster_s {
+	struct event_base*		base;
+	ev2citrusleaf_cluster*	asc;
+	cl_cluster_node*		nodes[N_NODES];
+} test_cluster;
+
+static int g_n_failed = 0;
+
+// What the nodes say - the node index of each partition's replicas, master
+// first, or -1.
+static int g_owners[N_PARTITIONS][CL_PARTITION_REPLICAS];
+static bool g_gone[N_NODES];
+
+static bool
+test_cluster_init(test_cluster* c, const char* prefix)
+{
+	c->base = event_base_new();
+	c->asc = ev2citrusleaf_cluster_create(c->base, NULL);
+	c->asc->n_partitions = N_PARTITIONS;
+
+	for (int n = 0; n < N_NODES; n++) {
+		char name[32];
+
+		sprintf(name, "%s%013X", prefix, n);
+
+		if (! (c->nodes[n] = cl_cluster_node_create(name, c->asc))) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static void
+test_cluster_destroy(test_cluster* c)
+{
+	ev2citrusleaf_cluster_destroy(c->asc);
+	event_base_free(c->base);
+}
+
+// Pick distinct nodes (not gone) for a partition's replicas.
+static void
+assign(int pid, int rf)
+{
+	int n_up = 0;
+
+	for (int n = 0; n < N_NODES; n++) {
+		if (! g_gone[n]) {
+			n_up++;
+		}
+	}
+
+	if (rf > n_up) {
+		rf = n_up;
+	}
+
+	for (int r = 0; r < CL_PARTITION_REPLICAS; r++) {
+		g_owners[pid][r] = -1;
+	}
+
+	for (int r = 0; r < rf; r++) {
+		int n;
+		bool taken;
+
+		do {
+			n = rand() % N_NODES;
+			taken = g_gone[n];
+
+			for (int k = 0; k < r; k++) {
+				if (g_owners[pid][k] == n) {
+					taken = true;
+				}
+			}
+		} while (taken);
+
+		g_owners[pid][r] = n;
+	}
+}
+
+static void
+update_node(test_cluster* c, int n, bool full)
+{
+	static uint8_t bits[CL_PARTITION_REPLICAS][BITMAP_SIZE];
+	const uint8_t* bitmaps[CL_PARTITION_REPLICAS];
+
+	memset(bits, 0, sizeof(bits));
+
+	for (int pid = 0; pid < N_PARTITIONS; pid++) {
+		for (int r = 0; r < CL_PARTITION_REPLICAS; r++) {
+			if (g_owners[pid][r] == n) {
+				bits[r][pid >> 3] |= 0x80 >> (pid & 7);
+			}
+		}
+	}
+
+	for (int r = 0; r < CL_PARTITION_REPLICAS; r++) {
+		bitmaps[r] = bits[r];
+	}
+
+	if (full) {
+		ownership_invalidate(c->nodes[n]);
+	}
+
+	cl_partition_table_update(c->nodes[n], "test", bitmaps);
+}
+
+// Check a cluster's map and counts against what the nodes said.
+static void
+check(test_cluster* c, const char* what, int round)
+{
+	cl_partition_table* pt = cl_partition_table_get_by_ns(c->asc, "test");
+	cl_partition_map* map = pt ? pmap_get(pt) : NULL;
+
+	if (! map) {
+		printf("FAIL %s round %d: no map\n", what, round);
+		g_n_failed++;
+		return;
+	}
+
+	uint32_t n_masters[N_NODES] = { 0 };
+	uint32_t n_proles[N_NODES] = { 0 };
+
+	for (int pid = 0; pid < N_PARTITIONS; pid++) {
+		const uint8_t* replicas = cl_partition_map_replicas(map, pid);
+
+		for (int r = 0; r < CL_PARTITION_REPLICAS; r++) {
+			int n = g_owners[pid][r];
+			cl_cluster_node* expect = n >= 0 ? c->nodes[n] : NULL;
+			cl_cluster_node* got = replicas[r] ? map->slots[replicas[r]] : NULL;
+
+			if (got != expect) {
+				printf("FAIL %s round %d: partition %d replica %d is %s, "
+						"expected %s\n", what, round, pid, r,
+						got ? got->name : "none",
+						expect ? expect->name : "none");
+				g_n_failed++;
+				return;
+			}
+
+			if (n >= 0) {
+				if (r == 0) {
+					n_masters[n]++;
+				}
+				else {
+					n_proles[n]++;
+				}
+			}
+		}
+	}
+
+	for (int n = 0; n < N_NODES; n++) {
+		if (c->nodes[n]->n_master_partitions != n_masters[n] ||
+				c->nodes[n]->n_prole_partitions != n_proles[n]) {
+			printf("FAIL %s round %d: node %d counts %u/%u, expected %u/%u\n",
+					what, round, n, c->nodes[n]->n_master_partitions,
+					c->nodes[n]->n_prole_partitions, n_masters[n],
+					n_proles[n]);
+			g_n_failed++;
+			return;
+		}
+	}
+}
+
+int
+main(int argc, char* argv[])
+{
+	cf_set_log_level(CF_WARN);
+	ev2citrusleaf_init(NULL);
+
+	// The bases are never run - nothing but this test touches the clusters.
+	test_cluster diff;
+	test_cluster full;
+
+	if (! test_cluster_init(&diff, "BB9") || ! test_cluster_init(&full, "BB8")) {
+		printf("FAIL node create\n");
+		return -1;
+	}
+
+	srand(1);
+
+	int rf = 2;
+
+	for (int pid = 0; pid < N_PARTITIONS; pid++) {
+		assign(pid, rf);
+	}
+
+	for (int round = 0; round < N_ROUNDS; round++) {
+		if (round != 0) {
+			if (round % 25 == 0) {
+				// Replication factor change - everything moves.
+				rf = 1 + (rand() % CL_PARTITION_REPLICAS);
+
+				for (int pid = 0; pid < N_PARTITIONS; pid++) {
+					assign(pid, rf);
+				}
+			}
+			else if (round % 10 == 0) {
+				// A node leaves, or one that left comes back.
+				int n = rand() % N_NODES;
+
+				g_gone[n] = ! g_gone[n];
+
+				for (int pid = 0; pid < N_PARTITIONS; pid++) {
+					bool has = false;
+
+					for (int r = 0; r < CL_PARTITION_REPLICAS; r++) {
+						has = has || g_owners[pid][r] == n;
+					}
+
+					if (has || (! g_gone[n] && rand() % N_NODES == 0)) {
+						assign(pid, rf);
+					}
+				}
+			}
+			else {
+				// Migrations - a few percent of partitions move.
+				for (int pid = 0; pid < N_PARTITIONS; pid++) {
+					if (rand() % 100 < 3) {
+						assign(pid, rf);
+					}
+				}
+			}
+		}
+
+		// Nodes report in a different order each round.
+		int first = rand() % N_NODES;
+
+		for (int k = 0; k < N_NODES; k++) {
+			int n = (first + k) % N_NODES;
+
+			update_node(&diff, n, false);
+			update_node(&full, n, true);
+		}
+
+		check(&diff, "diff", round);
+		check(&full, "full", round);
+
+		if (g_n_failed != 0) {
+			break;
+		}
+	}
+
+	test_cluster_destroy(&diff);
+	test_cluster_destroy(&full);
+	ev2citrusleaf_shutdown(true);
+
+	if (g_n_failed != 0) {
+		printf("%d partition update checks failed\n", g_n_failed);
+		return -1;
+	}
+
+	printf("ok partition updates, %d rounds\n", N_ROUNDS);
+
+	return 0;
+}
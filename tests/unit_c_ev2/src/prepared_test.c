@@ -0,0 +1,342 @@
+/*
+ *  Citrusleaf Tools
+ *  prepared_test
+ *
+ * Checks that prepared transactions compile to the same bytes as the ordinary
+ * compile functions, for gets, puts and operates, by key and by digest, with
+ * and without zero-copy values.
+ */
+
+// Built with the library source, to reach the static compile functions.
+#include "ev2citrusleaf.c"
+
+#include <stdio.h>
+
+static int g_n_failed = 0;
+
+#define FLAT_MAX (64 * 1024)
+
+typedef struct compiled_s {
+	uint8_t			tmp[1024];
+	struct iovec	iov_tmp[CL_REQUEST_IOV_TMP];
+	uint8_t*		buf;
+	size_t			buf_size;
+	struct iovec*	iov;
+	int				n_iov;
+	cf_digest		d;
+	uint8_t			flat[FLAT_MAX];
+	size_t			flat_size;
+} compiled;
+
+static void
+compiled_init(compiled* c)
+{
+	c->buf = c->tmp;
+	c->buf_size = sizeof(c->tmp);
+	c->iov = c->iov_tmp;
+	c->n_iov = 0;
+	memset(&c->d, 0, sizeof(c->d));
+}
+
+// What would go on the wire - the buffer, or the buffer segments and external
+// values the iovecs point at.
+static void
+compiled_flatten(compiled* c)
+{
+	if (c->n_iov == 0) {
+		memcpy(c->flat, c->buf, c->buf_size);
+		c->flat_size = c->buf_size;
+	}
+	else {
+		c->flat_size = 0;
+
+		for (int i = 0; i < c->n_iov; i++) {
+			memcpy(c->flat + c->flat_size, c->iov[i].iov_base, c->iov[i].iov_len);
+			c->flat_size += c->iov[i].iov_len;
+		}
+	}
+}
+
+static void
+compiled_free(compiled* c)
+{
+	if (c->buf != c->tmp) {
+		free(c->buf);
+	}
+
+	iov_free(c->iov, c->iov_tmp);
+}
+
+static void
+check(const char* name, compiled* expect, compiled* got)
+{
+	compiled_flatten(expect);
+	compiled_flatten(got);
+
+	if (expect->flat_size != got->flat_size) {
+		printf("FAIL %s: size %zu, expected %zu\n", name, got->flat_size,
+				expect->flat_size);
+		g_n_failed++;
+	}
+	else if (memcmp(expect->flat, got->flat, got->flat_size) != 0) {
+		for (size_t i = 0; i < got->flat_size; i++) {
+			if (expect->flat[i] != got->flat[i]) {
+				printf("FAIL %s: byte %zu is %02x, expected %02x\n", name, i,
+						got->flat[i], expect->flat[i]);
+				break;
+			}
+		}
+
+		g_n_failed++;
+	}
+	else if (memcmp(&expect->d, &got->d, sizeof(cf_digest)) != 0) {
+		printf("FAIL %s: digest differs\n", name);
+		g_n_failed++;
+	}
+	else if (expect->flat_size != expect->buf_size ||
+			got->flat_size != got->buf_size) {
+		printf("FAIL %s: iovecs don't add up to message size\n", name);
+		g_n_failed++;
+	}
+	else {
+		printf("ok   %s (%zu bytes, %d iovecs)\n", name, got->flat_size,
+				got->n_iov);
+	}
+
+	compiled_free(expect);
+	compiled_free(got);
+}
+
+static const char* BIN_NAMES[] = { "a", "bb", "a-longer-bin-nam" };
+#define N_BINS 3
+
+static char g_big_str[3000];
+static uint8_t g_big_blob[5000];
+
+static void
+values_init(ev2citrusleaf_object* values, bool big)
+{
+	ev2citrusleaf_object_init_int(&values[0], -1234567890123LL);
+
+	if (big) {
+		ev2citrusleaf_object_init_str(&values[1], g_big_str);
+		ev2citrusleaf_object_init_blob(&values[2], g_big_blob, sizeof(g_big_blob));
+	}
+	else {
+		ev2citrusleaf_object_init_str(&values[1], "hello");
+		ev2citrusleaf_object_init_blob(&values[2], (void*)"\x01\x02\x03", 3);
+	}
+}
+
+static void
+test_get(const char* name, const ev2citrusleaf_namespace_handle* nsh,
+		const char* set, const ev2citrusleaf_object* key,
+		const cf_digest* digest, int n_bins)
+{
+	ev2citrusleaf_bin bins[N_BINS];
+
+	for (int i = 0; i < n_bins; i++) {
+		strcpy(bins[i].bin_name, BIN_NAMES[i]);
+		bins[i].object.type = CL_NULL;
+	}
+
+	int info1 = CL_MSG_INFO1_READ | (n_bins == 0 ? CL_MSG_INFO1_GET_ALL : 0);
+	compiled expect;
+	compiled got;
+
+	compiled_init(&expect);
+	compiled_init(&got);
+
+	ev2citrusleaf_prepared* p = ev2citrusleaf_prepare_get(nsh->ns, set,
+			BIN_NAMES, n_bins);
+
+	if (0 != compile(info1, 0, nsh, key ? set : NULL, key, digest, NULL, 250,
+			bins, n_bins, &expect.buf, &expect.buf_size, &expect.d, 0,
+			&expect.iov, &expect.n_iov) ||
+		0 != compile_prepared(p, key, digest, NULL, NULL, 250, &got.buf,
+			&got.buf_size, &got.d, 0, &got.iov, &got.n_iov)) {
+		printf("FAIL %s: compile failed\n", name);
+		g_n_failed++;
+	}
+	else {
+		// The digest sent with the request must match the public calculation.
+		cf_digest d;
+
+		if (key && (0 != ev2citrusleaf_calculate_digest(set, key, &d) ||
+				0 != memcmp(&d, &expect.d, sizeof(d)))) {
+			printf("FAIL %s: digest differs from calculated digest\n", name);
+			g_n_failed++;
+		}
+
+		check(name, &expect, &got);
+	}
+
+	ev2citrusleaf_prepared_destroy(p);
+}
+
+static void
+test_put(const char* name, const ev2citrusleaf_namespace_handle* nsh,
+		const char* set, const ev2citrusleaf_object* key,
+		const cf_digest* digest, const ev2citrusleaf_write_parameters* wparam,
+		bool big, uint32_t zc_threshold)
+{
+	ev2citrusleaf_bin bins[N_BINS];
+	ev2citrusleaf_object values[N_BINS];
+
+	values_init(values, big);
+
+	for (int i = 0; i < N_BINS; i++) {
+		strcpy(bins[i].bin_name, BIN_NAMES[i]);
+		bins[i].object = values[i];
+	}
+
+	compiled expect;
+	compiled got;
+
+	compiled_init(&expect);
+	compiled_init(&got);
+
+	ev2citrusleaf_prepared* p = ev2citrusleaf_prepare_put(nsh->ns, set,
+			BIN_NAMES, N_BINS);
+
+	if (0 != compile(0, CL_MSG_INFO2_WRITE, nsh, key ? set : NULL, key, digest,
+			wparam, 1000, bins, N_BINS, &expect.buf, &expect.buf_size,
+			&expect.d, zc_threshold, &expect.iov, &expect.n_iov) ||
+		0 != compile_prepared(p, key, digest, values, wparam, 1000, &got.buf,
+			&got.buf_size, &got.d, zc_threshold, &got.iov, &got.n_iov)) {
+		printf("FAIL %s: compile failed\n", name);
+		g_n_failed++;
+	}
+	else {
+		check(name, &expect, &got);
+	}
+
+	ev2citrusleaf_prepared_destroy(p);
+}
+
+static void
+test_operate(const char* name, const ev2citrusleaf_namespace_handle* nsh,
+		const char* set, const ev2citrusleaf_object* key,
+		const cf_digest* digest, const ev2citrusleaf_write_parameters* wparam,
+		bool big, uint32_t zc_threshold)
+{
+	ev2citrusleaf_operation ops[4];
+	ev2citrusleaf_object values[4];
+
+	values_init(values, big);
+
+	strcpy(ops[0].bin_name, "counter");
+	ops[0].op = CL_OP_ADD;
+	ev2citrusleaf_object_init_int(&ops[0].object, 5);
+	strcpy(ops[1].bin_name, BIN_NAMES[1]);
+	ops[1].op = CL_OP_WRITE;
+	ops[1].object = values[1];
+	strcpy(ops[2].bin_name, BIN_NAMES[2]);
+	ops[2].op = CL_OP_WRITE;
+	ops[2].object = values[2];
+	strcpy(ops[3].bin_name, "counter");
+	ops[3].op = CL_OP_READ;
+	ops[3].object.type = CL_NULL;
+
+	for (int i = 0; i < 4; i++) {
+		values[i] = ops[i].object;
+	}
+
+	// compile_ops() puts the expiration in the transaction TTL - match it.
+	uint32_t timeout = wparam ? wparam->expiration : 0;
+	compiled expect;
+	compiled got;
+	bool write;
+
+	compiled_init(&expect);
+	compiled_init(&got);
+
+	ev2citrusleaf_prepared* p = ev2citrusleaf_prepare_operate(nsh->ns, set,
+			ops, 4);
+
+	if (0 != compile_ops(nsh, key ? set : NULL, key, digest, ops, 4, wparam,
+			&expect.buf, &expect.buf_size, &expect.d, &write, zc_threshold,
+			&expect.iov, &expect.n_iov) ||
+		0 != compile_prepared(p, key, digest, values, wparam, timeout,
+			&got.buf, &got.buf_size, &got.d, zc_threshold, &got.iov,
+			&got.n_iov)) {
+		printf("FAIL %s: compile failed\n", name);
+		g_n_failed++;
+	}
+	else {
+		check(name, &expect, &got);
+	}
+
+	ev2citrusleaf_prepared_destroy(p);
+}
+
+int
+main(int argc, char* argv[])
+{
+	ev2citrusleaf_namespace_handle nsh;
+
+	if (! cl_namespace_init(&nsh, NULL, "test")) {
+		printf("FAIL namespace init\n");
+		return -1;
+	}
+
+	memset(g_big_str, 'x', sizeof(g_big_str) - 1);
+	g_big_str[sizeof(g_big_str) - 1] = 0;
+
+	for (size_t i = 0; i < sizeof(g_big_blob); i++) {
+		g_big_blob[i] = (uint8_t)(i * 7);
+	}
+
+	ev2citrusleaf_object str_key;
+	ev2citrusleaf_object int_key;
+	ev2citrusleaf_object blob_key;
+	ev2citrusleaf_object java_key;
+	cf_digest digest;
+
+	ev2citrusleaf_object_init_str(&str_key, "some-key");
+	ev2citrusleaf_object_init_int(&int_key, 0x0102030405060708LL);
+	ev2citrusleaf_object_init_blob(&blob_key, (void*)"\xde\xad\xbe\xef", 4);
+	ev2citrusleaf_object_init_blob(&java_key, (void*)"\xca\xfe", 2);
+	java_key.type = CL_JAVA_BLOB;
+	ev2citrusleaf_calculate_digest("demo", &str_key, &digest);
+
+	ev2citrusleaf_write_parameters wparam;
+
+	ev2citrusleaf_write_parameters_init(&wparam);
+	wparam.use_generation = true;
+	wparam.generation = 77;
+	wparam.expiration = 3600;
+
+	test_get("get str key", &nsh, "demo", &str_key, NULL, N_BINS);
+	test_get("get int key, no set", &nsh, NULL, &int_key, NULL, 1);
+	test_get("get blob key", &nsh, "demo", &blob_key, NULL, 2);
+	test_get("get java blob key", &nsh, "demo", &java_key, NULL, 1);
+	test_get("get all", &nsh, "demo", &str_key, NULL, 0);
+	test_get("get digest", &nsh, "demo", NULL, &digest, N_BINS);
+	test_get("get all digest", &nsh, "demo", NULL, &digest, 0);
+
+	test_put("put str key", &nsh, "demo", &str_key, NULL, NULL, false, 0);
+	test_put("put int key, wparam", &nsh, "demo", &int_key, NULL, &wparam,
+			false, 0);
+	test_put("put digest", &nsh, "demo", NULL, &digest, &wparam, false, 0);
+	test_put("put big values, copied", &nsh, "demo", &str_key, NULL, NULL,
+			true, 0);
+	test_put("put big values, zero-copy", &nsh, "demo", &str_key, NULL,
+			&wparam, true, 1024);
+	test_put("put digest, zero-copy", &nsh, "demo", NULL, &digest, NULL, true,
+			1024);
+
+	test_operate("operate str key", &nsh, "demo", &str_key, NULL, NULL, false,
+			0);
+	test_operate("operate wparam", &nsh, "demo", &int_key, NULL, &wparam,
+			false, 0);
+	test_operate("operate digest, zero-copy", &nsh, "demo", NULL, &digest,
+			&wparam, true, 1024);
+
+	if (g_n_failed != 0) {
+		printf("%d prepared compile checks failed\n", g_n_failed);
+		return -1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,378 @@
+/*
+ *  Citrusleaf Tools
+ *  replica_walk_test
+ *
+ * Checks routing across full replica lists, on a synthetic 5-node cluster
+ * with namespaces at rf 3, 4 and 5 - replicas-all beyond
+ * CL_PARTITION_REPLICAS is dropped, writes go to the master, the failover
+ * walk (cl_partition_table_get_other()) goes through the replicas in order
+ * and wraps, nodes' partition counts add up, and reads spread over the
+ * replicas, follow the read replica policy, and avoid throttled nodes and
+ * open circuits.
+ */
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <event2/event.h>
+
+#include "citrusleaf/cf_clock.h"
+#include "citrusleaf_event2/cl_cluster.h"
+#include "citrusleaf_event2/ev2citrusleaf.h"
+
+// Not in any header.
+extern cl_cluster_node* cl_cluster_node_create(const char* name,
+		ev2citrusleaf_cluster* asc);
+extern void parse_and_apply_replicas_all(cl_cluster_node* cn,
+		char* replicas_all);
+
+#define N_PARTITIONS 4096
+#define BITMAP_SIZE (N_PARTITIONS / 8)
+#define N_NODES 5
+#define N_NAMESPACES 3
+#define N_READS 3000
+
+static const char* NAMESPACES[N_NAMESPACES] = { "rf3", "rf4", "rf5" };
+static const int RFS[N_NAMESPACES] = { 3, 4, 5 };
+
+static const char ALPHABET[] =
+		"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static int g_n_failed = 0;
+
+static ev2citrusleaf_cluster* g_asc;
+static cl_cluster_node* g_nodes[N_NODES];
+
+// Partition pid's replica r is node (pid + r) % N_NODES.
+static inline cl_cluster_node*
+replica_node(int pid, int r)
+{
+	return g_nodes[(pid + r) % N_NODES];
+}
+
+static inline int
+n_kept(int rf)
+{
+	return rf < CL_PARTITION_REPLICAS ? rf : CL_PARTITION_REPLICAS;
+}
+
+static char*
+encode(const uint8_t* in, int len, char* out)
+{
+	for (int i = 0; i < len; i += 3) {
+		uint32_t v = (in[i] << 16) | (i + 1 < len ? in[i + 1] << 8 : 0) |
+				(i + 2 < len ? in[i + 2] : 0);
+
+		*out++ = ALPHABET[v >> 18];
+		*out++ = ALPHABET[(v >> 12) & 63];
+		*out++ = i + 1 < len ? ALPHABET[(v >> 6) & 63] : '=';
+		*out++ = i + 2 < len ? ALPHABET[v & 63] : '=';
+	}
+
+	return out;
+}
+
+// Each node's replicas-all, for all the namespaces.
+static void
+apply_replicas_all()
+{
+	static char buf[N_NAMESPACES * 6 * (4 + (BITMAP_SIZE / 3 * 4) + 8)];
+
+	for (int n = 0; n < N_NODES; n++) {
+		char* p = buf;
+
+		for (int q = 0; q < N_NAMESPACES; q++) {
+			if (q != 0) {
+				*p++ = ';';
+			}
+
+			p += sprintf(p, "%s:%d", NAMESPACES[q], RFS[q]);
+
+			for (int r = 0; r < RFS[q]; r++) {
+				uint8_t bitmap[BITMAP_SIZE] = { 0 };
+
+				for (int pid = 0; pid < N_PARTITIONS; pid++) {
+					if (replica_node(pid, r) == g_nodes[n]) {
+						bitmap[pid >> 3] |= 0x80 >> (pid & 7);
+					}
+				}
+
+				*p++ = ',';
+				p = encode(bitmap, BITMAP_SIZE, p);
+			}
+		}
+
+		*p = 0;
+		parse_and_apply_replicas_all(g_nodes[n], buf);
+	}
+}
+
+static void
+check(bool ok, const char* what)
+{
+	if (! ok) {
+		printf("FAIL %s\n", what);
+		g_n_failed++;
+	}
+}
+
+static void
+test_walk()
+{
+	int n_bad_master = 0;
+	int n_bad_walk = 0;
+	int n_bad_outsider = 0;
+
+	for (int q = 0; q < N_NAMESPACES; q++) {
+		cl_partition_table* pt = cl_partition_table_get_by_ns(g_asc,
+				NAMESPACES[q]);
+		int kept = n_kept(RFS[q]);
+
+		if (! pt) {
+			printf("FAIL walk: no table for %s\n", NAMESPACES[q]);
+			g_n_failed++;
+			continue;
+		}
+
+		for (int pid = 0; pid < N_PARTITIONS; pid++) {
+			cl_cluster_node* node = cl_partition_table_get(g_asc, pt, pid, true);
+
+			if (node != replica_node(pid, 0)) {
+				n_bad_master++;
+			}
+
+			if (node) {
+				cl_cluster_node_put(node);
+			}
+
+			// From each replica to the next, wrapping at the last kept one.
+			for (int r = 0; r < kept; r++) {
+				node = cl_partition_table_get_other(g_asc, pt, pid,
+						replica_node(pid, r));
+
+				if (node != replica_node(pid, (r + 1) % kept)) {
+					n_bad_walk++;
+				}
+
+				if (node) {
+					cl_cluster_node_put(node);
+				}
+			}
+
+			// From a node that isn't a kept replica, start at the master. At
+			// rf 5, that includes the replica beyond CL_PARTITION_REPLICAS.
+			if (kept < N_NODES) {
+				node = cl_partition_table_get_other(g_asc, pt, pid,
+						replica_node(pid, kept));
+
+				if (node != replica_node(pid, 0)) {
+					n_bad_outsider++;
+				}
+
+				if (node) {
+					cl_cluster_node_put(node);
+				}
+			}
+		}
+	}
+
+	check(n_bad_master == 0, "walk: writes not routed to master");
+	check(n_bad_walk == 0, "walk: failover doesn't go to next replica");
+	check(n_bad_outsider == 0, "walk: failover from outsider doesn't start at "
+			"master");
+}
+
+static void
+test_counts()
+{
+	for (int n = 0; n < N_NODES; n++) {
+		uint32_t n_masters = 0;
+		uint32_t n_proles = 0;
+
+		for (int q = 0; q < N_NAMESPACES; q++) {
+			for (int pid = 0; pid < N_PARTITIONS; pid++) {
+				for (int r = 0; r < n_kept(RFS[q]); r++) {
+					if (replica_node(pid, r) == g_nodes[n]) {
+						if (r == 0) {
+							n_masters++;
+						}
+						else {
+							n_proles++;
+						}
+					}
+				}
+			}
+		}
+
+		if (g_nodes[n]->n_master_partitions != n_masters ||
+				g_nodes[n]->n_prole_partitions != n_proles) {
+			printf("FAIL counts: node %d has %u/%u, expected %u/%u\n", n,
+					g_nodes[n]->n_master_partitions,
+					g_nodes[n]->n_prole_partitions, n_masters, n_proles);
+			g_n_failed++;
+		}
+	}
+}
+
+static void
+set_policy(ev2citrusleaf_read_replica_policy policy, bool circuit_breaker)
+{
+	ev2citrusleaf_cluster_runtime_options opts;
+
+	ev2citrusleaf_cluster_get_runtime_options(g_asc, &opts);
+	opts.read_replica_policy = policy;
+	opts.circuit_breaker = circuit_breaker;
+	ev2citrusleaf_cluster_set_runtime_options(g_asc, &opts);
+}
+
+// Read partition pid of namespace q N_READS times, and count reads by
+// replica index. Reads to a node that isn't a replica go in counts[kept].
+static void
+read_counts(int q, int pid, uint32_t* counts)
+{
+	cl_partition_table* pt = cl_partition_table_get_by_ns(g_asc,
+			NAMESPACES[q]);
+	int kept = n_kept(RFS[q]);
+
+	memset(counts, 0, (kept + 1) * sizeof(uint32_t));
+
+	for (int i = 0; i < N_READS; i++) {
+		cl_cluster_node* node = cl_partition_table_get(g_asc, pt, pid, false);
+		int r = 0;
+
+		while (r < kept && replica_node(pid, r) != node) {
+			r++;
+		}
+
+		counts[r]++;
+
+		if (node) {
+			cl_cluster_node_put(node);
+		}
+	}
+}
+
+static void
+test_reads()
+{
+	uint32_t counts[CL_PARTITION_REPLICAS + 1];
+
+	// Random - every kept replica gets its share, rf 5 included.
+	set_policy(CL_READ_REPLICA_RANDOM, false);
+
+	for (int q = 0; q < N_NAMESPACES; q++) {
+		int kept = n_kept(RFS[q]);
+
+		read_counts(q, 7, counts);
+
+		for (int r = 0; r < kept; r++) {
+			if (counts[r] < N_READS / kept * 3 / 4 ||
+					counts[r] > N_READS / kept * 5 / 4) {
+				printf("FAIL reads: %s replica %d got %u of %d random reads\n",
+						NAMESPACES[q], r, counts[r], N_READS);
+				g_n_failed++;
+			}
+		}
+
+		check(counts[kept] == 0, "reads: random read to a non-replica");
+	}
+
+	// Least loaded - the replica with fewest in flight.
+	for (int r = 0; r < 3; r++) {
+		cf_atomic32_set(&replica_node(7, r)->n_in_flight, r == 2 ? 1 : 10);
+	}
+
+	set_policy(CL_READ_REPLICA_LEAST_LOADED, false);
+	read_counts(0, 7, counts);
+	check(counts[2] == N_READS, "reads: least loaded not chosen");
+
+	// Lowest latency - the fastest replica, apart from exploring.
+	for (int r = 0; r < 3; r++) {
+		cf_atomic32_set(&replica_node(7, r)->n_in_flight, 0);
+		cf_atomic32_set(&replica_node(7, r)->latency_us, r == 1 ? 100 : 5000);
+	}
+
+	set_policy(CL_READ_REPLICA_LOWEST_LATENCY, false);
+	read_counts(0, 7, counts);
+	check(counts[1] > N_READS * 9 / 10 && counts[0] != 0 && counts[2] != 0,
+			"reads: lowest latency not chosen, or no exploring");
+
+	// Throttled nodes are avoided while others aren't.
+	cf_atomic32_set(&replica_node(7, 0)->throttle_pct, 50);
+	cf_atomic32_set(&replica_node(7, 1)->throttle_pct, 50);
+
+	set_policy(CL_READ_REPLICA_RANDOM, false);
+	read_counts(0, 7, counts);
+	check(counts[2] == N_READS, "reads: throttled replicas not avoided");
+
+	cf_atomic32_set(&replica_node(7, 0)->throttle_pct, 0);
+	cf_atomic32_set(&replica_node(7, 1)->throttle_pct, 0);
+
+	// Open circuits are avoided by reads and by the failover walk.
+	cl_cluster_node* open = replica_node(7, 1);
+
+	cf_atomic32_set(&open->circuit_opened_ms, (uint32_t)cf_getms());
+	cf_atomic32_set(&open->circuit, CL_CIRCUIT_OPEN);
+
+	set_policy(CL_READ_REPLICA_RANDOM, true);
+	read_counts(0, 7, counts);
+	check(counts[1] == 0 && counts[0] != 0 && counts[2] != 0,
+			"reads: open circuit not avoided");
+
+	cl_partition_table* pt = cl_partition_table_get_by_ns(g_asc, "rf3");
+	cl_cluster_node* node = cl_partition_table_get_other(g_asc, pt, 7,
+			replica_node(7, 0));
+
+	check(node == replica_node(7, 2), "walk: open circuit not skipped");
+
+	if (node) {
+		cl_cluster_node_put(node);
+	}
+
+	cf_atomic32_set(&open->circuit, CL_CIRCUIT_CLOSED);
+	set_policy(CL_READ_REPLICA_RANDOM, false);
+}
+
+int
+main(int argc, char* argv[])
+{
+	cf_set_log_level(CF_WARN);
+	ev2citrusleaf_init(NULL);
+
+	// The base is never run - nothing but this test touches the cluster.
+	struct event_base* base = event_base_new();
+
+	g_asc = ev2citrusleaf_cluster_create(base, NULL);
+	g_asc->n_partitions = N_PARTITIONS;
+
+	for (int n = 0; n < N_NODES; n++) {
+		char name[32];
+
+		sprintf(name, "BB9%013X", n);
+
+		if (! (g_nodes[n] = cl_cluster_node_create(name, g_asc))) {
+			printf("FAIL node create\n");
+			return -1;
+		}
+	}
+
+	apply_replicas_all();
+
+	test_walk();
+	test_counts();
+	test_reads();
+
+	ev2citrusleaf_cluster_destroy(g_asc);
+	event_base_free(base);
+	ev2citrusleaf_shutdown(true);
+
+	if (g_n_failed != 0) {
+		printf("%d replica walk checks failed\n", g_n_failed);
+		return -1;
+	}
+
+	printf("ok replica walk, rf 3, 4 and 5\n");
+
+	return 0;
+}
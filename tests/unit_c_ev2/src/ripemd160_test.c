@@ -0,0 +1,321 @@
+/*
+ *  Citrusleaf Tools
+ *  ripemd160_test
+ *
+ * Checks the in-tree RIPEMD-160 against the standard test vectors, and against
+ * OpenSSL for random messages split into random parts - through cf_ripemd160()
+ * and cf_ripemd160_many(), including partly filled sets of lanes. Also checks
+ * key digests for each key type.
+ */
+
+// The low-level OpenSSL digest calls are deprecated, but fine for checking.
+#define OPENSSL_SUPPRESS_DEPRECATED
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <openssl/ripemd.h>
+
+#include "citrusleaf/cf_ripemd160.h"
+#include "citrusleaf_event2/ev2citrusleaf.h"
+
+static int g_n_failed = 0;
+
+static void
+to_hex(const uint8_t* digest, char* hex)
+{
+	for (int i = 0; i < CF_RIPEMD160_DIGEST_SZ; i++) {
+		sprintf(hex + (i * 2), "%02x", digest[i]);
+	}
+}
+
+static void
+fail_digest(const char* what, size_t len, const uint8_t* got,
+		const uint8_t* expect)
+{
+	char got_hex[41];
+	char expect_hex[41];
+
+	to_hex(got, got_hex);
+	to_hex(expect, expect_hex);
+	printf("FAIL %s, length %zu: got %s, expected %s\n", what, len, got_hex,
+			expect_hex);
+	g_n_failed++;
+}
+
+//
+// Standard vectors, from the RIPEMD-160 specification.
+//
+
+typedef struct vector_s {
+	const char*	msg;
+	size_t		repeat;
+	const char*	digest_hex;
+} vector;
+
+static const vector VECTORS[] = {
+	{ "", 1, "9c1185a5c5e9fc54612808977ee8f548b2258d31" },
+	{ "a", 1, "0bdc9d2d256b3ee9daae347be6f4dc835a467ffe" },
+	{ "abc", 1, "8eb208f7e05d987a9b044a8e98c6b087f15a0bfc" },
+	{ "message digest", 1, "5d0689ef49d2fae572b881b123a85ffa21595f36" },
+	{ "abcdefghijklmnopqrstuvwxyz", 1,
+			"f71c27109c692c1b56bbdceb5b9d2865b3708dbc" },
+	{ "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq", 1,
+			"12a053384a9c0c88e405a06c27dcf49ada62eb2b" },
+	{ "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789", 1,
+			"b0e20b6e3116640286ed3a87a5713079b21f5189" },
+	{ "1234567890", 8, "9b752e45573d4b39f4dbd3323cab82bf63326bfb" },
+	{ "a", 1000000, "52783243c1697bdbe16d37f97f68f08325dc1528" }
+};
+
+#define N_VECTORS (sizeof(VECTORS) / sizeof(vector))
+
+static void
+test_vectors()
+{
+	for (size_t v = 0; v < N_VECTORS; v++) {
+		size_t msg_len = strlen(VECTORS[v].msg);
+		size_t len = msg_len * VECTORS[v].repeat;
+		uint8_t* msg = (uint8_t*)malloc(len + 1);
+
+		for (size_t r = 0; r < VECTORS[v].repeat; r++) {
+			memcpy(msg + (r * msg_len), VECTORS[v].msg, msg_len);
+		}
+
+		uint8_t expect[CF_RIPEMD160_DIGEST_SZ];
+
+		for (int i = 0; i < CF_RIPEMD160_DIGEST_SZ; i++) {
+			unsigned int b;
+
+			sscanf(VECTORS[v].digest_hex + (i * 2), "%2x", &b);
+			expect[i] = (uint8_t)b;
+		}
+
+		uint8_t got[CF_RIPEMD160_DIGEST_SZ];
+		cf_ripemd160_part part = { msg, len };
+
+		cf_ripemd160(&part, 1, got);
+
+		if (memcmp(got, expect, sizeof(got)) != 0) {
+			fail_digest("vector", len, got, expect);
+		}
+
+		cf_ripemd160_many(&part, 1, 1, got);
+
+		if (memcmp(got, expect, sizeof(got)) != 0) {
+			fail_digest("vector, many", len, got, expect);
+		}
+
+		free(msg);
+	}
+}
+
+//
+// Random messages against OpenSSL.
+//
+
+#define N_PARTS 3
+#define MAX_MSGS 40
+#define MAX_LEN 300
+
+typedef struct message_s {
+	uint8_t				data[MAX_LEN];
+	size_t				len;
+	cf_ripemd160_part	parts[N_PARTS];
+	uint8_t				expect[CF_RIPEMD160_DIGEST_SZ];
+} message;
+
+static void
+message_random(message* m, size_t max_len)
+{
+	m->len = (size_t)rand() % (max_len + 1);
+
+	for (size_t i = 0; i < m->len; i++) {
+		m->data[i] = (uint8_t)rand();
+	}
+
+	// Random split points, so some parts may be empty.
+	size_t a = m->len == 0 ? 0 : (size_t)rand() % (m->len + 1);
+	size_t b = m->len == 0 ? 0 : (size_t)rand() % (m->len + 1);
+
+	if (a > b) {
+		size_t t = a;
+
+		a = b;
+		b = t;
+	}
+
+	m->parts[0].data = m->data;
+	m->parts[0].len = a;
+	m->parts[1].data = m->data + a;
+	m->parts[1].len = b - a;
+	m->parts[2].data = m->data + b;
+	m->parts[2].len = m->len - b;
+
+	RIPEMD160(m->data, m->len, m->expect);
+}
+
+static void
+test_random()
+{
+	static message msgs[MAX_MSGS];
+
+	for (int round = 0; round < 2000; round++) {
+		// Mostly short messages, so most go through the lanes.
+		size_t max_len = round % 4 == 0 ? MAX_LEN :
+				CF_RIPEMD160_SINGLE_BLOCK_MAX + 2;
+		int n_msgs = 1 + (rand() % MAX_MSGS);
+		cf_ripemd160_part parts[MAX_MSGS * N_PARTS];
+		uint8_t got[MAX_MSGS * CF_RIPEMD160_DIGEST_SZ];
+
+		for (int m = 0; m < n_msgs; m++) {
+			message_random(&msgs[m], max_len);
+			memcpy(&parts[m * N_PARTS], msgs[m].parts, sizeof(msgs[m].parts));
+
+			uint8_t one[CF_RIPEMD160_DIGEST_SZ];
+
+			cf_ripemd160(msgs[m].parts, N_PARTS, one);
+
+			if (memcmp(one, msgs[m].expect, sizeof(one)) != 0) {
+				fail_digest("random", msgs[m].len, one, msgs[m].expect);
+			}
+		}
+
+		cf_ripemd160_many(parts, N_PARTS, n_msgs, got);
+
+		for (int m = 0; m < n_msgs; m++) {
+			const uint8_t* d = got + (m * CF_RIPEMD160_DIGEST_SZ);
+
+			if (memcmp(d, msgs[m].expect, CF_RIPEMD160_DIGEST_SZ) != 0) {
+				fail_digest("random, many", msgs[m].len, d, msgs[m].expect);
+			}
+		}
+	}
+}
+
+//
+// Several threads making the first call at once must all see a complete
+// choice of lanes.
+//
+
+#define N_THREADS 8
+
+static void*
+first_call_fn(void* pv)
+{
+	message* m = (message*)pv;
+	cf_ripemd160_part parts[16 * N_PARTS];
+	uint8_t got[16 * CF_RIPEMD160_DIGEST_SZ];
+
+	for (int i = 0; i < 16; i++) {
+		memcpy(&parts[i * N_PARTS], m->parts, sizeof(m->parts));
+	}
+
+	cf_ripemd160_many(parts, N_PARTS, 16, got);
+
+	for (int i = 0; i < 16; i++) {
+		if (memcmp(got + (i * CF_RIPEMD160_DIGEST_SZ), m->expect,
+				CF_RIPEMD160_DIGEST_SZ) != 0) {
+			return (void*)1;
+		}
+	}
+
+	return NULL;
+}
+
+static void
+test_first_call()
+{
+	static message m;
+	pthread_t threads[N_THREADS];
+
+	message_random(&m, CF_RIPEMD160_SINGLE_BLOCK_MAX);
+
+	for (int i = 0; i < N_THREADS; i++) {
+		pthread_create(&threads[i], NULL, first_call_fn, &m);
+	}
+
+	for (int i = 0; i < N_THREADS; i++) {
+		void* rv;
+
+		pthread_join(threads[i], &rv);
+
+		if (rv) {
+			printf("FAIL first call, thread %d\n", i);
+			g_n_failed++;
+		}
+	}
+}
+
+//
+// Key digests are over set name, key type byte and key value.
+//
+
+static void
+test_key(const char* name, const char* set, const ev2citrusleaf_object* key,
+		const void* value, size_t value_len)
+{
+	uint8_t buf[256];
+	size_t set_len = strlen(set);
+
+	memcpy(buf, set, set_len);
+	buf[set_len] = (uint8_t)key->type;
+	memcpy(buf + set_len + 1, value, value_len);
+
+	uint8_t expect[CF_RIPEMD160_DIGEST_SZ];
+	cf_digest got;
+
+	RIPEMD160(buf, set_len + 1 + value_len, expect);
+
+	if (ev2citrusleaf_calculate_digest(set, key, &got) != 0 ||
+			memcmp(got.digest, expect, sizeof(expect)) != 0) {
+		fail_digest(name, value_len, got.digest, expect);
+	}
+}
+
+static void
+test_keys()
+{
+	ev2citrusleaf_object key;
+
+	ev2citrusleaf_object_init_str(&key, "some-key");
+	test_key("str key", "demo", &key, "some-key", 8);
+
+	ev2citrusleaf_object_init_int(&key, 0x0102030405060708LL);
+	test_key("int key", "demo", &key, "\x01\x02\x03\x04\x05\x06\x07\x08", 8);
+
+	ev2citrusleaf_object_init_blob(&key, (void*)"\xde\xad\xbe\xef", 4);
+	test_key("blob key", "", &key, "\xde\xad\xbe\xef", 4);
+
+	ev2citrusleaf_object_init_blob(&key, (void*)"\xca\xfe", 2);
+	key.type = CL_JAVA_BLOB;
+	test_key("java blob key", "demo", &key, "\xca\xfe", 2);
+}
+
+int
+main(int argc, char* argv[])
+{
+	srand(argc > 1 ? atoi(argv[1]) : 1);
+
+	// First, before anything else has chosen lanes.
+	test_first_call();
+
+	printf("%d lanes\n", cf_ripemd160_lanes());
+
+	test_vectors();
+	test_random();
+	test_keys();
+
+	if (g_n_failed != 0) {
+		printf("%d RIPEMD-160 checks failed\n", g_n_failed);
+		return -1;
+	}
+
+	printf("ok   RIPEMD-160\n");
+
+	return 0;
+}
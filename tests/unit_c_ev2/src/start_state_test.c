@@ -0,0 +1,142 @@
+/*
+ *  Citrusleaf Tools
+ *  start_state_test
+ *
+ * Checks the cross-threaded start handoff - an event waiting in
+ * cl_start_wait() for a start call in another thread is held while the start
+ * is pending, then sees CL_START_DONE or CL_START_FAILED as the start call
+ * reported it, along with everything the start call wrote before then.
+ */
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include "citrusleaf_event2/ev2citrusleaf-internal.h"
+
+#define N_ROUNDS 2000
+
+// Rounds in which the start call holds off until the event is waiting.
+#define N_SLOW_ROUNDS 20
+
+typedef struct txn_s {
+	cf_atomic32		start_state;
+	uint64_t		payload[4];
+} txn;
+
+typedef struct event_arg_s {
+	txn*			t;
+	volatile bool	started;
+	bool			saw_pending;
+	uint32_t		state;
+	uint64_t		payload[4];
+} event_arg;
+
+static int g_n_failed = 0;
+
+// Stands in for a network or timer event firing in the callback thread.
+static void*
+event_fn(void* pv)
+{
+	event_arg* arg = (event_arg*)pv;
+
+	arg->saw_pending = cf_atomic32_get(arg->t->start_state) == CL_START_PENDING;
+	arg->started = true;
+	arg->state = cl_start_wait(&arg->t->start_state);
+
+	for (int i = 0; i < 4; i++) {
+		arg->payload[i] = arg->t->payload[i];
+	}
+
+	return NULL;
+}
+
+static void
+test_done_no_wait()
+{
+	txn t = { CL_START_DONE, { 0 } };
+
+	if (cl_start_wait(&t.start_state) != CL_START_DONE) {
+		printf("FAIL done state: not done\n");
+		g_n_failed++;
+	}
+}
+
+static void
+test_handoff()
+{
+	int n_waited = 0;
+
+	for (uint64_t r = 0; r < N_ROUNDS; r++) {
+		txn t = { CL_START_DONE, { 0 } };
+		event_arg arg = { &t, false, false, 0, { 0 } };
+		bool ok = r % 3 != 0;
+		pthread_t thread;
+
+		cl_start_begin(&t.start_state);
+		pthread_create(&thread, NULL, event_fn, &arg);
+
+		// In the slow rounds, don't finish until the event is waiting.
+		if (r < N_SLOW_ROUNDS) {
+			while (! arg.started) {
+				sched_yield();
+			}
+
+			usleep(1000);
+		}
+
+		for (int i = 0; i < 4; i++) {
+			t.payload[i] = r * 4 + i + 1;
+		}
+
+		cl_start_end(&t.start_state, ok);
+		pthread_join(thread, NULL);
+
+		if (arg.saw_pending) {
+			n_waited++;
+		}
+
+		uint32_t expect = ok ? CL_START_DONE : CL_START_FAILED;
+
+		if (arg.state != expect) {
+			printf("FAIL round %lu: state %u, expected %u\n", (unsigned long)r,
+					arg.state, expect);
+			g_n_failed++;
+			continue;
+		}
+
+		for (int i = 0; i < 4; i++) {
+			if (arg.payload[i] != r * 4 + i + 1) {
+				printf("FAIL round %lu: event saw stale transaction\n",
+						(unsigned long)r);
+				g_n_failed++;
+				break;
+			}
+		}
+	}
+
+	// The slow rounds at least must have made the event wait.
+	if (n_waited < N_SLOW_ROUNDS) {
+		printf("FAIL only %d of %d rounds waited\n", n_waited, N_ROUNDS);
+		g_n_failed++;
+	}
+	else {
+		printf("ok handoff, %d of %d rounds waited\n", n_waited, N_ROUNDS);
+	}
+}
+
+int
+main(int argc, char* argv[])
+{
+	test_done_no_wait();
+	test_handoff();
+
+	if (g_n_failed != 0) {
+		printf("%d start state checks failed\n", g_n_failed);
+		return -1;
+	}
+
+	return 0;
+}